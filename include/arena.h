@@ -0,0 +1,98 @@
+//! @file arena.h
+#ifndef STASIS_ARENA_H
+#define STASIS_ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE_DEFAULT 65536
+#define ARENA_ALIGN (sizeof(void *) * 2)
+
+/*! \struct ArenaBlock
+ *  \brief A single region of memory owned by an `Arena`
+ */
+struct ArenaBlock {
+    struct ArenaBlock *next; ///< Next block in the chain
+    size_t size; ///< Usable bytes in data
+    size_t used; ///< Bytes handed out from data
+    char data[]; ///< Storage
+};
+
+/*! \struct Arena
+ *  \brief A bump allocator. Memory is released all at once by arena_free()
+ */
+struct Arena {
+    struct ArenaBlock *head; ///< Block currently being filled
+    size_t block_size; ///< Size of newly created blocks
+};
+
+/**
+ * Free `X` unless it belongs to `ARENA`. `X` is set to NULL either way.
+ */
+#define guard_arena_free(ARENA, X) do { \
+    if (!arena_owns(ARENA, X)) { \
+        guard_free(X); \
+    } \
+    (X) = NULL; \
+} while (0)
+
+/**
+ * Create an arena
+ *
+ * ```c
+ * struct Arena *arena = arena_init(0);
+ * char *name = arena_strdup(arena, "example");
+ * char *items = arena_alloc(arena, 10 * sizeof(*items));
+ * // ...
+ * arena_free(&arena); // releases name and items
+ * ```
+ *
+ * @param block_size size of each block (0 uses ARENA_BLOCK_SIZE_DEFAULT)
+ * @return `Arena` on success, NULL on error
+ */
+struct Arena *arena_init(size_t block_size);
+
+/**
+ * Allocate zero-initialized memory from an arena
+ *
+ * Requests larger than the arena's block size receive a dedicated block.
+ *
+ * @param arena `Arena`
+ * @param size number of bytes
+ * @return pointer to memory on success, NULL on error
+ */
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/**
+ * Duplicate a string into an arena
+ * @param arena `Arena`
+ * @param s string to copy
+ * @return pointer to string on success, NULL on error
+ */
+char *arena_strdup(struct Arena *arena, const char *s);
+
+/**
+ * Duplicate at most `n` bytes of a string into an arena
+ * @param arena `Arena`
+ * @param s string to copy
+ * @param n maximum number of bytes to copy
+ * @return pointer to string on success, NULL on error
+ */
+char *arena_strndup(struct Arena *arena, const char *s, size_t n);
+
+/**
+ * Determine whether memory was allocated by an arena
+ * @param arena `Arena` (may be NULL)
+ * @param ptr address to check
+ * @return 1 if `ptr` belongs to `arena`, 0 if not
+ */
+int arena_owns(const struct Arena *arena, const void *ptr);
+
+/**
+ * Release an arena and every allocation made from it
+ * @param arena pointer to `Arena`
+ */
+void arena_free(struct Arena **arena);
+
+#endif //STASIS_ARENA_H
@@ -0,0 +1,66 @@
+//! @file bytesearch.h
+#ifndef STASIS_BYTESEARCH_H
+#define STASIS_BYTESEARCH_H
+
+#include <stddef.h>
+
+#define BYTESEARCH_AUTO 0
+#define BYTESEARCH_SCALAR 1
+#define BYTESEARCH_SSE2 2
+#define BYTESEARCH_AVX2 3
+
+/**
+ * Find the first occurrence of byte `ch`
+ * @param s bytes to search
+ * @param len number of bytes in `s`
+ * @param ch byte to search for
+ * @return pointer to the match, or NULL when not found
+ */
+const char *bytes_find(const char *s, size_t len, int ch);
+
+/**
+ * Find the first byte that appears in `set`
+ * @param s bytes to search
+ * @param len number of bytes in `s`
+ * @param set NUL terminated string of bytes to search for
+ * @return pointer to the match, or NULL when not found
+ */
+const char *bytes_find_set(const char *s, size_t len, const char *set);
+
+/**
+ * Count occurrences of byte `ch`
+ * @param s bytes to search
+ * @param len number of bytes in `s`
+ * @param ch byte to count
+ * @return number of matches
+ */
+size_t bytes_count(const char *s, size_t len, int ch);
+
+/**
+ * Find the first occurrence of `needle`
+ * @param s bytes to search
+ * @param len number of bytes in `s`
+ * @param needle bytes to search for
+ * @param needle_len number of bytes in `needle`
+ * @return pointer to the match, or NULL when not found
+ */
+const char *bytes_find_str(const char *s, size_t len, const char *needle, size_t needle_len);
+
+/**
+ * Select the implementation used by the bytes_* functions
+ *
+ * The fastest implementation supported by the CPU is selected automatically
+ * on first use. This is mostly useful for testing.
+ *
+ * @param impl BYTESEARCH_AUTO, BYTESEARCH_SCALAR, BYTESEARCH_SSE2, or BYTESEARCH_AVX2
+ * @return the selected implementation, or -1 if `impl` is not supported by this CPU
+ */
+int bytesearch_select(int impl);
+
+/**
+ * Report the implementation used by the bytes_* functions
+ * @return BYTESEARCH_SCALAR, BYTESEARCH_SSE2, or BYTESEARCH_AVX2
+ */
+int bytesearch_impl(void);
+
+#endif //STASIS_BYTESEARCH_H
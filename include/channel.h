@@ -0,0 +1,94 @@
+//! @file channel.h
+#ifndef STASIS_CHANNEL_H
+#define STASIS_CHANNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "core.h"
+
+#define CHANNEL_INDEX_JSON "info/index.json"
+#define CHANNEL_INDEX_JSON_MAX (1024 * 1024)    //!< Largest info/index.json accepted
+#define CHANNEL_SUBDIR_NOARCH "noarch"
+#define CHANNEL_INDEX_CACHE_FILE ".cache/stasis_index.tsv"     //!< Package record cache, relative to a subdirectory
+#define CHANNEL_INDEX_CACHE_MAGIC "stasis-channel-index 1"      //!< First line of a cache file
+
+#define CHANNEL_INDEX_CACHE 1 << 0  //!< Read only new or changed packages, and keep a cache of their records
+
+/**
+ * Summary of a `channel_index` operation
+ */
+struct ChannelIndexStats {
+    size_t subdirs;         //!< Subdirectories indexed
+    size_t packages;        //!< Packages written to repodata.json
+    size_t bytes;           //!< Package bytes hashed
+    size_t cached;          //!< Packages whose records came from the cache (CHANNEL_INDEX_CACHE)
+    size_t failed;          //!< Packages that could not be read
+    size_t unsupported;     //!< Packages this build cannot read (.conda without zstd support)
+};
+
+/**
+ * Index a local conda channel
+ *
+ * Every subdirectory of `path` named "noarch", or named for a conda platform
+ * ("linux-64", "osx-arm64", "win-64", ...), is scanned for `.tar.bz2` and
+ * `.conda` packages. Other directories, such as "docs" or "my-notes", are
+ * ignored. Packages are read in parallel by a worker pool (see
+ * `pool_default_size`): `info/index.json` is extracted, and the archive's
+ * md5 and sha256 are computed. Each subdirectory receives a
+ * `repodata.json` and a `current_repodata.json` (the latest version of each
+ * package). `channeldata.json` is written to `path`. A "noarch"
+ * subdirectory is always created.
+ *
+ * A package that cannot be read is reported, and left out of the index.
+ *
+ * With CHANNEL_INDEX_CACHE, each subdirectory keeps the records of its
+ * packages in CHANNEL_INDEX_CACHE_FILE, keyed by file name, size, and
+ * modification time. Only new or changed packages are read, and the
+ * repodata is rewritten from the cache. Packages that were removed drop
+ * out of the cache.
+ *
+ * ```c
+ * struct ChannelIndexStats stats = {0};
+ * if (channel_index("/path/to/channel", CHANNEL_INDEX_CACHE, &stats)) {
+ *     fprintf(stderr, "%zu packages could not be indexed\n", stats.failed + stats.unsupported);
+ * }
+ * ```
+ *
+ * @param path top-level directory of the channel
+ * @param flags CHANNEL_INDEX_CACHE, or 0 to read every package
+ * @param stats optional counters to update
+ * @return 0 on success, -1 on error. errno is ENOTSUP when the only problem was an unsupported package format.
+ */
+int channel_index(const char *path, unsigned flags, struct ChannelIndexStats *stats);
+
+/**
+ * Add the package record caches of another channel to `channel`
+ *
+ * Use this when `channel` was assembled from copies of other channels,
+ * such as a previously published one, so `channel_index` can reuse their
+ * records. Only subdirectories present in both channels are imported.
+ *
+ * @param channel top-level directory of the channel to index
+ * @param from top-level directory of a channel indexed with CHANNEL_INDEX_CACHE
+ * @return 0 on success, -1 if a cache could not be written
+ */
+int channel_cache_import(const char *channel, const char *from);
+
+/**
+ * Compare two conda package versions
+ *
+ * Versions are compared component by component, as conda does: an epoch
+ * ("1!") first, numbers numerically, and letters case-insensitively.
+ * Missing components count as zero, so "1.0" equals "1.0.0". "dev" sorts
+ * before any other letters, letters before numbers, and "post" after
+ * numbers ("1.0dev" < "1.0a1" < "1.0" < "1.0post1").
+ *
+ * @param a version string
+ * @param b version string
+ * @return <0 when `a` is older than `b`, 0 when equal, >0 when newer
+ */
+int channel_version_cmp(const char *a, const char *b);
+
+#endif //STASIS_CHANNEL_H
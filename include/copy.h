@@ -1,5 +1,6 @@
 //! @file copy.h
 #ifndef STASIS_COPY_H
+#define STASIS_COPY_H
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,10 +13,31 @@
 
 #define CT_OWNER 1 << 1
 #define CT_PERM 1 << 2
+#define CT_TIME 1 << 3
+#define CT_SYNC 1 << 4
+#define CT_DELETE 1 << 5
+#define CT_CHECKSUM 1 << 6
+#define CT_LINK 1 << 7
+
+/**
+ * Summary of a `copytree_parallel` or `sync_tree` operation
+ */
+struct CopyTreeReport {
+    size_t dirs;                //!< Directories created
+    size_t files;               //!< Files, links, and special files copied
+    size_t bytes;               //!< Bytes copied from regular files
+    size_t linked;              //!< Files hard linked instead of copied (CT_LINK)
+    size_t skipped;             //!< Entries already up to date (`sync_tree`)
+    size_t deleted;             //!< Destination entries removed (`sync_tree`)
+    size_t errors;              //!< Entries that could not be copied
+    struct StrList *failed;     //!< "path: reason" for each error
+};
 
 /**
  * Recursively copy a directory, or a single file
  *
+ * Errors are printed to stderr. See `copytree_parallel`.
+ *
  * ```c
  * if (copytree("/source/path", "/destination/path", CT_PERM | CT_OWNER)) {
  *     fprintf(stderr, "Unable to copy files\n");
@@ -31,6 +53,82 @@
  */
 int copytree(const char *srcdir, const char *destdir, unsigned op);
 
+/**
+ * Recursively copy a directory using a pool of worker threads
+ *
+ * Each directory is a task on the pool (see `pool_default_size`). Entries are
+ * opened relative to their directory's descriptor, and files are copied in
+ * batches by whichever worker is idle. An error does not stop the copy; every
+ * entry that could not be copied is recorded in `report`.
+ *
+ * ```c
+ * struct CopyTreeReport report;
+ * if (copytree_parallel("/source/path", "/destination/path", CT_PERM, &report)) {
+ *     for (size_t i = 0; i < strlist_count(report.failed); i++) {
+ *         fprintf(stderr, "%s\n", strlist_item(report.failed, i));
+ *     }
+ * }
+ * printf("%zu files, %zu bytes\n", report.files, report.bytes);
+ * guard_strlist_free(&report.failed);
+ * ```
+ *
+ * @param srcdir source file or directory path
+ * @param destdir destination directory
+ * @param op CT_OWNER, CT_PERM, CT_TIME (see `copy2`)
+ * @param report optional summary. The caller frees `report->failed`
+ * @return 0 on success, -1 if anything could not be copied
+ */
+int copytree_parallel(const char *srcdir, const char *destdir, unsigned op, struct CopyTreeReport *report);
+
+/**
+ * Print the errors in a `CopyTreeReport`, and a summary in verbose mode
+ * @param report pointer to report
+ */
+void copytree_report_show(const struct CopyTreeReport *report);
+
+/**
+ * Make a destination directory match a source directory
+ *
+ * Like `rsync -a src/ dest/`, only the entries that differ are copied. A
+ * regular file is up to date when its size and modification time match the
+ * source (CT_CHECKSUM compares contents instead of modification times).
+ * Modification times are always preserved, and directory attributes are
+ * applied to existing directories too. Each file is written under a temporary
+ * name and renamed into place, so readers never see a partial file. The work
+ * is done in parallel, like `copytree_parallel`.
+ *
+ * Exclusion patterns are fnmatch(3) globs matched against entry names at any
+ * depth. A pattern ending with "/" only matches directories. Excluded entries
+ * are neither copied nor deleted.
+ *
+ * With CT_LINK, a destination file on the same device as the source is a hard
+ * link to it. Files that cannot be linked are copied (a reflink when the file
+ * system supports it), and such copies are up to date while their size and
+ * modification time match. An equal copy is turned into a link when linking
+ * becomes possible. Changed files are replaced, never written through, so the
+ * source is never modified.
+ *
+ * ```c
+ * struct CopyTreeReport report;
+ * if (sync_tree("/source/path", "/destination/path", CT_PERM | CT_DELETE, (char *[]) {"tmp/", "*.pyc", NULL}, &report)) {
+ *     fprintf(stderr, "%zu entries could not be synchronized\n", report.errors);
+ * }
+ * printf("%zu copied, %zu up to date, %zu deleted\n", report.files, report.skipped, report.deleted);
+ * guard_strlist_free(&report.failed);
+ * ```
+ *
+ * @param srcdir source file or directory path
+ * @param destdir destination directory
+ * @param op CT_OWNER, CT_PERM (see `copy2`)
+ * @param op CT_DELETE (remove destination entries that are not in the source)
+ * @param op CT_CHECKSUM (compare file contents)
+ * @param op CT_LINK (hard link regular files on the same device instead of copying them)
+ * @param exclude NULL terminated array of patterns, or NULL
+ * @param report optional summary. The caller frees `report->failed`
+ * @return 0 on success, -1 if anything could not be synchronized
+ */
+int sync_tree(const char *srcdir, const char *destdir, unsigned op, char **exclude, struct CopyTreeReport *report);
+
 /**
  * Create all leafs in directory path
  * @param _path directory path to create
@@ -42,6 +140,9 @@ int mkdirs(const char *_path, mode_t mode);
 /**
  * Copy a single file
  *
+ * Regular files are copied by the kernel when possible (reflink,
+ * copy_file_range, or sendfile), so the data may never pass through user space.
+ *
  * ```c
  * if (copy2("/source/path/example.txt", "/destination/path/example.txt", CT_PERM | CT_OWNER)) {
  *     fprintf(stderr, "Unable to copy file\n");
@@ -54,6 +155,7 @@ int mkdirs(const char *_path, mode_t mode);
  * @param dest destination file path
  * @param op CT_OWNER (preserve ownership)
  * @param op CT_PERM (preserve permission bits)
+ * @param op CT_TIME (preserve access and modification times)
  * @return 0 on success, -1 on error
  */
 int copy2(const char *src, const char *dest, unsigned op);
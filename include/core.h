@@ -21,11 +21,15 @@
 #define HTTP_ERROR(X) X >= 400
 
 #include "config.h"
+#include "arena.h"
+#include "bytesearch.h"
+#include "pool.h"
 #include "template.h"
 #include "utils.h"
 #include "copy.h"
 #include "ini.h"
 #include "conda.h"
+#include "channel.h"
 #include "environment.h"
 #include "artifactory.h"
 #include "docker.h"
@@ -65,11 +69,13 @@ struct STASIS_GLOBAL {
     bool enable_docker; //!< Enable docker image builds
     bool enable_artifactory; //!< Enable artifactory uploads
     bool enable_testing; //!< Enable package testing
+    long cpu_limit; //!< Maximum number of worker threads (0 = number of CPUs)
     struct StrList *conda_packages; //!< Conda packages to install after initial activation
     struct StrList *pip_packages; //!< Pip packages to install after initial activation
     char *tmpdir; //!< Path to temporary storage directory
     char *conda_install_prefix; //!< Path to install conda
     char *sysconfdir; //!< Path where STASIS reads its configuration files (mission directory, etc)
+    char *cache_dir; //!< Path where STASIS keeps data between runs (compiled configuration files, etc)
     struct {
         char *tox_posargs;
     } workaround;
@@ -186,6 +186,8 @@ struct Delivery {
         char *build_number_fmt;     ///< Build number format string
         struct Content content[1000];
     } rules;
+
+    struct Arena *arena; ///< Storage for every string in the context. Released by delivery_free()
 };
 
 /**
@@ -198,12 +200,51 @@ struct Delivery {
  */
 int delivery_init(struct Delivery *ctx);
 
+/**
+ * Expose a Delivery to the template engine
+ *
+ * Registers the `meta`, `info`, `storage`, and `conda` template namespaces.
+ * Values are read when a template is rendered, so this may be called before
+ * the context is populated.
+ *
+ * ```c
+ * delivery_register_templates(&ctx);
+ * char *path = tpl_render("{{ storage.delivery_dir }}/{{ info.release_name }}.yml");
+ * ```
+ *
+ * @param ctx pointer to Delivery context
+ */
+void delivery_register_templates(struct Delivery *ctx);
+
 /**
  * Free memory allocated by delivery_init()
+ *
+ * Strings are not freed one by one. They belong to `ctx->arena`, which is
+ * released in a single call.
+ *
  * @param ctx pointer to Delivery context
  */
 void delivery_free(struct Delivery *ctx);
 
+/**
+ * Return the context's arena, creating it on first use
+ * @param ctx pointer to Delivery context
+ * @return `Arena`, or NULL on error
+ */
+struct Arena *delivery_arena(struct Delivery *ctx);
+
+/**
+ * Duplicate a string into the context's arena
+ *
+ * Every string stored in a `Delivery` must be allocated from its arena, so
+ * that `delivery_free` can release them all at once.
+ *
+ * @param ctx pointer to Delivery context
+ * @param str string to copy (may be NULL)
+ * @return copy of `str`, or NULL if `str` is NULL or on error
+ */
+char *delivery_strdup(struct Delivery *ctx, const char *str);
+
 /**
  * Print Delivery metadata
  * @param ctx pointer to Delivery context
@@ -311,7 +352,11 @@ void delivery_get_installer_url(struct Delivery *ctx, char *result);
 int delivery_install_packages(struct Delivery *ctx, char *conda_install_dir, char *env_name, int type, struct StrList *manifest[]);
 
 /**
- * Update "conda index" on Conda artifact storage
+ * Index Conda artifact storage
+ *
+ * Only packages added or changed since the last index are read (see `channel_index`).
+ * Falls back to "conda index" when .conda packages cannot be read natively.
+ *
  * @param ctx pointer to Delivery context
  * @return 0 on success
  * @return Non-zero on error
@@ -387,7 +432,18 @@ int delivery_docker(struct Delivery *ctx);
 
 int delivery_fixup_test_results(struct Delivery *ctx);
 
-int *bootstrap_build_info(struct Delivery *ctx);
+/**
+ * Derive the build information (release name, build name and number, timestamps)
+ * from the delivery and global configuration already opened in `ctx->_stasis_ini_fp`
+ *
+ * This is the first configuration phase. delivery_init() reuses the populated
+ * context instead of parsing the configuration again.
+ *
+ * @param ctx pointer to Delivery context
+ * @return `0` on success
+ * @return Non-zero on error
+ */
+int bootstrap_build_info(struct Delivery *ctx);
 
 int delivery_dump_metadata(struct Delivery *ctx);
 
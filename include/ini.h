@@ -69,6 +69,25 @@ struct INISection {
 struct INIFILE {
     size_t section_count;            ///< Total INISection records
     struct INISection **section;     ///< Array of INISection records
+    char *_mapping;                  ///< Compiled cache image holding keys and values (see ini_open_cached())
+    size_t _mapping_size;            ///< Size of the compiled cache image
+};
+
+/*! \struct INIIterator
+ * \brief Cursor over INI sections, or over the records of one section
+ *
+ * An iterator is a plain value owned by the caller. Any number of iterators may
+ * be active at once. Several threads may iterate the same INIFILE and read its
+ * values with `ini_getval`, as long as none of them modify it (`ini_setval`,
+ * `ini_data_append`, ...). `ini_getall` keeps a global cursor and is not safe
+ * to share.
+ */
+struct INIIterator {
+    struct INIFILE *ini;             ///< INIFILE being iterated
+    struct INISection *section;      ///< Section being iterated (record iteration only)
+    const char *pattern;             ///< Section name filter (section iteration only)
+    unsigned mode;                   ///< INI_SEARCH_EXACT, INI_SEARCH_BEGINS, or INI_SEARCH_SUBSTR
+    size_t index;                    ///< Position of the next candidate
 };
 
 /**
@@ -92,6 +111,41 @@ struct INIFILE {
  */
 struct INIFILE *ini_open(const char *filename);
 
+/**
+ * Open and parse an INI configuration file without copying its contents line by line
+ *
+ * The file is mapped into memory and tokenized in a single pass. Keys and values are
+ * only copied once, when the INIFILE is assembled, so values are not limited to
+ * STASIS_BUFSIZ. The result is interchangeable with ini_open() and is released with
+ * ini_free().
+ *
+ * @param filename path to INI file
+ * @return pointer to INIFILE, or NULL on error
+ */
+struct INIFILE *ini_open_mmap(const char *filename);
+
+/**
+ * Open and parse an INI configuration file using a compiled cache
+ *
+ * The parsed result is stored in `cache_dir` as a flat image of
+ * position-independent records and strings. When the source file's
+ * size and modification time match the cache, the image is mapped and
+ * its strings are used in place. A changed modification time alone
+ * only triggers a content hash comparison. Any other change reparses
+ * the source with ini_open_mmap() and replaces the cache.
+ *
+ * Values may still be modified with ini_setval() and released with ini_free().
+ *
+ * ~~~{.c}
+ * struct INIFILE *ini = ini_open_cached("delivery.ini", globals.cache_dir);
+ * ~~~
+ *
+ * @param filename path to INI file
+ * @param cache_dir directory to store compiled configuration files (NULL disables the cache)
+ * @return pointer to INIFILE, or NULL on error
+ */
+struct INIFILE *ini_open_cached(const char *filename, const char *cache_dir);
+
 /**
  *
  * @param ini
@@ -149,12 +203,71 @@ int ini_setval(struct INIFILE **ini, unsigned type, char *section_name, char *ke
  * }
  * ~~~
  *
+ * @note Only one ini_getall() loop may be active at a time, and it must run until
+ * NULL is returned. Prefer ini_data_iter_init().
+ *
  * @param ini pointer to INIFILE
  * @param section_name to read
  * @return pointer to INIData
  */
 struct INIData *ini_getall(struct INIFILE *ini, char *section_name);
 
+/**
+ * Prepare an iterator over the sections of an INIFILE
+ *
+ * ~~~{.c}
+ * struct INIIterator iter;
+ * struct INISection *section;
+ *
+ * // Visit every "test:*" section
+ * ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "test:");
+ * while ((section = ini_section_iter_next(&iter)) != NULL) {
+ *     printf("%s\n", section->key);
+ * }
+ * ~~~
+ *
+ * @param iter pointer to INIIterator
+ * @param ini pointer to INIFILE
+ * @param mode INI_SEARCH_EXACT, INI_SEARCH_BEGINS, or INI_SEARCH_SUBSTR
+ * @param pattern section name filter (NULL visits all sections)
+ */
+void ini_section_iter_init(struct INIIterator *iter, struct INIFILE *ini, unsigned mode, const char *pattern);
+
+/**
+ * Advance a section iterator
+ * @param iter pointer to INIIterator initialized by ini_section_iter_init()
+ * @return pointer to the next matching INISection, or NULL when exhausted
+ */
+struct INISection *ini_section_iter_next(struct INIIterator *iter);
+
+/**
+ * Prepare an iterator over the records of a section
+ *
+ * ~~~{.c}
+ * struct INIIterator iter;
+ * struct INIData *data;
+ *
+ * if (!ini_data_iter_init(&iter, ini, "runtime")) {
+ *     while ((data = ini_data_iter_next(&iter)) != NULL) {
+ *         printf("%s=%s\n", data->key, data->value);
+ *     }
+ * }
+ * ~~~
+ *
+ * @param iter pointer to INIIterator
+ * @param ini pointer to INIFILE
+ * @param section_name section to read
+ * @return 0 on success, -1 if the section does not exist
+ */
+int ini_data_iter_init(struct INIIterator *iter, struct INIFILE *ini, const char *section_name);
+
+/**
+ * Advance a record iterator
+ * @param iter pointer to INIIterator initialized by ini_data_iter_init()
+ * @return pointer to the next INIData, or NULL when exhausted
+ */
+struct INIData *ini_data_iter_next(struct INIIterator *iter);
+
 /**
  * Retrieve a single record from a section key
  *
@@ -184,6 +297,11 @@ struct INIData *ini_getall(struct INIFILE *ini, char *section_name);
  * }
  * ~~~
  *
+ * Leading whitespace is stripped from every line of a value when it is stored,
+ * so reading never modifies the INIFILE. INIVAL_TYPE_STR also skips any
+ * leading whitespace left in the value; INIVAL_TYPE_STR_ARRAY returns the
+ * lines separated by '\n'.
+ *
  * @param ini pointer to INIFILE
  * @param section_name to read
  * @param key to return
@@ -20,6 +20,10 @@
 #include <sys/syslimits.h>
 #endif
 
+// struct stat timestamps as struct timespec
+#define STAT_ATIM(st) ((st).st_atimespec)
+#define STAT_MTIM(st) ((st).st_mtimespec)
+
 extern char **environ;
 #define __environ environ
 
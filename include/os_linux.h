@@ -7,4 +7,8 @@
 #include <linux/limits.h>
 #endif
 
+// struct stat timestamps as struct timespec
+#define STAT_ATIM(st) ((st).st_atim)
+#define STAT_MTIM(st) ((st).st_mtim)
+
 #endif
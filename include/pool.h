@@ -0,0 +1,82 @@
+//! @file pool.h
+#ifndef STASIS_POOL_H
+#define STASIS_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * Function executed by a pool worker
+ * @param arg the argument given to `pool_submit`
+ */
+typedef void pool_task_func(void *arg);
+
+struct PoolTask {
+    pool_task_func *func;
+    void *arg;
+    struct PoolTask *next;
+};
+
+/**
+ * Fixed size set of worker threads consuming a shared task queue
+ */
+struct Pool {
+    pthread_t *threads;         //!< Worker threads
+    size_t nthreads;            //!< Number of worker threads
+    pthread_mutex_t lock;       //!< Protects every member below
+    pthread_cond_t task_ready;  //!< Signaled when a task is queued or the pool shuts down
+    pthread_cond_t idle;        //!< Signaled when the last pending task finishes
+    struct PoolTask *head;      //!< Next task to run
+    struct PoolTask *tail;      //!< Last task queued
+    size_t pending;             //!< Number of queued and running tasks
+    int shutdown;               //!< Workers exit once the queue is empty
+};
+
+/**
+ * Determine the default number of worker threads
+ * @return `globals.cpu_limit` when set, otherwise the number of online CPUs
+ */
+size_t pool_default_size(void);
+
+/**
+ * Start a worker pool
+ *
+ * ~~~{.c}
+ * void work(void *arg) {
+ *     printf("%s\n", (char *) arg);
+ * }
+ *
+ * struct Pool *pool = pool_init(0);
+ * pool_submit(pool, work, "hello");
+ * pool_submit(pool, work, "world");
+ * pool_wait(pool);
+ * pool_free(&pool);
+ * ~~~
+ *
+ * @param nthreads number of worker threads (0 uses `pool_default_size`)
+ * @return a pool, or NULL on error
+ */
+struct Pool *pool_init(size_t nthreads);
+
+/**
+ * Queue `func(arg)` for execution by a worker
+ * @param pool pointer to pool
+ * @param func function to execute
+ * @param arg argument passed to `func`
+ * @return 0 on success, -1 on error
+ */
+int pool_submit(struct Pool *pool, pool_task_func *func, void *arg);
+
+/**
+ * Block until every submitted task has finished
+ * @param pool pointer to pool
+ */
+void pool_wait(struct Pool *pool);
+
+/**
+ * Finish the queued tasks, stop the workers, and free the pool
+ * @param pool pointer to pool
+ */
+void pool_free(struct Pool **pool);
+
+#endif //STASIS_POOL_H
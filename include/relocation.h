@@ -15,10 +15,40 @@
 #include <linux/limits.h>
 #endif
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define REPLACE_TRUNCATE_AFTER_MATCH 1
 
+#define RELOCATE_AUTO 0     //!< Choose text or binary relocation from the file's contents
+#define RELOCATE_TEXT 1     //!< Replace matches, changing the file size as needed
+#define RELOCATE_BINARY 2   //!< Replace matches in NUL terminated strings and pad them to their original length
+
+/**
+ * A replacement applied by `file_replace_text_rules`
+ */
+struct ReplaceRule {
+    const char *target;         //!< String to replace
+    const char *replacement;    //!< Replacement string
+    unsigned flags;             //!< REPLACE_TRUNCATE_AFTER_MATCH, or 0
+};
+
+struct RelocationStats {
+    size_t files_scanned;   //!< Files read
+    size_t files_rewritten; //!< Files containing at least one replacement
+    size_t files_binary;    //!< Rewritten files relocated as binary
+    size_t replacements;    //!< Occurrences replaced
+    size_t bytes_scanned;   //!< Bytes read
+    size_t bytes_written;   //!< Bytes written to rewritten files
+    size_t files_failed;    //!< Files that could not be relocated
+};
+
 int replace_text(char *original, const char *target, const char *replacement, unsigned flags);
 int file_replace_text(const char* filename, const char* target, const char* replacement, unsigned flags);
+ssize_t file_replace_text_rules(const char *filename, const struct ReplaceRule *rules);
+int relocation_is_binary(const char *data, size_t len);
+ssize_t relocate_file(const char *filename, const char *old_prefix, const char *new_prefix, int mode, struct RelocationStats *stats);
+ssize_t relocate_tree(const char *path, const char *old_prefix, const char *new_prefix, int mode, struct RelocationStats *stats);
 
 #endif //STASIS_RELOCATION_H
@@ -16,6 +16,111 @@
 #define STASIS_SORT_LEN_ASCENDING 1 << 2
 #define STASIS_SORT_LEN_DESCENDING 1 << 3
 
+/*! \struct StrView
+ *  \brief A string that is not necessarily NUL terminated
+ */
+struct StrView {
+    const char *ptr; ///< Start of string
+    size_t len; ///< Length of string
+};
+
+/*! \struct StrSplit
+ *  \brief State used by str_split_next()
+ */
+struct StrSplit {
+    const char *pos; ///< Start of the next token (NULL when finished)
+    const char *end; ///< End of the input
+    const char *delim; ///< Delimiter characters
+};
+
+/**
+ * Create a view of a NUL terminated string
+ * @param sptr string (NULL produces an empty view)
+ * @return `StrView`
+ */
+struct StrView strview(const char *sptr);
+
+/**
+ * Create a view of `len` bytes starting at `sptr`
+ * @param sptr pointer to bytes
+ * @param len number of bytes
+ * @return `StrView`
+ */
+struct StrView strview_n(const char *sptr, size_t len);
+
+/**
+ * Compare two views
+ * @param a `StrView`
+ * @param b `StrView`
+ * @return 1 = identical, 0 = different
+ */
+int strview_eq(struct StrView a, struct StrView b);
+
+/**
+ * Determine whether `s` begins with `prefix`
+ * @param s `StrView`
+ * @param prefix `StrView`
+ * @return 1 = found, 0 = not found
+ */
+int strview_startswith(struct StrView s, struct StrView prefix);
+
+/**
+ * Determine whether `s` ends with `suffix`
+ * @param s `StrView`
+ * @param suffix `StrView`
+ * @return 1 = found, 0 = not found
+ */
+int strview_endswith(struct StrView s, struct StrView suffix);
+
+/**
+ * Find the first occurrence of `needle` in `s`
+ * @param s `StrView`
+ * @param needle `StrView`
+ * @return offset of `needle` in `s`, or -1 when not found
+ */
+ssize_t strview_find(struct StrView s, struct StrView needle);
+
+/**
+ * Remove leading whitespace from a view
+ * @param s `StrView`
+ * @return `StrView`
+ */
+struct StrView strview_lstrip(struct StrView s);
+
+/**
+ * Remove trailing whitespace from a view
+ * @param s `StrView`
+ * @return `StrView`
+ */
+struct StrView strview_rstrip(struct StrView s);
+
+/**
+ * Remove leading and trailing whitespace from a view
+ * @param s `StrView`
+ * @return `StrView`
+ */
+struct StrView strview_strip(struct StrView s);
+
+/**
+ * Replace every occurrence of `target` in `s` with `replacement`
+ *
+ * The input is scanned once. Callee should free the result using `free()`.
+ *
+ * @param s `StrView`
+ * @param target `StrView` to search for (must not be empty)
+ * @param replacement `StrView`
+ * @return new NUL terminated string, or NULL on error
+ */
+char *strview_replace(struct StrView s, struct StrView target, struct StrView replacement);
+
+/**
+ * Prepare to iterate over the tokens of a view without allocating memory
+ * @param it pointer to `StrSplit`
+ * @param s `StrView` to split (must remain valid during iteration)
+ * @param delim characters to split on
+ */
+void strview_split_init(struct StrSplit *it, struct StrView s, const char *delim);
+
 /**
  * Determine how many times the character `ch` appears in `sptr` string
  * @param sptr string to scan
@@ -61,6 +166,52 @@ void strchrdel(char *sptr, const char *chars);
  */
 char** split(char *sptr, const char* delim, size_t max);
 
+/**
+ * Split a string by every delimiter in `delim` string.
+ *
+ * Works like `split()`, but the array and every token are stored in one
+ * block of memory. Callee should free the result using `free()`, NOT
+ * `GENERIC_ARRAY_FREE()`. Tokens may be modified in place but must not be
+ * reallocated or freed individually.
+ *
+ * @param sptr string to split
+ * @param delim characters to split on
+ * @param max maximum number of splits (0 = unlimited)
+ * @return success=parts of string, failure=NULL
+ */
+char **split_compact(const char *sptr, const char *delim, size_t max);
+
+/**
+ * Prepare to iterate over the tokens of a string without allocating memory
+ *
+ * ~~~{.c}
+ * struct StrSplit it;
+ * struct StrView token;
+ *
+ * str_split_init(&it, "PATH=/usr/bin", "=");
+ * while (str_split_next(&it, &token)) {
+ *     printf("%.*s\n", (int) token.len, token.ptr);
+ * }
+ * ~~~
+ *
+ * @param it pointer to `StrSplit`
+ * @param sptr string to split (must remain valid during iteration)
+ * @param delim characters to split on
+ */
+void str_split_init(struct StrSplit *it, const char *sptr, const char *delim);
+
+/**
+ * Retrieve the next token
+ *
+ * Tokens follow the same rules as `split()`. Adjacent delimiters produce
+ * empty tokens, and a string without delimiters is a single token.
+ *
+ * @param it pointer to `StrSplit`
+ * @param token pointer to `StrView` receiving the token
+ * @return 1 when `token` was set, 0 when no tokens remain
+ */
+int str_split_next(struct StrSplit *it, struct StrView *token);
+
 /**
  * Create new a string from an array of strings
  *
@@ -12,9 +12,11 @@ struct StrList {
     size_t num_alloc;
     size_t num_inuse;
     char **data;
+    struct Arena *arena;
 };
 
 struct StrList *strlist_init();
+struct StrList *strlist_init_arena(struct Arena *arena);
 void strlist_remove(struct StrList *pStrList, size_t index);
 long double strlist_item_as_long_double(struct StrList *pStrList, size_t index);
 double strlist_item_as_double(struct StrList *pStrList, size_t index);
@@ -38,6 +40,8 @@ void strlist_sort(struct StrList *pStrList, unsigned int mode);
 int strlist_append_file(struct StrList *pStrList, char *path, ReaderFn *readerFn);
 void strlist_append_strlist(struct StrList *pStrList1, struct StrList *pStrList2);
 void strlist_append(struct StrList **pStrList, char *str);
+void strlist_append_n(struct StrList *pStrList, char **arr, size_t count);
+int strlist_reserve(struct StrList *pStrList, size_t count);
 void strlist_append_array(struct StrList *pStrList, char **arr);
 void strlist_append_tokenize(struct StrList *pStrList, char *str, char *delim);
 struct StrList *strlist_copy(struct StrList *pStrList);
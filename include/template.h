@@ -12,6 +12,37 @@
  */
 void tpl_register(char *key, char **ptr);
 
+/**
+ * Resolve a name within a namespace
+ * @param name text following the namespace separator
+ * @param data pointer given to `tpl_register_namespace`
+ * @return a pointer to the value, or NULL
+ */
+typedef char *tpl_resolver(const char *name, void *data);
+
+/**
+ * Resolve keys beginning with `ns` followed by ':' or '.' through a function
+ *
+ * Keys registered with `tpl_register` take precedence. The `env` namespace
+ * resolves to the runtime environment by default. `delivery_register_templates`
+ * registers the namespaces of a delivery (meta, info, storage, conda).
+ *
+ * ~~~{.c}
+ * char *lookup_user(const char *name, void *data) {
+ *     return strcmp(name, "name") == 0 ? data : NULL;
+ * }
+ *
+ * tpl_register_namespace("user", lookup_user, "stasis");
+ * char *result = tpl_render("{{ user.name }}");
+ * // result is "stasis"
+ * ~~~
+ *
+ * @param ns namespace name
+ * @param resolver function called with the remainder of the key
+ * @param data passed to `resolver`
+ */
+void tpl_register_namespace(char *ns, tpl_resolver *resolver, void *data);
+
 /**
  * Free the template engine
  */
@@ -24,6 +55,72 @@ void tpl_free();
  */
 char *tpl_getval(char *key);
 
+enum tpl_opcode {
+    TPL_OP_TEXT,    //!< Copy a literal span of the source
+    TPL_OP_VAR,     //!< {{ key }}
+    TPL_OP_ENV,     //!< {{ env:NAME }}
+    TPL_OP_FUNC,    //!< {{ func:NAME(a, ...) }}
+};
+
+struct tpl_item;
+
+struct tpl_instruction {
+    enum tpl_opcode op;
+    const char *text;   //!< TPL_OP_TEXT: start of the literal span in tpl_program.source
+    size_t len;         //!< TPL_OP_TEXT: length of the literal span
+    char *name;         //!< Key, environment variable, or function name
+    char **args;        //!< TPL_OP_FUNC: NULL terminated argument list
+    int argc;           //!< TPL_OP_FUNC: number of arguments
+    size_t offset;      //!< Position of the tag in the source
+    uint64_t hash;      //!< TPL_OP_VAR: hash of the key
+    struct tpl_item *item;  //!< TPL_OP_VAR: registered item found at compile time
+};
+
+/**
+ * A template compiled by `tpl_compile`
+ *
+ * Values, environment variables, and functions are looked up when the program
+ * is executed, so one program may be rendered many times.
+ */
+struct tpl_program {
+    char *source;                   //!< Copy of the template text
+    struct tpl_instruction *code;   //!< Instructions
+    size_t count;                   //!< Number of instructions
+    size_t alloc;                   //!< Number of instructions allocated
+    size_t text_len;                //!< Total length of the literal spans
+    unsigned generation;            //!< Registry generation at compile time
+};
+
+/**
+ * Parse `str` into a reusable list of instructions
+ * @param str the text data to compile
+ * @return a template program, or NULL on error.
+ * The caller is responsible for freeing the program with `tpl_program_free`
+ */
+struct tpl_program *tpl_compile(const char *str);
+
+/**
+ * Render a compiled template
+ * @param prog program returned by `tpl_compile`
+ * @return the rendered text, or NULL on error.
+ * The caller is responsible for free()ing memory allocated by this function
+ */
+char *tpl_execute(const struct tpl_program *prog);
+
+/**
+ * Write a compiled template to a file descriptor
+ * @param prog program returned by `tpl_compile`
+ * @param fd destination file descriptor
+ * @return 0 on success, <0 on error
+ */
+int tpl_execute_fd(const struct tpl_program *prog, int fd);
+
+/**
+ * Free a program returned by `tpl_compile`
+ * @param prog pointer to program
+ */
+void tpl_program_free(struct tpl_program **prog);
+
 /**
  * Replaces occurrences of all registered key value pairs in `str`
  * @param str the text data to render
@@ -34,12 +131,76 @@ char *tpl_render(char *str);
 
 /**
  * Write tpl_render() output to a file
+ *
+ * Output is written to a temporary file in the same directory and renamed
+ * over `filename` when rendering succeeds.
+ *
  * @param str the text to render
  * @param filename the output file name
  * @return 0 on success, <0 on error
  */
 int tpl_render_to_file(char *str, const char *filename);
 
+/**
+ * Render a template without buffering the output
+ *
+ * Tags are evaluated while the input is parsed, and the output is written
+ * with writev(), so memory use does not depend on the size of the template.
+ *
+ * @param str the text to render (need not be NUL terminated)
+ * @param len length of `str`
+ * @param fd destination file descriptor
+ * @return 0 on success, <0 on error
+ */
+int tpl_render_fd(const char *str, size_t len, int fd);
+
+/**
+ * Render the template file `src` to `dest`
+ *
+ * `src` is memory mapped and streamed through `tpl_render_fd`. Output is
+ * written to a temporary file in the same directory and renamed over `dest`
+ * when rendering succeeds.
+ *
+ * @param src path to template
+ * @param dest path to output file
+ * @return 0 on success, <0 on error
+ */
+int tpl_render_file(const char *src, const char *dest);
+
+#define TPL_RENDER_UNCHANGED 1 //!< tpl_render_file_incremental() left the output untouched
+
+/**
+ * Hash a template and the values it refers to
+ *
+ * Every tag is evaluated, so `values_hash` changes whenever the output of a
+ * variable, environment variable, or function used by the template changes.
+ *
+ * @param str the text to hash (need not be NUL terminated)
+ * @param len length of `str`
+ * @param source_hash set to the hash of `str`
+ * @param values_hash set to the hash of the tag values
+ * @return 0 on success, <0 on error
+ */
+int tpl_fingerprint(const char *str, size_t len, uint64_t *source_hash, uint64_t *values_hash);
+
+/**
+ * Render `src` to `dest` only when the output would change
+ *
+ * The hashes from `tpl_fingerprint` are recorded in `state_dir` with the size
+ * and modification time of `dest`. The next call leaves `dest` untouched if
+ * none of them changed. A NULL `state_dir` always renders.
+ *
+ * Each tag is evaluated once per call: the values that were hashed are the
+ * ones written to `dest`. A function that returns a different result every
+ * time (e.g. a timestamp) causes `dest` to be written on every call.
+ *
+ * @param src path to template
+ * @param dest path to output file
+ * @param state_dir directory used to record render state
+ * @return 0 when `dest` was written, TPL_RENDER_UNCHANGED when it was up to date, <0 on error
+ */
+int tpl_render_file_incremental(const char *src, const char *dest, const char *state_dir);
+
 struct tplfunc_frame *tpl_getfunc(char *key);
 struct tplfunc_frame;
 typedef int tplfunc(struct tplfunc_frame *frame, void *result);
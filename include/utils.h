@@ -8,7 +8,9 @@
 #include <unistd.h>
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
 #include "system.h"
+#include "arena.h"
 
 #if defined(STASIS_OS_WINDOWS)
 #define PATH_ENV_VAR "path"
@@ -76,17 +78,49 @@ char *expandpath(const char *_path);
 /**
  * Remove a directory tree recursively
  *
+ * Entries are removed relative to directory file descriptors, and
+ * subdirectories are emptied in parallel by a worker pool (see
+ * `pool_default_size`). Symbolic links are removed, never followed.
+ * Read-only directories are made writable so their contents can be removed.
+ *
  * ```c
  * mkdirs("a/b/c");
  * rmtree("a");
  * // a/b/c is removed
  * ```
  *
- * @param _path
- * @return 0 on success, -1 on error
+ * @param _path directory to remove (not "/")
+ * @return 0 on success, -1 on error (errno is set to the first failure)
  */
 int rmtree(char *_path);
 
+/**
+ * Remove a directory tree without waiting for it
+ *
+ * `path` is renamed aside (`<path>.stasis-rm.XXXXXX`) and queued for
+ * removal by `rmtree` on a single background thread, so `path` can be
+ * reused immediately.
+ * Trees that cannot be renamed are removed before returning.
+ * Pending removals are finished by `rmtree_background_wait`, which also
+ * runs at exit.
+ *
+ * ```c
+ * if (rmtree_background("build")) {
+ *     perror("build");
+ * }
+ * mkdir("build", 0755);
+ * ```
+ *
+ * @param path directory to remove
+ * @return 0 on success, -1 on error
+ */
+int rmtree_background(const char *path);
+
+/**
+ * Wait for every `rmtree_background` removal to finish
+ */
+void rmtree_background_wait(void);
+
 
 char **file_readlines(const char *filename, size_t start, size_t limit, ReaderFn *readerFn);
 
@@ -188,6 +222,20 @@ char *git_rev_parse(const char *path, char *args);
  */
 int path_store(char **destptr, size_t maxlen, const char *base, const char *path);
 
+/**
+ * Same as path_store(), but the resulting path is allocated from `arena`
+ *
+ * A previous value of `destptr` is only freed when it was not allocated by `arena`.
+ *
+ * @param arena `Arena` (NULL allocates from the heap)
+ * @param destptr pointer to destination
+ * @param maxlen maximum length of the path
+ * @param base path
+ * @param path to append to base
+ * @return 0 on success, -1 on error
+ */
+int path_store_arena(struct Arena *arena, char **destptr, size_t maxlen, const char *base, const char *path);
+
 #if defined(STASIS_DUMB_TERMINAL)
 #define STASIS_COLOR_RED ""
 #define STASIS_COLOR_GREEN ""
@@ -351,4 +399,25 @@ int redact_sensitive(const char **to_redact, size_t to_redact_size, char *src, c
  */
 struct StrList *listdir(const char *path);
 
+#define HASH_FNV1A_INIT 0xcbf29ce484222325ULL //!< Initial value for hash_fnv1a()
+
+/**
+ * Compute a 64-bit FNV-1a hash
+ *
+ * The result of a previous call may be passed as `hash` to continue hashing
+ * additional data.
+ *
+ * ~~~{.c}
+ * uint64_t hash = hash_fnv1a(HASH_FNV1A_INIT, "hello ", 6);
+ * hash = hash_fnv1a(hash, "world", 5);
+ * // hash == hash_fnv1a(HASH_FNV1A_INIT, "hello world", 11)
+ * ~~~
+ *
+ * @param hash HASH_FNV1A_INIT, or the result of a previous call
+ * @param data bytes to hash
+ * @param len number of bytes in data
+ * @return hash value
+ */
+uint64_t hash_fnv1a(uint64_t hash, const void *data, size_t len);
+
 #endif //STASIS_UTILS_H
@@ -0,0 +1,128 @@
+/**
+ * Region based memory allocation
+ * @file arena.c
+ */
+#include "arena.h"
+
+static struct ArenaBlock *arena_block_new(size_t size) {
+    struct ArenaBlock *block = calloc(1, sizeof(*block) + size);
+    if (!block) {
+        return NULL;
+    }
+    block->size = size;
+    return block;
+}
+
+struct Arena *arena_init(size_t block_size) {
+    struct Arena *arena = calloc(1, sizeof(*arena));
+    if (!arena) {
+        return NULL;
+    }
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE_DEFAULT;
+    return arena;
+}
+
+/**
+ * Hand out `size` aligned bytes from a block
+ * @return pointer to memory, or NULL when the block is full
+ */
+static void *arena_block_take(struct ArenaBlock *block, size_t size) {
+    uintptr_t base = (uintptr_t) block->data;
+    size_t offset = ((base + block->used + ARENA_ALIGN - 1) & ~(uintptr_t) (ARENA_ALIGN - 1)) - base;
+    if (offset > block->size || size > block->size - offset) {
+        return NULL;
+    }
+    block->used = offset + size;
+    return &block->data[offset];
+}
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+    struct ArenaBlock *block;
+    void *result;
+
+    if (!arena) {
+        return NULL;
+    }
+    if (!size) {
+        size = 1;
+    }
+
+    if (arena->head && (result = arena_block_take(arena->head, size))) {
+        return result;
+    }
+
+    if (size + ARENA_ALIGN > arena->block_size) {
+        // Oversized requests get a block of their own. Keep filling the current block afterward.
+        block = arena_block_new(size + ARENA_ALIGN);
+        if (!block) {
+            return NULL;
+        }
+        if (arena->head) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            arena->head = block;
+        }
+        return arena_block_take(block, size);
+    }
+
+    block = arena_block_new(arena->block_size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = arena->head;
+    arena->head = block;
+    return arena_block_take(block, size);
+}
+
+char *arena_strndup(struct Arena *arena, const char *s, size_t n) {
+    char *result;
+    size_t len;
+
+    if (!s) {
+        return NULL;
+    }
+    len = strnlen(s, n);
+    result = arena_alloc(arena, len + 1);
+    if (!result) {
+        return NULL;
+    }
+    memcpy(result, s, len);
+    return result;
+}
+
+char *arena_strdup(struct Arena *arena, const char *s) {
+    if (!s) {
+        return NULL;
+    }
+    return arena_strndup(arena, s, strlen(s));
+}
+
+int arena_owns(const struct Arena *arena, const void *ptr) {
+    const char *p = ptr;
+    if (!arena || !ptr) {
+        return 0;
+    }
+    for (const struct ArenaBlock *block = arena->head; block != NULL; block = block->next) {
+        if (p >= block->data && p < block->data + block->size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void arena_free(struct Arena **arena) {
+    struct ArenaBlock *block;
+
+    if (!arena || !*arena) {
+        return;
+    }
+    block = (*arena)->head;
+    while (block) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(*arena);
+    *arena = NULL;
+}
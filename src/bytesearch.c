@@ -0,0 +1,310 @@
+/**
+ * Byte search primitives with SIMD implementations chosen at runtime
+ * @file bytesearch.c
+ */
+#include <string.h>
+#include "bytesearch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BYTESEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+struct ByteSearchOps {
+    int impl;
+    const char *(*find)(const char *s, size_t len, int ch);
+    const char *(*find_set)(const char *s, size_t len, const char *set, size_t set_len);
+    size_t (*count)(const char *s, size_t len, int ch);
+    const char *(*find_str)(const char *s, size_t len, const char *needle, size_t needle_len);
+};
+
+// Largest set handled by the vectorized byte-set search
+#define BYTESEARCH_SET_MAX 16
+
+static const char *find_scalar(const char *s, size_t len, int ch) {
+    return memchr(s, ch, len);
+}
+
+static const char *find_set_scalar(const char *s, size_t len, const char *set, size_t set_len) {
+    unsigned char table[256] = {0};
+    for (size_t i = 0; i < set_len; i++) {
+        table[(unsigned char) set[i]] = 1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (table[(unsigned char) s[i]]) {
+            return &s[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t count_scalar(const char *s, size_t len, int ch) {
+    size_t result = 0;
+    for (size_t i = 0; i < len; i++) {
+        result += s[i] == (char) ch;
+    }
+    return result;
+}
+
+static const char *find_str_scalar(const char *s, size_t len, const char *needle, size_t needle_len) {
+    const char *pos = s;
+    const char *end = s + len;
+
+    while ((size_t) (end - pos) >= needle_len) {
+        pos = memchr(pos, needle[0], (size_t) (end - pos) - needle_len + 1);
+        if (!pos) {
+            break;
+        }
+        if (memcmp(pos + 1, needle + 1, needle_len - 1) == 0) {
+            return pos;
+        }
+        pos++;
+    }
+    return NULL;
+}
+
+static const struct ByteSearchOps ops_scalar = {
+    .impl = BYTESEARCH_SCALAR,
+    .find = find_scalar,
+    .find_set = find_set_scalar,
+    .count = count_scalar,
+    .find_str = find_str_scalar,
+};
+
+#if defined(BYTESEARCH_X86)
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *s, size_t len, int ch) {
+    const __m128i needle = _mm_set1_epi8((char) ch);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (s + i));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(s + i, len - i, ch);
+}
+
+__attribute__((target("sse2")))
+static const char *find_set_sse2(const char *s, size_t len, const char *set, size_t set_len) {
+    __m128i needle[BYTESEARCH_SET_MAX];
+    size_t i = 0;
+
+    if (set_len > BYTESEARCH_SET_MAX) {
+        return find_set_scalar(s, len, set, set_len);
+    }
+    for (size_t n = 0; n < set_len; n++) {
+        needle[n] = _mm_set1_epi8(set[n]);
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i match = _mm_setzero_si128();
+        for (size_t n = 0; n < set_len; n++) {
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(block, needle[n]));
+        }
+        unsigned mask = (unsigned) _mm_movemask_epi8(match);
+        if (mask) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return find_set_scalar(s + i, len - i, set, set_len);
+}
+
+__attribute__((target("sse2,popcnt")))
+static size_t count_sse2(const char *s, size_t len, int ch) {
+    const __m128i needle = _mm_set1_epi8((char) ch);
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (s + i));
+        result += (size_t) __builtin_popcount((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    }
+    return result + count_scalar(s + i, len - i, ch);
+}
+
+__attribute__((target("sse2")))
+static const char *find_str_sse2(const char *s, size_t len, const char *needle, size_t needle_len) {
+    // Compare the first and last byte of the needle at every position, then
+    // verify the candidates. See "SIMD-friendly algorithms for substring searching".
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *) (s + i + needle_len - 1));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                                   _mm_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(s + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return s + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_str_scalar(s + i, len - i, needle, needle_len);
+}
+
+static const struct ByteSearchOps ops_sse2 = {
+    .impl = BYTESEARCH_SSE2,
+    .find = find_sse2,
+    .find_set = find_set_sse2,
+    .count = count_sse2,
+    .find_str = find_str_sse2,
+};
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *s, size_t len, int ch) {
+    const __m256i needle = _mm256_set1_epi8((char) ch);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (s + i));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return find_sse2(s + i, len - i, ch);
+}
+
+__attribute__((target("avx2")))
+static const char *find_set_avx2(const char *s, size_t len, const char *set, size_t set_len) {
+    __m256i needle[BYTESEARCH_SET_MAX];
+    size_t i = 0;
+
+    if (set_len > BYTESEARCH_SET_MAX) {
+        return find_set_scalar(s, len, set, set_len);
+    }
+    for (size_t n = 0; n < set_len; n++) {
+        needle[n] = _mm256_set1_epi8(set[n]);
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (s + i));
+        __m256i match = _mm256_setzero_si256();
+        for (size_t n = 0; n < set_len; n++) {
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, needle[n]));
+        }
+        unsigned mask = (unsigned) _mm256_movemask_epi8(match);
+        if (mask) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return find_set_sse2(s + i, len - i, set, set_len);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_avx2(const char *s, size_t len, int ch) {
+    const __m256i needle = _mm256_set1_epi8((char) ch);
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (s + i));
+        result += (size_t) __builtin_popcount((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    }
+    return result + count_sse2(s + i, len - i, ch);
+}
+
+__attribute__((target("avx2")))
+static const char *find_str_avx2(const char *s, size_t len, const char *needle, size_t needle_len) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *) (s + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *) (s + i + needle_len - 1));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                                         _mm256_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(s + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return s + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_str_sse2(s + i, len - i, needle, needle_len);
+}
+
+static const struct ByteSearchOps ops_avx2 = {
+    .impl = BYTESEARCH_AVX2,
+    .find = find_avx2,
+    .find_set = find_set_avx2,
+    .count = count_avx2,
+    .find_str = find_str_avx2,
+};
+#endif
+
+static const struct ByteSearchOps *ops;
+
+static const struct ByteSearchOps *bytesearch_ops(void) {
+    const struct ByteSearchOps *result = __atomic_load_n(&ops, __ATOMIC_ACQUIRE);
+    if (!result) {
+        bytesearch_select(BYTESEARCH_AUTO);
+        result = __atomic_load_n(&ops, __ATOMIC_ACQUIRE);
+    }
+    return result;
+}
+
+int bytesearch_select(int impl) {
+    const struct ByteSearchOps *selected = &ops_scalar;
+#if defined(BYTESEARCH_X86)
+    __builtin_cpu_init();
+    int have_sse2 = __builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt");
+    int have_avx2 = have_sse2 && __builtin_cpu_supports("avx2");
+
+    if (impl == BYTESEARCH_AUTO) {
+        impl = have_avx2 ? BYTESEARCH_AVX2 : have_sse2 ? BYTESEARCH_SSE2 : BYTESEARCH_SCALAR;
+    }
+    if ((impl == BYTESEARCH_AVX2 && !have_avx2) || (impl == BYTESEARCH_SSE2 && !have_sse2)) {
+        return -1;
+    }
+    if (impl == BYTESEARCH_AVX2) {
+        selected = &ops_avx2;
+    } else if (impl == BYTESEARCH_SSE2) {
+        selected = &ops_sse2;
+    }
+#else
+    if (impl != BYTESEARCH_AUTO && impl != BYTESEARCH_SCALAR) {
+        return -1;
+    }
+#endif
+    __atomic_store_n(&ops, selected, __ATOMIC_RELEASE);
+    return selected->impl;
+}
+
+int bytesearch_impl(void) {
+    return bytesearch_ops()->impl;
+}
+
+const char *bytes_find(const char *s, size_t len, int ch) {
+    return bytesearch_ops()->find(s, len, ch);
+}
+
+const char *bytes_find_set(const char *s, size_t len, const char *set) {
+    size_t set_len = strlen(set);
+    if (!set_len) {
+        return NULL;
+    }
+    if (set_len == 1) {
+        return bytesearch_ops()->find(s, len, set[0]);
+    }
+    return bytesearch_ops()->find_set(s, len, set, set_len);
+}
+
+size_t bytes_count(const char *s, size_t len, int ch) {
+    return bytesearch_ops()->count(s, len, ch);
+}
+
+const char *bytes_find_str(const char *s, size_t len, const char *needle, size_t needle_len) {
+    if (!needle_len) {
+        return s;
+    }
+    if (needle_len > len) {
+        return NULL;
+    }
+    if (needle_len == 1) {
+        return bytesearch_ops()->find(s, len, needle[0]);
+    }
+    return bytesearch_ops()->find_str(s, len, needle, needle_len);
+}
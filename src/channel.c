@@ -0,0 +1,1555 @@
+/**
+ * @file channel.c
+ */
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+#include <openssl/evp.h>
+#if defined(STASIS_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#include "channel.h"
+
+#define CHANNEL_TAR_BLOCK 512
+#define CHANNEL_DIGEST_CHUNK (1024 * 1024)
+
+/**
+ * A member of a JSON object. `value` is the member's minified JSON text.
+ */
+struct JsonMember {
+    char *key;
+    char *value;
+};
+
+struct ChannelPackage {
+    const char *subdir;         //!< Subdirectory name
+    char *filename;             //!< Archive file name
+    char *path;                 //!< Archive path
+    int conda;                  //!< Archive is a .conda (zip) file
+    int status;                 //!< 0 when indexed, -1 on error, 1 when the format is unsupported
+    int cached;                 //!< Record was loaded from the cache
+    off_t size;
+    struct timespec mtime;
+    char *name;
+    char *version;
+    char *license;
+    long long build_number;
+    long long timestamp;
+    struct JsonMember *members; //!< Repodata record, sorted by key
+    size_t members_count;
+};
+
+/**
+ * Decompresses one archive member held in memory
+ */
+struct ChannelStream {
+    int eof;
+#if defined(STASIS_HAVE_ZSTD)
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_in;
+#endif
+    bz_stream bz;
+    int bz_ready;
+};
+
+static const char *json_ws(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @return pointer past the closing quote, or NULL
+ */
+static const char *json_skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return pointer past the value starting at `p`, or NULL
+ */
+static const char *json_skip_value(const char *p, const char *end) {
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return json_skip_string(p, end);
+    }
+    if (*p == '{' || *p == '[') {
+        size_t depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = json_skip_string(p, end);
+                if (!p) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                depth++;
+            } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+    // number, true, false, or null
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && !isspace((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Copy JSON text, dropping whitespace outside of strings
+ */
+static char *json_minify(const char *p, const char *end) {
+    char *result = malloc(end - p + 1);
+    char *out = result;
+
+    if (!result) {
+        return NULL;
+    }
+    while (p < end) {
+        if (*p == '"') {
+            const char *next = json_skip_string(p, end);
+            if (!next) {
+                next = end;
+            }
+            memcpy(out, p, next - p);
+            out += next - p;
+            p = next;
+        } else {
+            if (!isspace((unsigned char) *p)) {
+                *out++ = *p;
+            }
+            p++;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+/**
+ * Decode a JSON string value
+ * @return the string, or NULL if `raw` is not a string
+ */
+static char *json_unquote(const char *raw) {
+    size_t len = strlen(raw);
+    if (len < 2 || raw[0] != '"' || raw[len - 1] != '"') {
+        return NULL;
+    }
+    char *result = malloc(len);
+    char *out = result;
+    if (!result) {
+        return NULL;
+    }
+    for (const char *p = raw + 1; p < raw + len - 1; p++) {
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                if (raw + len - 1 - p >= 5 && sscanf(p + 1, "%4x", &code) == 1) {
+                    p += 4;
+                } else {
+                    code = '?';
+                }
+                if (code < 0x80) {
+                    *out++ = (char) code;
+                } else if (code < 0x800) {
+                    *out++ = (char) (0xc0 | (code >> 6));
+                    *out++ = (char) (0x80 | (code & 0x3f));
+                } else {
+                    *out++ = (char) (0xe0 | (code >> 12));
+                    *out++ = (char) (0x80 | ((code >> 6) & 0x3f));
+                    *out++ = (char) (0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                *out++ = *p;
+                break;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+static void json_write_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char) *s;
+        if (ch == '"' || ch == '\\') {
+            fprintf(fp, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(fp, "\\u%04x", ch);
+        } else {
+            fputc(ch, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static int json_member_cmp(const void *a, const void *b) {
+    return strcmp(((const struct JsonMember *) a)->key, ((const struct JsonMember *) b)->key);
+}
+
+static void json_members_free(struct JsonMember *members, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        guard_free(members[i].key);
+        guard_free(members[i].value);
+    }
+    guard_free(members);
+}
+
+/**
+ * Split the top-level members of a JSON object
+ *
+ * Values are kept as minified JSON text. They are not validated.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int json_object_members(const char *data, size_t size, struct JsonMember **members, size_t *count) {
+    const char *end = data + size;
+    const char *p = json_ws(data, end);
+    struct JsonMember *result = NULL;
+    size_t result_count = 0;
+
+    if (p == end || *p != '{') {
+        goto l_json_object_members_fail;
+    }
+    p = json_ws(p + 1, end);
+    while (p < end && *p != '}') {
+        if (*p != '"') {
+            goto l_json_object_members_fail;
+        }
+        const char *key = p;
+        const char *key_end = json_skip_string(p, end);
+        if (!key_end) {
+            goto l_json_object_members_fail;
+        }
+        p = json_ws(key_end, end);
+        if (p == end || *p != ':') {
+            goto l_json_object_members_fail;
+        }
+        const char *value = json_ws(p + 1, end);
+        const char *value_end = json_skip_value(value, end);
+        if (!value_end || value_end == value) {
+            goto l_json_object_members_fail;
+        }
+
+        struct JsonMember *tmp = realloc(result, (result_count + 1) * sizeof(*result));
+        if (!tmp) {
+            goto l_json_object_members_fail;
+        }
+        result = tmp;
+        char *raw_key = strndup(key, key_end - key);
+        result[result_count].key = raw_key ? json_unquote(raw_key) : NULL;
+        result[result_count].value = json_minify(value, value_end);
+        guard_free(raw_key);
+        result_count++;
+        if (!result[result_count - 1].key || !result[result_count - 1].value) {
+            goto l_json_object_members_fail;
+        }
+
+        p = json_ws(value_end, end);
+        if (p < end && *p == ',') {
+            p = json_ws(p + 1, end);
+        }
+    }
+    if (p == end) {
+        goto l_json_object_members_fail;
+    }
+    *members = result;
+    *count = result_count;
+    return 0;
+
+    l_json_object_members_fail:
+    json_members_free(result, result_count);
+    errno = EINVAL;
+    return -1;
+}
+
+/**
+ * Find a member and return its value
+ * @return the member's JSON text, or NULL
+ */
+static const char *json_member_get(const struct JsonMember *members, size_t count, const char *key) {
+    for (size_t i = 0; i < count; i++) {
+        if (!strcmp(members[i].key, key)) {
+            return members[i].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add a member, replacing an existing member with the same key
+ * @return 0 on success, -1 on error
+ */
+static int json_member_set(struct JsonMember **members, size_t *count, const char *key, const char *value) {
+    char *copy = strdup(value);
+    if (!copy) {
+        return -1;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        if (!strcmp((*members)[i].key, key)) {
+            guard_free((*members)[i].value);
+            (*members)[i].value = copy;
+            return 0;
+        }
+    }
+    struct JsonMember *tmp = realloc(*members, (*count + 1) * sizeof(**members));
+    if (!tmp) {
+        guard_free(copy);
+        return -1;
+    }
+    *members = tmp;
+    (*members)[*count].key = strdup(key);
+    (*members)[*count].value = copy;
+    if (!(*members)[*count].key) {
+        guard_free(copy);
+        return -1;
+    }
+    (*count)++;
+    return 0;
+}
+
+/**
+ * A component of a version string
+ */
+struct ChannelVersionToken {
+    int rank;               //!< 0 = "dev", 1 = letters, 2 = number, 3 = "post"
+    const char *text;
+    size_t len;
+};
+
+static const char *channel_version_token(const char *p, struct ChannelVersionToken *token) {
+    while (*p && !isalnum((unsigned char) *p)) {
+        p++;
+    }
+    if (!*p) {
+        // Missing components are zero
+        token->rank = 2;
+        token->text = "";
+        token->len = 0;
+        return p;
+    }
+    token->text = p;
+    if (isdigit((unsigned char) *p)) {
+        while (*p == '0' && isdigit((unsigned char) p[1])) {
+            p++;
+        }
+        token->text = p;
+        while (isdigit((unsigned char) *p)) {
+            p++;
+        }
+        token->rank = 2;
+        token->len = p - token->text;
+        if (token->len == 1 && *token->text == '0') {
+            token->len = 0;
+        }
+    } else {
+        while (isalpha((unsigned char) *p)) {
+            p++;
+        }
+        token->len = p - token->text;
+        if (token->len == 3 && !strncasecmp(token->text, "dev", 3)) {
+            token->rank = 0;
+        } else if (token->len == 4 && !strncasecmp(token->text, "post", 4)) {
+            token->rank = 3;
+        } else {
+            token->rank = 1;
+        }
+    }
+    return p;
+}
+
+int channel_version_cmp(const char *a, const char *b) {
+    long epoch_a = 0;
+    long epoch_b = 0;
+    const char *bang;
+
+    if ((bang = strchr(a, '!'))) {
+        epoch_a = strtol(a, NULL, 10);
+        a = bang + 1;
+    }
+    if ((bang = strchr(b, '!'))) {
+        epoch_b = strtol(b, NULL, 10);
+        b = bang + 1;
+    }
+    if (epoch_a != epoch_b) {
+        return epoch_a < epoch_b ? -1 : 1;
+    }
+
+    while (*a || *b) {
+        struct ChannelVersionToken ta;
+        struct ChannelVersionToken tb;
+        a = channel_version_token(a, &ta);
+        b = channel_version_token(b, &tb);
+        if (ta.rank != tb.rank) {
+            return ta.rank < tb.rank ? -1 : 1;
+        }
+        int result = 0;
+        if (ta.rank == 2) {
+            // Leading zeros were skipped, so the longer number is larger
+            if (ta.len != tb.len) {
+                return ta.len < tb.len ? -1 : 1;
+            }
+            result = strncmp(ta.text, tb.text, ta.len);
+        } else {
+            result = strncasecmp(ta.text, tb.text, ta.len < tb.len ? ta.len : tb.len);
+            if (!result && ta.len != tb.len) {
+                result = ta.len < tb.len ? -1 : 1;
+            }
+        }
+        if (result) {
+            return result < 0 ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int channel_stream_init_bz2(struct ChannelStream *stream, const void *data, size_t size) {
+    memset(stream, 0, sizeof(*stream));
+    if (BZ2_bzDecompressInit(&stream->bz, 0, 0) != BZ_OK) {
+        errno = ENOMEM;
+        return -1;
+    }
+    stream->bz_ready = 1;
+    stream->bz.next_in = (char *) data;
+    stream->bz.avail_in = size;
+    return 0;
+}
+
+#if defined(STASIS_HAVE_ZSTD)
+static int channel_stream_init_zstd(struct ChannelStream *stream, const void *data, size_t size) {
+    memset(stream, 0, sizeof(*stream));
+    stream->zstd = ZSTD_createDStream();
+    if (!stream->zstd) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ZSTD_initDStream(stream->zstd);
+    stream->zstd_in.src = data;
+    stream->zstd_in.size = size;
+    stream->zstd_in.pos = 0;
+    return 0;
+}
+#endif
+
+static void channel_stream_free(struct ChannelStream *stream) {
+    if (stream->bz_ready) {
+        BZ2_bzDecompressEnd(&stream->bz);
+        stream->bz_ready = 0;
+    }
+#if defined(STASIS_HAVE_ZSTD)
+    if (stream->zstd) {
+        ZSTD_freeDStream(stream->zstd);
+        stream->zstd = NULL;
+    }
+#endif
+}
+
+/**
+ * Decompress up to `size` bytes
+ * @return number of bytes read (less than `size` at the end of the stream), or -1 on error
+ */
+static ssize_t channel_stream_read(struct ChannelStream *stream, void *buf, size_t size) {
+    if (stream->eof) {
+        return 0;
+    }
+#if defined(STASIS_HAVE_ZSTD)
+    if (stream->zstd) {
+        ZSTD_outBuffer out = {buf, size, 0};
+        while (out.pos < out.size) {
+            size_t in_pos = stream->zstd_in.pos;
+            size_t out_pos = out.pos;
+            size_t ret = ZSTD_decompressStream(stream->zstd, &out, &stream->zstd_in);
+            if (ZSTD_isError(ret)) {
+                errno = EIO;
+                return -1;
+            }
+            if (!ret && stream->zstd_in.pos == stream->zstd_in.size) {
+                stream->eof = 1;
+                break;
+            }
+            if (in_pos == stream->zstd_in.pos && out_pos == out.pos) {
+                // Truncated
+                errno = EIO;
+                return -1;
+            }
+        }
+        return (ssize_t) out.pos;
+    }
+#endif
+    stream->bz.next_out = buf;
+    stream->bz.avail_out = size;
+    while (stream->bz.avail_out) {
+        unsigned int avail_in = stream->bz.avail_in;
+        unsigned int avail_out = stream->bz.avail_out;
+        int ret = BZ2_bzDecompress(&stream->bz);
+        if (ret == BZ_STREAM_END) {
+            stream->eof = 1;
+            break;
+        }
+        if (ret != BZ_OK || (avail_in == stream->bz.avail_in && avail_out == stream->bz.avail_out)) {
+            errno = EIO;
+            return -1;
+        }
+    }
+    return (ssize_t) (size - stream->bz.avail_out);
+}
+
+/**
+ * Discard `size` bytes
+ * @return 0 on success, -1 on error
+ */
+static int channel_stream_skip(struct ChannelStream *stream, size_t size) {
+    char buf[64 * 1024];
+    while (size) {
+        size_t want = size < sizeof(buf) ? size : sizeof(buf);
+        ssize_t got = channel_stream_read(stream, buf, want);
+        if (got < 0) {
+            return -1;
+        }
+        if ((size_t) got != want) {
+            errno = EIO;
+            return -1;
+        }
+        size -= want;
+    }
+    return 0;
+}
+
+static size_t channel_tar_number(const unsigned char *field, size_t len) {
+    size_t result = 0;
+    if (field[0] & 0x80) {
+        // base-256 (GNU)
+        for (size_t i = 1; i < len; i++) {
+            result = (result << 8) | field[i];
+        }
+        return result;
+    }
+    for (size_t i = 0; i < len && field[i]; i++) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            result = (result << 3) | (field[i] - '0');
+        }
+    }
+    return result;
+}
+
+/**
+ * Read a tar archive until `want` is found, and return its contents
+ *
+ * @param stream decompressed tar archive
+ * @param want member name (leading "./" is ignored)
+ * @param size receives the size of the member
+ * @return NUL terminated contents (free with `free`), or NULL with errno ENOENT when not found
+ */
+static char *channel_tar_extract(struct ChannelStream *stream, const char *want, size_t *size) {
+    unsigned char header[CHANNEL_TAR_BLOCK];
+    char longname[PATH_MAX] = {0};
+
+    while (1) {
+        char name[PATH_MAX];
+        ssize_t got = channel_stream_read(stream, header, sizeof(header));
+        if (got < 0) {
+            return NULL;
+        }
+        if (got != sizeof(header) || !header[0]) {
+            // End of archive
+            break;
+        }
+
+        size_t member_size = channel_tar_number(&header[124], 12);
+        size_t padded = (member_size + CHANNEL_TAR_BLOCK - 1) / CHANNEL_TAR_BLOCK * CHANNEL_TAR_BLOCK;
+        char type = (char) header[156];
+
+        if (longname[0]) {
+            strcpy(name, longname);
+            longname[0] = '\0';
+        } else if (!memcmp(&header[257], "ustar", 5) && header[345]) {
+            snprintf(name, sizeof(name), "%.155s/%.100s", (char *) &header[345], (char *) header);
+        } else {
+            snprintf(name, sizeof(name), "%.100s", (char *) header);
+        }
+
+        if (type == 'L' || type == 'x') {
+            // GNU long name, or POSIX extended header. Either may rename the next member.
+            char *data = NULL;
+            if (member_size < CHANNEL_INDEX_JSON_MAX) {
+                data = calloc(1, padded + 1);
+            }
+            if (!data) {
+                if (channel_stream_skip(stream, padded)) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (channel_stream_read(stream, data, padded) != (ssize_t) padded) {
+                guard_free(data);
+                errno = EIO;
+                return NULL;
+            }
+            data[member_size] = '\0';
+            if (type == 'L') {
+                strncpy(longname, data, sizeof(longname) - 1);
+            } else {
+                // Records are "<length> <key>=<value>\n"
+                for (char *rec = data; rec < data + member_size;) {
+                    char *next = NULL;
+                    size_t rec_len = strtoul(rec, &next, 10);
+                    if (!rec_len || !next || *next != ' ' || rec + rec_len > data + member_size) {
+                        break;
+                    }
+                    if (!strncmp(next + 1, "path=", 5)) {
+                        size_t value_len = rec + rec_len - (next + 6) - 1;
+                        if (value_len < sizeof(longname)) {
+                            memcpy(longname, next + 6, value_len);
+                            longname[value_len] = '\0';
+                        }
+                    }
+                    rec += rec_len;
+                }
+            }
+            guard_free(data);
+            continue;
+        }
+
+        const char *member = name;
+        while (!strncmp(member, "./", 2)) {
+            member += 2;
+        }
+        if ((type == '0' || type == '\0') && !strcmp(member, want)) {
+            if (member_size > CHANNEL_INDEX_JSON_MAX) {
+                errno = EFBIG;
+                return NULL;
+            }
+            char *data = calloc(1, member_size + 1);
+            if (!data) {
+                return NULL;
+            }
+            if (channel_stream_read(stream, data, member_size) != (ssize_t) member_size) {
+                guard_free(data);
+                errno = EIO;
+                return NULL;
+            }
+            *size = member_size;
+            return data;
+        }
+        if (channel_stream_skip(stream, padded)) {
+            return NULL;
+        }
+    }
+    errno = ENOENT;
+    return NULL;
+}
+
+#if defined(STASIS_HAVE_ZSTD)
+static unsigned channel_le16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static size_t channel_le32(const unsigned char *p) {
+    return (size_t) p[0] | ((size_t) p[1] << 8) | ((size_t) p[2] << 16) | ((size_t) p[3] << 24);
+}
+
+/**
+ * Locate the "info-*.tar.zst" member of a .conda (zip) archive
+ * @return 0 on success, -1 on error
+ */
+static int channel_conda_info(const unsigned char *data, size_t size, const unsigned char **member, size_t *member_size) {
+    const size_t eocd_size = 22;
+    const unsigned char *eocd = NULL;
+
+    if (size < eocd_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    // The end of central directory record is followed by a comment of up to 64 KiB
+    for (size_t off = size - eocd_size + 1; off-- > 0 && size - off <= eocd_size + 0xffff;) {
+        if (channel_le32(&data[off]) == 0x06054b50) {
+            eocd = &data[off];
+            break;
+        }
+    }
+    if (!eocd) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t entries = channel_le16(&eocd[10]);
+    size_t offset = channel_le32(&eocd[16]);
+    for (size_t i = 0; i < entries; i++) {
+        if (offset + 46 > size || channel_le32(&data[offset]) != 0x02014b50) {
+            break;
+        }
+        const unsigned char *entry = &data[offset];
+        unsigned method = channel_le16(&entry[10]);
+        size_t compressed = channel_le32(&entry[20]);
+        size_t name_len = channel_le16(&entry[28]);
+        size_t extra_len = channel_le16(&entry[30]);
+        size_t comment_len = channel_le16(&entry[32]);
+        size_t local = channel_le32(&entry[42]);
+        const char *name = (const char *) &entry[46];
+
+        if (offset + 46 + name_len > size) {
+            break;
+        }
+        if (name_len > 13 && !strncmp(name, "info-", 5) && !strncmp(name + name_len - 8, ".tar.zst", 8)) {
+            if (method != 0) {
+                // conda stores the members uncompressed
+                errno = ENOTSUP;
+                return -1;
+            }
+            if (local + 30 > size || channel_le32(&data[local]) != 0x04034b50) {
+                break;
+            }
+            size_t start = local + 30 + channel_le16(&data[local + 26]) + channel_le16(&data[local + 28]);
+            if (start + compressed > size) {
+                break;
+            }
+            *member = &data[start];
+            *member_size = compressed;
+            return 0;
+        }
+        offset += 46 + name_len + extra_len + comment_len;
+    }
+    errno = EINVAL;
+    return -1;
+}
+#endif
+
+/**
+ * Compute the md5 and sha256 of a buffer as hex strings
+ * @return 0 on success, -1 on error
+ */
+static int channel_digest(const unsigned char *data, size_t size, char md5[33], char sha256[65]) {
+    unsigned char md5_raw[EVP_MAX_MD_SIZE];
+    unsigned char sha256_raw[EVP_MAX_MD_SIZE];
+    unsigned int md5_len = 0;
+    unsigned int sha256_len = 0;
+    int status = -1;
+    EVP_MD_CTX *md5_ctx = EVP_MD_CTX_new();
+    EVP_MD_CTX *sha256_ctx = EVP_MD_CTX_new();
+
+    if (!md5_ctx || !sha256_ctx
+        || !EVP_DigestInit_ex(md5_ctx, EVP_md5(), NULL)
+        || !EVP_DigestInit_ex(sha256_ctx, EVP_sha256(), NULL)) {
+        goto l_channel_digest_done;
+    }
+    // Both digests read each chunk while it is still in cache
+    for (size_t off = 0; off < size; off += CHANNEL_DIGEST_CHUNK) {
+        size_t len = size - off < CHANNEL_DIGEST_CHUNK ? size - off : CHANNEL_DIGEST_CHUNK;
+        if (!EVP_DigestUpdate(md5_ctx, &data[off], len) || !EVP_DigestUpdate(sha256_ctx, &data[off], len)) {
+            goto l_channel_digest_done;
+        }
+    }
+    if (!EVP_DigestFinal_ex(md5_ctx, md5_raw, &md5_len) || !EVP_DigestFinal_ex(sha256_ctx, sha256_raw, &sha256_len)) {
+        goto l_channel_digest_done;
+    }
+    for (unsigned int i = 0; i < md5_len; i++) {
+        sprintf(&md5[i * 2], "%02x", md5_raw[i]);
+    }
+    for (unsigned int i = 0; i < sha256_len; i++) {
+        sprintf(&sha256[i * 2], "%02x", sha256_raw[i]);
+    }
+    status = 0;
+
+    l_channel_digest_done:
+    EVP_MD_CTX_free(md5_ctx);
+    EVP_MD_CTX_free(sha256_ctx);
+    if (status) {
+        errno = EIO;
+    }
+    return status;
+}
+
+/**
+ * Populate the fields of `pkg` used to order packages from its repodata record
+ * @return 0 on success, -1 if the record has no name or version
+ */
+static int channel_package_fields(struct ChannelPackage *pkg) {
+    const char *raw;
+    if ((raw = json_member_get(pkg->members, pkg->members_count, "name"))) {
+        pkg->name = json_unquote(raw);
+    }
+    if ((raw = json_member_get(pkg->members, pkg->members_count, "version"))) {
+        pkg->version = json_unquote(raw);
+    }
+    if ((raw = json_member_get(pkg->members, pkg->members_count, "license"))) {
+        pkg->license = json_unquote(raw);
+    }
+    if ((raw = json_member_get(pkg->members, pkg->members_count, "build_number"))) {
+        pkg->build_number = strtoll(raw, NULL, 10);
+    }
+    if ((raw = json_member_get(pkg->members, pkg->members_count, "timestamp"))) {
+        pkg->timestamp = strtoll(raw, NULL, 10);
+    }
+    if (!pkg->name || !pkg->version) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Read a package's metadata, and build its repodata record
+ * @return 0 on success, -1 on error
+ */
+static int channel_package_read(struct ChannelPackage *pkg) {
+    struct ChannelStream stream;
+    struct stat st;
+    unsigned char *data = MAP_FAILED;
+    char *index_json = NULL;
+    size_t index_json_size = 0;
+    char md5[33] = {0};
+    char sha256[65] = {0};
+    char value[80];
+    int status = -1;
+
+    memset(&stream, 0, sizeof(stream));
+#if !defined(STASIS_HAVE_ZSTD)
+    if (pkg->conda) {
+        pkg->status = 1;
+        errno = ENOTSUP;
+        return -1;
+    }
+#endif
+
+    int fd = open(pkg->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        goto l_channel_package_read_done;
+    }
+    if (fstat(fd, &st)) {
+        goto l_channel_package_read_done;
+    }
+    if (!st.st_size) {
+        errno = EINVAL;
+        goto l_channel_package_read_done;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        goto l_channel_package_read_done;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    if (channel_digest(data, st.st_size, md5, sha256)) {
+        goto l_channel_package_read_done;
+    }
+
+#if defined(STASIS_HAVE_ZSTD)
+    if (pkg->conda) {
+        const unsigned char *member;
+        size_t member_size;
+        if (channel_conda_info(data, st.st_size, &member, &member_size)
+            || channel_stream_init_zstd(&stream, member, member_size)) {
+            goto l_channel_package_read_done;
+        }
+    } else
+#endif
+    if (channel_stream_init_bz2(&stream, data, st.st_size)) {
+        goto l_channel_package_read_done;
+    }
+
+    index_json = channel_tar_extract(&stream, CHANNEL_INDEX_JSON, &index_json_size);
+    if (!index_json) {
+        goto l_channel_package_read_done;
+    }
+    if (json_object_members(index_json, index_json_size, &pkg->members, &pkg->members_count)) {
+        goto l_channel_package_read_done;
+    }
+
+    if (channel_package_fields(pkg)) {
+        goto l_channel_package_read_done;
+    }
+
+    sprintf(value, "\"%s\"", md5);
+    if (json_member_set(&pkg->members, &pkg->members_count, "md5", value)) {
+        goto l_channel_package_read_done;
+    }
+    sprintf(value, "\"%s\"", sha256);
+    if (json_member_set(&pkg->members, &pkg->members_count, "sha256", value)) {
+        goto l_channel_package_read_done;
+    }
+    sprintf(value, "%lld", (long long) st.st_size);
+    if (json_member_set(&pkg->members, &pkg->members_count, "size", value)) {
+        goto l_channel_package_read_done;
+    }
+    qsort(pkg->members, pkg->members_count, sizeof(*pkg->members), json_member_cmp);
+    status = 0;
+
+    l_channel_package_read_done:
+    {
+        int error = errno;
+        channel_stream_free(&stream);
+        guard_free(index_json);
+        if (data != MAP_FAILED) {
+            munmap(data, st.st_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        pkg->status = status;
+        errno = error;
+    }
+    return status;
+}
+
+static void channel_package_task(void *arg) {
+    struct ChannelPackage *pkg = arg;
+    if (channel_package_read(pkg) && pkg->status < 0) {
+        msg(STASIS_MSG_WARN | STASIS_MSG_L2, "Unable to index %s: %s\n", pkg->path, strerror(errno));
+    }
+}
+
+/**
+ * Release the repodata record of `pkg`, keeping its file name and path
+ */
+static void channel_package_free_record(struct ChannelPackage *pkg) {
+    guard_free(pkg->name);
+    guard_free(pkg->version);
+    guard_free(pkg->license);
+    json_members_free(pkg->members, pkg->members_count);
+    pkg->members = NULL;
+    pkg->members_count = 0;
+}
+
+static void channel_package_free(struct ChannelPackage *pkg) {
+    guard_free(pkg->filename);
+    guard_free(pkg->path);
+    channel_package_free_record(pkg);
+}
+
+static int channel_package_filename_cmp(const void *a, const void *b) {
+    const struct ChannelPackage *pa = *(struct ChannelPackage * const *) a;
+    const struct ChannelPackage *pb = *(struct ChannelPackage * const *) b;
+    return strcmp(pa->filename, pb->filename);
+}
+
+/**
+ * Order by name, then newest version, build number, and timestamp first
+ */
+static int channel_package_newest_cmp(const void *a, const void *b) {
+    const struct ChannelPackage *pa = *(struct ChannelPackage * const *) a;
+    const struct ChannelPackage *pb = *(struct ChannelPackage * const *) b;
+    int result = strcmp(pa->name, pb->name);
+    if (!result) {
+        result = -channel_version_cmp(pa->version, pb->version);
+    }
+    if (!result && pa->build_number != pb->build_number) {
+        result = pa->build_number > pb->build_number ? -1 : 1;
+    }
+    if (!result && pa->timestamp != pb->timestamp) {
+        result = pa->timestamp > pb->timestamp ? -1 : 1;
+    }
+    return result;
+}
+
+static void channel_write_packages(FILE *fp, const char *key, struct ChannelPackage **pkgs, size_t count, int conda) {
+    int first = 1;
+
+    fprintf(fp, "  \"%s\": {", key);
+    for (size_t i = 0; i < count; i++) {
+        if (pkgs[i]->conda != conda) {
+            continue;
+        }
+        fprintf(fp, "%s\n    ", first ? "" : ",");
+        json_write_string(fp, pkgs[i]->filename);
+        fprintf(fp, ": {");
+        for (size_t m = 0; m < pkgs[i]->members_count; m++) {
+            fprintf(fp, "%s\n      ", m ? "," : "");
+            json_write_string(fp, pkgs[i]->members[m].key);
+            fprintf(fp, ": %s", pkgs[i]->members[m].value);
+        }
+        fprintf(fp, "\n    }");
+        first = 0;
+    }
+    fprintf(fp, "%s}", first ? "" : "\n  ");
+}
+
+/**
+ * Write a file atomically, so clients never read a partial index
+ */
+static FILE *channel_open(const char *path, char *tmp, size_t tmp_size) {
+    if ((size_t) snprintf(tmp, tmp_size, "%s.XXXXXX", path) >= tmp_size) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return NULL;
+    }
+    fchmod(fd, 0644);
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        unlink(tmp);
+    }
+    return fp;
+}
+
+static int channel_close(FILE *fp, const char *tmp, const char *path) {
+    int status = ferror(fp) ? -1 : 0;
+    if (fclose(fp)) {
+        status = -1;
+    }
+    if (!status && rename(tmp, path)) {
+        status = -1;
+    }
+    if (status) {
+        int error = errno;
+        unlink(tmp);
+        errno = error;
+    }
+    return status;
+}
+
+static int channel_write_repodata(const char *path, const char *subdir, struct ChannelPackage **pkgs, size_t count) {
+    char tmp[PATH_MAX];
+    FILE *fp = channel_open(path, tmp, sizeof(tmp));
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp, "{\n  \"info\": {\n    \"subdir\": ");
+    json_write_string(fp, subdir);
+    fprintf(fp, "\n  },\n");
+    channel_write_packages(fp, "packages", pkgs, count, 0);
+    fprintf(fp, ",\n");
+    channel_write_packages(fp, "packages.conda", pkgs, count, 1);
+    fprintf(fp, ",\n  \"removed\": [],\n  \"repodata_version\": 1\n}\n");
+    return channel_close(fp, tmp, path);
+}
+
+/**
+ * Write repodata.json, and current_repodata.json
+ *
+ * @param pkgs indexed packages of one subdirectory (reordered)
+ */
+static int channel_write_subdir(const char *channel, const char *subdir, struct ChannelPackage **pkgs, size_t count) {
+    char path[PATH_MAX];
+    size_t current_count = 0;
+    int status = 0;
+
+    qsort(pkgs, count, sizeof(*pkgs), channel_package_filename_cmp);
+    snprintf(path, sizeof(path), "%s/%s/repodata.json", channel, subdir);
+    if (channel_write_repodata(path, subdir, pkgs, count)) {
+        return -1;
+    }
+
+    // Keep every build of the latest version of each package
+    struct ChannelPackage **current = calloc(count + 1, sizeof(*current));
+    if (!current) {
+        return -1;
+    }
+    memcpy(current, pkgs, count * sizeof(*pkgs));
+    qsort(current, count, sizeof(*current), channel_package_newest_cmp);
+    for (size_t i = 0; i < count; i++) {
+        if (current_count && !strcmp(current[current_count - 1]->name, current[i]->name)
+            && channel_version_cmp(current[current_count - 1]->version, current[i]->version)) {
+            continue;
+        }
+        current[current_count++] = current[i];
+    }
+    qsort(current, current_count, sizeof(*current), channel_package_filename_cmp);
+    snprintf(path, sizeof(path), "%s/%s/current_repodata.json", channel, subdir);
+    if (channel_write_repodata(path, subdir, current, current_count)) {
+        status = -1;
+    }
+    guard_free(current);
+    return status;
+}
+
+static int channel_write_channeldata(const char *channel, struct StrList *subdirs, struct ChannelPackage **pkgs, size_t count) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/channeldata.json", channel);
+    FILE *fp = channel_open(path, tmp, sizeof(tmp));
+    if (!fp) {
+        return -1;
+    }
+    qsort(pkgs, count, sizeof(*pkgs), channel_package_newest_cmp);
+    fprintf(fp, "{\n  \"channeldata_version\": 1,\n  \"packages\": {");
+    for (size_t i = 0; i < count;) {
+        // pkgs[i] is the newest build of this package
+        const struct ChannelPackage *newest = pkgs[i];
+        long long timestamp = 0;
+        size_t last = i;
+        while (last < count && !strcmp(pkgs[last]->name, newest->name)) {
+            if (pkgs[last]->timestamp > timestamp) {
+                timestamp = pkgs[last]->timestamp;
+            }
+            last++;
+        }
+
+        fprintf(fp, "%s\n    ", i ? "," : "");
+        json_write_string(fp, newest->name);
+        fprintf(fp, ": {\n");
+        if (newest->license) {
+            fprintf(fp, "      \"license\": ");
+            json_write_string(fp, newest->license);
+            fprintf(fp, ",\n");
+        }
+        fprintf(fp, "      \"subdirs\": [");
+        for (size_t s = 0, n = 0; s < strlist_count(subdirs); s++) {
+            const char *subdir = strlist_item(subdirs, s);
+            for (size_t k = i; k < last; k++) {
+                if (!strcmp(pkgs[k]->subdir, subdir)) {
+                    fprintf(fp, "%s\n        ", n++ ? "," : "");
+                    json_write_string(fp, subdir);
+                    break;
+                }
+            }
+        }
+        fprintf(fp, "\n      ],\n");
+        if (timestamp) {
+            fprintf(fp, "      \"timestamp\": %lld,\n", timestamp);
+        }
+        fprintf(fp, "      \"version\": ");
+        json_write_string(fp, newest->version);
+        fprintf(fp, "\n    }");
+        i = last;
+    }
+    fprintf(fp, "%s},\n  \"subdirs\": [", count ? "\n  " : "");
+    for (size_t s = 0; s < strlist_count(subdirs); s++) {
+        fprintf(fp, "%s\n    ", s ? "," : "");
+        json_write_string(fp, strlist_item(subdirs, s));
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    return channel_close(fp, tmp, path);
+}
+
+// Platform and architecture components of conda subdirectory names
+static const char *channel_subdir_platforms[] = {
+    "emscripten", "freebsd", "linux", "osx", "wasi", "win", "zos", NULL,
+};
+static const char *channel_subdir_archs[] = {
+    "32", "64", "aarch64", "arm64", "armv6l", "armv7l", "ppc64", "ppc64le",
+    "riscv64", "s390x", "wasm32", "z", NULL,
+};
+
+/**
+ * @return 1 when `name` is "noarch", or "<platform>-<arch>" using a known platform and architecture
+ */
+static int channel_is_subdir_name(const char *name) {
+    const char *sep = strchr(name, '-');
+    int platform_ok = 0;
+
+    if (!strcmp(name, CHANNEL_SUBDIR_NOARCH)) {
+        return 1;
+    }
+    if (!sep) {
+        return 0;
+    }
+    for (size_t i = 0; channel_subdir_platforms[i]; i++) {
+        if (strlen(channel_subdir_platforms[i]) == (size_t) (sep - name)
+            && !strncmp(name, channel_subdir_platforms[i], sep - name)) {
+            platform_ok = 1;
+            break;
+        }
+    }
+    if (!platform_ok) {
+        return 0;
+    }
+    for (size_t i = 0; channel_subdir_archs[i]; i++) {
+        if (!strcmp(sep + 1, channel_subdir_archs[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @return 1 when `name` is a conda subdirectory of `channel` (see `channel_is_subdir_name`)
+ */
+static int channel_is_subdir(const char *channel, const char *name) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (!channel_is_subdir_name(name)) {
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/%s", channel, name);
+    return !stat(path, &st) && S_ISDIR(st.st_mode);
+}
+
+/**
+ * Append the packages found in `subdir` to `pkgs`
+ * @return 0 on success, -1 on error
+ */
+static int channel_scan_subdir(const char *channel, const char *subdir, struct ChannelPackage **pkgs, size_t *count) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", channel, subdir);
+    struct StrList *files = listdir(path);
+    if (!files) {
+        return -1;
+    }
+    strlist_sort(files, STASIS_SORT_ALPHA);
+    for (size_t i = 0; i < strlist_count(files); i++) {
+        char *filename = strlist_item(files, i);
+        int conda = endswith(filename, ".conda") > 0;
+        if (!conda && endswith(filename, ".tar.bz2") <= 0) {
+            continue;
+        }
+        char pkg_path[PATH_MAX];
+        struct stat st;
+        if ((size_t) snprintf(pkg_path, sizeof(pkg_path), "%s/%s", path, filename) >= sizeof(pkg_path)
+            || stat(pkg_path, &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        struct ChannelPackage *tmp = realloc(*pkgs, (*count + 1) * sizeof(**pkgs));
+        if (!tmp) {
+            guard_strlist_free(&files);
+            return -1;
+        }
+        *pkgs = tmp;
+        memset(&(*pkgs)[*count], 0, sizeof(**pkgs));
+        (*pkgs)[*count].subdir = subdir;
+        (*pkgs)[*count].conda = conda;
+        (*pkgs)[*count].size = st.st_size;
+        (*pkgs)[*count].mtime = STAT_MTIM(st);
+        (*pkgs)[*count].filename = strdup(filename);
+        (*pkgs)[*count].path = strdup(pkg_path);
+        (*count)++;
+        if (!(*pkgs)[*count - 1].filename || !(*pkgs)[*count - 1].path) {
+            guard_strlist_free(&files);
+            return -1;
+        }
+    }
+    guard_strlist_free(&files);
+    return 0;
+}
+
+static int channel_cache_path(const char *channel, const char *subdir, char *result, size_t maxlen) {
+    if ((size_t) snprintf(result, maxlen, "%s/%s/%s", channel, subdir, CHANNEL_INDEX_CACHE_FILE) >= maxlen) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static int channel_package_ptr_filename_cmp(const void *key, const void *item) {
+    return strcmp((const char *) key, (*(struct ChannelPackage * const *) item)->filename);
+}
+
+/**
+ * Reuse the cached records of packages whose size and modification time are unchanged
+ *
+ * Lines are "<filename>\t<size>\t<mtime sec>\t<mtime nsec>\t<record>". A cache
+ * that cannot be read is ignored.
+ *
+ * @param pkgs packages of one subdirectory
+ * @return number of records loaded
+ */
+static size_t channel_cache_load(const char *channel, const char *subdir, struct ChannelPackage *pkgs, size_t count) {
+    char path[PATH_MAX];
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t loaded = 0;
+    FILE *fp = NULL;
+    struct ChannelPackage **sorted = NULL;
+
+    if (!count || channel_cache_path(channel, subdir, path, sizeof(path))) {
+        return 0;
+    }
+    fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    sorted = calloc(count, sizeof(*sorted));
+    if (!sorted || getline(&line, &line_size, fp) < 0 || strcmp(line, CHANNEL_INDEX_CACHE_MAGIC "\n") != 0) {
+        goto l_channel_cache_load_done;
+    }
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = &pkgs[i];
+    }
+    qsort(sorted, count, sizeof(*sorted), channel_package_filename_cmp);
+
+    ssize_t len;
+    while ((len = getline(&line, &line_size, fp)) > 0) {
+        char *fields[5] = {0};
+        char *rec = line;
+        if (line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        for (size_t i = 0; i < sizeof(fields) / sizeof(*fields) && rec; i++) {
+            fields[i] = strsep(&rec, "\t");
+        }
+        if (!fields[4]) {
+            continue;
+        }
+        struct ChannelPackage **match = bsearch(fields[0], sorted, count, sizeof(*sorted), channel_package_ptr_filename_cmp);
+        if (!match) {
+            continue;
+        }
+        struct ChannelPackage *pkg = *match;
+        if (pkg->cached
+            || strtoll(fields[1], NULL, 10) != (long long) pkg->size
+            || strtoll(fields[2], NULL, 10) != (long long) pkg->mtime.tv_sec
+            || strtol(fields[3], NULL, 10) != (long) pkg->mtime.tv_nsec) {
+            continue;
+        }
+        if (json_object_members(fields[4], strlen(fields[4]), &pkg->members, &pkg->members_count)
+            || channel_package_fields(pkg)) {
+            // Read the package again instead
+            channel_package_free_record(pkg);
+            continue;
+        }
+        pkg->cached = 1;
+        loaded++;
+    }
+
+    l_channel_cache_load_done:
+    guard_free(line);
+    guard_free(sorted);
+    fclose(fp);
+    return loaded;
+}
+
+/**
+ * Record the packages of one subdirectory for the next `channel_index`
+ * @return 0 on success, -1 on error
+ */
+static int channel_cache_write(const char *channel, const char *subdir, struct ChannelPackage **pkgs, size_t count) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    char cache_dir[PATH_MAX];
+
+    if (channel_cache_path(channel, subdir, path, sizeof(path))) {
+        return -1;
+    }
+    strcpy(cache_dir, path);
+    char *sep = strrchr(cache_dir, '/');
+    if (sep) {
+        *sep = '\0';
+        if (mkdir(cache_dir, 0755) && errno != EEXIST) {
+            return -1;
+        }
+    }
+    FILE *fp = channel_open(path, tmp, sizeof(tmp));
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp, "%s\n", CHANNEL_INDEX_CACHE_MAGIC);
+    for (size_t i = 0; i < count; i++) {
+        const struct ChannelPackage *pkg = pkgs[i];
+        fprintf(fp, "%s\t%lld\t%lld\t%ld\t{", pkg->filename, (long long) pkg->size,
+                (long long) pkg->mtime.tv_sec, (long) pkg->mtime.tv_nsec);
+        for (size_t m = 0; m < pkg->members_count; m++) {
+            fprintf(fp, "%s", m ? "," : "");
+            json_write_string(fp, pkg->members[m].key);
+            fprintf(fp, ":%s", pkg->members[m].value);
+        }
+        fprintf(fp, "}\n");
+    }
+    return channel_close(fp, tmp, path);
+}
+
+/**
+ * Copy the entries of a cache file
+ * @return 0 on success (or when `path` is not a cache), -1 on error
+ */
+static int channel_cache_copy(FILE *out, const char *path) {
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    FILE *in = fopen(path, "r");
+
+    if (!in) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (getline(&line, &line_size, in) > 0 && !strcmp(line, CHANNEL_INDEX_CACHE_MAGIC "\n")) {
+        while ((len = getline(&line, &line_size, in)) > 0) {
+            fwrite(line, 1, len, out);
+        }
+    }
+    guard_free(line);
+    fclose(in);
+    return 0;
+}
+
+int channel_cache_import(const char *channel, const char *from) {
+    struct StrList *entries = listdir(from);
+    int status = 0;
+
+    if (!entries) {
+        return -1;
+    }
+    for (size_t i = 0; i < strlist_count(entries); i++) {
+        const char *subdir = strlist_item(entries, i);
+        char src[PATH_MAX];
+        char dest[PATH_MAX];
+        char tmp[PATH_MAX];
+        char cache_dir[PATH_MAX];
+
+        if (!channel_is_subdir(from, subdir) || !channel_is_subdir(channel, subdir)
+            || channel_cache_path(from, subdir, src, sizeof(src))
+            || channel_cache_path(channel, subdir, dest, sizeof(dest))
+            || access(src, F_OK)) {
+            continue;
+        }
+        strcpy(cache_dir, dest);
+        *strrchr(cache_dir, '/') = '\0';
+        if (mkdir(cache_dir, 0755) && errno != EEXIST) {
+            status = -1;
+            continue;
+        }
+        // The cache is replaced, never appended to, in case it is a hard link
+        FILE *out = channel_open(dest, tmp, sizeof(tmp));
+        if (!out) {
+            status = -1;
+            continue;
+        }
+        // Duplicate entries are harmless, and dropped when the cache is rewritten
+        fprintf(out, "%s\n", CHANNEL_INDEX_CACHE_MAGIC);
+        if (channel_cache_copy(out, dest) || channel_cache_copy(out, src)) {
+            fclose(out);
+            unlink(tmp);
+            status = -1;
+            continue;
+        }
+        if (channel_close(out, tmp, dest)) {
+            status = -1;
+        }
+    }
+    guard_strlist_free(&entries);
+    return status;
+}
+
+int channel_index(const char *path, unsigned flags, struct ChannelIndexStats *stats) {
+    struct ChannelIndexStats result = {0};
+    struct ChannelPackage *pkgs = NULL;
+    struct ChannelPackage **indexed = NULL;
+    struct StrList *subdirs = NULL;
+    struct StrList *entries = NULL;
+    struct Pool *pool = NULL;
+    size_t count = 0;
+    size_t indexed_count = 0;
+    int status = -1;
+    char noarch[PATH_MAX];
+
+    // conda requires noarch/repodata.json, even when it is empty
+    snprintf(noarch, sizeof(noarch), "%s/%s", path, CHANNEL_SUBDIR_NOARCH);
+    if (access(noarch, F_OK) && mkdirs(noarch, 0755)) {
+        return -1;
+    }
+    entries = listdir(path);
+    subdirs = strlist_init();
+    if (!entries || !subdirs) {
+        goto l_channel_index_done;
+    }
+    strlist_sort(entries, STASIS_SORT_ALPHA);
+    for (size_t i = 0; i < strlist_count(entries); i++) {
+        char *name = strlist_item(entries, i);
+        if (channel_is_subdir(path, name)) {
+            strlist_append(&subdirs, name);
+        }
+    }
+    for (size_t i = 0; i < strlist_count(subdirs); i++) {
+        size_t first = count;
+        if (channel_scan_subdir(path, strlist_item(subdirs, i), &pkgs, &count)) {
+            goto l_channel_index_done;
+        }
+        if (flags & CHANNEL_INDEX_CACHE) {
+            result.cached += channel_cache_load(path, strlist_item(subdirs, i), &pkgs[first], count - first);
+        }
+    }
+
+    pool = pool_init(0);
+    if (!pool) {
+        goto l_channel_index_done;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (pkgs[i].cached) {
+            continue;
+        }
+        if (pool_submit(pool, channel_package_task, &pkgs[i])) {
+            channel_package_task(&pkgs[i]);
+        }
+    }
+    pool_wait(pool);
+    pool_free(&pool);
+
+    indexed = calloc(count + 1, sizeof(*indexed));
+    if (!indexed) {
+        goto l_channel_index_done;
+    }
+    status = 0;
+    for (size_t s = 0; s < strlist_count(subdirs); s++) {
+        const char *subdir = strlist_item(subdirs, s);
+        size_t first = indexed_count;
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(pkgs[i].subdir, subdir) != 0) {
+                continue;
+            }
+            if (pkgs[i].status > 0) {
+                result.unsupported++;
+            } else if (pkgs[i].status < 0) {
+                result.failed++;
+            } else {
+                indexed[indexed_count++] = &pkgs[i];
+                if (!pkgs[i].cached) {
+                    result.bytes += pkgs[i].size;
+                }
+            }
+        }
+        if (channel_write_subdir(path, subdir, &indexed[first], indexed_count - first)) {
+            SYSERROR("Unable to write repodata for %s/%s: %s", path, subdir, strerror(errno));
+            status = -1;
+        }
+        if (flags & CHANNEL_INDEX_CACHE && channel_cache_write(path, subdir, &indexed[first], indexed_count - first)) {
+            // The next run reads every package again
+            msg(STASIS_MSG_WARN | STASIS_MSG_L2, "Unable to write the index cache for %s/%s: %s\n", path, subdir, strerror(errno));
+        }
+        result.subdirs++;
+    }
+    result.packages = indexed_count;
+    if (channel_write_channeldata(path, subdirs, indexed, indexed_count)) {
+        SYSERROR("Unable to write %s/channeldata.json: %s", path, strerror(errno));
+        status = -1;
+    }
+    if (!status && (result.failed || result.unsupported)) {
+        status = -1;
+        errno = result.failed ? EIO : ENOTSUP;
+    }
+
+    l_channel_index_done:
+    for (size_t i = 0; i < count; i++) {
+        channel_package_free(&pkgs[i]);
+    }
+    guard_free(pkgs);
+    guard_free(indexed);
+    guard_strlist_free(&entries);
+    guard_strlist_free(&subdirs);
+    if (stats) {
+        stats->subdirs += result.subdirs;
+        stats->packages += result.packages;
+        stats->bytes += result.bytes;
+        stats->cached += result.cached;
+        stats->failed += result.failed;
+        stats->unsupported += result.unsupported;
+    }
+    return status;
+}
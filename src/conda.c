@@ -114,43 +114,54 @@ int conda_activate(const char *root, const char *env_name) {
         perror(logfile);
         return -1;
     }
-    int i = 0;
-    while (!feof(fp)) {
-        char buf[STASIS_BUFSIZ] = {0};
-        int ch = 0;
-        size_t z = 0;
-        // We are ingesting output from "env -0", can't use fgets()
-        // Copy each character into the buffer until we encounter '\0' or EOF
-        while (z < sizeof(buf) && (ch = (int) fgetc(fp)) != 0) {
-            if (ch == EOF) {
-                break;
-            }
-            buf[z] = (char) ch;
-            z++;
+    struct stat st;
+    if (fstat(fileno(fp), &st) < 0) {
+        perror(logfile);
+        fclose(fp);
+        return -1;
+    }
+    char *data = calloc(st.st_size + 1, sizeof(*data));
+    if (!data) {
+        SYSERROR("unable to allocate %zu bytes for environment", (size_t) st.st_size + 1);
+        fclose(fp);
+        return -1;
+    }
+    size_t data_len = fread(data, sizeof(*data), st.st_size, fp);
+
+    // We are ingesting output from "env -0", can't use fgets()
+    // Each record ends with '\0'
+    const char *pos = data;
+    const char *end = data + data_len;
+    while (pos < end) {
+        const char *next = bytes_find(pos, end - pos, '\0');
+        const char *buf = pos;
+        if (!next) {
+            // final record is not terminated. data[data_len] is always '\0'
+            next = end;
         }
-        buf[strlen(buf)] = 0;
+        pos = next + 1;
 
-        if (!strlen(buf)) {
+        if (next == buf) {
             continue;
         }
 
-        char **part = split(buf, "=", 1);
+        char **part = split_compact(buf, "=", 1);
         if (!part) {
             perror("unable to split environment variable buffer");
+            guard_free(data);
+            fclose(fp);
             return -1;
         }
         if (!part[0]) {
             msg(STASIS_MSG_WARN | STASIS_MSG_L1, "Invalid environment variable key ignored: '%s'\n", buf);
-            i++;
         } else if (!part[1]) {
             msg(STASIS_MSG_WARN | STASIS_MSG_L1, "Invalid environment variable value ignored: '%s'\n", buf);
-            i++;
         } else {
             setenv(part[0], part[1], 1);
         }
-        GENERIC_ARRAY_FREE(part);
-        i++;
+        guard_free(part);
     }
+    guard_free(data);
     fclose(fp);
     remove(logfile);
     return 0;
@@ -1,83 +1,195 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
 #include "copy.h"
+#include "pool.h"
+#include <fnmatch.h>
+#if defined(STASIS_OS_LINUX)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
 
-int copy2(const char *src, const char *dest, unsigned int op) {
-    size_t bytes_read;
-    size_t bytes_written;
-    char buf[STASIS_BUFSIZ];
-    struct stat src_stat, dnamest;
-    FILE *fp1, *fp2;
+#define COPY_BUFSIZ (1024 * 1024)
 
-    if (lstat(src, &src_stat) < 0) {
-        perror(src);
-        return -1;
+/**
+ * Copy the contents of `in` to `out`
+ *
+ * The fastest method supported by the kernel and file system is used:
+ * a reflink (FICLONE), copy_file_range(), sendfile(), and finally read()
+ * and write() through a large buffer.
+ *
+ * @param in source file descriptor
+ * @param out destination file descriptor (empty)
+ * @param size number of bytes to copy
+ * @return number of bytes copied, or -1 on error
+ */
+static ssize_t copy_fd(int in, int out, off_t size) {
+    off_t done = 0;
+
+#if defined(STASIS_OS_LINUX)
+    // Share the source's extents on file systems that support it (btrfs, xfs)
+    if (size > 0 && ioctl(out, FICLONE, in) == 0) {
+        return size;
     }
 
-    if (access(dest, F_OK) == 0) {
-        unlink(dest);
+    // Copy inside the kernel, or let the file system offload it
+    while (done < size) {
+        off_t off_in = done;
+        off_t off_out = done;
+        ssize_t n = copy_file_range(in, &off_in, out, &off_out, size - done, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
     }
 
-    char dname[1024] = {0};
-    strcpy(dname, dest);
-    char *dname_endptr;
+    // Older kernels cannot copy_file_range() across file systems
+    if (done < size && lseek(out, done, SEEK_SET) == done) {
+        while (done < size) {
+            off_t offset = done;
+            ssize_t n = sendfile(out, in, &offset, size - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+    }
+    if (done >= size) {
+        return done;
+    }
+#endif
 
-    dname_endptr = strrchr(dname, '/');
-    if (dname_endptr != NULL) {
-        *dname_endptr = '\0';
+    char *buf = malloc(COPY_BUFSIZ);
+    if (!buf) {
+        return -1;
+    }
+    while (1) {
+        ssize_t n = pread(in, buf, COPY_BUFSIZ, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            guard_free(buf);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = pwrite(out, buf + written, n - written, done + written);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w < 0) {
+                guard_free(buf);
+                return -1;
+            }
+            written += w;
+        }
+        done += n;
     }
+    guard_free(buf);
+    return done;
+}
 
-    stat(dname, &dnamest);
-    if (S_ISLNK(src_stat.st_mode)) {
-        char lpath[1024] = {0};
-        if (readlink(src, lpath, sizeof(lpath)) < 0) {
-            perror(src);
+/**
+ * Name a temporary entry in the same directory as `dest`
+ * @return 0 on success, -1 if the name is too long
+ */
+static int copy_tmpname(const char *dest, char *result, size_t maxlen) {
+    static unsigned counter = 0;
+    const char *sep = strrchr(dest, '/');
+    const int dir_len = sep ? (int) (sep - dest + 1) : 0;
+
+    // Short enough for any file name. A leftover from a crash is pruned by the next CT_DELETE.
+    if ((size_t) snprintf(result, maxlen, "%.*s.stasis-tmp.%d.%u", dir_len, dest, (int) getpid(),
+                          __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED)) >= maxlen) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Create a copy of one directory entry named `dest`
+ * @return 0 on success, 1 if `dest` was hard linked to `src`, -1 on error (errno is set)
+ */
+static int copy_create_at(int src_dirfd, const char *src, const struct stat *src_stat, int dest_dirfd, const char *dest, dev_t dest_dev, unsigned int op) {
+    if (S_ISREG(src_stat->st_mode) && op & CT_LINK && src_stat->st_dev == dest_dev) {
+        if (!linkat(src_dirfd, src, dest_dirfd, dest, 0)) {
+            return 1;
+        }
+        if (errno != EPERM && errno != EMLINK && errno != EXDEV) {
             return -1;
         }
-        if (symlink(lpath, dest) < 0) {
-            // silent
+        // Not allowed to link this file. Copy it instead (which may still produce a reflink).
+    }
+
+    if (S_ISLNK(src_stat->st_mode)) {
+        char lpath[PATH_MAX] = {0};
+        if (readlinkat(src_dirfd, src, lpath, sizeof(lpath) - 1) < 0) {
             return -1;
         }
-    } else if (S_ISREG(src_stat.st_mode) && src_stat.st_nlink > 2 && src_stat.st_dev == dnamest.st_dev) {
-        if (link(src, dest) < 0) {
-            perror(src);
+        if (symlinkat(lpath, dest_dirfd, dest) < 0) {
             return -1;
         }
-    } else if (S_ISFIFO(src_stat.st_mode) || S_ISBLK(src_stat.st_mode) || S_ISCHR(src_stat.st_mode) || S_ISSOCK(src_stat.st_mode)) {
-        if (mknod(dest, src_stat.st_mode, src_stat.st_rdev) < 0) {
-            perror(src);
+    } else if (S_ISREG(src_stat->st_mode) && !(op & CT_LINK) && src_stat->st_nlink > 2 && src_stat->st_dev == dest_dev) {
+        if (linkat(src_dirfd, src, dest_dirfd, dest, 0) < 0) {
             return -1;
         }
-    } else if (S_ISREG(src_stat.st_mode)) {
-        fp1 = fopen(src, "rb");
-        if (!fp1) {
-            perror(src);
+    } else if (S_ISFIFO(src_stat->st_mode) || S_ISBLK(src_stat->st_mode) || S_ISCHR(src_stat->st_mode) || S_ISSOCK(src_stat->st_mode)) {
+        if (mknodat(dest_dirfd, dest, src_stat->st_mode, src_stat->st_rdev) < 0) {
+            return -1;
+        }
+    } else if (S_ISREG(src_stat->st_mode)) {
+        int fd1 = openat(src_dirfd, src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd1 < 0) {
             return -1;
         }
 
-        fp2 = fopen(dest, "w+b");
-        if (!fp2) {
-            perror(dest);
+        int fd2 = openat(dest_dirfd, dest, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd2 < 0) {
+            close(fd1);
             return -1;
         }
 
-        bytes_written = 0;
-        while ((bytes_read = fread(buf, sizeof(char), sizeof(buf), fp1)) != 0) {
-            bytes_written += fwrite(buf, sizeof(char), bytes_read, fp2);
+        ssize_t bytes_written = copy_fd(fd1, fd2, src_stat->st_size);
+        close(fd1);
+        if (bytes_written < 0) {
+            close(fd2);
+            return -1;
         }
-        fclose(fp1);
-        fclose(fp2);
 
-        if (bytes_written != (size_t) src_stat.st_size) {
-            fprintf(stderr, "%s: SHORT WRITE (expected %zu bytes, but wrote %zu bytes)\n", dest, src_stat.st_size, bytes_written);
+        if (bytes_written != (ssize_t) src_stat->st_size) {
+            fprintf(stderr, "%s: SHORT WRITE (expected %zu bytes, but wrote %zd bytes)\n", dest, (size_t) src_stat->st_size, bytes_written);
+            close(fd2);
+            errno = EIO;
             return -1;
         }
 
-        if (op & CT_OWNER && chown(dest, src_stat.st_uid, src_stat.st_gid) < 0) {
+        if (op & CT_OWNER && fchown(fd2, src_stat->st_uid, src_stat->st_gid) < 0) {
             perror(dest);
         }
 
-        if (op & CT_PERM && chmod(dest, src_stat.st_mode) < 0) {
+        if (op & CT_PERM && fchmod(fd2, src_stat->st_mode) < 0) {
             perror(dest);
         }
+
+        if (op & CT_TIME) {
+            const struct timespec times[2] = {STAT_ATIM(*src_stat), STAT_MTIM(*src_stat)};
+            if (futimens(fd2, times) < 0) {
+                perror(dest);
+            }
+        }
+        if (close(fd2) < 0) {
+            return -1;
+        }
     } else {
         errno = EOPNOTSUPP;
         return -1;
@@ -85,6 +197,96 @@ int copy2(const char *src, const char *dest, unsigned int op) {
     return 0;
 }
 
+/**
+ * Replace `dest` with a hard link to `src`
+ * @return 0 on success, -1 on error (errno is set)
+ */
+static int copy_link_at(int src_dirfd, const char *src, int dest_dirfd, const char *dest) {
+    char tmp[PATH_MAX];
+
+    if (copy_tmpname(dest, tmp, sizeof(tmp)) || linkat(src_dirfd, src, dest_dirfd, tmp, 0) < 0) {
+        return -1;
+    }
+    if (renameat(dest_dirfd, tmp, dest_dirfd, dest) < 0) {
+        int error = errno;
+        unlinkat(dest_dirfd, tmp, 0);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Copy one directory entry
+ *
+ * The copy is made under a temporary name beside `dest`, and renamed over
+ * it, so readers of `dest` see either the old entry or the complete new one.
+ * An existing file is replaced, never written through, so the other names
+ * of a hard linked file are not modified.
+ *
+ * @param src_dirfd directory containing `src` (or AT_FDCWD)
+ * @param src source name
+ * @param src_stat lstat() of the source
+ * @param dest_dirfd directory containing `dest` (or AT_FDCWD)
+ * @param dest destination name
+ * @param dest_dev device of the destination directory
+ * @param op CT_OWNER, CT_PERM, CT_TIME, CT_LINK
+ * @return 0 on success, 1 if `dest` was hard linked to `src`, -1 on error (errno is set,
+ * EISDIR when `dest` is a directory)
+ */
+static int copy_at(int src_dirfd, const char *src, const struct stat *src_stat, int dest_dirfd, const char *dest, dev_t dest_dev, unsigned int op) {
+    char tmp[PATH_MAX];
+    int status;
+
+    if (copy_tmpname(dest, tmp, sizeof(tmp))) {
+        return -1;
+    }
+    status = copy_create_at(src_dirfd, src, src_stat, dest_dirfd, tmp, dest_dev, op);
+    if (status < 0) {
+        int error = errno;
+        unlinkat(dest_dirfd, tmp, 0);
+        errno = error;
+        return -1;
+    }
+    if (renameat(dest_dirfd, tmp, dest_dirfd, dest) < 0) {
+        int error = errno;
+        unlinkat(dest_dirfd, tmp, 0);
+        errno = error;
+        return -1;
+    }
+    if (S_ISREG(src_stat->st_mode) && src_stat->st_nlink > 1) {
+        // rename() does nothing when both names are links to the same file
+        unlinkat(dest_dirfd, tmp, 0);
+    }
+    return status;
+}
+
+int copy2(const char *src, const char *dest, unsigned int op) {
+    struct stat src_stat, dnamest;
+
+    if (lstat(src, &src_stat) < 0) {
+        perror(src);
+        return -1;
+    }
+
+    char dname[1024] = {0};
+    strcpy(dname, dest);
+    char *dname_endptr;
+
+    dname_endptr = strrchr(dname, '/');
+    if (dname_endptr != NULL) {
+        *dname_endptr = '\0';
+    }
+
+    memset(&dnamest, 0, sizeof(dnamest));
+    stat(dname, &dnamest);
+    if (copy_at(AT_FDCWD, src, &src_stat, AT_FDCWD, dest, dnamest.st_dev, op) < 0) {
+        perror(dest);
+        return -1;
+    }
+    return 0;
+}
+
 int mkdirs(const char *_path, mode_t mode) {
     int status;
     char *token;
@@ -111,86 +313,740 @@ int mkdirs(const char *_path, mode_t mode) {
     return status;
 }
 
-int copytree(const char *srcdir, const char *destdir, unsigned int op) {
-    DIR *dir;
-    struct dirent *d;
-    struct stat st;
+#define COPYTREE_BATCH 64
+
+/**
+ * Attributes of a source directory (CT_PERM, CT_TIME)
+ */
+struct CopyTreeDir {
+    char *path;                 //!< Directory relative to the roots
     mode_t mode;
+    struct timespec times[2];
+};
+
+/**
+ * State shared by the workers of `copytree_parallel` and `sync_tree`
+ */
+struct CopyTree {
+    struct Pool *pool;
+    int src_root;               //!< Source directory
+    int dest_root;              //!< Destination directory
+    unsigned op;
+    char **exclude;             //!< Name patterns to skip (see `sync_tree`)
     mode_t umask_value;
-    errno = 0;
+    pthread_mutex_t lock;       //!< Protects every member below
+    size_t inflight;            //!< Number of queued file batches
+    size_t inflight_max;        //!< Upper limit for `inflight`
+    struct CopyTreeDir *dirs;   //!< Directories whose attributes are applied when the copy is done
+    size_t dirs_count;
+    size_t dirs_max;
+    struct CopyTreeReport report;
+};
+
+
+/**
+ * A directory to copy, or a batch of files in one directory
+ */
+struct CopyTreeTask {
+    struct CopyTree *tree;
+    char *path;         //!< Directory relative to the roots
+    int src_fd;         //!< Source directory (batches only)
+    int dest_fd;        //!< Destination directory (batches only)
+    char **names;       //!< Entries to copy (NULL terminated, batches only)
+};
 
-    dir = opendir(srcdir);
+static void copytree_task(void *arg);
+
+static void copytree_merge(struct CopyTree *tree, const struct CopyTreeReport *report) {
+    pthread_mutex_lock(&tree->lock);
+    tree->report.dirs += report->dirs;
+    tree->report.files += report->files;
+    tree->report.bytes += report->bytes;
+    tree->report.linked += report->linked;
+    tree->report.skipped += report->skipped;
+    tree->report.deleted += report->deleted;
+    pthread_mutex_unlock(&tree->lock);
+}
+
+static void copytree_failed(struct CopyTree *tree, const char *path, const char *name) {
+    char reason[PATH_MAX + 255];
+    if (!name) {
+        snprintf(reason, sizeof(reason), "%s: %s", path, strerror(errno));
+    } else if (!strcmp(path, ".")) {
+        snprintf(reason, sizeof(reason), "%s: %s", name, strerror(errno));
+    } else {
+        snprintf(reason, sizeof(reason), "%s/%s: %s", path, name, strerror(errno));
+    }
+    pthread_mutex_lock(&tree->lock);
+    tree->report.errors++;
+    if (tree->report.failed) {
+        strlist_append(&tree->report.failed, reason);
+    }
+    pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * Remember the attributes of directory `path`, to apply to the destination
+ * once nothing else will be written to it
+ */
+static void copytree_dir_attr(struct CopyTree *tree, const char *path, int src_fd) {
+    struct stat st;
+    char *copy = NULL;
+
+    if (fstat(src_fd, &st) < 0 || !(copy = strdup(path))) {
+        copytree_failed(tree, path, NULL);
+        return;
+    }
+    pthread_mutex_lock(&tree->lock);
+    if (tree->dirs_count == tree->dirs_max) {
+        size_t dirs_max = tree->dirs_max ? tree->dirs_max * 2 : COPYTREE_BATCH;
+        struct CopyTreeDir *tmp = realloc(tree->dirs, dirs_max * sizeof(*tmp));
+        if (!tmp) {
+            pthread_mutex_unlock(&tree->lock);
+            guard_free(copy);
+            copytree_failed(tree, path, NULL);
+            return;
+        }
+        tree->dirs = tmp;
+        tree->dirs_max = dirs_max;
+    }
+    struct CopyTreeDir *dir = &tree->dirs[tree->dirs_count++];
+    dir->path = copy;
+    dir->mode = st.st_mode & 07777;
+    dir->times[0] = STAT_ATIM(st);
+    dir->times[1] = STAT_MTIM(st);
+    pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * Apply source directory attributes to the destination, new and existing
+ * directories alike. Directories stay writable by their owner.
+ */
+static void copytree_dir_attr_apply(struct CopyTree *tree) {
+    for (size_t i = 0; i < tree->dirs_count; i++) {
+        struct CopyTreeDir *dir = &tree->dirs[i];
+        if ((tree->op & CT_PERM && fchmodat(tree->dest_root, dir->path, dir->mode | S_IWUSR, 0) < 0)
+            || (tree->op & CT_TIME && utimensat(tree->dest_root, dir->path, dir->times, AT_SYMLINK_NOFOLLOW) < 0)) {
+            copytree_failed(tree, dir->path, NULL);
+        }
+        guard_free(dir->path);
+    }
+    guard_free(tree->dirs);
+    tree->dirs_count = 0;
+    tree->dirs_max = 0;
+}
+
+static char *copytree_path(const char *path, const char *name) {
+    const size_t path_len = strlen(path);
+    const size_t name_len = strlen(name);
+    if (!strcmp(path, ".")) {
+        return strdup(name);
+    }
+    char *result = malloc(path_len + name_len + 2);
+    if (result) {
+        memcpy(result, path, path_len);
+        result[path_len] = '/';
+        memcpy(result + path_len + 1, name, name_len + 1);
+    }
+    return result;
+}
+
+/**
+ * Remove a directory entry, and everything below it
+ * @return 0 on success, -1 on error
+ */
+static int copy_remove_at(int dirfd, const char *name) {
+    struct dirent *rec;
+    int status = 0;
+
+    if (!unlinkat(dirfd, name, 0)) {
+        return 0;
+    }
+    if (errno != EISDIR && errno != EPERM) {
+        return -1;
+    }
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    DIR *dir = fdopendir(fd);
     if (!dir) {
+        close(fd);
         return -1;
     }
+    while ((rec = readdir(dir))) {
+        if (strcmp(rec->d_name, ".") != 0 && strcmp(rec->d_name, "..") != 0 && copy_remove_at(fd, rec->d_name) < 0) {
+            status = -1;
+        }
+    }
+    closedir(dir);
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) < 0) {
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * Compare the contents of two files of the same size
+ * @return 1 if equal, 0 if different or unreadable
+ */
+static int copy_same_contents(int src_dirfd, const char *src, int dest_dirfd, const char *dest) {
+    const size_t bufsiz = 64 * 1024;
+    int result = 0;
+    int fd1 = openat(src_dirfd, src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    int fd2 = openat(dest_dirfd, dest, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    char *buf1 = malloc(bufsiz);
+    char *buf2 = malloc(bufsiz);
 
-    umask_value = umask(0);
-    umask(umask_value);
+    if (fd1 >= 0 && fd2 >= 0 && buf1 && buf2) {
+        while (1) {
+            ssize_t n1 = read(fd1, buf1, bufsiz);
+            ssize_t n2 = n1 > 0 ? read(fd2, buf2, n1) : read(fd2, buf2, 1);
+            if (n1 < 0 || n2 < 0 || n1 != n2 || memcmp(buf1, buf2, n1) != 0) {
+                break;
+            }
+            if (n1 == 0) {
+                result = 1;
+                break;
+            }
+        }
+    }
+    if (fd1 >= 0) {
+        close(fd1);
+    }
+    if (fd2 >= 0) {
+        close(fd2);
+    }
+    guard_free(buf1);
+    guard_free(buf2);
+    return result;
+}
+
+/**
+ * Determine whether a destination entry is already up to date
+ *
+ * Regular files match when their sizes and modification times (in seconds)
+ * are equal, or with CT_CHECKSUM, when their sizes and contents are equal.
+ * With CT_LINK, a hard link to the source always matches. Symbolic links
+ * match when they point to the same place.
+ *
+ * @return 1 if `dest` does not need to be copied, 2 if it is an equal copy that
+ * should be linked instead (CT_LINK), 0 otherwise
+ */
+static int copy_is_current(int src_dirfd, const char *src, const struct stat *src_stat, int dest_dirfd, const char *dest, unsigned op) {
+    struct stat dest_stat;
+    if (fstatat(dest_dirfd, dest, &dest_stat, AT_SYMLINK_NOFOLLOW) < 0
+        || (src_stat->st_mode & S_IFMT) != (dest_stat.st_mode & S_IFMT)) {
+        return 0;
+    }
+    if (S_ISREG(src_stat->st_mode)) {
+        if (src_stat->st_size != dest_stat.st_size) {
+            return 0;
+        }
+        if (src_stat->st_dev == dest_stat.st_dev && src_stat->st_ino == dest_stat.st_ino) {
+            return 1;
+        }
+        int same = op & CT_CHECKSUM ? copy_same_contents(src_dirfd, src, dest_dirfd, dest)
+                                    : STAT_MTIM(*src_stat).tv_sec == STAT_MTIM(dest_stat).tv_sec;
+        if (same && op & CT_LINK && src_stat->st_dev == dest_stat.st_dev) {
+            // Should be a link to the source, but is a copy. Linking may have been refused before.
+            return 2;
+        }
+        return same;
+    }
+    if (S_ISLNK(src_stat->st_mode)) {
+        char src_link[PATH_MAX] = {0};
+        char dest_link[PATH_MAX] = {0};
+        return readlinkat(src_dirfd, src, src_link, sizeof(src_link) - 1) >= 0
+               && readlinkat(dest_dirfd, dest, dest_link, sizeof(dest_link) - 1) >= 0
+               && !strcmp(src_link, dest_link);
+    }
+    // Devices, FIFOs, and sockets are not recreated
+    return 1;
+}
+
+/**
+ * Determine whether `name` matches one of the exclusion patterns
+ *
+ * Patterns are fnmatch(3) globs compared with the entry's name. A pattern
+ * ending with "/" only matches directories.
+ */
+static int copytree_excluded(const struct CopyTree *tree, const char *name, int is_dir) {
+    if (!tree->exclude) {
+        return 0;
+    }
+    for (size_t i = 0; tree->exclude[i]; i++) {
+        char pattern[PATH_MAX];
+        size_t len = strlen(tree->exclude[i]);
+        if (!len || len >= sizeof(pattern)) {
+            continue;
+        }
+        memcpy(pattern, tree->exclude[i], len + 1);
+        if (pattern[len - 1] == '/') {
+            if (!is_dir) {
+                continue;
+            }
+            pattern[len - 1] = '\0';
+        }
+        if (!fnmatch(pattern, name, 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int copytree_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * Remove destination entries that do not exist in the source
+ * @param names sorted source entry names
+ */
+static void copytree_delete(struct CopyTree *tree, const char *path, int dest_fd, char **names, size_t names_count, struct CopyTreeReport *report) {
+    struct dirent *rec;
+    int list_fd = dup(dest_fd);
+    DIR *dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+
+    if (!dir) {
+        copytree_failed(tree, path, NULL);
+        if (list_fd >= 0) {
+            close(list_fd);
+        }
+        return;
+    }
+    while ((rec = readdir(dir))) {
+        const char *name = rec->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, "..")
+            || (names_count && bsearch(&name, names, names_count, sizeof(*names), copytree_name_cmp))) {
+            continue;
+        }
+        int is_dir = rec->d_type == DT_DIR;
+        if (rec->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = fstatat(dest_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        // Excluded entries are protected from deletion
+        if (copytree_excluded(tree, name, is_dir)) {
+            continue;
+        }
+        if (copy_remove_at(dest_fd, name) < 0) {
+            copytree_failed(tree, path, name);
+        } else {
+            report->deleted++;
+        }
+    }
+    closedir(dir);
+}
+
+static void copytree_files(struct CopyTree *tree, const char *path, int src_fd, int dest_fd, char **names) {
+    struct CopyTreeReport report = {0};
+    struct stat dest_stat;
+    dev_t dest_dev = fstat(dest_fd, &dest_stat) == 0 ? dest_stat.st_dev : 0;
+
+    for (size_t i = 0; names[i]; i++) {
+        struct stat st;
+        int status;
+        int current = 0;
+        if (fstatat(src_fd, names[i], &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            copytree_failed(tree, path, names[i]);
+        } else if (tree->op & CT_SYNC && (current = copy_is_current(src_fd, names[i], &st, dest_fd, names[i], tree->op)) == 2) {
+            // An equal copy is kept when linking is refused, rather than copied again
+            if (!copy_link_at(src_fd, names[i], dest_fd, names[i])) {
+                report.linked++;
+            } else if (errno == EPERM || errno == EMLINK || errno == EXDEV) {
+                report.skipped++;
+            } else {
+                copytree_failed(tree, path, names[i]);
+            }
+        } else if (current) {
+            report.skipped++;
+        } else if ((status = copy_at(src_fd, names[i], &st, dest_fd, names[i], dest_dev, tree->op)) < 0
+                   && !(errno == EISDIR && tree->op & CT_SYNC && copy_remove_at(dest_fd, names[i]) == 0
+                        && (status = copy_at(src_fd, names[i], &st, dest_fd, names[i], dest_dev, tree->op)) >= 0)) {
+            // A directory in the way is replaced when synchronizing
+            copytree_failed(tree, path, names[i]);
+        } else if (status > 0) {
+            report.linked++;
+        } else {
+            report.files++;
+            if (S_ISREG(st.st_mode)) {
+                report.bytes += st.st_size;
+            }
+        }
+        guard_free(names[i]);
+    }
+    copytree_merge(tree, &report);
+}
+
+static int copytree_submit(struct CopyTree *tree, char *path, int src_fd, int dest_fd, char **names) {
+    struct CopyTreeTask *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return -1;
+    }
+    task->tree = tree;
+    task->path = path;
+    task->src_fd = src_fd;
+    task->dest_fd = dest_fd;
+    task->names = names;
+    if (pool_submit(tree->pool, copytree_task, task)) {
+        guard_free(task);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Hand a batch of files to another worker, or copy them now
+ *
+ * At most `inflight_max` batches are queued at a time. Once the limit is
+ * reached the directory's own worker copies the batch, which keeps memory and
+ * open descriptors bounded without blocking a worker on the queue.
+ */
+static void copytree_dispatch(struct CopyTree *tree, const char *path, int src_fd, int dest_fd, char **names) {
+    int queued = 0;
+
+    pthread_mutex_lock(&tree->lock);
+    if (tree->inflight < tree->inflight_max) {
+        tree->inflight++;
+        queued = 1;
+    }
+    pthread_mutex_unlock(&tree->lock);
+
+    if (queued) {
+        char *batch_path = strdup(path);
+        int batch_src_fd = dup(src_fd);
+        int batch_dest_fd = dup(dest_fd);
+        if (batch_path && batch_src_fd >= 0 && batch_dest_fd >= 0
+            && !copytree_submit(tree, batch_path, batch_src_fd, batch_dest_fd, names)) {
+            return;
+        }
+        guard_free(batch_path);
+        if (batch_src_fd >= 0) {
+            close(batch_src_fd);
+        }
+        if (batch_dest_fd >= 0) {
+            close(batch_dest_fd);
+        }
+        pthread_mutex_lock(&tree->lock);
+        tree->inflight--;
+        pthread_mutex_unlock(&tree->lock);
+    }
+    copytree_files(tree, path, src_fd, dest_fd, names);
+    guard_free(names);
+}
+
+static void copytree_dir(struct CopyTree *tree, const char *path) {
+    struct CopyTreeReport report = {0};
+    struct dirent *rec;
+    char **names = NULL;
+    size_t names_count = 0;
+    char **all = NULL;
+    size_t all_count = 0;
+    size_t all_max = 0;
+    DIR *dir = NULL;
+    int dest_fd = -1;
+    int src_fd = openat(tree->src_root, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (src_fd < 0) {
+        copytree_failed(tree, path, NULL);
+        return;
+    }
+    dest_fd = openat(tree->dest_root, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dest_fd < 0) {
+        copytree_failed(tree, path, NULL);
+        close(src_fd);
+        return;
+    }
+    if (tree->op & (CT_PERM | CT_TIME)) {
+        copytree_dir_attr(tree, path, src_fd);
+    }
+    int list_fd = dup(src_fd);
+    if (list_fd < 0 || !(dir = fdopendir(list_fd))) {
+        copytree_failed(tree, path, NULL);
+        if (list_fd >= 0) {
+            close(list_fd);
+        }
+        goto l_copytree_dir_done;
+    }
+
+    while ((rec = readdir(dir))) {
+        if (!strcmp(rec->d_name, ".") || !strcmp(rec->d_name, "..")) {
+            continue;
+        }
+        unsigned char type = rec->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN || (type == DT_DIR && tree->op & CT_PERM)) {
+            if (fstatat(src_fd, rec->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                copytree_failed(tree, path, rec->d_name);
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+        }
+        if (copytree_excluded(tree, rec->d_name, type == DT_DIR)) {
+            continue;
+        }
+
+        if (tree->op & CT_DELETE) {
+            // Remember every source entry so the rest can be deleted from the destination
+            if (all_count == all_max) {
+                size_t all_max_new = all_max ? all_max * 2 : COPYTREE_BATCH;
+                char **tmp = realloc(all, all_max_new * sizeof(*all));
+                if (!tmp) {
+                    copytree_failed(tree, path, rec->d_name);
+                    continue;
+                }
+                all = tmp;
+                all_max = all_max_new;
+            }
+            all[all_count] = strdup(rec->d_name);
+            if (!all[all_count]) {
+                copytree_failed(tree, path, rec->d_name);
+                continue;
+            }
+            all_count++;
+        }
+
+        if (type == DT_DIR) {
+            // Make sure the directory can be written to, regardless of the source's mode
+            mode_t mode = tree->op & CT_PERM ? (st.st_mode & 07777) | S_IWUSR : 0777;
+            char *child = copytree_path(path, rec->d_name);
+            int created = 0;
+            if (child) {
+                created = !mkdirat(dest_fd, rec->d_name, mode);
+                if (!created && errno == EEXIST && tree->op & CT_SYNC) {
+                    // Replace whatever is in the way
+                    struct stat dest_st;
+                    if (fstatat(dest_fd, rec->d_name, &dest_st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(dest_st.st_mode)
+                        && copy_remove_at(dest_fd, rec->d_name) == 0) {
+                        created = !mkdirat(dest_fd, rec->d_name, mode);
+                    } else {
+                        errno = EEXIST;
+                    }
+                }
+            }
+            if (!child || (!created && errno != EEXIST)) {
+                copytree_failed(tree, path, rec->d_name);
+                guard_free(child);
+                continue;
+            }
+            if (created) {
+                report.dirs++;
+            }
+            // Idle workers pick up subdirectories from the pool's queue
+            if (copytree_submit(tree, child, -1, -1, NULL)) {
+                copytree_failed(tree, child, NULL);
+                guard_free(child);
+            }
+            continue;
+        }
+
+        if (!names) {
+            names = calloc(COPYTREE_BATCH + 1, sizeof(*names));
+            if (!names) {
+                copytree_failed(tree, path, rec->d_name);
+                continue;
+            }
+        }
+        names[names_count] = strdup(rec->d_name);
+        if (!names[names_count]) {
+            copytree_failed(tree, path, rec->d_name);
+            continue;
+        }
+        if (++names_count == COPYTREE_BATCH) {
+            copytree_dispatch(tree, path, src_fd, dest_fd, names);
+            names = NULL;
+            names_count = 0;
+        }
+    }
+    closedir(dir);
+    if (names) {
+        copytree_files(tree, path, src_fd, dest_fd, names);
+        guard_free(names);
+    }
+    if (tree->op & CT_DELETE) {
+        if (all_count) {
+            qsort(all, all_count, sizeof(*all), copytree_name_cmp);
+        }
+        copytree_delete(tree, path, dest_fd, all, all_count, &report);
+    }
+
+    l_copytree_dir_done:
+    for (size_t i = 0; i < all_count; i++) {
+        guard_free(all[i]);
+    }
+    guard_free(all);
+    copytree_merge(tree, &report);
+    close(src_fd);
+    close(dest_fd);
+}
+
+static void copytree_task(void *arg) {
+    struct CopyTreeTask *task = arg;
+    if (task->names) {
+        copytree_files(task->tree, task->path, task->src_fd, task->dest_fd, task->names);
+        guard_free(task->names);
+        close(task->src_fd);
+        close(task->dest_fd);
+        pthread_mutex_lock(&task->tree->lock);
+        task->tree->inflight--;
+        pthread_mutex_unlock(&task->tree->lock);
+    } else {
+        copytree_dir(task->tree, task->path);
+    }
+    guard_free(task->path);
+    guard_free(task);
+}
+
+static int copytree_run(const char *srcdir, const char *destdir, unsigned int op, char **exclude, struct CopyTreeReport *report) {
+    struct CopyTree tree;
+    struct stat st;
+    char src_real[PATH_MAX];
+    char dest_real[PATH_MAX];
+    mode_t mode;
+    char *root;
+
+    memset(&tree, 0, sizeof(tree));
+    tree.src_root = -1;
+    tree.dest_root = -1;
+    if (report) {
+        memset(report, 0, sizeof(*report));
+    }
 
     if (lstat(srcdir, &st) < 0) {
         perror(srcdir);
-        closedir(dir);
         return -1;
     }
+    if (!S_ISDIR(st.st_mode)) {
+        int current = op & CT_SYNC ? copy_is_current(AT_FDCWD, srcdir, &st, AT_FDCWD, destdir, op) : 0;
+        if (current == 2 && !copy_link_at(AT_FDCWD, srcdir, AT_FDCWD, destdir)) {
+            if (report) {
+                report->linked = 1;
+            }
+            return 0;
+        }
+        if (current == 1 || (current == 2 && (errno == EPERM || errno == EMLINK || errno == EXDEV))) {
+            if (report) {
+                report->skipped = 1;
+            }
+            return 0;
+        }
+        if (copy2(srcdir, destdir, op) < 0) {
+            return -1;
+        }
+        if (report) {
+            report->files = 1;
+            report->bytes = S_ISREG(st.st_mode) ? st.st_size : 0;
+        }
+        return 0;
+    }
 
+    tree.umask_value = umask(0);
+    umask(tree.umask_value);
     if (op & CT_PERM) {
-        mode = st.st_mode;
+        mode = st.st_mode & 07777;
     } else {
-        mode = 0777 & ~umask_value;
+        mode = 0777 & ~tree.umask_value;
     }
-
     // Source directory is not writable so modify the mode for the destination
-    if (mode & ~S_IWUSR) {
-        mode |= S_IWUSR;
-    }
+    mode |= S_IWUSR;
 
+    int created = 0;
     if (access(destdir, F_OK) < 0) {
         if (mkdirs(destdir, mode) < 0) {
             perror(destdir);
-            closedir(dir);
             return -1;
         }
+        created = 1;
     }
 
-    memset(&st, 0, sizeof(st));
-    while ((d = readdir(dir)) != NULL) {
-        char src[PATH_MAX] = {0};
-        char dest[PATH_MAX] = {0};
-        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
-            continue;
+    // Refuse to copy a directory into itself
+    if (!realpath(srcdir, src_real) || !realpath(destdir, dest_real)) {
+        return -1;
+    }
+    size_t src_real_len = strlen(src_real);
+    if (!strncmp(src_real, dest_real, src_real_len)
+        && (dest_real[src_real_len] == '/' || dest_real[src_real_len] == '\0' || !strcmp(src_real, "/"))) {
+        fprintf(stderr, "%s: cannot copy a directory into itself (%s)\n", srcdir, destdir);
+        if (created) {
+            rmdir(destdir);
         }
-        strcat(src, srcdir);
-        strcat(src, "/");
-        strcat(src, d->d_name);
+        errno = EINVAL;
+        return -1;
+    }
 
-        strcat(dest, destdir);
-        strcat(dest, "/");
-        strcat(dest, d->d_name);
+    tree.op = op;
+    tree.exclude = exclude;
+    tree.src_root = open(srcdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    tree.dest_root = open(destdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (tree.src_root < 0 || tree.dest_root < 0) {
+        perror(tree.src_root < 0 ? srcdir : destdir);
+        goto l_copytree_parallel_error;
+    }
+    if (report) {
+        tree.report.failed = strlist_init();
+    }
+    tree.pool = pool_init(0);
+    root = strdup(".");
+    if (!tree.pool || !root) {
+        guard_free(root);
+        goto l_copytree_parallel_error;
+    }
+    tree.inflight_max = tree.pool->nthreads * 2;
+    pthread_mutex_init(&tree.lock, NULL);
+    if (copytree_submit(&tree, root, -1, -1, NULL)) {
+        guard_free(root);
+        pthread_mutex_destroy(&tree.lock);
+        goto l_copytree_parallel_error;
+    }
+    pool_wait(tree.pool);
+    pool_free(&tree.pool);
+    // Every entry has been written, so directory times will not change again
+    copytree_dir_attr_apply(&tree);
+    pthread_mutex_destroy(&tree.lock);
+    close(tree.src_root);
+    close(tree.dest_root);
 
-        if (lstat(src, &st) < 0) {
-            perror(srcdir);
-            closedir(dir);
-            return -1;
-        }
+    if (report) {
+        *report = tree.report;
+    }
+    return tree.report.errors ? -1 : 0;
 
-        if (d->d_type == DT_DIR) {
-            if (strncmp(src, dest, strlen(src)) == 0) {
-                closedir(dir);
-                return -1;
-            }
+    l_copytree_parallel_error:
+    pool_free(&tree.pool);
+    if (tree.src_root >= 0) {
+        close(tree.src_root);
+    }
+    if (tree.dest_root >= 0) {
+        close(tree.dest_root);
+    }
+    guard_strlist_free(&tree.report.failed);
+    return -1;
+}
 
-            if (access(dest, F_OK) < 0) {
-                if (mkdir(dest, mode) < 0) {
-                    perror(dest);
-                    closedir(dir);
-                    return -1;
-                }
-            }
+int copytree_parallel(const char *srcdir, const char *destdir, unsigned int op, struct CopyTreeReport *report) {
+    return copytree_run(srcdir, destdir, op & ~(CT_SYNC | CT_DELETE | CT_CHECKSUM), NULL, report);
+}
 
-            copytree(src, dest, op);
-        }
-        copy2(src, dest, op);
+int sync_tree(const char *srcdir, const char *destdir, unsigned int op, char **exclude, struct CopyTreeReport *report) {
+    // Modification times are what make the next sync incremental
+    return copytree_run(srcdir, destdir, op | CT_SYNC | CT_TIME, exclude, report);
+}
+
+void copytree_report_show(const struct CopyTreeReport *report) {
+    for (size_t i = 0; i < strlist_count(report->failed); i++) {
+        fprintf(stderr, "%s\n", strlist_item(report->failed, i));
     }
-    closedir(dir);
-    return 0;
+    if (globals.verbose) {
+        msg(STASIS_MSG_L3, "%zu copied (%zu bytes), %zu linked, %zu up to date, %zu deleted, %zu failed\n",
+            report->files, report->bytes, report->linked, report->skipped, report->deleted, report->errors);
+    }
+}
+
+int copytree(const char *srcdir, const char *destdir, unsigned int op) {
+    struct CopyTreeReport report;
+    int status = copytree_parallel(srcdir, destdir, op, &report);
+    copytree_report_show(&report);
+    guard_strlist_free(&report.failed);
+    return status;
 }
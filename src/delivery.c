@@ -1,6 +1,8 @@
 #define _GNU_SOURCE
 
 #include <fnmatch.h>
+#include <glob.h>
+#include <stddef.h>
 #include "core.h"
 
 extern struct STASIS_GLOBAL globals;
@@ -25,32 +27,31 @@ static void conv_int(int *x, union INIVal val) {
     *x = val.as_int;
 }
 
-static void conv_str(char **x, union INIVal val) {
-    if (*x) {
-        guard_free(*x);
-    }
+static void conv_str(struct Arena *arena, char **x, union INIVal val) {
+    guard_arena_free(arena, *x);
     if (val.as_char_p) {
         char *tplop = tpl_render(val.as_char_p);
-        if (tplop) {
-            *x = tplop;
+        if (tplop && arena) {
+            *x = arena_strdup(arena, tplop);
+            guard_free(tplop);
         } else {
-            *x = NULL;
+            *x = tplop;
         }
-    } else {
-        *x = NULL;
     }
 }
 
-static void conv_str_noexpand(char **x, union INIVal val) {
-    if (*x) {
-        guard_free(*x);
+static void conv_str_noexpand(struct Arena *arena, char **x, union INIVal val) {
+    guard_arena_free(arena, *x);
+    if (arena) {
+        *x = arena_strdup(arena, val.as_char_p);
+    } else {
+        *x = strdup(val.as_char_p);
     }
-    *x = strdup(val.as_char_p);
 }
 
-static void conv_strlist(struct StrList **x, char *tok, union INIVal val) {
+static void conv_strlist(struct Arena *arena, struct StrList **x, char *tok, union INIVal val) {
     if (!(*x))
-        (*x) = strlist_init();
+        (*x) = strlist_init_arena(arena);
     if (val.as_char_p) {
         char *tplop = tpl_render(val.as_char_p);
         if (tplop) {
@@ -65,16 +66,40 @@ static void conv_bool(bool *x, union INIVal val) {
     *x = val.as_bool;
 }
 
+struct Arena *delivery_arena(struct Delivery *ctx) {
+    if (!ctx->arena) {
+        ctx->arena = arena_init(0);
+    }
+    return ctx->arena;
+}
+
+char *delivery_strdup(struct Delivery *ctx, const char *str) {
+    struct Arena *arena;
+    if (!str || !(arena = delivery_arena(ctx))) {
+        return NULL;
+    }
+    return arena_strdup(arena, str);
+}
+
+/**
+ * Move a heap allocated string into the context's arena
+ * @return copy of `str` (which is freed), or NULL
+ */
+static char *delivery_strdup_owned(struct Delivery *ctx, char *str) {
+    char *result = delivery_strdup(ctx, str);
+    guard_free(str);
+    return result;
+}
+
 int delivery_init_tmpdir(struct Delivery *ctx) {
-    char *tmpdir = NULL;
+    const char *tmpdir = NULL;
     char *x = NULL;
     int unusable = 0;
     errno = 0;
 
     x = getenv("TMPDIR");
     if (x) {
-        guard_free(ctx->storage.tmpdir);
-        tmpdir = strdup(x);
+        tmpdir = x;
     } else {
         tmpdir = ctx->storage.tmpdir;
     }
@@ -119,8 +144,8 @@ int delivery_init_tmpdir(struct Delivery *ctx) {
         globals.tmpdir = strdup(tmpdir);
     }
 
-    if (!ctx->storage.tmpdir) {
-        ctx->storage.tmpdir = strdup(globals.tmpdir);
+    if (x || !ctx->storage.tmpdir) {
+        ctx->storage.tmpdir = delivery_strdup(ctx, globals.tmpdir);
     }
     return unusable;
 
@@ -130,50 +155,9 @@ int delivery_init_tmpdir(struct Delivery *ctx) {
 }
 
 void delivery_free(struct Delivery *ctx) {
-    guard_free(ctx->system.arch);
+    // Strings belong to the arena, and are released with it below
     GENERIC_ARRAY_FREE(ctx->system.platform);
-    guard_free(ctx->meta.name);
-    guard_free(ctx->meta.version);
-    guard_free(ctx->meta.codename);
-    guard_free(ctx->meta.mission);
-    guard_free(ctx->meta.python);
-    guard_free(ctx->meta.mission);
-    guard_free(ctx->meta.python_compact);
-    guard_free(ctx->meta.based_on);
     guard_runtime_free(ctx->runtime.environ);
-    guard_free(ctx->storage.root);
-    guard_free(ctx->storage.tmpdir);
-    guard_free(ctx->storage.delivery_dir);
-    guard_free(ctx->storage.tools_dir);
-    guard_free(ctx->storage.package_dir);
-    guard_free(ctx->storage.results_dir);
-    guard_free(ctx->storage.output_dir);
-    guard_free(ctx->storage.conda_install_prefix);
-    guard_free(ctx->storage.conda_artifact_dir);
-    guard_free(ctx->storage.conda_staging_dir);
-    guard_free(ctx->storage.conda_staging_url);
-    guard_free(ctx->storage.wheel_artifact_dir);
-    guard_free(ctx->storage.wheel_staging_dir);
-    guard_free(ctx->storage.wheel_staging_url);
-    guard_free(ctx->storage.build_dir);
-    guard_free(ctx->storage.build_recipes_dir);
-    guard_free(ctx->storage.build_sources_dir);
-    guard_free(ctx->storage.build_testing_dir);
-    guard_free(ctx->storage.build_docker_dir);
-    guard_free(ctx->storage.mission_dir);
-    guard_free(ctx->storage.docker_artifact_dir);
-    guard_free(ctx->info.time_str_epoch);
-    guard_free(ctx->info.build_name);
-    guard_free(ctx->info.build_number);
-    guard_free(ctx->info.release_name);
-    guard_free(ctx->conda.installer_baseurl);
-    guard_free(ctx->conda.installer_name);
-    guard_free(ctx->conda.installer_version);
-    guard_free(ctx->conda.installer_platform);
-    guard_free(ctx->conda.installer_arch);
-    guard_free(ctx->conda.installer_path);
-    guard_free(ctx->conda.tool_version);
-    guard_free(ctx->conda.tool_build_version);
     guard_strlist_free(&ctx->conda.conda_packages);
     guard_strlist_free(&ctx->conda.conda_packages_defer);
     guard_strlist_free(&ctx->conda.pip_packages);
@@ -181,30 +165,15 @@ void delivery_free(struct Delivery *ctx) {
     guard_strlist_free(&ctx->conda.wheels_packages);
 
     for (size_t i = 0; i < sizeof(ctx->tests) / sizeof(ctx->tests[0]); i++) {
-        guard_free(ctx->tests[i].name);
-        guard_free(ctx->tests[i].version);
-        guard_free(ctx->tests[i].repository);
-        guard_free(ctx->tests[i].repository_info_ref);
-        guard_free(ctx->tests[i].repository_info_tag);
-        guard_free(ctx->tests[i].script);
-        guard_free(ctx->tests[i].build_recipe);
+        guard_strlist_free(&ctx->tests[i].repository_remove_tags);
         // test-specific runtime variables
         guard_runtime_free(ctx->tests[i].runtime.environ);
     }
 
-    guard_free(ctx->rules.release_fmt);
-    guard_free(ctx->rules.build_name_fmt);
-    guard_free(ctx->rules.build_number_fmt);
-
-    guard_free(ctx->deploy.docker.test_script);
-    guard_free(ctx->deploy.docker.registry);
-    guard_free(ctx->deploy.docker.image_compression);
     guard_strlist_free(&ctx->deploy.docker.tags);
     guard_strlist_free(&ctx->deploy.docker.build_args);
 
     for (size_t i = 0; i < sizeof(ctx->deploy.jfrog) / sizeof(ctx->deploy.jfrog[0]); i++) {
-        guard_free(ctx->deploy.jfrog[i].repo);
-        guard_free(ctx->deploy.jfrog[i].dest);
         guard_strlist_free(&ctx->deploy.jfrog[i].files);
     }
 
@@ -223,23 +192,25 @@ void delivery_free(struct Delivery *ctx) {
         ini_free(&ctx->_stasis_ini_fp.mission);
     }
     guard_free(ctx->_stasis_ini_fp.mission_path);
+
+    arena_free(&ctx->arena);
 }
 
 void delivery_init_dirs_stage2(struct Delivery *ctx) {
-    path_store(&ctx->storage.build_recipes_dir, PATH_MAX, ctx->storage.build_dir, "recipes");
-    path_store(&ctx->storage.build_sources_dir, PATH_MAX, ctx->storage.build_dir, "sources");
-    path_store(&ctx->storage.build_testing_dir, PATH_MAX, ctx->storage.build_dir, "testing");
-    path_store(&ctx->storage.build_docker_dir, PATH_MAX, ctx->storage.build_dir, "docker");
-
-    path_store(&ctx->storage.delivery_dir, PATH_MAX, ctx->storage.output_dir, "delivery");
-    path_store(&ctx->storage.results_dir, PATH_MAX, ctx->storage.output_dir, "results");
-    path_store(&ctx->storage.package_dir, PATH_MAX, ctx->storage.output_dir, "packages");
-    path_store(&ctx->storage.cfgdump_dir, PATH_MAX, ctx->storage.output_dir, "config");
-    path_store(&ctx->storage.meta_dir, PATH_MAX, ctx->storage.output_dir, "meta");
-
-    path_store(&ctx->storage.conda_artifact_dir, PATH_MAX, ctx->storage.package_dir, "conda");
-    path_store(&ctx->storage.wheel_artifact_dir, PATH_MAX, ctx->storage.package_dir, "wheels");
-    path_store(&ctx->storage.docker_artifact_dir, PATH_MAX, ctx->storage.package_dir, "docker");
+    path_store_arena(ctx->arena, &ctx->storage.build_recipes_dir, PATH_MAX, ctx->storage.build_dir, "recipes");
+    path_store_arena(ctx->arena, &ctx->storage.build_sources_dir, PATH_MAX, ctx->storage.build_dir, "sources");
+    path_store_arena(ctx->arena, &ctx->storage.build_testing_dir, PATH_MAX, ctx->storage.build_dir, "testing");
+    path_store_arena(ctx->arena, &ctx->storage.build_docker_dir, PATH_MAX, ctx->storage.build_dir, "docker");
+
+    path_store_arena(ctx->arena, &ctx->storage.delivery_dir, PATH_MAX, ctx->storage.output_dir, "delivery");
+    path_store_arena(ctx->arena, &ctx->storage.results_dir, PATH_MAX, ctx->storage.output_dir, "results");
+    path_store_arena(ctx->arena, &ctx->storage.package_dir, PATH_MAX, ctx->storage.output_dir, "packages");
+    path_store_arena(ctx->arena, &ctx->storage.cfgdump_dir, PATH_MAX, ctx->storage.output_dir, "config");
+    path_store_arena(ctx->arena, &ctx->storage.meta_dir, PATH_MAX, ctx->storage.output_dir, "meta");
+
+    path_store_arena(ctx->arena, &ctx->storage.conda_artifact_dir, PATH_MAX, ctx->storage.package_dir, "conda");
+    path_store_arena(ctx->arena, &ctx->storage.wheel_artifact_dir, PATH_MAX, ctx->storage.package_dir, "wheels");
+    path_store_arena(ctx->arena, &ctx->storage.docker_artifact_dir, PATH_MAX, ctx->storage.package_dir, "docker");
 }
 
 void delivery_init_dirs_stage1(struct Delivery *ctx) {
@@ -249,13 +220,13 @@ void delivery_init_dirs_stage1(struct Delivery *ctx) {
             fprintf(stderr, "STASIS_ROOT is set, but empty. Please assign a file system path to this environment variable.\n");
             exit(1);
         }
-        path_store(&ctx->storage.root, PATH_MAX, rootdir, ctx->info.build_name);
+        path_store_arena(ctx->arena, &ctx->storage.root, PATH_MAX, rootdir, ctx->info.build_name);
     } else {
         // use "stasis" in current working directory
-        path_store(&ctx->storage.root, PATH_MAX, "stasis", ctx->info.build_name);
+        path_store_arena(ctx->arena, &ctx->storage.root, PATH_MAX, "stasis", ctx->info.build_name);
     }
-    path_store(&ctx->storage.tools_dir, PATH_MAX, ctx->storage.root, "tools");
-    path_store(&ctx->storage.tmpdir, PATH_MAX, ctx->storage.root, "tmp");
+    path_store_arena(ctx->arena, &ctx->storage.tools_dir, PATH_MAX, ctx->storage.root, "tools");
+    path_store_arena(ctx->arena, &ctx->storage.tmpdir, PATH_MAX, ctx->storage.root, "tmp");
     if (delivery_init_tmpdir(ctx)) {
         msg(STASIS_MSG_ERROR | STASIS_MSG_L1, "Set $TMPDIR to a location other than %s\n", globals.tmpdir);
         if (globals.tmpdir)
@@ -263,11 +234,11 @@ void delivery_init_dirs_stage1(struct Delivery *ctx) {
         exit(1);
     }
 
-    path_store(&ctx->storage.build_dir, PATH_MAX, ctx->storage.root, "build");
-    path_store(&ctx->storage.output_dir, PATH_MAX, ctx->storage.root, "output");
+    path_store_arena(ctx->arena, &ctx->storage.build_dir, PATH_MAX, ctx->storage.root, "build");
+    path_store_arena(ctx->arena, &ctx->storage.output_dir, PATH_MAX, ctx->storage.root, "output");
 
     if (!ctx->storage.mission_dir) {
-        path_store(&ctx->storage.mission_dir, PATH_MAX, globals.sysconfdir, "mission");
+        path_store_arena(ctx->arena, &ctx->storage.mission_dir, PATH_MAX, globals.sysconfdir, "mission");
     }
 
     if (access(ctx->storage.mission_dir, F_OK)) {
@@ -294,13 +265,102 @@ void delivery_init_dirs_stage1(struct Delivery *ctx) {
         }
         ctx->storage.conda_install_prefix = strdup(globals.conda_install_prefix);
          */
-        path_store(&ctx->storage.conda_install_prefix, PATH_MAX, globals.conda_install_prefix, "conda");
+        path_store_arena(ctx->arena, &ctx->storage.conda_install_prefix, PATH_MAX, globals.conda_install_prefix, "conda");
     } else {
         // install conda under the STASIS tree
-        path_store(&ctx->storage.conda_install_prefix, PATH_MAX, ctx->storage.tools_dir, "conda");
+        path_store_arena(ctx->arena, &ctx->storage.conda_install_prefix, PATH_MAX, ctx->storage.tools_dir, "conda");
     }
 }
 
+/**
+ * A string field of `struct Delivery` exposed to templates
+ */
+struct DeliveryTemplateField {
+    const char *name;   //!< Key within the namespace
+    size_t offset;      //!< Offset of the `char *` member
+};
+
+#define DELIVERY_TPL_FIELD(NS, MEMBER) {#MEMBER, offsetof(struct Delivery, NS.MEMBER)}
+
+static const struct DeliveryTemplateField delivery_tpl_meta[] = {
+    DELIVERY_TPL_FIELD(meta, name),
+    DELIVERY_TPL_FIELD(meta, version),
+    DELIVERY_TPL_FIELD(meta, codename),
+    DELIVERY_TPL_FIELD(meta, mission),
+    DELIVERY_TPL_FIELD(meta, python),
+    DELIVERY_TPL_FIELD(meta, python_compact),
+    DELIVERY_TPL_FIELD(meta, based_on),
+    {NULL, 0},
+};
+
+static const struct DeliveryTemplateField delivery_tpl_info[] = {
+    DELIVERY_TPL_FIELD(info, time_str_epoch),
+    DELIVERY_TPL_FIELD(info, release_name),
+    DELIVERY_TPL_FIELD(info, build_name),
+    DELIVERY_TPL_FIELD(info, build_number),
+    {NULL, 0},
+};
+
+static const struct DeliveryTemplateField delivery_tpl_storage[] = {
+    DELIVERY_TPL_FIELD(storage, root),
+    DELIVERY_TPL_FIELD(storage, tmpdir),
+    DELIVERY_TPL_FIELD(storage, output_dir),
+    DELIVERY_TPL_FIELD(storage, delivery_dir),
+    DELIVERY_TPL_FIELD(storage, tools_dir),
+    DELIVERY_TPL_FIELD(storage, package_dir),
+    DELIVERY_TPL_FIELD(storage, results_dir),
+    DELIVERY_TPL_FIELD(storage, meta_dir),
+    DELIVERY_TPL_FIELD(storage, conda_artifact_dir),
+    DELIVERY_TPL_FIELD(storage, wheel_artifact_dir),
+    DELIVERY_TPL_FIELD(storage, docker_artifact_dir),
+    DELIVERY_TPL_FIELD(storage, build_dir),
+    DELIVERY_TPL_FIELD(storage, build_recipes_dir),
+    DELIVERY_TPL_FIELD(storage, build_sources_dir),
+    DELIVERY_TPL_FIELD(storage, build_docker_dir),
+    {NULL, 0},
+};
+
+static const struct DeliveryTemplateField delivery_tpl_conda[] = {
+    DELIVERY_TPL_FIELD(conda, installer_baseurl),
+    DELIVERY_TPL_FIELD(conda, installer_name),
+    DELIVERY_TPL_FIELD(conda, installer_version),
+    DELIVERY_TPL_FIELD(conda, installer_arch),
+    DELIVERY_TPL_FIELD(conda, installer_platform),
+    {NULL, 0},
+};
+
+static char *delivery_tpl_field(const struct DeliveryTemplateField *fields, const char *name, struct Delivery *ctx) {
+    for (size_t i = 0; fields[i].name; i++) {
+        if (!strcmp(fields[i].name, name)) {
+            return *(char **) ((char *) ctx + fields[i].offset);
+        }
+    }
+    return NULL;
+}
+
+static char *delivery_tpl_resolve_meta(const char *name, void *data) {
+    return delivery_tpl_field(delivery_tpl_meta, name, data);
+}
+
+static char *delivery_tpl_resolve_info(const char *name, void *data) {
+    return delivery_tpl_field(delivery_tpl_info, name, data);
+}
+
+static char *delivery_tpl_resolve_storage(const char *name, void *data) {
+    return delivery_tpl_field(delivery_tpl_storage, name, data);
+}
+
+static char *delivery_tpl_resolve_conda(const char *name, void *data) {
+    return delivery_tpl_field(delivery_tpl_conda, name, data);
+}
+
+void delivery_register_templates(struct Delivery *ctx) {
+    tpl_register_namespace("meta", delivery_tpl_resolve_meta, ctx);
+    tpl_register_namespace("info", delivery_tpl_resolve_info, ctx);
+    tpl_register_namespace("storage", delivery_tpl_resolve_storage, ctx);
+    tpl_register_namespace("conda", delivery_tpl_resolve_conda, ctx);
+}
+
 int delivery_init_platform(struct Delivery *ctx) {
     msg(STASIS_MSG_L2, "Setting architecture\n");
     char archsuffix[20];
@@ -319,7 +379,7 @@ int delivery_init_platform(struct Delivery *ctx) {
         ctx->system.platform[i] = calloc(DELIVERY_PLATFORM_MAXLEN, sizeof(*ctx->system.platform[0]));
     }
 
-    ctx->system.arch = strdup(uts.machine);
+    ctx->system.arch = delivery_strdup(ctx, uts.machine);
     if (!ctx->system.arch) {
         // memory error
         return -1;
@@ -384,7 +444,7 @@ static int populate_mission_ini(struct Delivery **ctx) {
     }
 
     msg(STASIS_MSG_L2, "Reading mission configuration: %s\n", missionfile);
-    (*ctx)->_stasis_ini_fp.mission = ini_open(missionfile);
+    (*ctx)->_stasis_ini_fp.mission = ini_open_cached(missionfile, globals.cache_dir);
     ini = (*ctx)->_stasis_ini_fp.mission;
     if (!ini) {
         msg(STASIS_MSG_ERROR | STASIS_MSG_L2, "Failed to read misson configuration: %s, %s\n", missionfile, strerror(errno));
@@ -393,15 +453,15 @@ static int populate_mission_ini(struct Delivery **ctx) {
     (*ctx)->_stasis_ini_fp.mission_path = strdup(missionfile);
 
     ini_getval_required(ini, "meta", "release_fmt", INIVAL_TYPE_STR, &val);
-    conv_str(&(*ctx)->rules.release_fmt, val);
+    conv_str((*ctx)->arena, &(*ctx)->rules.release_fmt, val);
 
     // Used for setting artifactory build info
     ini_getval_required(ini, "meta", "build_name_fmt", INIVAL_TYPE_STR, &val);
-    conv_str(&(*ctx)->rules.build_name_fmt, val);
+    conv_str((*ctx)->arena, &(*ctx)->rules.build_name_fmt, val);
 
     // Used for setting artifactory build info
     ini_getval_required(ini, "meta", "build_number_fmt", INIVAL_TYPE_STR, &val);
-    conv_str(&(*ctx)->rules.build_number_fmt, val);
+    conv_str((*ctx)->arena, &(*ctx)->rules.build_number_fmt, val);
     return 0;
 }
 
@@ -427,35 +487,34 @@ void validate_delivery_ini(struct INIFILE *ini) {
         exit(1);
     }
 
-    for (size_t i = 0; i < ini->section_count; i++) {
-        struct INISection *section = ini->section[i];
-        if (section && startswith(section->key, "test:")) {
-            char *name = strstr(section->key, ":");
-            if (name && strlen(name) > 1) {
-                name = &name[1];
-            }
-            ini_has_key_required(ini, section->key, "version");
-            ini_has_key_required(ini, section->key, "repository");
-            ini_has_key_required(ini, section->key, "script");
+    struct INIIterator iter;
+    struct INISection *section;
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "test:");
+    while ((section = ini_section_iter_next(&iter)) != NULL) {
+        char *name = strstr(section->key, ":");
+        if (name && strlen(name) > 1) {
+            name = &name[1];
         }
+        ini_has_key_required(ini, section->key, "version");
+        ini_has_key_required(ini, section->key, "repository");
+        ini_has_key_required(ini, section->key, "script");
     }
 
     if (ini_section_search(&ini, INI_SEARCH_EXACT, "deploy:docker")) {
         // yeah?
     }
 
-    for (size_t i = 0; i < ini->section_count; i++) {
-        struct INISection *section = ini->section[i];
-        if (section && startswith(section->key, "deploy:artifactory")) {
-            ini_has_key_required(ini, section->key, "files");
-            ini_has_key_required(ini, section->key, "dest");
-        }
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "deploy:artifactory");
+    while ((section = ini_section_iter_next(&iter)) != NULL) {
+        ini_has_key_required(ini, section->key, "files");
+        ini_has_key_required(ini, section->key, "dest");
     }
 }
 
-static int populate_delivery_ini(struct Delivery *ctx) {
+static int populate_delivery_meta(struct Delivery *ctx) {
     union INIVal val;
     struct INIFILE *ini = ctx->_stasis_ini_fp.delivery;
+    struct INIIterator iter;
     struct INIData *rtdata;
     RuntimeEnv *rt;
 
@@ -463,20 +522,21 @@ static int populate_delivery_ini(struct Delivery *ctx) {
     // Populate runtime variables first they may be interpreted by other
     // keys in the configuration
     rt = runtime_copy(__environ);
-    while ((rtdata = ini_getall(ini, "runtime")) != NULL) {
+    ini_data_iter_init(&iter, ini, "runtime");
+    while ((rtdata = ini_data_iter_next(&iter)) != NULL) {
         char rec[STASIS_BUFSIZ];
         sprintf(rec, "%s=%s", lstrip(strip(rtdata->key)), lstrip(strip(rtdata->value)));
         runtime_set(rt, rtdata->key, rtdata->value);
     }
     runtime_apply(rt);
-    ctx->runtime.environ = rt;
+    runtime_free(rt);
 
     ini_getval_required(ini, "meta", "mission", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->meta.mission, val);
+    conv_str(ctx->arena, &ctx->meta.mission, val);
 
     if (!strcasecmp(ctx->meta.mission, "hst")) {
         ini_getval(ini, "meta", "codename", INIVAL_TYPE_STR, &val);
-        conv_str(&ctx->meta.codename, val);
+        conv_str(ctx->arena, &ctx->meta.codename, val);
     } else {
         ctx->meta.codename = NULL;
     }
@@ -484,17 +544,17 @@ static int populate_delivery_ini(struct Delivery *ctx) {
     /*
     if (!strcasecmp(ctx->meta.mission, "jwst")) {
         ini_getval(ini, "meta", "version", INIVAL_TYPE_STR, &val);
-        conv_str(&ctx->meta.version, val);
+        conv_str(ctx->arena, &ctx->meta.version, val);
 
     } else {
         ctx->meta.version = NULL;
     }
     */
     ini_getval(ini, "meta", "version", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->meta.version, val);
+    conv_str(ctx->arena, &ctx->meta.version, val);
 
     ini_getval_required(ini, "meta", "name", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->meta.name, val);
+    conv_str(ctx->arena, &ctx->meta.name, val);
 
     ini_getval(ini, "meta", "rc", INIVAL_TYPE_INT, &val);
     conv_int(&ctx->meta.rc, val);
@@ -503,34 +563,58 @@ static int populate_delivery_ini(struct Delivery *ctx) {
     conv_bool(&ctx->meta.final, val);
 
     ini_getval(ini, "meta", "based_on", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->meta.based_on, val);
+    conv_str(ctx->arena, &ctx->meta.based_on, val);
 
     if (!ctx->meta.python) {
         ini_getval(ini, "meta", "python", INIVAL_TYPE_STR, &val);
-        conv_str(&ctx->meta.python, val);
-        guard_free(ctx->meta.python_compact);
-        ctx->meta.python_compact = to_short_version(ctx->meta.python);
+        conv_str(ctx->arena, &ctx->meta.python, val);
+        ctx->meta.python_compact = delivery_strdup_owned(ctx, to_short_version(ctx->meta.python));
     } else {
         ini_setval(&ini, INI_SETVAL_REPLACE, "meta", "python", ctx->meta.python);
     }
 
+    // Delivery metadata consumed
+    populate_mission_ini(&ctx);
+
+    if (delivery_format_str(ctx, &ctx->info.release_name, ctx->rules.release_fmt)) {
+        fprintf(stderr, "Failed to generate release name. Format used: %s\n", ctx->rules.release_fmt);
+        return -1;
+    }
+
+    if (!ctx->info.build_name) {
+        delivery_format_str(ctx, &ctx->info.build_name, ctx->rules.build_name_fmt);
+    }
+    if (!ctx->info.build_number) {
+        delivery_format_str(ctx, &ctx->info.build_number, ctx->rules.build_number_fmt);
+    }
+
+    return 0;
+}
+
+static int populate_delivery_ini(struct Delivery *ctx) {
+    union INIVal val;
+    struct INIFILE *ini = ctx->_stasis_ini_fp.delivery;
+
+    // The [runtime] section was applied to the environment while bootstrapping
+    ctx->runtime.environ = runtime_copy(__environ);
+
     ini_getval_required(ini, "conda", "installer_name", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->conda.installer_name, val);
+    conv_str(ctx->arena, &ctx->conda.installer_name, val);
 
     ini_getval_required(ini, "conda", "installer_version", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->conda.installer_version, val);
+    conv_str(ctx->arena, &ctx->conda.installer_version, val);
 
     ini_getval_required(ini, "conda", "installer_platform", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->conda.installer_platform, val);
+    conv_str(ctx->arena, &ctx->conda.installer_platform, val);
 
     ini_getval_required(ini, "conda", "installer_arch", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->conda.installer_arch, val);
+    conv_str(ctx->arena, &ctx->conda.installer_arch, val);
 
     ini_getval_required(ini, "conda", "installer_baseurl", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->conda.installer_baseurl, val);
+    conv_str(ctx->arena, &ctx->conda.installer_baseurl, val);
 
     ini_getval(ini, "conda", "conda_packages", INIVAL_TYPE_STR_ARRAY, &val);
-    conv_strlist(&ctx->conda.conda_packages, LINE_SEP, val);
+    conv_strlist(ctx->arena, &ctx->conda.conda_packages, LINE_SEP, val);
 
     for (size_t i = 0; i < strlist_count(ctx->conda.conda_packages); i++) {
         char *pkg = strlist_item(ctx->conda.conda_packages, i);
@@ -540,7 +624,7 @@ static int populate_delivery_ini(struct Delivery *ctx) {
     }
 
     ini_getval(ini, "conda", "pip_packages", INIVAL_TYPE_STR_ARRAY, &val);
-    conv_strlist(&ctx->conda.pip_packages, LINE_SEP, val);
+    conv_strlist(ctx->arena, &ctx->conda.pip_packages, LINE_SEP, val);
 
     for (size_t i = 0; i < strlist_count(ctx->conda.pip_packages); i++) {
         char *pkg = strlist_item(ctx->conda.pip_packages, i);
@@ -549,27 +633,6 @@ static int populate_delivery_ini(struct Delivery *ctx) {
         }
     }
 
-    // Delivery metadata consumed
-    populate_mission_ini(&ctx);
-
-    if (ctx->info.release_name) {
-        guard_free(ctx->info.release_name);
-        guard_free(ctx->info.build_name);
-        guard_free(ctx->info.build_number);
-    }
-
-    if (delivery_format_str(ctx, &ctx->info.release_name, ctx->rules.release_fmt)) {
-        fprintf(stderr, "Failed to generate release name. Format used: %s\n", ctx->rules.release_fmt);
-        return -1;
-    }
-
-    if (!ctx->info.build_name) {
-        delivery_format_str(ctx, &ctx->info.build_name, ctx->rules.build_name_fmt);
-    }
-    if (!ctx->info.build_number) {
-        delivery_format_str(ctx, &ctx->info.build_number, ctx->rules.build_number_fmt);
-    }
-
     // Best I can do to make output directories unique. Annoying.
     delivery_init_dirs_stage2(ctx);
 
@@ -580,100 +643,97 @@ static int populate_delivery_ini(struct Delivery *ctx) {
         ctx->conda.pip_packages_defer = strlist_init();
     }
 
-    for (size_t z = 0, i = 0; i < ini->section_count; i++) {
-        if (startswith(ini->section[i]->key, "test:")) {
-            val.as_char_p = strchr(ini->section[i]->key, ':') + 1;
-            if (val.as_char_p && isempty(val.as_char_p)) {
-                return 1;
-            }
-            conv_str(&ctx->tests[z].name, val);
+    struct INIIterator iter;
+    struct INISection *section;
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "test:");
+    for (size_t z = 0; (section = ini_section_iter_next(&iter)) != NULL; z++) {
+        val.as_char_p = strchr(section->key, ':') + 1;
+        if (val.as_char_p && isempty(val.as_char_p)) {
+            return 1;
+        }
+        conv_str(ctx->arena, &ctx->tests[z].name, val);
 
-            ini_getval_required(ini, ini->section[i]->key, "version", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->tests[z].version, val);
+        ini_getval_required(ini, section->key, "version", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->tests[z].version, val);
 
-            ini_getval_required(ini, ini->section[i]->key, "repository", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->tests[z].repository, val);
+        ini_getval_required(ini, section->key, "repository", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->tests[z].repository, val);
 
-            ini_getval_required(ini, ini->section[i]->key, "script", INIVAL_TYPE_STR, &val);
-            conv_str_noexpand(&ctx->tests[z].script, val);
+        ini_getval_required(ini, section->key, "script", INIVAL_TYPE_STR, &val);
+        conv_str_noexpand(ctx->arena, &ctx->tests[z].script, val);
 
-            ini_getval(ini, ini->section[i]->key, "repository_remove_tags", INIVAL_TYPE_STR_ARRAY, &val);
-            conv_strlist(&ctx->tests[z].repository_remove_tags, LINE_SEP, val);
+        ini_getval(ini, section->key, "repository_remove_tags", INIVAL_TYPE_STR_ARRAY, &val);
+        conv_strlist(ctx->arena, &ctx->tests[z].repository_remove_tags, LINE_SEP, val);
 
-            ini_getval(ini, ini->section[i]->key, "build_recipe", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->tests[z].build_recipe, val);
+        ini_getval(ini, section->key, "build_recipe", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->tests[z].build_recipe, val);
 
-            ini_getval(ini, ini->section[i]->key, "runtime", INIVAL_TO_LIST, &val);
-            conv_strlist(&ctx->tests[z].runtime.environ, LINE_SEP, val);
-            z++;
-        }
+        ini_getval(ini, section->key, "runtime", INIVAL_TO_LIST, &val);
+        conv_strlist(ctx->arena, &ctx->tests[z].runtime.environ, LINE_SEP, val);
     }
 
-    for (size_t z = 0, i = 0; i < ini->section_count; i++) {
-        if (startswith(ini->section[i]->key, "deploy:artifactory")) {
-            // Artifactory base configuration
-            ini_getval(ini, ini->section[i]->key, "workaround_parent_only", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.workaround_parent_only, val);
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "deploy:artifactory");
+    for (size_t z = 0; (section = ini_section_iter_next(&iter)) != NULL; z++) {
+        // Artifactory base configuration
+        ini_getval(ini, section->key, "workaround_parent_only", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.workaround_parent_only, val);
 
-            ini_getval(ini, ini->section[i]->key, "exclusions", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.jfrog[z].upload_ctx.exclusions, val);
+        ini_getval(ini, section->key, "exclusions", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.jfrog[z].upload_ctx.exclusions, val);
 
-            ini_getval(ini, ini->section[i]->key, "explode", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.explode, val);
+        ini_getval(ini, section->key, "explode", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.explode, val);
 
-            ini_getval(ini, ini->section[i]->key, "recursive", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.recursive, val);
+        ini_getval(ini, section->key, "recursive", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.recursive, val);
 
-            ini_getval(ini, ini->section[i]->key, "retries", INIVAL_TYPE_INT, &val);
-            conv_int(&ctx->deploy.jfrog[z].upload_ctx.retries, val);
+        ini_getval(ini, section->key, "retries", INIVAL_TYPE_INT, &val);
+        conv_int(&ctx->deploy.jfrog[z].upload_ctx.retries, val);
 
-            ini_getval(ini, ini->section[i]->key, "retry_wait_time", INIVAL_TYPE_INT, &val);
-            conv_int(&ctx->deploy.jfrog[z].upload_ctx.retry_wait_time, val);
+        ini_getval(ini, section->key, "retry_wait_time", INIVAL_TYPE_INT, &val);
+        conv_int(&ctx->deploy.jfrog[z].upload_ctx.retry_wait_time, val);
 
-            ini_getval(ini, ini->section[i]->key, "detailed_summary", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.detailed_summary, val);
+        ini_getval(ini, section->key, "detailed_summary", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.detailed_summary, val);
 
-            ini_getval(ini, ini->section[i]->key, "quiet", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.quiet, val);
+        ini_getval(ini, section->key, "quiet", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.quiet, val);
 
-            ini_getval(ini, ini->section[i]->key, "regexp", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.regexp, val);
+        ini_getval(ini, section->key, "regexp", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.regexp, val);
 
-            ini_getval(ini, ini->section[i]->key, "spec", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.jfrog[z].upload_ctx.spec, val);
+        ini_getval(ini, section->key, "spec", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.jfrog[z].upload_ctx.spec, val);
 
-            ini_getval(ini, ini->section[i]->key, "flat", INIVAL_TYPE_BOOL, &val);
-            conv_bool(&ctx->deploy.jfrog[z].upload_ctx.flat, val);
+        ini_getval(ini, section->key, "flat", INIVAL_TYPE_BOOL, &val);
+        conv_bool(&ctx->deploy.jfrog[z].upload_ctx.flat, val);
 
-            ini_getval(ini, ini->section[i]->key, "repo", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.jfrog[z].repo, val);
+        ini_getval(ini, section->key, "repo", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.jfrog[z].repo, val);
 
-            ini_getval(ini, ini->section[i]->key, "dest", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.jfrog[z].dest, val);
+        ini_getval(ini, section->key, "dest", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.jfrog[z].dest, val);
 
-            ini_getval(ini, ini->section[i]->key, "files", INIVAL_TYPE_STR_ARRAY, &val);
-            conv_strlist(&ctx->deploy.jfrog[z].files, LINE_SEP, val);
-            z++;
-        }
+        ini_getval(ini, section->key, "files", INIVAL_TYPE_STR_ARRAY, &val);
+        conv_strlist(ctx->arena, &ctx->deploy.jfrog[z].files, LINE_SEP, val);
     }
 
-    for (size_t i = 0; i < ini->section_count; i++) {
-        if (startswith(ini->section[i]->key, "deploy:docker")) {
-            ini_getval(ini, ini->section[i]->key, "registry", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.docker.registry, val);
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "deploy:docker");
+    while ((section = ini_section_iter_next(&iter)) != NULL) {
+        ini_getval(ini, section->key, "registry", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.docker.registry, val);
 
-            ini_getval(ini, ini->section[i]->key, "image_compression", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.docker.image_compression, val);
+        ini_getval(ini, section->key, "image_compression", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.docker.image_compression, val);
 
-            ini_getval(ini, ini->section[i]->key, "test_script", INIVAL_TYPE_STR, &val);
-            conv_str(&ctx->deploy.docker.test_script, val);
+        ini_getval(ini, section->key, "test_script", INIVAL_TYPE_STR, &val);
+        conv_str(ctx->arena, &ctx->deploy.docker.test_script, val);
 
-            ini_getval(ini, ini->section[i]->key, "build_args", INIVAL_TYPE_STR_ARRAY, &val);
-            conv_strlist(&ctx->deploy.docker.build_args, LINE_SEP, val);
+        ini_getval(ini, section->key, "build_args", INIVAL_TYPE_STR_ARRAY, &val);
+        conv_strlist(ctx->arena, &ctx->deploy.docker.build_args, LINE_SEP, val);
 
-            ini_getval(ini, ini->section[i]->key, "tags", INIVAL_TYPE_STR_ARRAY, &val);
-            conv_strlist(&ctx->deploy.docker.tags, LINE_SEP, val);
-        }
+        ini_getval(ini, section->key, "tags", INIVAL_TYPE_STR_ARRAY, &val);
+        conv_strlist(ctx->arena, &ctx->deploy.docker.tags, LINE_SEP, val);
     }
     return 0;
 }
@@ -685,13 +745,13 @@ static int populate_delivery_cfg(struct Delivery *ctx) {
         return -1;
     }
     ini_getval(cfg, "default", "conda_staging_dir", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->storage.conda_staging_dir, val);
+    conv_str(ctx->arena, &ctx->storage.conda_staging_dir, val);
     ini_getval(cfg, "default", "conda_staging_url", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->storage.conda_staging_url, val);
+    conv_str(ctx->arena, &ctx->storage.conda_staging_url, val);
     ini_getval(cfg, "default", "wheel_staging_dir", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->storage.wheel_staging_dir, val);
+    conv_str(ctx->arena, &ctx->storage.wheel_staging_dir, val);
     ini_getval(cfg, "default", "wheel_staging_url", INIVAL_TYPE_STR, &val);
-    conv_str(&ctx->storage.wheel_staging_url, val);
+    conv_str(ctx->arena, &ctx->storage.wheel_staging_url, val);
     ini_getval(cfg, "default", "conda_fresh_start", INIVAL_TYPE_BOOL, &val);
     conv_bool(&globals.conda_fresh_start, val);
     // Below can also be toggled by command-line arguments
@@ -705,26 +765,26 @@ static int populate_delivery_cfg(struct Delivery *ctx) {
         conv_bool(&globals.always_update_base_environment, val);
     }
     ini_getval(cfg, "default", "conda_install_prefix", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.conda_install_prefix, val);
+    conv_str(NULL, &globals.conda_install_prefix, val);
     ini_getval(cfg, "default", "conda_packages", INIVAL_TYPE_STR_ARRAY, &val);
-    conv_strlist(&globals.conda_packages, LINE_SEP, val);
+    conv_strlist(NULL, &globals.conda_packages, LINE_SEP, val);
     ini_getval(cfg, "default", "pip_packages", INIVAL_TYPE_STR_ARRAY, &val);
-    conv_strlist(&globals.pip_packages, LINE_SEP, val);
+    conv_strlist(NULL, &globals.pip_packages, LINE_SEP, val);
     // Configure jfrog cli downloader
     ini_getval(cfg, "jfrog_cli_download", "url", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.jfrog_artifactory_base_url, val);
+    conv_str(NULL, &globals.jfrog.jfrog_artifactory_base_url, val);
     ini_getval(cfg, "jfrog_cli_download", "product", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.jfrog_artifactory_product, val);
+    conv_str(NULL, &globals.jfrog.jfrog_artifactory_product, val);
     ini_getval(cfg, "jfrog_cli_download", "version_series", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.cli_major_ver, val);
+    conv_str(NULL, &globals.jfrog.cli_major_ver, val);
     ini_getval(cfg, "jfrog_cli_download", "version", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.version, val);
+    conv_str(NULL, &globals.jfrog.version, val);
     ini_getval(cfg, "jfrog_cli_download", "filename", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.remote_filename, val);
+    conv_str(NULL, &globals.jfrog.remote_filename, val);
     ini_getval(cfg, "deploy:artifactory", "url", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.url, val);
+    conv_str(NULL, &globals.jfrog.url, val);
     ini_getval(cfg, "deploy:artifactory", "repo", INIVAL_TYPE_STR, &val);
-    conv_str(&globals.jfrog.repo, val);
+    conv_str(NULL, &globals.jfrog.repo, val);
     return 0;
 }
 
@@ -734,7 +794,7 @@ static int populate_info(struct Delivery *ctx) {
         time(&ctx->info.time_now);
         ctx->info.time_info = localtime(&ctx->info.time_now);
 
-        ctx->info.time_str_epoch = calloc(STASIS_TIME_STR_MAX, sizeof(*ctx->info.time_str_epoch));
+        ctx->info.time_str_epoch = arena_alloc(delivery_arena(ctx), STASIS_TIME_STR_MAX * sizeof(*ctx->info.time_str_epoch));
         if (!ctx->info.time_str_epoch) {
             msg(STASIS_MSG_ERROR, "Unable to allocate memory for Unix epoch string\n");
             return -1;
@@ -744,28 +804,31 @@ static int populate_info(struct Delivery *ctx) {
     return 0;
 }
 
-int *bootstrap_build_info(struct Delivery *ctx) {
-    struct Delivery local;
-    memset(&local, 0, sizeof(local));
-    local._stasis_ini_fp.cfg = ini_open(ctx->_stasis_ini_fp.cfg_path);
-    local._stasis_ini_fp.delivery = ini_open(ctx->_stasis_ini_fp.delivery_path);
-    delivery_init_platform(&local);
-    populate_delivery_cfg(&local);
-    populate_delivery_ini(&local);
-    populate_info(&local);
-    ctx->info.build_name = strdup(local.info.build_name);
-    ctx->info.build_number = strdup(local.info.build_number);
-    ctx->info.release_name = strdup(local.info.release_name);
-    memcpy(&ctx->info.time_info, &local.info.time_info, sizeof(ctx->info.time_info));
-    ctx->info.time_now = local.info.time_now;
-    ctx->info.time_str_epoch = strdup(local.info.time_str_epoch);
-    delivery_free(&local);
+int bootstrap_build_info(struct Delivery *ctx) {
+    // Configuration strings share the lifetime of the context
+    if (!delivery_arena(ctx)) {
+        return -1;
+    }
+
+    // Everything needed to name the build is derived from the INI handles already
+    // parsed by the caller. delivery_init() picks up where this leaves off.
+    if (populate_info(ctx)) {
+        return -1;
+    }
+    if (delivery_init_platform(ctx)) {
+        return -1;
+    }
+    populate_delivery_cfg(ctx);
+    if (populate_delivery_meta(ctx)) {
+        return -1;
+    }
     return 0;
 }
 
 int delivery_init(struct Delivery *ctx) {
-    populate_info(ctx);
-    populate_delivery_cfg(ctx);
+    if (!ctx->info.release_name && bootstrap_build_info(ctx)) {
+        return -1;
+    }
 
     // Set artifactory URL via environment variable if possible
     char *jfurl = getenv("STASIS_JF_ARTIFACTORY_URL");
@@ -785,9 +848,6 @@ int delivery_init(struct Delivery *ctx) {
         globals.jfrog.repo = strdup(jfrepo);
     }
 
-    // Configure architecture and platform information
-    delivery_init_platform(ctx);
-
     // Create STASIS directory structure
     delivery_init_dirs_stage1(ctx);
 
@@ -829,7 +889,7 @@ int delivery_format_str(struct Delivery *ctx, char **dest, const char *fmt) {
     size_t fmt_len = strlen(fmt);
 
     if (!*dest) {
-        *dest = calloc(STASIS_NAME_MAX, sizeof(**dest));
+        *dest = arena_alloc(delivery_arena(ctx), STASIS_NAME_MAX * sizeof(**dest));
         if (!*dest) {
             return -1;
         }
@@ -1023,11 +1083,17 @@ int delivery_build_recipes(struct Delivery *ctx) {
                     // For now, remove the sha256 requirement
                     file_replace_text("meta.yaml", "sha256:", "\n", flags);
                 } else {
-                    file_replace_text("meta.yaml", "{% set version = ", recipe_version, flags);
-                    file_replace_text("meta.yaml", "  url:", recipe_git_url, flags);
-                    //file_replace_text("meta.yaml", "sha256:", recipe_git_rev);
-                    file_replace_text("meta.yaml", "  sha256:", "\n", flags);
-                    file_replace_text("meta.yaml", "  number:", recipe_buildno, flags);
+                    struct ReplaceRule rules[] = {
+                        {.target = "{% set version = ", .replacement = recipe_version, .flags = flags},
+                        {.target = "  url:", .replacement = recipe_git_url, .flags = flags},
+                        //{.target = "sha256:", .replacement = recipe_git_rev},
+                        {.target = "  sha256:", .replacement = "\n", .flags = flags},
+                        {.target = "  number:", .replacement = recipe_buildno, .flags = flags},
+                        {NULL},
+                    };
+                    if (file_replace_text_rules("meta.yaml", rules) < 0) {
+                        return -1;
+                    }
                 }
 
                 char command[PATH_MAX];
@@ -1254,7 +1320,7 @@ int delivery_get_installer(struct Delivery *ctx, char *installer_url) {
         msg(STASIS_MSG_RESTRICT | STASIS_MSG_L3, "Skipped, installer already exists\n", script_path);
     }
 
-    ctx->conda.installer_path = strdup(script_path);
+    ctx->conda.installer_path = delivery_strdup(ctx, script_path);
     if (!ctx->conda.installer_path) {
         SYSERROR("Unable to duplicate script_path: '%s'", script_path);
         return -1;
@@ -1263,13 +1329,25 @@ int delivery_get_installer(struct Delivery *ctx, char *installer_url) {
     return 0;
 }
 
+/**
+ * Synchronize `src` with `dest`, printing any errors
+ * @return 0 on success, -1 on error
+ */
+static int delivery_sync(const char *src, const char *dest, unsigned op, char **exclude) {
+    struct CopyTreeReport report;
+    int status = sync_tree(src, dest, op, exclude, &report);
+    copytree_report_show(&report);
+    guard_strlist_free(&report.failed);
+    return status;
+}
+
 int delivery_copy_conda_artifacts(struct Delivery *ctx) {
-    char cmd[STASIS_BUFSIZ];
     char conda_build_dir[PATH_MAX];
     char subdir[PATH_MAX];
-    memset(cmd, 0, sizeof(cmd));
+    char dest[PATH_MAX];
     memset(conda_build_dir, 0, sizeof(conda_build_dir));
     memset(subdir, 0, sizeof(subdir));
+    memset(dest, 0, sizeof(dest));
 
     sprintf(conda_build_dir, "%s/%s", ctx->storage.conda_install_prefix, "conda-bld");
     // One must run conda build at least once to create the "conda-bld" directory.
@@ -1280,21 +1358,32 @@ int delivery_copy_conda_artifacts(struct Delivery *ctx) {
         return 0;
     }
 
-    snprintf(cmd, sizeof(cmd) - 1, "rsync -avi --progress %s/%s %s",
-             conda_build_dir,
-             ctx->system.platform[DELIVERY_PLATFORM_CONDA_SUBDIR],
-             ctx->storage.conda_artifact_dir);
-
-    return system(cmd);
+    snprintf(subdir, sizeof(subdir) - 1, "%s/%s/%s", ctx->storage.conda_install_prefix, "conda-bld", ctx->system.platform[DELIVERY_PLATFORM_CONDA_SUBDIR]);
+    snprintf(dest, sizeof(dest) - 1, "%s/%s", ctx->storage.conda_artifact_dir, ctx->system.platform[DELIVERY_PLATFORM_CONDA_SUBDIR]);
+    return delivery_sync(subdir, dest, CT_PERM, NULL);
 }
 
 int delivery_copy_wheel_artifacts(struct Delivery *ctx) {
-    char cmd[PATH_MAX];
-    memset(cmd, 0, sizeof(cmd));
-    snprintf(cmd, sizeof(cmd) - 1, "rsync -avi --progress %s/*/dist/*.whl %s",
-             ctx->storage.build_sources_dir,
-             ctx->storage.wheel_artifact_dir);
-    return system(cmd);
+    char pattern[PATH_MAX];
+    glob_t wheels;
+    int status = 0;
+
+    memset(pattern, 0, sizeof(pattern));
+    snprintf(pattern, sizeof(pattern) - 1, "%s/*/dist/*.whl", ctx->storage.build_sources_dir);
+    if (glob(pattern, 0, NULL, &wheels)) {
+        fprintf(stderr, "No wheels found: %s\n", pattern);
+        return -1;
+    }
+    for (size_t i = 0; i < wheels.gl_pathc; i++) {
+        char dest[PATH_MAX];
+        memset(dest, 0, sizeof(dest));
+        snprintf(dest, sizeof(dest) - 1, "%s/%s", ctx->storage.wheel_artifact_dir, path_basename(wheels.gl_pathv[i]));
+        if (delivery_sync(wheels.gl_pathv[i], dest, CT_PERM, NULL)) {
+            status = -1;
+        }
+    }
+    globfree(&wheels);
+    return status;
 }
 
 int delivery_index_wheel_artifacts(struct Delivery *ctx) {
@@ -1375,7 +1464,7 @@ void delivery_install_conda(char *install_script, char *conda_install_dir) {
     if (globals.conda_fresh_start) {
         if (!access(conda_install_dir, F_OK)) {
             // directory exists so remove it
-            if (rmtree(conda_install_dir)) {
+            if (rmtree_background(conda_install_dir)) {
                 perror("unable to remove previous installation");
                 exit(1);
             }
@@ -1622,28 +1711,41 @@ void delivery_rewrite_spec(struct Delivery *ctx, char *filename, unsigned stage)
         remove(tempfile);
         guard_free(tempfile);
     } else if (stage == DELIVERY_REWRITE_SPEC_STAGE_2) {
+        char pip_arguments[PATH_MAX];
+        struct ReplaceRule rules[3] = {0};
+        struct ReplaceRule *rule = rules;
+
         // Replace "local" channel with the staging URL
         if (ctx->storage.conda_staging_url) {
-            file_replace_text(filename, "@CONDA_CHANNEL@", ctx->storage.conda_staging_url, 0);
+            *rule++ = (struct ReplaceRule) {.target = "@CONDA_CHANNEL@", .replacement = ctx->storage.conda_staging_url};
         } else if (globals.jfrog.repo) {
             sprintf(output, "%s/%s/%s/%s/packages/conda", globals.jfrog.url, globals.jfrog.repo, ctx->meta.mission, ctx->info.build_name);
-            file_replace_text(filename, "@CONDA_CHANNEL@", output, 0);
+            *rule++ = (struct ReplaceRule) {.target = "@CONDA_CHANNEL@", .replacement = output};
         } else {
             msg(STASIS_MSG_WARN, "conda_staging_url is not configured\n", filename);
-            file_replace_text(filename, "  - @CONDA_CHANNEL@", "", 0);
+            *rule++ = (struct ReplaceRule) {.target = "  - @CONDA_CHANNEL@", .replacement = ""};
         }
 
         if (ctx->storage.wheel_staging_url) {
-            file_replace_text(filename, "@PIP_ARGUMENTS@", ctx->storage.wheel_staging_url, 0);
+            *rule++ = (struct ReplaceRule) {.target = "@PIP_ARGUMENTS@", .replacement = ctx->storage.wheel_staging_url};
         } else if (globals.jfrog.repo) {
-            sprintf(output, "--extra-index-url %s/%s/%s/%s/packages/wheels", globals.jfrog.url, globals.jfrog.repo, ctx->meta.mission, ctx->info.build_name);
-            file_replace_text(filename, "@PIP_ARGUMENTS@", output, 0);
+            sprintf(pip_arguments, "--extra-index-url %s/%s/%s/%s/packages/wheels", globals.jfrog.url, globals.jfrog.repo, ctx->meta.mission, ctx->info.build_name);
+            *rule++ = (struct ReplaceRule) {.target = "@PIP_ARGUMENTS@", .replacement = pip_arguments};
         }
+        file_replace_text_rules(filename, rules);
     }
 }
 
 int delivery_index_conda_artifacts(struct Delivery *ctx) {
-    return conda_index(ctx->storage.conda_artifact_dir);
+    struct ChannelIndexStats stats = {0};
+    int status = channel_index(ctx->storage.conda_artifact_dir, CHANNEL_INDEX_CACHE, &stats);
+
+    if (status && !stats.failed && stats.unsupported) {
+        // Only the .conda format could not be read by this build
+        msg(STASIS_MSG_L3 | STASIS_MSG_WARN, "%zu .conda packages require zstd support. Falling back to conda-index.\n", stats.unsupported);
+        return conda_index(ctx->storage.conda_artifact_dir);
+    }
+    return status;
 }
 
 void delivery_tests_run(struct Delivery *ctx) {
@@ -1670,14 +1772,14 @@ void delivery_tests_run(struct Delivery *ctx) {
 
             if (!access(destdir, F_OK)) {
                 msg(STASIS_MSG_L3, "Purging repository %s\n", destdir);
-                if (rmtree(destdir)) {
+                if (rmtree_background(destdir)) {
                     COE_CHECK_ABORT(1, "Unable to remove repository\n");
                 }
             }
             msg(STASIS_MSG_L3, "Cloning repository %s\n", ctx->tests[i].repository);
             if (!git_clone(&proc, ctx->tests[i].repository, destdir, ctx->tests[i].version)) {
-                ctx->tests[i].repository_info_tag = strdup(git_describe(destdir));
-                ctx->tests[i].repository_info_ref = strdup(git_rev_parse(destdir, "HEAD"));
+                ctx->tests[i].repository_info_tag = delivery_strdup(ctx, git_describe(destdir));
+                ctx->tests[i].repository_info_ref = delivery_strdup(ctx, git_rev_parse(destdir, "HEAD"));
             } else {
                 COE_CHECK_ABORT(1, "Unable to clone repository\n");
             }
@@ -1745,11 +1847,11 @@ void delivery_gather_tool_versions(struct Delivery *ctx) {
     int status = 0;
 
     // Extract version from tool output
-    ctx->conda.tool_version = shell_output("conda --version", &status);
+    ctx->conda.tool_version = delivery_strdup_owned(ctx, shell_output("conda --version", &status));
     if (ctx->conda.tool_version)
         strip(ctx->conda.tool_version);
 
-    ctx->conda.tool_build_version = shell_output("conda build --version", &status);
+    ctx->conda.tool_build_version = delivery_strdup_owned(ctx, shell_output("conda build --version", &status));
     if (ctx->conda.tool_build_version)
         strip(ctx->conda.tool_version);
 }
@@ -1815,7 +1917,7 @@ int delivery_artifact_upload(struct Delivery *ctx) {
             status++;
             break;
         } else if (!ctx->deploy.jfrog[i].repo) {
-            ctx->deploy.jfrog[i].repo = strdup(globals.jfrog.repo);
+            ctx->deploy.jfrog[i].repo = delivery_strdup(ctx, globals.jfrog.repo);
         }
 
         if (!ctx->deploy.jfrog[i].repo || isempty(ctx->deploy.jfrog[i].repo) || !strlen(ctx->deploy.jfrog[i].repo)) {
@@ -1856,86 +1958,112 @@ int delivery_artifact_upload(struct Delivery *ctx) {
     return status;
 }
 
+struct MissionTemplate {
+    char src[PATH_MAX];
+    char *dest;
+    const char *state_dir;
+    int status;
+    double elapsed;
+};
+
+static void delivery_mission_render_one(void *arg) {
+    struct MissionTemplate *item = arg;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    item->status = tpl_render_file_incremental(item->src, item->dest, item->state_dir);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    item->elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
 int delivery_mission_render_files(struct Delivery *ctx) {
     if (!ctx->storage.mission_dir) {
         fprintf(stderr, "Mission directory is not configured. Context not initialized?\n");
         return -1;
     }
-    struct Data {
-        char *src;
-        char *dest;
-    } data;
     struct INIFILE *cfg = ctx->_stasis_ini_fp.mission;
     union INIVal val;
+    struct MissionTemplate *items = NULL;
+    size_t items_count = 0;
+    size_t items_alloc = 0;
+    char state_dir[PATH_MAX] = {0};
+    int status = 0;
 
-    memset(&data, 0, sizeof(data));
-    data.src = calloc(PATH_MAX, sizeof(*data.src));
-    if (!data.src) {
-        perror("data.src");
-        return -1;
+    // Outputs are only rewritten when their template or values change
+    if (globals.cache_dir) {
+        snprintf(state_dir, sizeof(state_dir), "%s/templates", globals.cache_dir);
+        if (mkdirs(state_dir, 0755)) {
+            state_dir[0] = '\0';
+        }
     }
 
-    for (size_t i = 0; i < cfg->section_count; i++) {
-        char *section_name = cfg->section[i]->key;
-        if (!startswith(section_name, "template:")) {
-            continue;
-        }
+    // Resolve every source and destination up front. conv_str() renders
+    // templates itself, so this must happen before any worker starts.
+    struct INIIterator iter;
+    struct INISection *section;
+    ini_section_iter_init(&iter, cfg, INI_SEARCH_BEGINS, "template:");
+    while ((section = ini_section_iter_next(&iter)) != NULL) {
+        char *section_name = section->key;
         val.as_char_p = strchr(section_name, ':') + 1;
         if (val.as_char_p && isempty(val.as_char_p)) {
-            guard_free(data.src);
-            return 1;
+            status = 1;
+            goto l_delivery_mission_render_files_cleanup;
+        }
+        if (items_count == items_alloc) {
+            size_t new_alloc = items_alloc ? items_alloc * 2 : 8;
+            struct MissionTemplate *tmp = realloc(items, new_alloc * sizeof(*items));
+            if (!tmp) {
+                perror("mission templates");
+                status = -1;
+                goto l_delivery_mission_render_files_cleanup;
+            }
+            items = tmp;
+            items_alloc = new_alloc;
         }
-        sprintf(data.src, "%s/%s/%s", ctx->storage.mission_dir, ctx->meta.mission, val.as_char_p);
-        msg(STASIS_MSG_L2, "%s\n", data.src);
+        struct MissionTemplate *item = &items[items_count];
+        memset(item, 0, sizeof(*item));
+        snprintf(item->src, sizeof(item->src), "%s/%s/%s", ctx->storage.mission_dir, ctx->meta.mission, val.as_char_p);
+        item->state_dir = state_dir[0] ? state_dir : NULL;
 
         ini_getval_required(cfg, section_name, "destination", INIVAL_TYPE_STR, &val);
-        conv_str(&data.dest, val);
-
-        char *contents;
-        struct stat st;
-        if (lstat(data.src, &st)) {
-            perror(data.src);
-            guard_free(data.dest);
-            continue;
-        }
-
-        contents = calloc(st.st_size + 1, sizeof(*contents));
-        if (!contents) {
-            perror("template file contents");
-            guard_free(data.dest);
-            continue;
-        }
-
-        FILE *fp;
-        fp = fopen(data.src, "rb");
-        if (!fp) {
-            perror(data.src);
-            guard_free(contents);
-            guard_free(data.dest);
-            continue;
-        }
+        conv_str(NULL, &item->dest, val);
+        items_count++;
+    }
 
-        if (fread(contents, st.st_size, sizeof(*contents), fp) < 1) {
-            perror("while reading template file");
-            guard_free(contents);
-            guard_free(data.dest);
-            fclose(fp);
-            continue;
+    // Rendering only reads the template registry. Nothing may call
+    // tpl_register() until every worker has finished.
+    size_t nthreads = pool_default_size();
+    struct Pool *pool = NULL;
+    if (items_count > 1 && nthreads > 1) {
+        pool = pool_init(nthreads < items_count ? nthreads : items_count);
+    }
+    for (size_t i = 0; i < items_count; i++) {
+        if (!pool || pool_submit(pool, delivery_mission_render_one, &items[i])) {
+            delivery_mission_render_one(&items[i]);
         }
-        fclose(fp);
+    }
+    if (pool) {
+        pool_wait(pool);
+        pool_free(&pool);
+    }
 
-        msg(STASIS_MSG_L3, "Writing %s\n", data.dest);
-        if (tpl_render_to_file(contents, data.dest)) {
-            guard_free(contents);
-            guard_free(data.dest);
-            continue;
+    for (size_t i = 0; i < items_count; i++) {
+        msg(STASIS_MSG_L2, "%s\n", items[i].src);
+        if (items[i].status < 0) {
+            msg(STASIS_MSG_L3 | STASIS_MSG_WARN, "Unable to render %s\n", items[i].dest);
+        } else if (items[i].status == TPL_RENDER_UNCHANGED) {
+            msg(STASIS_MSG_L3, "Unchanged %s\n", items[i].dest);
+        } else {
+            msg(STASIS_MSG_L3, "Writing %s (%.3fs)\n", items[i].dest, items[i].elapsed);
         }
-        guard_free(contents);
-        guard_free(data.dest);
     }
 
-    guard_free(data.src);
-    return 0;
+    l_delivery_mission_render_files_cleanup:
+    for (size_t i = 0; i < items_count; i++) {
+        guard_free(items[i].dest);
+    }
+    guard_free(items);
+    return status;
 }
 
 int delivery_docker(struct Delivery *ctx) {
@@ -1999,7 +2127,7 @@ int delivery_docker(struct Delivery *ctx) {
     // Build the image
     char delivery_file[PATH_MAX];
     char dest[PATH_MAX];
-    char rsync_cmd[PATH_MAX * 2];
+    char packages_dest[PATH_MAX * 2];
     memset(delivery_file, 0, sizeof(delivery_file));
     memset(dest, 0, sizeof(dest));
 
@@ -2018,18 +2146,18 @@ int delivery_docker(struct Delivery *ctx) {
     memset(dest, 0, sizeof(dest));
     sprintf(dest, "%s/packages", ctx->storage.build_docker_dir);
 
-    msg(STASIS_MSG_L2, "Copying conda packages\n");
-    memset(rsync_cmd, 0, sizeof(rsync_cmd));
-    sprintf(rsync_cmd, "rsync -avi --progress '%s' '%s'", ctx->storage.conda_artifact_dir, dest);
-    if (system(rsync_cmd)) {
+    // Packages are hard linked into the build context when it is on the same
+    // file system as the artifacts. Packages that no longer exist are pruned.
+    msg(STASIS_MSG_L2, "Linking conda packages\n");
+    sprintf(packages_dest, "%s/%s", dest, path_basename(ctx->storage.conda_artifact_dir));
+    if (delivery_sync(ctx->storage.conda_artifact_dir, packages_dest, CT_PERM | CT_LINK | CT_DELETE, NULL)) {
         fprintf(stderr, "Failed to copy conda artifacts to docker build directory\n");
         return -1;
     }
 
-    msg(STASIS_MSG_L2, "Copying wheel packages\n");
-    memset(rsync_cmd, 0, sizeof(rsync_cmd));
-    sprintf(rsync_cmd, "rsync -avi --progress '%s' '%s'", ctx->storage.wheel_artifact_dir, dest);
-    if (system(rsync_cmd)) {
+    msg(STASIS_MSG_L2, "Linking wheel packages\n");
+    sprintf(packages_dest, "%s/%s", dest, path_basename(ctx->storage.wheel_artifact_dir));
+    if (delivery_sync(ctx->storage.wheel_artifact_dir, packages_dest, CT_PERM | CT_LINK | CT_DELETE, NULL)) {
         fprintf(stderr, "Failed to copy wheel artifactory to docker build directory\n");
     }
 
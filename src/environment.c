@@ -93,15 +93,9 @@ void runtime_export(RuntimeEnv *env, char **keys) {
     }
 
     for (size_t i = 0; i < strlist_count(env); i++) {
-        char **pair = split(strlist_item(env, i), "=", 0);
+        char **pair = split_compact(strlist_item(env, i), "=", 1);
         char *key = pair[0];
-        char *value = NULL;
-
-        // We split a potentially large string by "=" so:
-        // Recombine elements pair[1..N] into a single string by "="
-        if (pair[1] != NULL) {
-            value = join(&pair[1], "=");
-        }
+        char *value = pair[1];
 
         if (keys != NULL) {
             for (size_t j = 0; keys[j] != NULL; j++) {
@@ -116,8 +110,7 @@ void runtime_export(RuntimeEnv *env, char **keys) {
             sprintf(output, "%s %s=\"%s\"", export_command, key, value ? value : "");
             puts(output);
         }
-        guard_free(value);
-        GENERIC_ARRAY_FREE(pair);
+        guard_free(pair);
     }
 }
 
@@ -148,9 +141,7 @@ RuntimeEnv *runtime_copy(char **env) {
     for (env_count = 0; env[env_count] != NULL; env_count++);
 
     rt = strlist_init();
-    for (size_t i = 0; i < env_count; i++) {
-        strlist_append(&rt, env[i]);
-    }
+    strlist_append_n(rt, env, env_count);
     return rt;
 }
 
@@ -203,17 +194,18 @@ int runtime_replace(RuntimeEnv **dest, char **src) {
  */
 ssize_t runtime_contains(RuntimeEnv *env, const char *key) {
     ssize_t result = -1;
+    size_t key_len = strlen(key);
     for (ssize_t i = 0; i < (ssize_t) strlist_count(env); i++) {
-        char **pair = split(strlist_item(env, i), "=", 0);
-        if (pair == NULL) {
+        struct StrSplit it;
+        struct StrView name;
+        str_split_init(&it, strlist_item(env, i), "=");
+        if (!str_split_next(&it, &name)) {
             break;
         }
-        if (strcmp(pair[0], key) == 0) {
+        if (name.len == key_len && memcmp(name.ptr, key, key_len) == 0) {
             result = i;
-            GENERIC_ARRAY_FREE(pair);
             break;
         }
-        GENERIC_ARRAY_FREE(pair);
     }
     return result;
 }
@@ -244,9 +236,8 @@ char *runtime_get(RuntimeEnv *env, const char *key) {
     char *result = NULL;
     ssize_t key_offset = runtime_contains(env, key);
     if (key_offset != -1) {
-        char **pair = split(strlist_item(env, key_offset), "=", 0);
-        result = join(&pair[1], "=");
-        GENERIC_ARRAY_FREE(pair);
+        const char *value = strchr(strlist_item(env, key_offset), '=');
+        result = strdup(value ? value + 1 : "");
     }
     return result;
 }
@@ -425,9 +416,9 @@ void runtime_set(RuntimeEnv *env, const char *_key, char *_value) {
  */
 void runtime_apply(RuntimeEnv *env) {
     for (size_t i = 0; i < strlist_count(env); i++) {
-        char **pair = split(strlist_item(env, i), "=", 1);
+        char **pair = split_compact(strlist_item(env, i), "=", 1);
         setenv(pair[0], pair[1], 1);
-        GENERIC_ARRAY_FREE(pair);
+        guard_free(pair);
     }
 }
 
@@ -36,11 +36,13 @@ struct STASIS_GLOBAL globals = {
         .enable_docker = true,
         .enable_artifactory = true,
         .enable_testing = true,
+        .cpu_limit = 0,
 };
 
 void globals_free() {
     guard_free(globals.tmpdir);
     guard_free(globals.sysconfdir);
+    guard_free(globals.cache_dir);
     guard_free(globals.conda_install_prefix);
     guard_strlist_free(&globals.conda_packages);
     guard_strlist_free(&globals.pip_packages);
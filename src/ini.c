@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "core.h"
 #include "ini.h"
 
@@ -12,6 +15,18 @@ struct INIFILE *ini_init() {
     return ini;
 }
 
+// Strings loaded from a compiled cache live inside the mapped image and are never free()'d
+static int ini_is_mapped(const struct INIFILE *ini, const void *ptr) {
+    return ini->_mapping && (const char *) ptr >= ini->_mapping && (const char *) ptr < ini->_mapping + ini->_mapping_size;
+}
+
+static void ini_string_free(const struct INIFILE *ini, char **ptr) {
+    if (*ptr && !ini_is_mapped(ini, *ptr)) {
+        free(*ptr);
+    }
+    *ptr = NULL;
+}
+
 void ini_section_init(struct INIFILE **ini) {
     (*ini)->section = calloc((*ini)->section_count + 1, sizeof(**(*ini)->section));
 }
@@ -112,10 +127,113 @@ struct INIData *ini_getall(struct INIFILE *ini, char *section_name) {
     return result;
 }
 
+static int ini_section_match(const struct INISection *section, unsigned mode, const char *pattern) {
+    if (!section || !section->key) {
+        return 0;
+    }
+    if (!pattern) {
+        return 1;
+    }
+    switch (mode) {
+        case INI_SEARCH_EXACT:
+            return !strcmp(section->key, pattern);
+        case INI_SEARCH_BEGINS:
+            return !strncmp(section->key, pattern, strlen(pattern));
+        case INI_SEARCH_SUBSTR:
+            return strstr(section->key, pattern) != NULL;
+        default:
+            return 0;
+    }
+}
+
+void ini_section_iter_init(struct INIIterator *iter, struct INIFILE *ini, unsigned mode, const char *pattern) {
+    memset(iter, 0, sizeof(*iter));
+    iter->ini = ini;
+    iter->mode = mode;
+    iter->pattern = pattern;
+}
+
+struct INISection *ini_section_iter_next(struct INIIterator *iter) {
+    if (!iter->ini) {
+        return NULL;
+    }
+    while (iter->index < iter->ini->section_count) {
+        struct INISection *section = iter->ini->section[iter->index++];
+        if (ini_section_match(section, iter->mode, iter->pattern)) {
+            return section;
+        }
+    }
+    return NULL;
+}
+
+int ini_data_iter_init(struct INIIterator *iter, struct INIFILE *ini, const char *section_name) {
+    memset(iter, 0, sizeof(*iter));
+    if (!ini || !section_name) {
+        return -1;
+    }
+    iter->ini = ini;
+    iter->section = ini_section_search(&ini, INI_SEARCH_EXACT, section_name);
+    if (!iter->section) {
+        return -1;
+    }
+    return 0;
+}
+
+struct INIData *ini_data_iter_next(struct INIIterator *iter) {
+    if (!iter->section) {
+        return NULL;
+    }
+    while (iter->index < iter->section->data_count) {
+        struct INIData *data = iter->section->data[iter->index++];
+        if (data) {
+            return data;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Strip leading whitespace from every line of `value`, in place
+ *
+ * Each line follows the rules of lstrip(). Lines only get shorter, and the
+ * line separators are kept as they are, so the rewrite never grows the
+ * value and applying it again changes nothing.
+ *
+ * Values are normalized when they are stored, so `ini_getval` only reads.
+ */
+static void ini_value_lstrip_lines(char *value) {
+    char *out = value;
+    char *line = value;
+    for (;;) {
+        char *eol = strchr(line, '\n');
+        const size_t len = eol ? (size_t) (eol - line) : strlen(line);
+        struct StrView view = strview_n(line, len);
+        if (len > 1) {
+            // The final character is never removed
+            const struct StrView head = strview_lstrip(strview_n(line, len - 1));
+            view = strview_n(head.ptr, len - (head.ptr - line));
+        }
+        memmove(out, view.ptr, view.len);
+        out += view.len;
+        if (!eol) {
+            break;
+        }
+        *out++ = '\n';
+        line = eol + 1;
+    }
+    *out = '\0';
+}
+
+// Normalize the lines of `value` from the one containing offset `from` onward
+static void ini_value_normalize(char *value, size_t from) {
+    char *line = value + from;
+    while (line > value && line[-1] != '\n') {
+        line--;
+    }
+    ini_value_lstrip_lines(line);
+}
+
 int ini_getval(struct INIFILE *ini, char *section_name, char *key, int type, union INIVal *result) {
-    char *token = NULL;
-    char tbuf[STASIS_BUFSIZ];
-    char *tbufp = tbuf;
     struct INIData *data;
     data = ini_data_get(ini, section_name, key);
     if (!data) {
@@ -147,17 +265,17 @@ int ini_getval(struct INIFILE *ini, char *section_name, char *key, int type, uni
         case INIVAL_TYPE_FLOAT:
             result->as_float = (float) strtod(data->value, NULL);
             break;
-        case INIVAL_TYPE_STR:
-            result->as_char_p = lstrip(data->value);
+        case INIVAL_TYPE_STR: {
+            // Same rules as lstrip(), without modifying the stored value
+            const size_t len = strlen(data->value);
+            result->as_char_p = data->value;
+            if (len > 1) {
+                result->as_char_p = (char *) strview_lstrip(strview_n(data->value, len - 1)).ptr;
+            }
             break;
+        }
         case INIVAL_TYPE_STR_ARRAY:
-            strcpy(tbufp, data->value);
-            *data->value = '\0';
-            for (size_t i = 0; (token = strsep(&tbufp, "\n")) != NULL; i++) {
-                lstrip(token);
-                strcat(data->value, token);
-                strcat(data->value, "\n");
-            }
+            // Lines were stripped when the value was stored
             result->as_char_p = data->value;
             break;
         case INIVAL_TYPE_BOOL:
@@ -204,6 +322,7 @@ int ini_data_append(struct INIFILE **ini, char *section_name, char *key, char *v
             SYSERROR("Unable to allocate data value%s", "");
             return -1;
         }
+        ini_value_normalize(data[section->data_count]->value, 0);
         section->data_count++;
     } else {
         struct INIData *data = ini_data_get(*ini, section_name, key);
@@ -211,7 +330,14 @@ int ini_data_append(struct INIFILE **ini, char *section_name, char *key, char *v
         size_t value_len = strlen(value);
         size_t value_len_new = value_len_old + value_len;
         char *value_tmp = NULL;
-        value_tmp = realloc(data->value, value_len_new + 2);
+        if (ini_is_mapped(*ini, data->value)) {
+            value_tmp = malloc(value_len_new + 2);
+            if (value_tmp) {
+                strcpy(value_tmp, data->value);
+            }
+        } else {
+            value_tmp = realloc(data->value, value_len_new + 2);
+        }
         if (value_tmp != data->value) {
             data->value = value_tmp;
         } else if (!value_tmp) {
@@ -219,6 +345,7 @@ int ini_data_append(struct INIFILE **ini, char *section_name, char *key, char *v
             return -1;
         }
         strcat(data->value, value);
+        ini_value_normalize(data->value, value_len_old);
     }
     return 0;
 }
@@ -238,12 +365,13 @@ int ini_setval(struct INIFILE **ini, unsigned type, char *section_name, char *ke
         } else {
             struct INIData *data = ini_data_get(*ini, section_name, key);
             if (data) {
-                guard_free(data->value);
+                ini_string_free(*ini, &data->value);
                 data->value = strdup(value);
                 if (!data->value) {
                     // allocation failed
                     return -1;
                 }
+                ini_value_normalize(data->value, 0);
             } else {
                 // getting data failed
                 return -1;
@@ -336,19 +464,22 @@ void ini_free(struct INIFILE **ini) {
 #ifdef DEBUG
                 SYSERROR("freeing data key: %s", (*ini)->section[section]->data[data]->key);
 #endif
-                guard_free((*ini)->section[section]->data[data]->key);
+                ini_string_free(*ini, &(*ini)->section[section]->data[data]->key);
 #ifdef DEBUG
                 SYSERROR("freeing data value: %s", (*ini)->section[section]->data[data]->value);
 #endif
-                guard_free((*ini)->section[section]->data[data]->value);
+                ini_string_free(*ini, &(*ini)->section[section]->data[data]->value);
                 guard_free((*ini)->section[section]->data[data]);
             }
         }
         guard_free((*ini)->section[section]->data);
-        guard_free((*ini)->section[section]->key);
+        ini_string_free(*ini, &(*ini)->section[section]->key);
         guard_free((*ini)->section[section]);
     }
     guard_free((*ini)->section);
+    if ((*ini)->_mapping) {
+        munmap((*ini)->_mapping, (*ini)->_mapping_size);
+    }
     guard_free((*ini));
 }
 
@@ -400,7 +531,7 @@ struct INIFILE *ini_open(const char *filename) {
             memset(key, 0, sizeof(inikey[0]));
         }
         // Find pointer to first comment character
-        char *comment = strpbrk(line, ";#");
+        char *comment = (char *) bytes_find_set(line, strlen(line), ";#");
         if (comment) {
             if (!reading_value || line - comment == 0) {
                 // Remove comment from line (standalone and inline comments)
@@ -504,4 +635,833 @@ struct INIFILE *ini_open(const char *filename) {
     fclose(fp);
 
     return ini;
-}
\ No newline at end of file
+}
+
+/*
+ * Zero-copy INI parser
+ *
+ * The source file is mapped into memory and tokenized in a single pass. Tokens only
+ * record views (pointer, length) into the mapping. Strings are materialized once,
+ * at their final size, when the INIFILE structure is assembled.
+ */
+
+#define INI_TOKEN_SECTION 1
+#define INI_TOKEN_DATA 2
+
+struct INIView {
+    const char *ptr;
+    size_t len;
+};
+
+struct INIToken {
+    int type;
+    struct INIView key;
+    struct INIView value;
+};
+
+struct INITokens {
+    struct INIToken *item;
+    size_t count;
+    size_t alloc;
+    char **scratch;
+    size_t scratch_count;
+};
+
+static int ini_view_isspace(const char c) {
+    return isblank((unsigned char) c) || isspace((unsigned char) c);
+}
+
+// Same rules as lstrip(): at least one character is always left behind
+static struct INIView ini_view_lstrip(struct INIView v) {
+    while (v.len > 1 && ini_view_isspace(*v.ptr)) {
+        v.ptr++;
+        v.len--;
+    }
+    return v;
+}
+
+// Same rules as strip(): the first character is only removed when it is the only character
+static struct INIView ini_view_strip(struct INIView v) {
+    if (v.len == 1 && ini_view_isspace(*v.ptr)) {
+        v.len = 0;
+        return v;
+    }
+    while (v.len > 1 && ini_view_isspace(v.ptr[v.len - 1])) {
+        v.len--;
+    }
+    return v;
+}
+
+static int ini_view_isempty(struct INIView v) {
+    for (size_t i = 0; i < v.len; i++) {
+        const unsigned char c = v.ptr[i];
+        if (!isblank(c) && !isspace(c) && !iscntrl(c)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static struct INIView ini_view_unquote(struct INIView v) {
+    if (v.len && (*v.ptr == '\'' || *v.ptr == '"') && v.ptr[v.len - 1] == *v.ptr) {
+        if (v.len > 1) {
+            v.ptr++;
+            v.len -= 2;
+        } else {
+            v.len = 0;
+        }
+    }
+    return v;
+}
+
+static int ini_view_eq(struct INIView a, struct INIView b) {
+    return a.len == b.len && (a.ptr == b.ptr || !memcmp(a.ptr, b.ptr, a.len));
+}
+
+static int ini_tokens_push(struct INITokens *tokens, int type, struct INIView key, struct INIView value) {
+    if (tokens->count == tokens->alloc) {
+        size_t alloc = tokens->alloc ? tokens->alloc * 2 : 64;
+        struct INIToken *tmp = realloc(tokens->item, alloc * sizeof(*tokens->item));
+        if (!tmp) {
+            SYSERROR("Unable to allocate %zu INI tokens", alloc);
+            return -1;
+        }
+        tokens->item = tmp;
+        tokens->alloc = alloc;
+    }
+    tokens->item[tokens->count].type = type;
+    tokens->item[tokens->count].key = key;
+    tokens->item[tokens->count].value = value;
+    tokens->count++;
+    return 0;
+}
+
+static void ini_tokens_free(struct INITokens *tokens) {
+    for (size_t i = 0; i < tokens->scratch_count; i++) {
+        guard_free(tokens->scratch[i]);
+    }
+    guard_free(tokens->scratch);
+    guard_free(tokens->item);
+}
+
+// Lines containing an escaped comment character can't be represented as a single view.
+// The line is copied once with the escape character removed, and lives until the tokens are released.
+static int ini_view_unescape(struct INITokens *tokens, struct INIView *line, size_t escape) {
+    char **tmp = realloc(tokens->scratch, (tokens->scratch_count + 1) * sizeof(*tokens->scratch));
+    if (!tmp) {
+        return -1;
+    }
+    tokens->scratch = tmp;
+
+    char *copy = malloc(line->len);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, line->ptr, escape);
+    memcpy(copy + escape, line->ptr + escape + 1, line->len - escape - 1);
+    tokens->scratch[tokens->scratch_count++] = copy;
+
+    line->ptr = copy;
+    line->len--;
+    return 0;
+}
+
+static int ini_tokenize(const char *buf, size_t size, struct INITokens *tokens) {
+    const char *end = buf + size;
+    int reading_value = 0;
+    int multiline_data = 0;
+    int no_data = 0;
+    struct INIView key_last = {0};
+
+    for (size_t lineno = 1; buf < end; lineno++) {
+        struct INIView line = {buf, end - buf};
+        const char *eol = memchr(buf, '\n', line.len);
+        if (eol) {
+            // Keep the newline. Multi-line values retain it.
+            line.len = eol - buf + 1;
+        }
+        buf += line.len;
+
+        if (no_data && multiline_data) {
+            if (!ini_view_isempty(line)) {
+                no_data = 0;
+            } else {
+                multiline_data = 0;
+            }
+        }
+
+        // Find the first comment character
+        for (size_t i = 0; i < line.len; i++) {
+            if (line.ptr[i] != ';' && line.ptr[i] != '#') {
+                continue;
+            }
+            if (!reading_value || i == 0) {
+                if (i > 0 && line.ptr[i - 1] == '\\') {
+                    // Handle escaped comment characters. Remove the escape character '\'
+                    if (ini_view_unescape(tokens, &line, i - 1)) {
+                        SYSERROR("Unable to allocate line %zu", lineno);
+                        return -1;
+                    }
+                } else {
+                    // Remove comment from line (standalone and inline comments)
+                    line.len = i;
+                }
+            }
+            break;
+        }
+
+        // Test for section header: [string]
+        if (line.len && *line.ptr == '[') {
+            // The previous key is irrelevant now
+            key_last.len = 0;
+
+            const char *close = line.len > 1 ? memchr(line.ptr + 1, ']', line.len - 1) : NULL;
+            if (!close || close == line.ptr + 1) {
+                fprintf(stderr, "error: invalid section syntax, line %zu: '%.*s'\n", lineno, (int) line.len, line.ptr);
+                return -1;
+            }
+            struct INIView section_name = {line.ptr + 1, close - line.ptr - 1};
+
+            // Ignore default section because we already have an implicit one
+            if (section_name.len >= strlen("default") && !strncmp(section_name.ptr, "default", strlen("default"))) {
+                continue;
+            }
+            if (ini_tokens_push(tokens, INI_TOKEN_SECTION, ini_view_strip(section_name), (struct INIView) {0})) {
+                return -1;
+            }
+            continue;
+        }
+
+        // no data, skip
+        if (!reading_value && ini_view_isempty(line)) {
+            continue;
+        }
+
+        const char *operator = memchr(line.ptr, '=', line.len);
+
+        // a value continuation line
+        if (multiline_data && line.len && (*line.ptr == ' ' || *line.ptr == '\t')) {
+            operator = NULL;
+        }
+
+        struct INIView key;
+        struct INIView value;
+        if (operator) {
+            key.ptr = line.ptr;
+            key.len = operator - line.ptr;
+            key = ini_view_strip(ini_view_lstrip(key));
+            key_last = key;
+            reading_value = 1;
+            value.ptr = operator + 1;
+            value.len = line.len - (value.ptr - line.ptr);
+            if (ini_view_isempty(value)) {
+                multiline_data = 1;
+                no_data = 1;
+            } else {
+                multiline_data = 0;
+            }
+            value = ini_view_strip(value);
+        } else {
+            key = key_last;
+            value = line;
+        }
+
+        // Store key value pair in section's data array
+        if (key.len) {
+            value = ini_view_lstrip(ini_view_unquote(value));
+            if (!multiline_data) {
+                value = ini_view_strip(value);
+                reading_value = 0;
+            } else {
+                reading_value = 1;
+            }
+            if (ini_tokens_push(tokens, INI_TOKEN_DATA, key, value)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static char *ini_view_strdup(struct INIView v) {
+    char *result = malloc(v.len + 1);
+    if (result) {
+        memcpy(result, v.ptr, v.len);
+        result[v.len] = '\0';
+    }
+    return result;
+}
+
+static struct INISection *ini_section_find(struct INIFILE *ini, struct INIView name) {
+    for (size_t i = 0; i < ini->section_count; i++) {
+        const char *key = ini->section[i]->key;
+        if (strlen(key) == name.len && !strncmp(key, name.ptr, name.len)) {
+            return ini->section[i];
+        }
+    }
+    return NULL;
+}
+
+static int ini_materialize(struct INIFILE *ini, struct INITokens *tokens) {
+    size_t sections = 1;
+    for (size_t i = 0; i < tokens->count; i++) {
+        if (tokens->item[i].type == INI_TOKEN_SECTION) {
+            sections++;
+        }
+    }
+
+    ini->section = calloc(sections, sizeof(*ini->section));
+    if (!ini->section) {
+        SYSERROR("Unable to allocate %zu INI sections", sections);
+        return -1;
+    }
+
+    // Records are stored in the first section with a matching name (same as ini_open)
+    struct INISection *current = NULL;
+    size_t data_alloc = 0;
+    struct INIView section_default = {"default", strlen("default")};
+    for (size_t i = 0; i <= tokens->count; i++) {
+        struct INIView name = section_default;
+        if (i > 0) {
+            if (tokens->item[i - 1].type != INI_TOKEN_SECTION) {
+                continue;
+            }
+            name = tokens->item[i - 1].key;
+        }
+
+        // Sections are created in the order they appear, even when the name is reused
+        struct INISection *section = calloc(1, sizeof(*section));
+        if (!section) {
+            return -1;
+        }
+        ini->section[ini->section_count++] = section;
+        section->key = ini_view_strdup(name);
+        if (!section->key) {
+            return -1;
+        }
+        current = ini_section_find(ini, name);
+
+        // Upper bound of records destined for this section
+        data_alloc = 0;
+        for (size_t x = i; x < tokens->count && tokens->item[x].type == INI_TOKEN_DATA; x++) {
+            data_alloc++;
+        }
+        if (data_alloc) {
+            struct INIData **tmp = realloc(current->data, (current->data_count + data_alloc) * sizeof(*current->data));
+            if (!tmp) {
+                return -1;
+            }
+            current->data = tmp;
+        }
+
+        for (size_t x = i; x < tokens->count && tokens->item[x].type == INI_TOKEN_DATA;) {
+            const struct INIView key = tokens->item[x].key;
+
+            // Consecutive tokens for the same key form one value (multi-line data)
+            size_t value_len = 0;
+            size_t last = x;
+            for (; last < tokens->count && tokens->item[last].type == INI_TOKEN_DATA && ini_view_eq(tokens->item[last].key, key); last++) {
+                value_len += tokens->item[last].value.len;
+            }
+
+            struct INIData *data = NULL;
+            for (size_t d = 0; d < current->data_count; d++) {
+                if (strlen(current->data[d]->key) == key.len && !strncmp(current->data[d]->key, key.ptr, key.len)) {
+                    data = current->data[d];
+                    break;
+                }
+            }
+
+            size_t offset = 0;
+            if (!data) {
+                data = calloc(1, sizeof(*data));
+                if (!data) {
+                    return -1;
+                }
+                current->data[current->data_count++] = data;
+                data->key = ini_view_strdup(key);
+                if (!data->key) {
+                    return -1;
+                }
+            } else {
+                // Redefined keys are appended to the existing value (same as ini_data_append)
+                offset = strlen(data->value);
+            }
+
+            char *value = realloc(data->value, offset + value_len + 1);
+            if (!value) {
+                SYSERROR("Unable to allocate %zu bytes for data value", offset + value_len + 1);
+                return -1;
+            }
+            data->value = value;
+            const size_t value_start = offset;
+            for (; x < last; x++) {
+                memcpy(data->value + offset, tokens->item[x].value.ptr, tokens->item[x].value.len);
+                offset += tokens->item[x].value.len;
+            }
+            data->value[offset] = '\0';
+            ini_value_normalize(data->value, value_start);
+        }
+    }
+    return 0;
+}
+
+// Read an unmappable stream (pipes, character devices) into memory
+static char *ini_read_stream(int fd, size_t *size) {
+    size_t alloc = STASIS_BUFSIZ;
+    char *buf = malloc(alloc);
+    if (!buf) {
+        return NULL;
+    }
+    *size = 0;
+    ssize_t bytes;
+    while ((bytes = read(fd, buf + *size, alloc - *size)) > 0) {
+        *size += bytes;
+        if (*size == alloc) {
+            char *tmp = realloc(buf, alloc * 2);
+            if (!tmp) {
+                guard_free(buf);
+                return NULL;
+            }
+            buf = tmp;
+            alloc *= 2;
+        }
+    }
+    if (bytes < 0) {
+        guard_free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+struct INISource {
+    int fd;
+    struct stat st;
+    void *map;
+    char *heap;
+    const char *data;
+    size_t size;
+};
+
+static void ini_source_close(struct INISource *src) {
+    if (src->map != MAP_FAILED) {
+        munmap(src->map, src->size);
+        src->map = MAP_FAILED;
+    }
+    guard_free(src->heap);
+    if (src->fd >= 0) {
+        close(src->fd);
+        src->fd = -1;
+    }
+}
+
+static int ini_source_open(const char *filename, struct INISource *src) {
+    memset(src, 0, sizeof(*src));
+    src->map = MAP_FAILED;
+    src->fd = open(filename, O_RDONLY);
+    if (src->fd < 0) {
+        return -1;
+    }
+    if (fstat(src->fd, &src->st) < 0) {
+        ini_source_close(src);
+        return -1;
+    }
+
+    if (S_ISREG(src->st.st_mode)) {
+        src->size = src->st.st_size;
+        if (src->size) {
+            src->map = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE, src->fd, 0);
+            if (src->map == MAP_FAILED) {
+                ini_source_close(src);
+                return -1;
+            }
+            madvise(src->map, src->size, MADV_SEQUENTIAL);
+            src->data = src->map;
+        }
+    } else {
+        src->heap = ini_read_stream(src->fd, &src->size);
+        if (!src->heap) {
+            ini_source_close(src);
+            return -1;
+        }
+        src->data = src->heap;
+    }
+    return 0;
+}
+
+static struct INIFILE *ini_parse(const char *data, size_t size) {
+    struct INIFILE *ini = NULL;
+    struct INITokens tokens = {0};
+
+    if (ini_tokenize(data, size, &tokens)) {
+        ini_tokens_free(&tokens);
+        return NULL;
+    }
+
+    ini = ini_init();
+    if (!ini || ini_materialize(ini, &tokens)) {
+        if (ini) {
+            ini_free(&ini);
+        }
+    }
+    ini_tokens_free(&tokens);
+    return ini;
+}
+
+struct INIFILE *ini_open_mmap(const char *filename) {
+    struct INISource src;
+    if (ini_source_open(filename, &src)) {
+        return NULL;
+    }
+    struct INIFILE *ini = ini_parse(src.data, src.size);
+    ini_source_close(&src);
+    return ini;
+}
+
+/*
+ * Compiled configuration cache
+ *
+ * Layout (native byte order, all offsets are relative so the image can be mapped anywhere).
+ * The header's ABI tag rejects images written by a host with another byte
+ * order or record layout, e.g. through a shared cache directory:
+ *
+ *   struct INICacheHeader
+ *   struct INICacheSection[section_count]
+ *   struct INICacheData[data_count]
+ *   strings (NUL terminated)
+ *
+ * Values are copied from a parsed INIFILE, so they are already normalized
+ * (see ini_value_lstrip_lines) and the image is never written to.
+ */
+
+#define INI_CACHE_MAGIC "STASISIC"
+#define INI_CACHE_VERSION 3
+
+struct INICacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t abi;                   // see ini_cache_abi()
+    uint64_t source_size;
+    int64_t source_mtime;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+    uint64_t section_count;
+    uint64_t data_count;
+    uint64_t strings_size;
+};
+
+struct INICacheSection {
+    uint64_t key;
+    uint64_t data_first;
+    uint64_t data_count;
+};
+
+struct INICacheData {
+    uint64_t key;
+    uint64_t value;
+};
+
+static int ini_cache_path(const char *filename, const char *cache_dir, char *result, size_t maxlen) {
+    char path[PATH_MAX];
+    if (!realpath(filename, path)) {
+        return -1;
+    }
+    const uint64_t hash = hash_fnv1a(HASH_FNV1A_INIT, path, strlen(path));
+    if ((size_t) snprintf(result, maxlen, "%s/%016llx.ini-cache", cache_dir, (unsigned long long) hash) >= maxlen) {
+        return -1;
+    }
+    return 0;
+}
+
+static size_t ini_cache_string(char *strings, size_t *offset, const char *str) {
+    const size_t result = *offset;
+    const size_t len = strlen(str);
+    memcpy(strings + result, str, len + 1);
+    *offset += len + 1;
+    return result;
+}
+
+/**
+ * Describe the byte order and record sizes of a compiled image
+ *
+ * The top byte is a fixed marker, so the tag of an image written with the
+ * other byte order never matches.
+ */
+static uint32_t ini_cache_abi(void) {
+    return (uint32_t) 0xA5 << 24
+           | (uint32_t) (sizeof(struct INICacheHeader) & 0xff) << 16
+           | (uint32_t) (sizeof(struct INICacheSection) & 0xff) << 8
+           | (uint32_t) (sizeof(struct INICacheData) & 0xff);
+}
+
+/**
+ * Write a compiled image to `cachefile`
+ *
+ * The image is written to a temporary file that is renamed over
+ * `cachefile`, so readers never observe a partial image, and a mapped image
+ * stays intact.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int ini_cache_write(const char *cachefile, const struct INICacheHeader *header, const char *body, size_t body_size) {
+    char tempfile[PATH_MAX];
+    if ((size_t) snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX", cachefile) >= sizeof(tempfile)) {
+        return -1;
+    }
+    int fd = mkstemp(tempfile);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Other users sharing the cache directory may read it
+    int status = fchmod(fd, 0644) ? -1 : 0;
+    const struct {
+        const char *ptr;
+        size_t len;
+    } parts[] = {
+        {(const char *) header, sizeof(*header)},
+        {body, body_size},
+    };
+    for (size_t i = 0; !status && i < sizeof(parts) / sizeof(*parts); i++) {
+        size_t written = 0;
+        while (written < parts[i].len) {
+            ssize_t bytes = write(fd, parts[i].ptr + written, parts[i].len - written);
+            if (bytes < 0) {
+                status = -1;
+                break;
+            }
+            written += bytes;
+        }
+    }
+    if (close(fd) < 0) {
+        status = -1;
+    }
+    if (!status && rename(tempfile, cachefile)) {
+        status = -1;
+    }
+    if (status) {
+        remove(tempfile);
+    }
+    return status;
+}
+
+static int ini_cache_store(struct INIFILE *ini, const char *cachefile, const char *cache_dir, const struct INISource *src) {
+    struct INICacheHeader header = {0};
+    size_t strings_size = 0;
+    size_t data_count = 0;
+
+    for (size_t i = 0; i < ini->section_count; i++) {
+        strings_size += strlen(ini->section[i]->key) + 1;
+        for (size_t d = 0; d < ini->section[i]->data_count; d++) {
+            strings_size += strlen(ini->section[i]->data[d]->key) + 1;
+            strings_size += strlen(ini->section[i]->data[d]->value) + 1;
+        }
+        data_count += ini->section[i]->data_count;
+    }
+
+    memcpy(header.magic, INI_CACHE_MAGIC, sizeof(header.magic));
+    header.version = INI_CACHE_VERSION;
+    header.abi = ini_cache_abi();
+    header.source_size = src->size;
+    header.source_mtime = STAT_MTIM(src->st).tv_sec;
+    header.source_mtime_nsec = STAT_MTIM(src->st).tv_nsec;
+    header.source_hash = hash_fnv1a(HASH_FNV1A_INIT, src->data, src->size);
+    header.section_count = ini->section_count;
+    header.data_count = data_count;
+    header.strings_size = strings_size;
+
+    const size_t image_size = sizeof(header)
+                              + ini->section_count * sizeof(struct INICacheSection)
+                              + data_count * sizeof(struct INICacheData)
+                              + strings_size;
+    char *image = calloc(1, image_size);
+    if (!image) {
+        return -1;
+    }
+    memcpy(image, &header, sizeof(header));
+    struct INICacheSection *sections = (struct INICacheSection *) (image + sizeof(header));
+    struct INICacheData *records = (struct INICacheData *) (sections + ini->section_count);
+    char *strings = (char *) (records + data_count);
+
+    size_t offset = 0;
+    size_t record = 0;
+    for (size_t i = 0; i < ini->section_count; i++) {
+        struct INISection *section = ini->section[i];
+        sections[i].key = ini_cache_string(strings, &offset, section->key);
+        sections[i].data_first = record;
+        sections[i].data_count = section->data_count;
+        for (size_t d = 0; d < section->data_count; d++, record++) {
+            records[record].key = ini_cache_string(strings, &offset, section->data[d]->key);
+            records[record].value = ini_cache_string(strings, &offset, section->data[d]->value);
+        }
+    }
+
+    int status = -1;
+    if (!mkdirs(cache_dir, 0755)) {
+        status = ini_cache_write(cachefile, &header, image + sizeof(header), image_size - sizeof(header));
+    }
+    guard_free(image);
+    return status;
+}
+
+static int ini_cache_is_current(const struct INICacheHeader *header, const char *filename, const struct stat *st) {
+    if ((uint64_t) st->st_size != header->source_size) {
+        return 0;
+    }
+    if (STAT_MTIM(*st).tv_sec == header->source_mtime && STAT_MTIM(*st).tv_nsec == header->source_mtime_nsec) {
+        return 1;
+    }
+
+    // The file was touched. Compare the content.
+    struct INISource src;
+    if (ini_source_open(filename, &src)) {
+        return 0;
+    }
+    const int result = src.size == header->source_size
+                       && hash_fnv1a(HASH_FNV1A_INIT, src.data, src.size) == header->source_hash;
+    ini_source_close(&src);
+    return result;
+}
+
+static struct INIFILE *ini_cache_load(const char *cachefile, const char *filename, const struct stat *st) {
+    struct INIFILE *ini = NULL;
+    struct INICacheHeader *header;
+    struct stat cache_st;
+    char *image;
+
+    // Read-only access is enough, so caches on read-only mounts or owned by another user are used
+    int fd = open(cachefile, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &cache_st) || (size_t) cache_st.st_size < sizeof(*header)) {
+        close(fd);
+        return NULL;
+    }
+
+    // Private mapping: callers may modify values returned by ini_getval without touching the file
+    const size_t image_size = cache_st.st_size;
+    image = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    header = (struct INICacheHeader *) image;
+    if (memcmp(header->magic, INI_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != INI_CACHE_VERSION
+        || header->abi != ini_cache_abi()
+        || header->section_count > image_size / sizeof(struct INICacheSection)
+        || header->data_count > image_size / sizeof(struct INICacheData)
+        || image_size != sizeof(*header)
+                         + header->section_count * sizeof(struct INICacheSection)
+                         + header->data_count * sizeof(struct INICacheData)
+                         + header->strings_size
+        || !header->strings_size
+        || !ini_cache_is_current(header, filename, st)) {
+        goto ini_cache_load_failed;
+    }
+
+    if (header->source_mtime != STAT_MTIM(*st).tv_sec || header->source_mtime_nsec != STAT_MTIM(*st).tv_nsec) {
+        // Content is unchanged. Record the new timestamp to skip hashing next time.
+        // Not fatal: a cache that cannot be replaced is still used, and the content is hashed again.
+        struct INICacheHeader update = *header;
+        update.source_mtime = STAT_MTIM(*st).tv_sec;
+        update.source_mtime_nsec = STAT_MTIM(*st).tv_nsec;
+        ini_cache_write(cachefile, &update, image + sizeof(*header), image_size - sizeof(*header));
+    }
+
+    const struct INICacheSection *sections = (struct INICacheSection *) (image + sizeof(*header));
+    const struct INICacheData *records = (struct INICacheData *) (sections + header->section_count);
+    char *strings = (char *) (records + header->data_count);
+
+    // Every string must terminate inside the image
+    if (strings[header->strings_size - 1] != '\0') {
+        goto ini_cache_load_failed;
+    }
+
+    ini = ini_init();
+    if (!ini) {
+        goto ini_cache_load_failed;
+    }
+    ini->_mapping = image;
+    ini->_mapping_size = image_size;
+    ini->section = calloc(header->section_count + 1, sizeof(*ini->section));
+    if (!ini->section) {
+        goto ini_cache_load_failed;
+    }
+
+    for (size_t i = 0; i < header->section_count; i++) {
+        const struct INICacheSection *rec = &sections[i];
+        if (rec->key >= header->strings_size
+            || rec->data_first > header->data_count
+            || rec->data_count > header->data_count - rec->data_first) {
+            goto ini_cache_load_failed;
+        }
+
+        struct INISection *section = calloc(1, sizeof(*section));
+        if (!section) {
+            goto ini_cache_load_failed;
+        }
+        ini->section[ini->section_count++] = section;
+        section->key = strings + rec->key;
+        if (!rec->data_count) {
+            continue;
+        }
+
+        section->data = calloc(rec->data_count, sizeof(*section->data));
+        if (!section->data) {
+            goto ini_cache_load_failed;
+        }
+        for (size_t d = 0; d < rec->data_count; d++) {
+            const struct INICacheData *drec = &records[rec->data_first + d];
+            if (drec->key >= header->strings_size || drec->value >= header->strings_size) {
+                goto ini_cache_load_failed;
+            }
+            struct INIData *data = calloc(1, sizeof(*data));
+            if (!data) {
+                goto ini_cache_load_failed;
+            }
+            section->data[section->data_count++] = data;
+            data->key = strings + drec->key;
+            data->value = strings + drec->value;
+        }
+    }
+    return ini;
+
+    ini_cache_load_failed:
+    if (ini) {
+        // ini_free() releases the mapping
+        ini_free(&ini);
+    } else {
+        munmap(image, image_size);
+    }
+    return NULL;
+}
+
+struct INIFILE *ini_open_cached(const char *filename, const char *cache_dir) {
+    char cachefile[PATH_MAX];
+    struct stat st;
+
+    if (!cache_dir || stat(filename, &st) || !S_ISREG(st.st_mode)
+        || ini_cache_path(filename, cache_dir, cachefile, sizeof(cachefile))) {
+        return ini_open_mmap(filename);
+    }
+
+    struct INIFILE *ini = ini_cache_load(cachefile, filename, &st);
+    if (ini) {
+        return ini;
+    }
+
+    struct INISource src;
+    if (ini_source_open(filename, &src)) {
+        return NULL;
+    }
+    ini = ini_parse(src.data, src.size);
+    if (ini && ini_cache_store(ini, cachefile, cache_dir, &src) && globals.verbose) {
+        // Not fatal. The file will be parsed again next time.
+        SYSERROR("Unable to write configuration cache: %s", cachefile);
+    }
+    ini_source_close(&src);
+    return ini;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file pool.c
+ */
+#include <unistd.h>
+#include "core.h"
+#include "pool.h"
+
+size_t pool_default_size(void) {
+    long ncpu;
+    if (globals.cpu_limit > 0) {
+        return (size_t) globals.cpu_limit;
+    }
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpu > 0 ? (size_t) ncpu : 1;
+}
+
+static void *pool_worker(void *data) {
+    struct Pool *pool = data;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->head && !pool->shutdown) {
+            pthread_cond_wait(&pool->task_ready, &pool->lock);
+        }
+        if (!pool->head) {
+            // shutting down and nothing is left to do
+            break;
+        }
+        struct PoolTask *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task->func(task->arg);
+        guard_free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        if (!pool->pending) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct Pool *pool_init(size_t nthreads) {
+    struct Pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        SYSERROR("%s", "unable to allocate pool");
+        return NULL;
+    }
+    if (!nthreads) {
+        nthreads = pool_default_size();
+    }
+    pool->threads = calloc(nthreads, sizeof(*pool->threads));
+    if (!pool->threads) {
+        SYSERROR("unable to allocate %zu pool threads", nthreads);
+        guard_free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_ready, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (size_t i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool)) {
+            SYSERROR("unable to start pool thread %zu", i);
+            break;
+        }
+        pool->nthreads++;
+    }
+    if (!pool->nthreads) {
+        pool_free(&pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int pool_submit(struct Pool *pool, pool_task_func *func, void *arg) {
+    struct PoolTask *task = calloc(1, sizeof(*task));
+    if (!task) {
+        SYSERROR("%s", "unable to allocate pool task");
+        return -1;
+    }
+    task->func = func;
+    task->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pool->pending++;
+    pthread_cond_signal(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void pool_wait(struct Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(struct Pool **pool) {
+    if (!pool || !*pool) {
+        return;
+    }
+    pthread_mutex_lock(&(*pool)->lock);
+    (*pool)->shutdown = 1;
+    pthread_cond_broadcast(&(*pool)->task_ready);
+    pthread_mutex_unlock(&(*pool)->lock);
+
+    for (size_t i = 0; i < (*pool)->nthreads; i++) {
+        pthread_join((*pool)->threads[i], NULL);
+    }
+    pthread_cond_destroy(&(*pool)->idle);
+    pthread_cond_destroy(&(*pool)->task_ready);
+    pthread_mutex_destroy(&(*pool)->lock);
+    guard_free((*pool)->threads);
+    guard_free(*pool);
+}
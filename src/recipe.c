@@ -25,7 +25,7 @@ int recipe_clone(char *recipe_dir, char *url, char *gitref, char **result) {
                     recipe_dir, reponame, destdir);
             exit(1);
         }
-        if (rmtree(destdir)) {
+        if (rmtree_background(destdir)) {
             guard_free(*result);
             *result = NULL;
             return -1;
@@ -3,6 +3,9 @@
  */
 #include "relocation.h"
 #include "str.h"
+#include "bytesearch.h"
+#include "pool.h"
+#include <dirent.h>
 
 /**
  * Replace all occurrences of `target` with `replacement` in `original`
@@ -25,12 +28,13 @@
  */
 int replace_text(char *original, const char *target, const char *replacement, unsigned flags) {
     char buffer[STASIS_BUFSIZ];
-    char *pos = original;
-    char *match = NULL;
+    const char *pos = original;
+    const char *match = NULL;
     size_t original_len = strlen(original);
     size_t target_len = strlen(target);
     size_t rep_len = strlen(replacement);
     size_t buffer_len = 0;
+    const char *end = original + original_len;
 
     if (original_len > sizeof(buffer)) {
         errno = EINVAL;
@@ -38,58 +42,399 @@ int replace_text(char *original, const char *target, const char *replacement, un
         return -1;
     }
 
-    memset(buffer, 0, sizeof(buffer));
-    if ((match = strstr(pos, target))) {
-        while (*pos != '\0') {
-            // append to buffer the bytes leading up to the match
-            strncat(buffer, pos, match - pos);
-            // position in the string jump ahead to the beginning of the match
-            pos = match;
-
-            // replacement is shorter than the target
-            if (rep_len < target_len) {
-                // shrink the string
-                strcat(buffer, replacement);
-                memmove(pos, pos + target_len, strlen(pos) - target_len);
-                memset(pos + (strlen(pos) - target_len), 0, target_len);
-            } else { // replacement is longer than the target
-                // write the replacement value to the buffer
-                strcat(buffer, replacement);
-                // target consumed. jump to the end of the substring.
-                pos += target_len;
-            }
-            if (flags & REPLACE_TRUNCATE_AFTER_MATCH) {
-                if (strstr(pos, LINE_SEP)) {
-                    strcat(buffer, LINE_SEP);
+    if (!target_len || !(match = bytes_find_str(pos, original_len, target, target_len))) {
+        return 0;
+    }
+
+    while (match) {
+        size_t prefix_len = match - pos;
+        if (buffer_len + prefix_len + rep_len >= sizeof(buffer)) {
+            goto l_replace_text_overflow;
+        }
+        // append to buffer the bytes leading up to the match, followed by the replacement
+        memcpy(buffer + buffer_len, pos, prefix_len);
+        buffer_len += prefix_len;
+        memcpy(buffer + buffer_len, replacement, rep_len);
+        buffer_len += rep_len;
+        // target consumed. jump to the end of the substring.
+        pos = match + target_len;
+
+        if (flags & REPLACE_TRUNCATE_AFTER_MATCH) {
+            if (bytes_find_str(pos, end - pos, LINE_SEP, strlen(LINE_SEP))) {
+                if (buffer_len + strlen(LINE_SEP) >= sizeof(buffer)) {
+                    goto l_replace_text_overflow;
                 }
-                break;
-            }
-            // find more matches
-            if (!(match = strstr(pos, target))) {
-                // no more matches
-                // append whatever remains to the buffer
-                strcat(buffer, pos);
-                // stop
-                break;
+                memcpy(buffer + buffer_len, LINE_SEP, strlen(LINE_SEP));
+                buffer_len += strlen(LINE_SEP);
             }
+            pos = end;
+            break;
         }
-    } else {
-        return 0;
+        // find more matches
+        match = bytes_find_str(pos, end - pos, target, target_len);
+    }
+
+    // append whatever remains to the buffer
+    if (buffer_len + (end - pos) >= sizeof(buffer)) {
+        goto l_replace_text_overflow;
     }
+    memcpy(buffer + buffer_len, pos, end - pos);
+    buffer_len += end - pos;
 
-    buffer_len = strlen(buffer);
+    // replace original with contents of buffer
+    memcpy(original, buffer, buffer_len);
     if (buffer_len < original_len) {
         // truncate whatever remains of the original buffer
         memset(original + buffer_len, 0, original_len - buffer_len);
     }
-    // replace original with contents of buffer
-    strcpy(original, buffer);
+    original[buffer_len] = '\0';
+    return 0;
+
+    l_replace_text_overflow:
+    errno = ENOBUFS;
+    SYSERROR("Replacing '%s' with '%s' exceeds the buffer size: %zu\n", target, replacement, sizeof(buffer));
+    return -1;
+}
+
+/**
+ * Read-only view of a file
+ */
+struct RelocationSource {
+    char *data;
+    size_t len;
+    struct stat st;
+};
+
+static int relocation_source_open(struct RelocationSource *src, const char *filename) {
+    int fd;
+
+    memset(src, 0, sizeof(*src));
+    src->data = "";
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &src->st)) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(src->st.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    src->len = src->st.st_size;
+    if (src->len) {
+        src->data = mmap(NULL, src->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (src->data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+static void relocation_source_close(struct RelocationSource *src) {
+    if (src->len) {
+        munmap(src->data, src->len);
+    }
+    src->data = NULL;
+    src->len = 0;
+}
+
+#define RELOCATION_OUTPUT_BUFSIZ (64 * 1024)
+
+/**
+ * Buffered writer for a temporary file that replaces `filename` on commit
+ */
+struct RelocationOutput {
+    int fd;
+    char path[PATH_MAX];
+    size_t written;
+    size_t len;
+    char buf[RELOCATION_OUTPUT_BUFSIZ];
+};
+
+static int relocation_output_open(struct RelocationOutput *out, const char *filename, mode_t mode) {
+    out->fd = -1;
+    out->written = 0;
+    out->len = 0;
+    // Created beside the original so the final rename() does not cross file systems
+    if ((size_t) snprintf(out->path, sizeof(out->path), "%s.relocate.XXXXXX", filename) >= sizeof(out->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    out->fd = mkstemp(out->path);
+    if (out->fd < 0) {
+        return -1;
+    }
+    if (fchmod(out->fd, mode & 07777)) {
+        close(out->fd);
+        remove(out->path);
+        out->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int relocation_output_flush(struct RelocationOutput *out) {
+    const char *pos = out->buf;
+    while (out->len) {
+        ssize_t n = write(out->fd, pos, out->len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pos += n;
+        out->len -= n;
+    }
+    return 0;
+}
+
+static int relocation_output_write(struct RelocationOutput *out, const char *data, size_t len) {
+    out->written += len;
+    if (out->len + len > sizeof(out->buf)) {
+        if (relocation_output_flush(out)) {
+            return -1;
+        }
+        // Large spans bypass the buffer
+        if (len >= sizeof(out->buf)) {
+            while (len) {
+                ssize_t n = write(out->fd, data, len);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return -1;
+                }
+                data += n;
+                len -= n;
+            }
+            return 0;
+        }
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+static int relocation_output_fill(struct RelocationOutput *out, int ch, size_t count) {
+    char chunk[256];
+    memset(chunk, ch, sizeof(chunk));
+    while (count) {
+        size_t n = count < sizeof(chunk) ? count : sizeof(chunk);
+        if (relocation_output_write(out, chunk, n)) {
+            return -1;
+        }
+        count -= n;
+    }
+    return 0;
+}
+
+static void relocation_output_abort(struct RelocationOutput *out) {
+    if (out->fd >= 0) {
+        close(out->fd);
+        remove(out->path);
+        out->fd = -1;
+    }
+}
+
+static int relocation_output_commit(struct RelocationOutput *out, const char *filename) {
+    int status = relocation_output_flush(out);
+    if (close(out->fd)) {
+        status = -1;
+    }
+    out->fd = -1;
+    if (status || rename(out->path, filename)) {
+        remove(out->path);
+        return -1;
+    }
     return 0;
 }
 
+/**
+ * Determine whether data should be relocated as a binary file
+ *
+ * Like git and grep, data with a NUL byte in its first 8 KiB is binary.
+ *
+ * @param data bytes to check
+ * @param len length of `data`
+ * @return 1 if binary, 0 if text
+ */
+int relocation_is_binary(const char *data, size_t len) {
+    return bytes_find(data, len < 8192 ? len : 8192, '\0') != NULL;
+}
+
+/**
+ * Write `data` with every `target` replaced by `replacement`
+ * @return number of replacements, or -1 on error
+ */
+static ssize_t relocate_text(struct RelocationOutput *out, const char *data, size_t len,
+                             const char *target, size_t target_len, const char *replacement, size_t rep_len) {
+    const char *pos = data;
+    const char *end = data + len;
+    const char *match;
+    ssize_t count = 0;
+
+    while ((match = bytes_find_str(pos, end - pos, target, target_len))) {
+        if (relocation_output_write(out, pos, match - pos)
+            || relocation_output_write(out, replacement, rep_len)) {
+            return -1;
+        }
+        pos = match + target_len;
+        count++;
+    }
+    if (relocation_output_write(out, pos, end - pos)) {
+        return -1;
+    }
+    return count;
+}
+
+/**
+ * Write `data` with every `target` replaced by `replacement`, keeping string lengths
+ *
+ * This is the same method conda uses for binary files. Each NUL terminated
+ * string that contains the target has every occurrence replaced, and is
+ * padded with NUL bytes so that offsets inside the file do not change. A match
+ * that is not followed by a NUL byte is left alone.
+ *
+ * @return number of replacements, or -1 on error
+ */
+static ssize_t relocate_binary(struct RelocationOutput *out, const char *data, size_t len,
+                               const char *target, size_t target_len, const char *replacement, size_t rep_len) {
+    const char *pos = data;
+    const char *end = data + len;
+    const char *match;
+    ssize_t count = 0;
+
+    if (rep_len > target_len) {
+        errno = EINVAL;
+        return -1;
+    }
+    while ((match = bytes_find_str(pos, end - pos, target, target_len))) {
+        const char *terminator = bytes_find(match, end - match, '\0');
+        if (!terminator) {
+            break;
+        }
+        if (relocation_output_write(out, pos, match - pos)) {
+            return -1;
+        }
+        ssize_t replaced = relocate_text(out, match, terminator - match, target, target_len, replacement, rep_len);
+        if (replaced < 0 || relocation_output_fill(out, '\0', (size_t) replaced * (target_len - rep_len))) {
+            return -1;
+        }
+        count += replaced;
+        pos = terminator;
+    }
+    if (relocation_output_write(out, pos, end - pos)) {
+        return -1;
+    }
+    return count;
+}
+
+/**
+ * Replace every occurrence of `old_prefix` with `new_prefix` in a file
+ *
+ * The file is memory mapped and the result is written to a temporary file
+ * beside it, which replaces the original with rename(). Files without a
+ * match are not modified. Permissions are preserved.
+ *
+ * Binary files are relocated in place: each NUL terminated string containing
+ * `old_prefix` is padded with NUL bytes to its original length. `new_prefix`
+ * cannot be longer than `old_prefix` in that case.
+ *
+ * ~~~{.c}
+ * struct RelocationStats stats = {0};
+ * if (relocate_file("/opt/env/bin/python3", "/build/env", "/opt/env", RELOCATE_AUTO, &stats) < 0) {
+ *     perror("relocation failed");
+ * }
+ * ~~~
+ *
+ * @param filename path to file
+ * @param old_prefix string value to replace
+ * @param new_prefix replacement string value
+ * @param mode RELOCATE_AUTO, RELOCATE_TEXT, or RELOCATE_BINARY
+ * @param stats optional counters to update
+ * @return number of replacements, or -1 on error
+ */
+ssize_t relocate_file(const char *filename, const char *old_prefix, const char *new_prefix, int mode, struct RelocationStats *stats) {
+    struct RelocationSource src;
+    struct RelocationOutput *out = NULL;
+    const size_t old_len = strlen(old_prefix);
+    const size_t new_len = strlen(new_prefix);
+    ssize_t count;
+    char target[PATH_MAX];
+
+    if (!old_len) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Replace the file a symbolic link points to, not the link
+    if (!realpath(filename, target)) {
+        return -1;
+    }
+    if (relocation_source_open(&src, target)) {
+        return -1;
+    }
+    if (stats) {
+        stats->files_scanned++;
+        stats->bytes_scanned += src.len;
+    }
+    if (!bytes_find_str(src.data, src.len, old_prefix, old_len)) {
+        relocation_source_close(&src);
+        return 0;
+    }
+    if (mode == RELOCATE_AUTO) {
+        mode = relocation_is_binary(src.data, src.len) ? RELOCATE_BINARY : RELOCATE_TEXT;
+    }
+
+    out = malloc(sizeof(*out));
+    if (!out || relocation_output_open(out, target, src.st.st_mode)) {
+        guard_free(out);
+        relocation_source_close(&src);
+        return -1;
+    }
+    if (mode == RELOCATE_BINARY) {
+        count = relocate_binary(out, src.data, src.len, old_prefix, old_len, new_prefix, new_len);
+    } else {
+        count = relocate_text(out, src.data, src.len, old_prefix, old_len, new_prefix, new_len);
+    }
+    relocation_source_close(&src);
+
+    if (count < 0) {
+        int err = errno;
+        relocation_output_abort(out);
+        guard_free(out);
+        errno = err;
+        return -1;
+    }
+    if (!count) {
+        // Binary matches that are not NUL terminated are left alone
+        relocation_output_abort(out);
+    } else if (relocation_output_commit(out, target)) {
+        guard_free(out);
+        return -1;
+    } else if (stats) {
+        stats->files_rewritten++;
+        stats->replacements += count;
+        stats->bytes_written += out->written;
+        if (mode == RELOCATE_BINARY) {
+            stats->files_binary++;
+        }
+    }
+    guard_free(out);
+    return count;
+}
+
 /**
  * Replace `target` with `replacement` in `filename`
  *
+ * Each line containing `target` is processed with the same rules as
+ * `replace_text`. Files without a match are not modified.
+ *
  * ~~~{.c}
  * if (file_replace_text("/path/to/file.txt", "are", "is")) {
  *     fprintf(stderr, "failed to replace strings in file\n");
@@ -103,41 +448,563 @@ int replace_text(char *original, const char *target, const char *replacement, un
  * @return 0 on success, -1 on error
  */
 int file_replace_text(const char* filename, const char* target, const char* replacement, unsigned flags) {
-    int result;
-    char buffer[STASIS_BUFSIZ];
-    char tempfilename[] = "tempfileXXXXXX";
-    FILE *fp;
-    FILE *tfp;
+    struct RelocationSource src;
+    struct RelocationOutput *out = NULL;
+    const size_t target_len = strlen(target);
+    const size_t rep_len = strlen(replacement);
+    const size_t sep_len = strlen(LINE_SEP);
+    const char *pos;
+    const char *end;
+    const char *match;
 
-    fp = fopen(filename, "r");
-    if (!fp) {
+    if (relocation_source_open(&src, filename)) {
         fprintf(stderr, "unable to open for reading: %s\n", filename);
         return -1;
     }
+    pos = src.data;
+    end = src.data + src.len;
+    if (!target_len || !(match = bytes_find_str(pos, end - pos, target, target_len))) {
+        relocation_source_close(&src);
+        return 0;
+    }
 
-    tfp = fopen(tempfilename, "w");
-    if (!tfp) {
-        SYSERROR("unable to open temporary fp for writing: %s", tempfilename);
-        fclose(fp);
+    out = malloc(sizeof(*out));
+    if (!out || relocation_output_open(out, filename, src.st.st_mode)) {
+        SYSERROR("unable to open temporary file for writing: %s", filename);
+        guard_free(out);
+        relocation_source_close(&src);
         return -1;
     }
 
-    // Write modified strings to temporary file
-    result = 0;
-    while (fgets(buffer, sizeof(buffer), fp)) {
-        if (strstr(buffer, target)) {
-            if (replace_text(buffer, target, replacement, flags)) {
-                result = -1;
+    // Lines before the first match are copied as-is
+    while (match) {
+        const char *line = match;
+        while (line > pos && line[-1] != '\n') {
+            line--;
+        }
+        const char *line_end = bytes_find(match, end - match, '\n');
+        line_end = line_end ? line_end + 1 : end;
+
+        if (relocation_output_write(out, pos, line - pos)) {
+            goto l_file_replace_text_error;
+        }
+        if (flags & REPLACE_TRUNCATE_AFTER_MATCH) {
+            // Keep text up to the first match, then the replacement, then the line separator
+            const char *rest = match + target_len;
+            if (relocation_output_write(out, line, match - line)
+                || relocation_output_write(out, replacement, rep_len)
+                || (bytes_find_str(rest, line_end - rest, LINE_SEP, sep_len)
+                    && relocation_output_write(out, LINE_SEP, sep_len))) {
+                goto l_file_replace_text_error;
             }
+        } else if (relocate_text(out, line, line_end - line, target, target_len, replacement, rep_len) < 0) {
+            goto l_file_replace_text_error;
+        }
+        pos = line_end;
+        match = bytes_find_str(pos, end - pos, target, target_len);
+    }
+    if (relocation_output_write(out, pos, end - pos)) {
+        goto l_file_replace_text_error;
+    }
+    relocation_source_close(&src);
+    if (relocation_output_commit(out, filename)) {
+        SYSERROR("unable to replace %s", filename);
+        guard_free(out);
+        return -1;
+    }
+    guard_free(out);
+    return 0;
+
+    l_file_replace_text_error:
+    SYSERROR("unable to write temporary file: %s", out->path);
+    relocation_output_abort(out);
+    guard_free(out);
+    relocation_source_close(&src);
+    return -1;
+}
+
+#define REPLACE_MATCHER_ALPHABET 256
+
+/**
+ * Aho-Corasick automaton for a set of `ReplaceRule` targets
+ */
+struct ReplaceMatcher {
+    const struct ReplaceRule *rules;
+    size_t *target_len;
+    size_t *rep_len;
+    int *delta;     //!< State transitions, REPLACE_MATCHER_ALPHABET per state
+    int *rule;      //!< Rule with the longest target ending in each state, or -1
+    char first[REPLACE_MATCHER_ALPHABET];  //!< NUL terminated set of the targets' first bytes
+};
+
+static void replace_matcher_free(struct ReplaceMatcher *m) {
+    guard_free(m->target_len);
+    guard_free(m->rep_len);
+    guard_free(m->delta);
+    guard_free(m->rule);
+}
+
+static int replace_matcher_init(struct ReplaceMatcher *m, const struct ReplaceRule *rules) {
+    size_t rules_count = 0;
+    size_t max_states = 1;
+    size_t states = 1;
+    int *fail = NULL;
+    int *queue = NULL;
+    size_t first_len = 0;
+
+    memset(m, 0, sizeof(*m));
+    m->rules = rules;
+    for (rules_count = 0; rules[rules_count].target; rules_count++) {
+        max_states += strlen(rules[rules_count].target);
+    }
+    m->target_len = calloc(rules_count + 1, sizeof(*m->target_len));
+    m->rep_len = calloc(rules_count + 1, sizeof(*m->rep_len));
+    m->delta = calloc(max_states * REPLACE_MATCHER_ALPHABET, sizeof(*m->delta));
+    m->rule = malloc(max_states * sizeof(*m->rule));
+    fail = calloc(max_states, sizeof(*fail));
+    queue = calloc(max_states, sizeof(*queue));
+    if (!m->target_len || !m->rep_len || !m->delta || !m->rule || !fail || !queue) {
+        goto l_replace_matcher_init_error;
+    }
+    for (size_t i = 0; i < max_states; i++) {
+        m->rule[i] = -1;
+    }
+
+    // Build the trie. State 0 is the root, so a zero transition means "no child" until the links are computed.
+    for (size_t i = 0; i < rules_count; i++) {
+        const unsigned char *target = (const unsigned char *) rules[i].target;
+        int state = 0;
+        m->target_len[i] = strlen(rules[i].target);
+        m->rep_len[i] = strlen(rules[i].replacement ? rules[i].replacement : "");
+        if (!m->target_len[i]) {
+            continue;
+        }
+        if (!memchr(m->first, target[0], first_len)) {
+            m->first[first_len++] = (char) target[0];
+        }
+        for (size_t c = 0; c < m->target_len[i]; c++) {
+            int *next = &m->delta[state * REPLACE_MATCHER_ALPHABET + target[c]];
+            if (!*next) {
+                *next = (int) states++;
+            }
+            state = *next;
+        }
+        // Duplicate targets: the first rule wins
+        if (m->rule[state] < 0) {
+            m->rule[state] = (int) i;
         }
-        fputs(buffer, tfp);
     }
 
-    fclose(fp);
-    fclose(tfp);
+    // Compute failure links breadth first and fold them into the transition table
+    size_t head = 0;
+    size_t tail = 0;
+    for (int c = 0; c < REPLACE_MATCHER_ALPHABET; c++) {
+        if (m->delta[c]) {
+            queue[tail++] = m->delta[c];
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        int *row = &m->delta[state * REPLACE_MATCHER_ALPHABET];
+        const int *fail_row = &m->delta[fail[state] * REPLACE_MATCHER_ALPHABET];
+        if (m->rule[state] < 0) {
+            m->rule[state] = m->rule[fail[state]];
+        }
+        for (int c = 0; c < REPLACE_MATCHER_ALPHABET; c++) {
+            if (row[c]) {
+                fail[row[c]] = fail_row[c];
+                queue[tail++] = row[c];
+            } else {
+                row[c] = fail_row[c];
+            }
+        }
+    }
+    guard_free(fail);
+    guard_free(queue);
+    return 0;
+
+    l_replace_matcher_init_error:
+    guard_free(fail);
+    guard_free(queue);
+    replace_matcher_free(m);
+    return -1;
+}
 
-    // Replace original with modified copy
-    remove(filename);
-    rename(tempfilename, filename);
-    return result;
-}
\ No newline at end of file
+/**
+ * Write `data` with every rule applied in a single pass
+ * @return number of replacements, or -1 on error
+ */
+static ssize_t replace_matcher_apply(struct ReplaceMatcher *m, struct RelocationOutput *out, const char *data, size_t len) {
+    const size_t sep_len = strlen(LINE_SEP);
+    const char *pos = data;
+    const char *end = data + len;
+    const char *p = data;
+    ssize_t count = 0;
+    int state = 0;
+
+    while (p < end) {
+        if (!state) {
+            // Skip ahead to the next byte that can start a match
+            p = bytes_find_set(p, end - p, m->first);
+            if (!p) {
+                break;
+            }
+        }
+        state = m->delta[state * REPLACE_MATCHER_ALPHABET + (unsigned char) *p++];
+        int r = m->rule[state];
+        if (r < 0) {
+            continue;
+        }
+
+        const struct ReplaceRule *rule = &m->rules[r];
+        const char *match = p - m->target_len[r];
+        if (relocation_output_write(out, pos, match - pos)
+            || relocation_output_write(out, rule->replacement ? rule->replacement : "", m->rep_len[r])) {
+            return -1;
+        }
+        pos = p;
+        if (rule->flags & REPLACE_TRUNCATE_AFTER_MATCH) {
+            // Discard the rest of the line, but keep its line separator
+            const char *line_end = bytes_find(p, end - p, '\n');
+            line_end = line_end ? line_end + 1 : end;
+            if (bytes_find_str(p, line_end - p, LINE_SEP, sep_len)
+                && relocation_output_write(out, LINE_SEP, sep_len)) {
+                return -1;
+            }
+            pos = p = line_end;
+        }
+        state = 0;
+        count++;
+    }
+    if (relocation_output_write(out, pos, end - pos)) {
+        return -1;
+    }
+    return count;
+}
+
+/**
+ * Apply a set of replacement rules to `filename` in a single pass
+ *
+ * The file is read and rewritten once. This is not equivalent to calling
+ * `file_replace_text` once per rule:
+ *
+ * - Replacement text is never scanned again, so one rule cannot match the
+ *   output of another.
+ * - The input is scanned from left to right, and the first target to end
+ *   wins. When several targets end at the same byte the longest one is used.
+ *   Rule order only matters for duplicate targets, where the first rule wins.
+ * - Scanning resumes after the replaced text, so targets overlapping a match
+ *   are not replaced.
+ * - Empty targets are ignored.
+ *
+ * ~~~{.c}
+ * struct ReplaceRule rules[] = {
+ *     {.target = "  url:", .replacement = "  url: https://example.com/archive.tar.gz", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+ *     {.target = "@VERSION@", .replacement = "1.0.0"},
+ *     {NULL},
+ * };
+ * if (file_replace_text_rules("meta.yaml", rules) < 0) {
+ *     fprintf(stderr, "failed to replace strings in file\n");
+ *     exit(1);
+ * }
+ * ~~~
+ *
+ * @param filename path to file
+ * @param rules array of rules terminated by a rule with a NULL target
+ * @return number of replacements, or -1 on error
+ */
+ssize_t file_replace_text_rules(const char *filename, const struct ReplaceRule *rules) {
+    struct RelocationSource src;
+    struct RelocationOutput *out = NULL;
+    struct ReplaceMatcher matcher;
+    ssize_t count;
+
+    if (replace_matcher_init(&matcher, rules)) {
+        SYSERROR("unable to allocate replacement rules for %s", filename);
+        return -1;
+    }
+    if (relocation_source_open(&src, filename)) {
+        fprintf(stderr, "unable to open for reading: %s\n", filename);
+        replace_matcher_free(&matcher);
+        return -1;
+    }
+
+    out = malloc(sizeof(*out));
+    if (!out || relocation_output_open(out, filename, src.st.st_mode)) {
+        SYSERROR("unable to open temporary file for writing: %s", filename);
+        guard_free(out);
+        relocation_source_close(&src);
+        replace_matcher_free(&matcher);
+        return -1;
+    }
+    count = replace_matcher_apply(&matcher, out, src.data, src.len);
+    relocation_source_close(&src);
+    replace_matcher_free(&matcher);
+
+    if (count < 0) {
+        SYSERROR("unable to write temporary file: %s", out->path);
+        relocation_output_abort(out);
+    } else if (!count) {
+        // Nothing changed
+        relocation_output_abort(out);
+    } else if (relocation_output_commit(out, filename)) {
+        SYSERROR("unable to replace %s", filename);
+        count = -1;
+    }
+    guard_free(out);
+    return count;
+}
+
+#define RELOCATE_TREE_BATCH 64
+
+/**
+ * State shared by the workers of `relocate_tree`
+ */
+struct RelocationTree {
+    struct Pool *pool;
+    const char *old_prefix;
+    const char *new_prefix;
+    int mode;
+    pthread_mutex_t lock;           //!< Protects every member below
+    struct RelocationStats stats;
+    ssize_t replacements;
+};
+
+/**
+ * A directory to list, or a batch of files to relocate
+ */
+struct RelocationTreeTask {
+    struct RelocationTree *tree;
+    char *path;         //!< Directory to list
+    char **files;       //!< Files to relocate (NULL terminated)
+};
+
+static void relocate_tree_task(void *arg);
+
+static void relocation_stats_add(struct RelocationStats *dest, const struct RelocationStats *src) {
+    dest->files_scanned += src->files_scanned;
+    dest->files_rewritten += src->files_rewritten;
+    dest->files_binary += src->files_binary;
+    dest->replacements += src->replacements;
+    dest->bytes_scanned += src->bytes_scanned;
+    dest->bytes_written += src->bytes_written;
+    dest->files_failed += src->files_failed;
+}
+
+static void relocate_tree_merge(struct RelocationTree *tree, const struct RelocationStats *stats, ssize_t replacements) {
+    pthread_mutex_lock(&tree->lock);
+    relocation_stats_add(&tree->stats, stats);
+    tree->replacements += replacements;
+    pthread_mutex_unlock(&tree->lock);
+}
+
+static void relocate_tree_failed(struct RelocationTree *tree, const char *path) {
+    struct RelocationStats failed = {.files_failed = 1};
+    fprintf(stderr, "unable to relocate %s: %s\n", path, strerror(errno));
+    relocate_tree_merge(tree, &failed, 0);
+}
+
+static int relocate_tree_submit(struct RelocationTree *tree, char *path, char **files) {
+    struct RelocationTreeTask *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return -1;
+    }
+    task->tree = tree;
+    task->path = path;
+    task->files = files;
+    if (pool_submit(tree->pool, relocate_tree_task, task)) {
+        guard_free(task);
+        return -1;
+    }
+    return 0;
+}
+
+static void relocate_tree_files(struct RelocationTree *tree, char **files) {
+    struct RelocationStats stats = {0};
+    ssize_t replacements = 0;
+
+    for (size_t i = 0; files[i]; i++) {
+        ssize_t count = relocate_file(files[i], tree->old_prefix, tree->new_prefix, tree->mode, &stats);
+        if (count < 0) {
+            relocate_tree_failed(tree, files[i]);
+        } else {
+            replacements += count;
+        }
+        guard_free(files[i]);
+    }
+    relocate_tree_merge(tree, &stats, replacements);
+}
+
+static void relocate_tree_dir(struct RelocationTree *tree, const char *path) {
+    struct dirent *rec;
+    char **files = NULL;
+    size_t files_count = 0;
+    DIR *dir = opendir(path);
+
+    if (!dir) {
+        relocate_tree_failed(tree, path);
+        return;
+    }
+    // The directory is listed completely before any file is replaced, so
+    // readdir() never sees the temporary files created by relocate_file().
+    while ((rec = readdir(dir))) {
+        if (!strcmp(rec->d_name, ".") || !strcmp(rec->d_name, "..")) {
+            continue;
+        }
+        char child_path[PATH_MAX];
+        if ((size_t) snprintf(child_path, sizeof(child_path), "%s/%s", path, rec->d_name) >= sizeof(child_path)) {
+            errno = ENAMETOOLONG;
+            relocate_tree_failed(tree, child_path);
+            continue;
+        }
+        char *child = strdup(child_path);
+        if (!child) {
+            relocate_tree_failed(tree, child_path);
+            break;
+        }
+
+        unsigned char type = rec->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(child, &st)) {
+                relocate_tree_failed(tree, child);
+                guard_free(child);
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR) {
+            // Idle workers pick up subdirectories from the pool's queue
+            if (relocate_tree_submit(tree, child, NULL)) {
+                relocate_tree_failed(tree, child);
+                guard_free(child);
+            }
+        } else if (type == DT_REG) {
+            if (files_count % RELOCATE_TREE_BATCH == 0) {
+                char **tmp = realloc(files, (files_count + RELOCATE_TREE_BATCH + 1) * sizeof(*files));
+                if (!tmp) {
+                    relocate_tree_failed(tree, child);
+                    guard_free(child);
+                    continue;
+                }
+                files = tmp;
+            }
+            files[files_count++] = child;
+            files[files_count] = NULL;
+        } else {
+            // Symbolic links and special files are not followed
+            guard_free(child);
+        }
+    }
+    closedir(dir);
+
+    // Large directories are split into batches so they can be relocated in parallel
+    for (size_t i = RELOCATE_TREE_BATCH; i < files_count; i += RELOCATE_TREE_BATCH) {
+        size_t batch_count = files_count - i < RELOCATE_TREE_BATCH ? files_count - i : RELOCATE_TREE_BATCH;
+        char **batch = calloc(batch_count + 1, sizeof(*batch));
+        if (!batch) {
+            // Relocate them here instead
+            continue;
+        }
+        memcpy(batch, &files[i], batch_count * sizeof(*batch));
+        if (relocate_tree_submit(tree, NULL, batch)) {
+            guard_free(batch);
+            continue;
+        }
+        memset(&files[i], 0, batch_count * sizeof(*batch));
+    }
+    if (files) {
+        // Files that were not handed off are relocated by this worker
+        size_t keep = 0;
+        for (size_t i = 0; i < files_count; i++) {
+            if (files[i]) {
+                files[keep++] = files[i];
+            }
+        }
+        files[keep] = NULL;
+        relocate_tree_files(tree, files);
+        guard_free(files);
+    }
+}
+
+static void relocate_tree_task(void *arg) {
+    struct RelocationTreeTask *task = arg;
+    if (task->files) {
+        relocate_tree_files(task->tree, task->files);
+        guard_free(task->files);
+    } else {
+        relocate_tree_dir(task->tree, task->path);
+        guard_free(task->path);
+    }
+    guard_free(task);
+}
+
+/**
+ * Replace every occurrence of `old_prefix` with `new_prefix` in a directory tree
+ *
+ * Directories are walked in parallel by a worker pool (see `pool_default_size`).
+ * Every regular file is scanned for `old_prefix` and only files containing it
+ * are rewritten with `relocate_file`. Symbolic links are not followed. A file
+ * that cannot be relocated is reported and the walk continues.
+ *
+ * ~~~{.c}
+ * struct RelocationStats stats = {0};
+ * if (relocate_tree("/opt/env", "/build/env", "/opt/env", RELOCATE_AUTO, &stats) < 0) {
+ *     fprintf(stderr, "%zu files could not be relocated\n", stats.files_failed);
+ * }
+ * printf("%zu of %zu files rewritten\n", stats.files_rewritten, stats.files_scanned);
+ * ~~~
+ *
+ * @param path directory (or file) to relocate
+ * @param old_prefix string value to replace
+ * @param new_prefix replacement string value
+ * @param mode RELOCATE_AUTO, RELOCATE_TEXT, or RELOCATE_BINARY
+ * @param stats optional counters to update
+ * @return number of replacements, or -1 if any file could not be relocated
+ */
+ssize_t relocate_tree(const char *path, const char *old_prefix, const char *new_prefix, int mode, struct RelocationStats *stats) {
+    struct RelocationTree tree;
+    struct stat st;
+    char *root;
+
+    if (isempty((char *) old_prefix)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lstat(path, &st)) {
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        ssize_t count = relocate_file(path, old_prefix, new_prefix, mode, stats);
+        if (count < 0 && stats) {
+            stats->files_failed++;
+        }
+        return count;
+    }
+
+    memset(&tree, 0, sizeof(tree));
+    tree.old_prefix = old_prefix;
+    tree.new_prefix = new_prefix;
+    tree.mode = mode;
+    tree.pool = pool_init(0);
+    root = strdup(path);
+    if (!tree.pool || !root) {
+        pool_free(&tree.pool);
+        guard_free(root);
+        return -1;
+    }
+    pthread_mutex_init(&tree.lock, NULL);
+    if (relocate_tree_submit(&tree, root, NULL)) {
+        guard_free(root);
+        tree.stats.files_failed++;
+    }
+    pool_wait(tree.pool);
+    pool_free(&tree.pool);
+    pthread_mutex_destroy(&tree.lock);
+
+    if (stats) {
+        relocation_stats_add(stats, &tree.stats);
+    }
+    return tree.stats.files_failed ? -1 : tree.replacements;
+}
@@ -8,6 +8,7 @@ static struct option long_options[] = {
         {"verbose", no_argument, 0, 'v'},
         {"unbuffered", no_argument, 0, 'U'},
         {"web", no_argument, 0, 'w'},
+        {"link", no_argument, 0, 'l'},
         {0, 0, 0, 0},
 };
 
@@ -17,6 +18,7 @@ const char *long_options_help[] = {
         "Increase output verbosity",
         "Disable line buffering",
         "Generate HTML indexes (requires pandoc)",
+        "Merge with hard links, and publish changed files only",
         NULL,
 };
 
@@ -37,24 +39,41 @@ static void usage(char *name) {
 
 }
 
-int indexer_combine_rootdirs(const char *dest, char **rootdirs, const size_t rootdirs_total) {
-    char cmd[PATH_MAX];
-
-    memset(cmd, 0, sizeof(cmd));
-    sprintf(cmd, "rsync -ah%s --delete --exclude 'tools/' --exclude 'tmp/' --exclude 'build/' ", globals.verbose ? "v" : "q");
-    for (size_t i = 0; i < rootdirs_total; i++) {
-        sprintf(cmd + strlen(cmd), "'%s'/ ", rootdirs[i]);
-    }
-    sprintf(cmd + strlen(cmd), "%s/", dest);
+/**
+ * Files written by the indexer. They are never linked from a root directory,
+ * so regenerating them cannot modify the root directory's copy.
+ */
+static char *indexer_generated[] = {"README.md", "index.html", "repodata.json", "current_repodata.json", "channeldata.json", ".cache/"};
+
+/**
+ * Merge STASIS root directories into `dest`
+ *
+ * With CT_LINK, files are hard linked to the root directories instead of
+ * copied, when they share a file system, and files the indexer regenerates
+ * are left out.
+ *
+ * @param op 0, or CT_LINK
+ */
+int indexer_combine_rootdirs(const char *dest, char **rootdirs, const size_t rootdirs_total, unsigned op) {
+    char *exclude[4 + sizeof(indexer_generated) / sizeof(*indexer_generated)] = {"tools/", "tmp/", "build/", NULL};
+    int status = 0;
 
-    if (globals.verbose) {
-        puts(cmd);
+    if (op & CT_LINK) {
+        memcpy(&exclude[3], indexer_generated, sizeof(indexer_generated));
     }
-
-    if (system(cmd)) {
-        return -1;
+    // The destination is a new directory, so there is nothing to delete
+    for (size_t i = 0; i < rootdirs_total; i++) {
+        struct CopyTreeReport report;
+        if (globals.verbose) {
+            printf("Merging %s into %s\n", rootdirs[i], dest);
+        }
+        if (sync_tree(rootdirs[i], dest, CT_PERM | (op & CT_LINK), exclude, &report)) {
+            status = -1;
+        }
+        copytree_report_show(&report);
+        guard_strlist_free(&report.failed);
     }
-    return 0;
+    return status;
 }
 
 int indexer_wheels(struct Delivery *ctx) {
@@ -71,24 +90,24 @@ int indexer_load_metadata(struct Delivery *ctx, const char *filename) {
     }
 
     while (fgets(line, sizeof(line) - 1, fp) != NULL) {
-        char **parts = split(line, " ", 1);
+        char **parts = split_compact(line, " ", 1);
         char *name = parts[0];
         char *value = parts[1];
         strip(value);
         if (!strcmp(name, "name")) {
-            ctx->meta.name = strdup(value);
+            ctx->meta.name = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "version")) {
-            ctx->meta.version = strdup(value);
+            ctx->meta.version = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "rc")) {
             ctx->meta.rc = (int) strtol(value, NULL, 10);
         } else if (!strcmp(name, "python")) {
-            ctx->meta.python = strdup(value);
+            ctx->meta.python = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "python_compact")) {
-            ctx->meta.python_compact = strdup(value);
+            ctx->meta.python_compact = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "mission")) {
-            ctx->meta.mission = strdup(value);
+            ctx->meta.mission = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "codename")) {
-            ctx->meta.codename = strdup(value);
+            ctx->meta.codename = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "platform")) {
             ctx->system.platform = calloc(DELIVERY_PLATFORM_MAX, sizeof(*ctx->system.platform));
             char **platform = split(value, " ", 0);
@@ -97,33 +116,33 @@ int indexer_load_metadata(struct Delivery *ctx, const char *filename) {
             ctx->system.platform[DELIVERY_PLATFORM_CONDA_INSTALLER] = platform[DELIVERY_PLATFORM_CONDA_INSTALLER];
             ctx->system.platform[DELIVERY_PLATFORM_RELEASE] = platform[DELIVERY_PLATFORM_RELEASE];
         } else if (!strcmp(name, "arch")) {
-            ctx->system.arch = strdup(value);
+            ctx->system.arch = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "time")) {
-            ctx->info.time_str_epoch = strdup(value);
+            ctx->info.time_str_epoch = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "release_fmt")) {
-            ctx->rules.release_fmt = strdup(value);
+            ctx->rules.release_fmt = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "release_name")) {
-            ctx->info.release_name = strdup(value);
+            ctx->info.release_name = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "build_name_fmt")) {
-            ctx->rules.build_name_fmt = strdup(value);
+            ctx->rules.build_name_fmt = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "build_name")) {
-            ctx->info.build_name = strdup(value);
+            ctx->info.build_name = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "build_number_fmt")) {
-            ctx->rules.build_number_fmt = strdup(value);
+            ctx->rules.build_number_fmt = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "build_number")) {
-            ctx->info.build_number = strdup(value);
+            ctx->info.build_number = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "conda_installer_baseurl")) {
-            ctx->conda.installer_baseurl = strdup(value);
+            ctx->conda.installer_baseurl = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "conda_installer_name")) {
-            ctx->conda.installer_name = strdup(value);
+            ctx->conda.installer_name = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "conda_installer_version")) {
-            ctx->conda.installer_version = strdup(value);
+            ctx->conda.installer_version = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "conda_installer_platform")) {
-            ctx->conda.installer_platform = strdup(value);
+            ctx->conda.installer_platform = delivery_strdup(ctx, value);
         } else if (!strcmp(name, "conda_installer_arch")) {
-            ctx->conda.installer_arch = strdup(value);
+            ctx->conda.installer_arch = delivery_strdup(ctx, value);
         }
-        GENERIC_ARRAY_FREE(parts);
+        guard_free(parts);
     }
     fclose(fp);
 
@@ -289,7 +308,7 @@ int indexer_make_website(struct Delivery *ctx) {
     return 0;
 }
 
-int indexer_conda(struct Delivery *ctx) {
+static int indexer_conda_micromamba(struct Delivery *ctx) {
     int status = 0;
     char prefix[PATH_MAX];
     sprintf(prefix, "%s/%s", ctx->storage.tmpdir, "indexer");
@@ -304,6 +323,19 @@ int indexer_conda(struct Delivery *ctx) {
     return status;
 }
 
+int indexer_conda(struct Delivery *ctx) {
+    struct ChannelIndexStats stats = {0};
+    int status = channel_index(ctx->storage.conda_artifact_dir, CHANNEL_INDEX_CACHE, &stats);
+
+    msg(STASIS_MSG_L2, "%zu packages indexed in %zu subdirectories (%zu cached, %zu bytes read)\n", stats.packages, stats.subdirs, stats.cached, stats.bytes);
+    if (status && !stats.failed && stats.unsupported) {
+        // Only the .conda format could not be read by this build
+        msg(STASIS_MSG_L2 | STASIS_MSG_WARN, "%zu .conda packages require zstd support. Falling back to conda-index.\n", stats.unsupported);
+        return indexer_conda_micromamba(ctx);
+    }
+    return status;
+}
+
 static struct StrList *get_architectures(struct Delivery ctx[], size_t nelem) {
     struct StrList *architectures = strlist_init();
     for (size_t i = 0; i < nelem; i++) {
@@ -551,20 +583,21 @@ int indexer_junitxml_report(struct Delivery ctx[], size_t nelem) {
 }
 
 void indexer_init_dirs(struct Delivery *ctx, const char *workdir) {
-    path_store(&ctx->storage.root, PATH_MAX, workdir, "");
-    path_store(&ctx->storage.tmpdir, PATH_MAX, ctx->storage.root, "tmp");
+    struct Arena *arena = delivery_arena(ctx);
+    path_store_arena(arena, &ctx->storage.root, PATH_MAX, workdir, "");
+    path_store_arena(arena, &ctx->storage.tmpdir, PATH_MAX, ctx->storage.root, "tmp");
     if (delivery_init_tmpdir(ctx)) {
         fprintf(stderr, "Failed to configure temporary storage directory\n");
         exit(1);
     }
-    path_store(&ctx->storage.output_dir, PATH_MAX, ctx->storage.root, "output");
-    path_store(&ctx->storage.cfgdump_dir, PATH_MAX, ctx->storage.output_dir, "config");
-    path_store(&ctx->storage.meta_dir, PATH_MAX, ctx->storage.output_dir, "meta");
-    path_store(&ctx->storage.delivery_dir, PATH_MAX, ctx->storage.output_dir, "delivery");
-    path_store(&ctx->storage.package_dir, PATH_MAX, ctx->storage.output_dir, "packages");
-    path_store(&ctx->storage.results_dir, PATH_MAX, ctx->storage.output_dir, "results");
-    path_store(&ctx->storage.wheel_artifact_dir, PATH_MAX, ctx->storage.package_dir, "wheels");
-    path_store(&ctx->storage.conda_artifact_dir, PATH_MAX, ctx->storage.package_dir, "conda");
+    path_store_arena(arena, &ctx->storage.output_dir, PATH_MAX, ctx->storage.root, "output");
+    path_store_arena(arena, &ctx->storage.cfgdump_dir, PATH_MAX, ctx->storage.output_dir, "config");
+    path_store_arena(arena, &ctx->storage.meta_dir, PATH_MAX, ctx->storage.output_dir, "meta");
+    path_store_arena(arena, &ctx->storage.delivery_dir, PATH_MAX, ctx->storage.output_dir, "delivery");
+    path_store_arena(arena, &ctx->storage.package_dir, PATH_MAX, ctx->storage.output_dir, "packages");
+    path_store_arena(arena, &ctx->storage.results_dir, PATH_MAX, ctx->storage.output_dir, "results");
+    path_store_arena(arena, &ctx->storage.wheel_artifact_dir, PATH_MAX, ctx->storage.package_dir, "wheels");
+    path_store_arena(arena, &ctx->storage.conda_artifact_dir, PATH_MAX, ctx->storage.package_dir, "conda");
 }
 
 int main(int argc, char *argv[]) {
@@ -572,9 +605,10 @@ int main(int argc, char *argv[]) {
     char *destdir = NULL;
     char **rootdirs = NULL;
     int do_html = 0;
+    unsigned link_op = 0;
     int c = 0;
     int option_index = 0;
-    while ((c = getopt_long(argc, argv, "hd:vUw", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "hd:vUwl", long_options, &option_index)) != -1) {
         switch (c) {
             case 'h':
                 usage(path_basename(argv[0]));
@@ -594,6 +628,9 @@ int main(int argc, char *argv[]) {
             case 'w':
                 do_html = 1;
                 break;
+            case 'l':
+                link_op = CT_LINK;
+                break;
             case '?':
             default:
                 exit(1);
@@ -627,9 +664,17 @@ int main(int argc, char *argv[]) {
     }
 
     char *workdir;
-    char workdir_template[PATH_MAX];
+    char workdir_template[PATH_MAX] = {0};
     char *system_tmp = getenv("TMPDIR");
-    if (system_tmp) {
+    if (link_op) {
+        // Work beside the destination, so publishing can link to the work directory
+        char parent[PATH_MAX];
+        if (mkdirs(destdir, 0755) || !realpath(destdir, parent)) {
+            SYSERROR("Unable to create destination directory: %s", destdir);
+            exit(1);
+        }
+        strcat(workdir_template, path_dirname(parent));
+    } else if (system_tmp) {
         strcat(workdir_template, system_tmp);
     } else {
         strcat(workdir_template, "/tmp");
@@ -654,7 +699,7 @@ int main(int argc, char *argv[]) {
     msg(STASIS_MSG_L1, "%s delivery root %s\n",
         rootdirs_total > 1 ? "Merging" : "Indexing",
         rootdirs_total > 1 ? "directories" : "directory");
-    if (indexer_combine_rootdirs(workdir, rootdirs, rootdirs_total)) {
+    if (indexer_combine_rootdirs(workdir, rootdirs, rootdirs_total, link_op)) {
         SYSERROR("%s", "Copy operation failed");
         rmtree(workdir);
         exit(1);
@@ -668,6 +713,15 @@ int main(int argc, char *argv[]) {
         mkdirs(ctx.storage.wheel_artifact_dir, 0755);
     }
 
+    // Reuse package records from the root directories, and the previous output
+    for (size_t i = 0; i <= rootdirs_total; i++) {
+        char channel[PATH_MAX];
+        snprintf(channel, sizeof(channel), "%s/packages/conda", i < rootdirs_total ? rootdirs[i] : destdir);
+        if (!access(channel, F_OK) && channel_cache_import(ctx.storage.conda_artifact_dir, channel)) {
+            msg(STASIS_MSG_WARN | STASIS_MSG_L2, "Unable to import the package index cache from %s\n", channel);
+        }
+    }
+
     msg(STASIS_MSG_L1, "Indexing conda packages\n");
     if (indexer_conda(&ctx)) {
         SYSERROR("%s", "Conda package indexing operation failed");
@@ -725,16 +779,16 @@ int main(int argc, char *argv[]) {
     }
 
     msg(STASIS_MSG_L1, "Copying indexed delivery to '%s'\n", destdir);
-    char cmd[PATH_MAX];
-    memset(cmd, 0, sizeof(cmd));
-    sprintf(cmd, "rsync -ah%s --delete --exclude 'tmp/' --exclude 'tools/' '%s/' '%s/'", globals.verbose ? "v" : "q", workdir, destdir);
+    struct CopyTreeReport report;
+    // Unchanged files are skipped. With --link, the others are hard linked
+    // into place. sync_tree() replaces files rather than writing to them, so
+    // files linked from the root directories are never modified.
+    int sync_status = sync_tree(workdir, destdir, CT_PERM | CT_DELETE | link_op, (char *[]) {"tmp/", "tools/", NULL}, &report);
+    copytree_report_show(&report);
+    guard_strlist_free(&report.failed);
     guard_free(destdir);
 
-    if (globals.verbose) {
-        puts(cmd);
-    }
-
-    if (system(cmd)) {
+    if (sync_status) {
         SYSERROR("%s", "Copy operation failed");
         rmtree(workdir);
         exit(1);
@@ -9,6 +9,7 @@
 #define OPT_NO_DOCKER 1001
 #define OPT_NO_ARTIFACTORY 1002
 #define OPT_NO_TESTING 1003
+#define OPT_CPU_LIMIT 1004
 static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'V'},
@@ -21,6 +22,7 @@ static struct option long_options[] = {
         {"no-docker", no_argument, 0, OPT_NO_DOCKER},
         {"no-artifactory", no_argument, 0, OPT_NO_ARTIFACTORY},
         {"no-testing", no_argument, 0, OPT_NO_TESTING},
+        {"cpu-limit", required_argument, 0, OPT_CPU_LIMIT},
         {0, 0, 0, 0},
 };
 
@@ -36,6 +38,7 @@ const char *long_options_help[] = {
         "Do not build docker images",
         "Do not upload artifacts to Artifactory",
         "Do not execute test scripts",
+        "Number of worker threads (default: number of CPUs)",
         NULL,
 };
 
@@ -99,7 +102,6 @@ static void usage(char *progname) {
 
 static void check_system_requirements(struct Delivery *ctx) {
     const char *tools_required[] = {
-        "rsync",
         NULL,
     };
 
@@ -203,6 +205,13 @@ int main(int argc, char *argv[]) {
             case OPT_NO_TESTING:
                 globals.enable_testing = false;
                 break;
+            case OPT_CPU_LIMIT:
+                globals.cpu_limit = strtol(optarg, NULL, 10);
+                if (globals.cpu_limit < 1) {
+                    fprintf(stderr, "--cpu-limit requires a positive integer\n");
+                    exit(1);
+                }
+                break;
             case '?':
             default:
                 exit(1);
@@ -230,29 +239,7 @@ int main(int argc, char *argv[]) {
     // Expose variables for use with the template engine
     // NOTE: These pointers are populated by delivery_init() so please avoid using
     // tpl_render() until then.
-    tpl_register("meta.name", &ctx.meta.name);
-    tpl_register("meta.version", &ctx.meta.version);
-    tpl_register("meta.codename", &ctx.meta.codename);
-    tpl_register("meta.mission", &ctx.meta.mission);
-    tpl_register("meta.python", &ctx.meta.python);
-    tpl_register("meta.python_compact", &ctx.meta.python_compact);
-    tpl_register("info.time_str_epoch", &ctx.info.time_str_epoch);
-    tpl_register("info.release_name", &ctx.info.release_name);
-    tpl_register("info.build_name", &ctx.info.build_name);
-    tpl_register("info.build_number", &ctx.info.build_number);
-    tpl_register("storage.tmpdir", &ctx.storage.tmpdir);
-    tpl_register("storage.output_dir", &ctx.storage.output_dir);
-    tpl_register("storage.delivery_dir", &ctx.storage.delivery_dir);
-    tpl_register("storage.conda_artifact_dir", &ctx.storage.conda_artifact_dir);
-    tpl_register("storage.wheel_artifact_dir", &ctx.storage.wheel_artifact_dir);
-    tpl_register("storage.build_sources_dir", &ctx.storage.build_sources_dir);
-    tpl_register("storage.build_docker_dir", &ctx.storage.build_docker_dir);
-    tpl_register("storage.results_dir", &ctx.storage.results_dir);
-    tpl_register("conda.installer_baseurl", &ctx.conda.installer_baseurl);
-    tpl_register("conda.installer_name", &ctx.conda.installer_name);
-    tpl_register("conda.installer_version", &ctx.conda.installer_version);
-    tpl_register("conda.installer_arch", &ctx.conda.installer_arch);
-    tpl_register("conda.installer_platform", &ctx.conda.installer_platform);
+    delivery_register_templates(&ctx);
     tpl_register("deploy.jfrog.repo", &globals.jfrog.repo);
     tpl_register("deploy.jfrog.url", &globals.jfrog.url);
     tpl_register("deploy.docker.registry", &ctx.deploy.docker.registry);
@@ -274,12 +261,29 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    // Compiled configuration files are kept between runs
+    // The user may manipulate the cache path with STASIS_CACHE_DIR. An empty value disables the cache.
+    if (getenv("STASIS_CACHE_DIR")) {
+        if (strlen(getenv("STASIS_CACHE_DIR"))) {
+            globals.cache_dir = strdup(getenv("STASIS_CACHE_DIR"));
+        }
+    } else {
+        char cache_dir_tmp[PATH_MAX];
+        if (getenv("XDG_CACHE_HOME")) {
+            snprintf(cache_dir_tmp, sizeof(cache_dir_tmp), "%s/stasis", getenv("XDG_CACHE_HOME"));
+            globals.cache_dir = strdup(cache_dir_tmp);
+        } else if (getenv("HOME")) {
+            snprintf(cache_dir_tmp, sizeof(cache_dir_tmp), "%s/.cache/stasis", getenv("HOME"));
+            globals.cache_dir = strdup(cache_dir_tmp);
+        }
+    }
+
     // Override Python version from command-line, if any
     if (strlen(python_override_version)) {
-        guard_free(ctx.meta.python);
-        ctx.meta.python = strdup(python_override_version);
-        guard_free(ctx.meta.python_compact);
-        ctx.meta.python_compact = to_short_version(ctx.meta.python);
+        ctx.meta.python = delivery_strdup(&ctx, python_override_version);
+        char *python_compact = to_short_version(ctx.meta.python);
+        ctx.meta.python_compact = delivery_strdup(&ctx, python_compact);
+        guard_free(python_compact);
     }
 
     if (!config_input) {
@@ -295,7 +299,7 @@ int main(int argc, char *argv[]) {
 
     if (config_input) {
         msg(STASIS_MSG_L2, "Reading STASIS global configuration: %s\n", config_input);
-        ctx._stasis_ini_fp.cfg = ini_open(config_input);
+        ctx._stasis_ini_fp.cfg = ini_open_cached(config_input, globals.cache_dir);
         if (!ctx._stasis_ini_fp.cfg) {
             msg(STASIS_MSG_ERROR | STASIS_MSG_L2, "Failed to read config file: %s, %s\n", delivery_input, strerror(errno));
             exit(1);
@@ -305,7 +309,7 @@ int main(int argc, char *argv[]) {
     }
 
     msg(STASIS_MSG_L2, "Reading STASIS delivery configuration: %s\n", delivery_input);
-    ctx._stasis_ini_fp.delivery = ini_open(delivery_input);
+    ctx._stasis_ini_fp.delivery = ini_open_cached(delivery_input, globals.cache_dir);
     if (!ctx._stasis_ini_fp.delivery) {
         msg(STASIS_MSG_ERROR | STASIS_MSG_L2, "Failed to read delivery file: %s, %s\n", delivery_input, strerror(errno));
         exit(1);
@@ -0,0 +1,119 @@
+#include <getopt.h>
+#include "core.h"
+
+#define OPT_CPU_LIMIT 1000
+static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"mode", required_argument, 0, 'm'},
+        {"verbose", no_argument, 0, 'v'},
+        {"unbuffered", no_argument, 0, 'U'},
+        {"cpu-limit", required_argument, 0, OPT_CPU_LIMIT},
+        {0, 0, 0, 0},
+};
+
+const char *long_options_help[] = {
+        "Display this usage statement",
+        "File handling: auto, text, or binary (default: auto)",
+        "Increase output verbosity",
+        "Disable line buffering",
+        "Number of worker threads (default: number of CPUs)",
+        NULL,
+};
+
+static void usage(char *name) {
+    printf("usage: %s [-hmvU] {OLD_PREFIX} {NEW_PREFIX} {PATH...}\n", name);
+    for (int i = 0; long_options[i].name != NULL; i++) {
+        char line[255];
+        char arg[4] = {0};
+        if (long_options[i].val < 256) {
+            sprintf(arg, "-%c", long_options[i].val);
+        }
+        sprintf(line, "  --%-12s %-3s %-20s", long_options[i].name, arg, long_options_help[i]);
+        puts(line);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct RelocationStats stats;
+    int mode = RELOCATE_AUTO;
+    int status = 0;
+    int c = 0;
+    int option_index = 0;
+    while ((c = getopt_long(argc, argv, "hm:vU", long_options, &option_index)) != -1) {
+        switch (c) {
+            case 'h':
+                usage(path_basename(argv[0]));
+                exit(0);
+            case 'm':
+                if (!strcmp(optarg, "auto")) {
+                    mode = RELOCATE_AUTO;
+                } else if (!strcmp(optarg, "text")) {
+                    mode = RELOCATE_TEXT;
+                } else if (!strcmp(optarg, "binary")) {
+                    mode = RELOCATE_BINARY;
+                } else {
+                    fprintf(stderr, "--mode must be one of: auto, text, binary\n");
+                    exit(1);
+                }
+                break;
+            case 'U':
+                fflush(stdout);
+                fflush(stderr);
+                setvbuf(stdout, NULL, _IONBF, 0);
+                setvbuf(stderr, NULL, _IONBF, 0);
+                break;
+            case 'v':
+                globals.verbose = 1;
+                break;
+            case OPT_CPU_LIMIT:
+                globals.cpu_limit = strtol(optarg, NULL, 10);
+                if (globals.cpu_limit < 1) {
+                    fprintf(stderr, "--cpu-limit requires a positive integer\n");
+                    exit(1);
+                }
+                break;
+            case '?':
+            default:
+                exit(1);
+        }
+    }
+
+    if (argc - optind < 3) {
+        usage(path_basename(argv[0]));
+        exit(1);
+    }
+    const char *old_prefix = argv[optind++];
+    const char *new_prefix = argv[optind++];
+    if (isempty((char *) old_prefix)) {
+        fprintf(stderr, "OLD_PREFIX cannot be empty\n");
+        exit(1);
+    }
+    if (mode == RELOCATE_BINARY && strlen(new_prefix) > strlen(old_prefix)) {
+        fprintf(stderr, "NEW_PREFIX cannot be longer than OLD_PREFIX in binary mode\n");
+        exit(1);
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    for (int i = optind; i < argc; i++) {
+        size_t failed = stats.files_failed;
+        msg(STASIS_MSG_L1, "Relocating %s\n", argv[i]);
+        if (relocate_tree(argv[i], old_prefix, new_prefix, mode, &stats) < 0) {
+            if (stats.files_failed == failed) {
+                // The walk did not start
+                fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            }
+            status = 1;
+        }
+    }
+
+    msg(STASIS_MSG_L1, "Summary\n");
+    msg(STASIS_MSG_L2, "Files scanned: %zu (%zu bytes)\n", stats.files_scanned, stats.bytes_scanned);
+    msg(STASIS_MSG_L2, "Files rewritten: %zu (%zu binary)\n", stats.files_rewritten, stats.files_binary);
+    msg(STASIS_MSG_L2, "Replacements: %zu\n", stats.replacements);
+    msg(STASIS_MSG_L2, "Bytes written: %zu\n", stats.bytes_written);
+    if (stats.files_failed) {
+        msg(STASIS_MSG_L2 | STASIS_MSG_ERROR, "Failures: %zu\n", stats.files_failed);
+        status = 1;
+    }
+    return status;
+}
@@ -5,66 +5,129 @@
 #include "str.h"
 
 int num_chars(const char *sptr, int ch) {
-    int result = 0;
-    for (int i = 0; sptr[i] != '\0'; i++) {
-        if (sptr[i] == ch) {
-            result++;
-        }
-    }
+    return (int) bytes_count(sptr, strlen(sptr), ch);
+}
+
+struct StrView strview(const char *sptr) {
+    return strview_n(sptr, sptr ? strlen(sptr) : 0);
+}
+
+struct StrView strview_n(const char *sptr, size_t len) {
+    struct StrView result = {.ptr = sptr ? sptr : "", .len = sptr ? len : 0};
     return result;
 }
 
-int startswith(const char *sptr, const char *pattern) {
-    if (!sptr || !pattern) {
+int strview_eq(struct StrView a, struct StrView b) {
+    return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+}
+
+int strview_startswith(struct StrView s, struct StrView prefix) {
+    return s.len >= prefix.len && memcmp(s.ptr, prefix.ptr, prefix.len) == 0;
+}
+
+int strview_endswith(struct StrView s, struct StrView suffix) {
+    return s.len >= suffix.len && memcmp(s.ptr + s.len - suffix.len, suffix.ptr, suffix.len) == 0;
+}
+
+ssize_t strview_find(struct StrView s, struct StrView needle) {
+    const char *match;
+    if (needle.len == 0) {
         return 0;
     }
-    for (size_t i = 0; i < strlen(pattern); i++) {
-        if (sptr[i] != pattern[i]) {
-            return 0;
-        }
+    match = bytes_find_str(s.ptr, s.len, needle.ptr, needle.len);
+    return match ? match - s.ptr : -1;
+}
+
+struct StrView strview_lstrip(struct StrView s) {
+    while (s.len && isspace((unsigned char) *s.ptr)) {
+        s.ptr++;
+        s.len--;
     }
-    return 1;
+    return s;
 }
 
-int endswith(const char *sptr, const char *pattern) {
-    if (!sptr || !pattern) {
-        return 0;
+struct StrView strview_rstrip(struct StrView s) {
+    while (s.len && isspace((unsigned char) s.ptr[s.len - 1])) {
+        s.len--;
     }
-    ssize_t sptr_size = (ssize_t) strlen(sptr);
-    ssize_t pattern_size = (ssize_t) strlen(pattern);
+    return s;
+}
 
-    if (sptr_size == pattern_size) {
-       if (strcmp(sptr, pattern) == 0) {
-           return 1; // yes
-       }
-       return 0; // no
+struct StrView strview_strip(struct StrView s) {
+    return strview_rstrip(strview_lstrip(s));
+}
+
+char *strview_replace(struct StrView s, struct StrView target, struct StrView replacement) {
+    struct StrView rest = s;
+    size_t count = 0;
+    ssize_t off;
+    char *result;
+    char *dest;
+
+    if (!target.len) {
+        return NULL;
     }
 
-    ssize_t s = sptr_size - pattern_size;
-    if (s < 0) {
+    // Size the result
+    while ((off = strview_find(rest, target)) >= 0) {
+        count++;
+        rest = strview_n(rest.ptr + off + target.len, rest.len - off - target.len);
+    }
+
+    result = malloc(s.len - count * target.len + count * replacement.len + 1);
+    if (!result) {
+        return NULL;
+    }
+
+    dest = result;
+    rest = s;
+    while (count-- && (off = strview_find(rest, target)) >= 0) {
+        memcpy(dest, rest.ptr, off);
+        dest += off;
+        memcpy(dest, replacement.ptr, replacement.len);
+        dest += replacement.len;
+        rest = strview_n(rest.ptr + off + target.len, rest.len - off - target.len);
+    }
+    memcpy(dest, rest.ptr, rest.len);
+    dest[rest.len] = '\0';
+    return result;
+}
+
+int startswith(const char *sptr, const char *pattern) {
+    if (!sptr || !pattern) {
         return 0;
     }
+    // Never read more of sptr than the pattern could match
+    size_t pattern_len = strlen(pattern);
+    return strview_startswith(strview_n(sptr, strnlen(sptr, pattern_len)), strview_n(pattern, pattern_len));
+}
 
-    for (size_t p = 0 ; s < sptr_size; s++, p++) {
-        if (sptr[s] != pattern[p]) {
-            // sptr does not end with pattern
-            return 0;
-        }
+int endswith(const char *sptr, const char *pattern) {
+    if (!sptr || !pattern) {
+        return 0;
     }
-    // sptr ends with pattern
-    return 1;
+    return strview_endswith(strview(sptr), strview(pattern));
 }
 
 void strchrdel(char *sptr, const char *chars) {
+    unsigned char del[UCHAR_MAX + 1] = {0};
+    char *dest;
+
     if (sptr == NULL || chars == NULL) {
         return;
     }
 
-    for (size_t i = 0; i < strlen(chars); i++) {
-        char ch[2] = {0};
-        strncpy(ch, &chars[i], 1);
-        replace_text(sptr, ch, "", 0);
+    for (const char *ch = chars; *ch != '\0'; ch++) {
+        del[(unsigned char) *ch] = 1;
     }
+
+    dest = sptr;
+    for (const char *src = sptr; *src != '\0'; src++) {
+        if (!del[(unsigned char) *src]) {
+            *dest++ = *src;
+        }
+    }
+    *dest = '\0';
 }
 
 char** split(char *_sptr, const char* delim, size_t max)
@@ -115,27 +178,99 @@ char** split(char *_sptr, const char* delim, size_t max)
             pos = token - sptr;
             break;
         }
-        result[i] = calloc(STASIS_BUFSIZ, sizeof(char));
+        result[i] = strdup(token);
         if (!result[i]) {
+            GENERIC_ARRAY_FREE(result);
+            guard_free(sptr);
             return NULL;
         }
-        strcpy(result[i], token);
     }
 
     // pos is non-zero when maximum split is reached
     if (pos) {
         // append the remaining string contents to array
-        result[i] = calloc(STASIS_BUFSIZ, sizeof(char));
+        result[i] = strdup(&orig[pos]);
         if (!result[i]) {
+            GENERIC_ARRAY_FREE(result);
+            guard_free(sptr);
             return NULL;
         }
-        strcpy(result[i], &orig[pos]);
     }
 
     guard_free(sptr);
     return result;
 }
 
+char **split_compact(const char *sptr, const char *delim, size_t max) {
+    size_t len;
+    size_t count = 1;
+    char **result;
+    char *data;
+
+    if (sptr == NULL || delim == NULL) {
+        return NULL;
+    }
+
+    // Count the tokens. Splitting stops after max delimiters (0 = unlimited)
+    len = strlen(sptr);
+    for (const char *p = sptr; *p != '\0' && (!max || count <= max); p++) {
+        if (strchr(delim, *p)) {
+            count++;
+        }
+    }
+
+    // The pointer array and a copy of the string share one allocation
+    result = malloc((count + 1) * sizeof(*result) + len + 1);
+    if (!result) {
+        return NULL;
+    }
+    data = (char *) &result[count + 1];
+    memcpy(data, sptr, len + 1);
+
+    // Terminate each token in place
+    result[0] = data;
+    for (size_t i = 1; i < count; i++) {
+        data += strcspn(data, delim);
+        *data = '\0';
+        data++;
+        result[i] = data;
+    }
+    result[count] = NULL;
+    return result;
+}
+
+void strview_split_init(struct StrSplit *it, struct StrView s, const char *delim) {
+    it->pos = s.ptr;
+    it->end = s.ptr + s.len;
+    it->delim = delim;
+}
+
+void str_split_init(struct StrSplit *it, const char *sptr, const char *delim) {
+    strview_split_init(it, strview(sptr), delim);
+    if (!sptr) {
+        it->pos = NULL;
+    }
+}
+
+int str_split_next(struct StrSplit *it, struct StrView *token) {
+    const char *p;
+
+    if (!it->pos || !it->delim) {
+        return 0;
+    }
+
+    for (p = it->pos; p < it->end && (*p == '\0' || !strchr(it->delim, *p)); p++);
+    token->ptr = it->pos;
+    token->len = p - it->pos;
+    if (p == it->end) {
+        // last token
+        it->pos = NULL;
+    } else {
+        it->pos = p + 1;
+    }
+    return 1;
+}
+
 char *join(char **arr, const char *separator) {
     char *result = NULL;
     int records = 0;
@@ -398,45 +533,45 @@ char **strdeldup(char **arr) {
 }
 
 char *lstrip(char *sptr) {
-    char *tmp = sptr;
-    size_t bytes = 0;
+    size_t len;
+    struct StrView view;
 
     if (sptr == NULL) {
         return NULL;
     }
 
-    while (strlen(tmp) > 1 && (isblank(*tmp) || isspace(*tmp))) {
-        bytes++;
-        tmp++;
+    len = strlen(sptr);
+    if (len < 2) {
+        return sptr;
     }
-    if (tmp != sptr) {
-        memmove(sptr, sptr + bytes, strlen(sptr) - bytes);
-        memset((sptr + strlen(sptr)) - bytes, '\0', bytes);
+
+    // The final character is never removed
+    view = strview_lstrip(strview_n(sptr, len - 1));
+    if (view.ptr != sptr) {
+        memmove(sptr, view.ptr, len - (view.ptr - sptr) + 1);
     }
     return sptr;
 }
 
 char *strip(char *sptr) {
+    size_t len;
+    struct StrView view;
+
     if (sptr == NULL) {
         return NULL;
     }
 
-    size_t len = strlen(sptr);
+    len = strlen(sptr);
     if (len == 0) {
         return sptr;
     } else if (len == 1 && (isblank(*sptr) || isspace(*sptr))) {
         *sptr = '\0';
         return sptr;
-    } for (size_t i = len; i != 0; --i) {
-        if (sptr[i] == '\0') {
-            continue;
-        }
-        if (isspace(sptr[i]) || isblank(sptr[i])) {
-            sptr[i] = '\0';
-        } else {
-            break;
-        }
     }
+
+    // The first character is never removed
+    view = strview_rstrip(strview_n(sptr + 1, len - 1));
+    sptr[1 + view.len] = '\0';
     return sptr;
 }
 
@@ -505,55 +640,30 @@ void print_banner(const char *s, int len) {
  * @return pointer to `s`
  */
 char *normalize_space(char *s) {
-    size_t len;
-    size_t trim_pos;
+    char *dest;
     int add_whitespace = 0;
-    char *result = s;
-    char *tmp;
 
     if (s == NULL) {
         return NULL;
     }
 
-    if ((tmp = calloc(strlen(s) + 1, sizeof(char))) == NULL) {
-        perror("could not allocate memory for temporary string");
-        return NULL;
-    }
-    char *tmp_orig = tmp;
-
-    // count whitespace, if any
-    for (trim_pos = 0; isblank(s[trim_pos]); trim_pos++);
-    // trim whitespace from the left, if any
-    memmove(s, &s[trim_pos], strlen(&s[trim_pos]));
-    // cull bytes not part of the string after moving
-    len = strlen(s);
-    s[len - trim_pos] = '\0';
-
-    // Generate a new string with extra whitespace stripped out
-    while (*s != '\0') {
+    // Blanks are dropped from the start and end of the string. Blanks between
+    // words are replaced by a single space.
+    dest = s;
+    for (const char *src = s; *src != '\0'; src++) {
         // Skip over any whitespace, but record that we encountered it
-        if (isblank(*s)) {
-            s++;
-            add_whitespace = 1;
+        if (isblank((unsigned char) *src)) {
+            add_whitespace = dest != s;
             continue;
         }
-        // This gate avoids filling tmp with whitespace; we want to make our own
         if (add_whitespace) {
-            *tmp = ' ';
-            tmp++;
+            *dest++ = ' ';
             add_whitespace = 0;
         }
-        // Write character in s to tmp
-        *tmp = *s;
-        // Increment string pointers
-        s++;
-        tmp++;
+        *dest++ = *src;
     }
-
-    // Rewrite the input string
-    strcpy(result, tmp_orig);
-    guard_free(tmp_orig);
-    return result;
+    *dest = '\0';
+    return s;
 }
 
 char **strdup_array(char **array) {
@@ -5,6 +5,19 @@
 #include "strlist.h"
 #include "utils.h"
 
+/**
+ * Duplicate a string using the list's allocator
+ * @param pStrList `StrList`
+ * @param str
+ * @return copy of `str`, or NULL on error
+ */
+static char *strlist_strdup(struct StrList *pStrList, const char *str) {
+    if (pStrList->arena) {
+        return arena_strdup(pStrList->arena, str);
+    }
+    return strdup(str);
+}
+
 /**
  *
  * @param pStrList `StrList`
@@ -14,7 +27,8 @@ void strlist_free(struct StrList **pStrList) {
         return;
     }
 
-    for (size_t i = 0; i < (*pStrList)->num_inuse; i++) {
+    // Records allocated from an arena are released with the arena
+    for (size_t i = 0; !(*pStrList)->arena && i < (*pStrList)->num_inuse; i++) {
         if ((*pStrList)->data[i]) {
             guard_free((*pStrList)->data[i]);
         }
@@ -25,31 +39,116 @@ void strlist_free(struct StrList **pStrList) {
     guard_free((*pStrList));
 }
 
+/**
+ * Grow the list so it can hold at least `count` records
+ *
+ * Storage grows geometrically so a sequence of appends costs amortized O(1)
+ * per record. One extra slot is always kept for the NULL terminator.
+ *
+ * @param pStrList `StrList`
+ * @param count minimum number of records the list must be able to hold
+ * @return 0 on success, -1 on error
+ */
+int strlist_reserve(struct StrList *pStrList, size_t count) {
+    char **tmp = NULL;
+    size_t num_alloc;
+
+    if (pStrList == NULL) {
+        return -1;
+    }
+
+    if (count < pStrList->num_alloc) {
+        // capacity is sufficient
+        return 0;
+    }
+
+    num_alloc = pStrList->num_alloc ? pStrList->num_alloc : 1;
+    while (num_alloc <= count) {
+        num_alloc *= 2;
+    }
+
+    tmp = realloc(pStrList->data, num_alloc * sizeof(*pStrList->data));
+    if (tmp == NULL) {
+        return -1;
+    }
+    memset(&tmp[pStrList->num_alloc], 0, (num_alloc - pStrList->num_alloc) * sizeof(*tmp));
+    pStrList->data = tmp;
+    pStrList->num_alloc = num_alloc;
+    return 0;
+}
+
+/**
+ * Grow the list for `count` additional records, or die trying
+ * @param pStrList `StrList`
+ * @param count number of records to make room for
+ */
+static void strlist_grow(struct StrList **pStrList, size_t count) {
+    if (strlist_reserve(*pStrList, (*pStrList)->num_inuse + count)) {
+        guard_strlist_free(pStrList);
+        perror("failed to append to array");
+        exit(1);
+    }
+}
+
+/**
+ * Append an already allocated string to the list. The list takes ownership
+ * of `str`. Capacity must be reserved by the caller.
+ * @param pStrList `StrList`
+ * @param str heap allocated string
+ */
+static void strlist_append_owned(struct StrList *pStrList, char *str) {
+    pStrList->data[pStrList->num_inuse] = str;
+    pStrList->num_inuse++;
+    pStrList->data[pStrList->num_inuse] = NULL;
+}
+
 /**
  * Append a value to the list
  * @param pStrList `StrList`
  * @param str
  */
 void strlist_append(struct StrList **pStrList, char *str) {
-    char **tmp = NULL;
+    char *item = NULL;
 
     if (pStrList == NULL) {
         return;
     }
 
-    tmp = realloc((*pStrList)->data, ((*pStrList)->num_alloc + 1) * sizeof(char *));
-    if (tmp == NULL) {
+    strlist_grow(pStrList, 1);
+    item = strlist_strdup(*pStrList, str);
+    if (item == NULL) {
         guard_strlist_free(pStrList);
         perror("failed to append to array");
         exit(1);
-    } else if (tmp != (*pStrList)->data) {
-        (*pStrList)->data = tmp;
     }
-    (*pStrList)->data[(*pStrList)->num_inuse] = strdup(str);
-    (*pStrList)->data[(*pStrList)->num_alloc] = NULL;
-    strcpy((*pStrList)->data[(*pStrList)->num_inuse], str);
-    (*pStrList)->num_inuse++;
-    (*pStrList)->num_alloc++;
+    strlist_append_owned(*pStrList, item);
+}
+
+/**
+ * Append `count` values from an array of strings
+ *
+ * Storage is reserved once for the whole array. `arr` does not need to be NULL
+ * terminated.
+ *
+ * @param pStrList `StrList`
+ * @param arr array of strings
+ * @param count number of strings in `arr`
+ */
+void strlist_append_n(struct StrList *pStrList, char **arr, size_t count) {
+    if (!pStrList || !arr) {
+        return;
+    }
+
+    strlist_grow(&pStrList, count);
+    for (size_t i = 0; i < count; i++) {
+        char *item = strlist_strdup(pStrList, arr[i]);
+        if (item == NULL) {
+            guard_strlist_free(&pStrList);
+            perror("failed to append to array");
+            exit(1);
+        }
+        strlist_append_owned(pStrList, item);
+    }
 }
 
 static int reader_strlist_append_file(size_t lineno, char **line) {
@@ -110,9 +209,30 @@ int strlist_append_file(struct StrList *pStrList, char *_path, ReaderFn *readerF
         retval = 1;
         goto fatal;
     }
-    for (size_t record = 0; data[record] != NULL; record++) {
-        strlist_append(&pStrList, data[record]);
-        guard_free(data[record]);
+    size_t records;
+    for (records = 0; data[records] != NULL; records++);
+    strlist_grow(&pStrList, records);
+    for (size_t record = 0; record < records; record++) {
+        if (pStrList->arena) {
+            char *item = arena_strdup(pStrList->arena, data[record]);
+            if (item == NULL) {
+                // Lines already appended stay in the list
+                for (size_t i = record; i < records; i++) {
+                    guard_free(data[i]);
+                }
+                guard_free(data);
+                if (is_url) {
+                    remove(filename);
+                }
+                retval = -1;
+                goto fatal;
+            }
+            strlist_append_owned(pStrList, item);
+            guard_free(data[record]);
+        } else {
+            // The list takes ownership of each line
+            strlist_append_owned(pStrList, data[record]);
+        }
     }
     if (is_url) {
         // remove temporary data
@@ -142,10 +262,10 @@ void strlist_append_strlist(struct StrList *pStrList1, struct StrList *pStrList2
     }
 
     count = strlist_count(pStrList2);
-    for (size_t i = 0; i < count; i++) {
-        char *item = strlist_item(pStrList2, i);
-        strlist_append(&pStrList1, item);
-    }
+    // Reserve before reading pStrList2->data. When both lists are the same,
+    // growing the list moves the source array.
+    strlist_grow(&pStrList1, count);
+    strlist_append_n(pStrList1, pStrList2->data, count);
 }
 
 /**
@@ -154,12 +274,12 @@ void strlist_append_strlist(struct StrList *pStrList1, struct StrList *pStrList2
  * @param arr NULL terminated array of strings
  */
  void strlist_append_array(struct StrList *pStrList, char **arr) {
+     size_t count;
      if (!pStrList || !arr) {
          return;
      }
-     for (size_t i = 0; arr[i] != NULL; i++) {
-         strlist_append(&pStrList, arr[i]);
-     }
+     for (count = 0; arr[count] != NULL; count++);
+     strlist_append_n(pStrList, arr, count);
  }
 
 /**
@@ -169,20 +289,37 @@ void strlist_append_strlist(struct StrList *pStrList1, struct StrList *pStrList2
  * @param delim
  */
  void strlist_append_tokenize(struct StrList *pStrList, char *str, char *delim) {
-    char **token;
-     if (!str || !delim) {
+     struct StrSplit it;
+     struct StrView token;
+     size_t count = 0;
+     if (!pStrList || !str || !delim) {
          return;
      }
 
-     token = split(str, delim, 0);
-     if (token) {
-         for (size_t i = 0; token[i] != NULL; i++) {
-             strlist_append(&pStrList, token[i]);
+     str_split_init(&it, str, delim);
+     while (str_split_next(&it, &token)) {
+         count++;
+     }
+     strlist_grow(&pStrList, count);
+
+     str_split_init(&it, str, delim);
+     while (str_split_next(&it, &token)) {
+         char *item;
+         if (pStrList->arena) {
+             item = arena_strndup(pStrList->arena, token.ptr, token.len);
+         } else {
+             item = strndup(token.ptr, token.len);
+         }
+         if (!item) {
+             guard_strlist_free(&pStrList);
+             perror("failed to append to array");
+             exit(1);
          }
-         GENERIC_ARRAY_FREE(token);
+         strlist_append_owned(pStrList, item);
      }
  }
 
+
 /**
  * Produce a new copy of a `StrList`
  * @param pStrList  `StrList`
@@ -199,9 +336,7 @@ struct StrList *strlist_copy(struct StrList *pStrList) {
         return NULL;
     }
 
-    for (size_t i = 0; i < strlist_count(pStrList); i++) {
-        strlist_append(&result, strlist_item(pStrList, i));
-    }
+    strlist_append_n(result, pStrList->data, strlist_count(pStrList));
     return result;
 }
 
@@ -240,7 +375,7 @@ int strlist_cmp(struct StrList *a, struct StrList *b) {
         return -2;
     }
 
-    if (a->num_alloc != b->num_alloc || a->num_inuse != b->num_inuse) {
+    if (a->num_inuse != b->num_inuse) {
         return 1;
     }
 
@@ -317,6 +452,9 @@ void strlist_set(struct StrList **pStrList, size_t index, char *value) {
 
     if (value == NULL) {
         (*pStrList)->data[index] = NULL;
+    } else if ((*pStrList)->arena) {
+        // The previous value is released with the arena
+        (*pStrList)->data[index] = arena_strdup((*pStrList)->arena, value);
     } else {
         tmp = realloc((*pStrList)->data[index], (strlen(value) + 1) * sizeof(char *));
         if (!tmp) {
@@ -652,3 +790,19 @@ struct StrList *strlist_init() {
     pStrList->data = calloc(pStrList->num_alloc, sizeof(char *));
     return pStrList;
 }
+
+/**
+ * Initialize an empty `StrList` that allocates its records from `arena`
+ *
+ * Records are not freed by strlist_free(). They are released by arena_free().
+ *
+ * @param arena `Arena` (NULL behaves like strlist_init())
+ * @return `StrList`
+ */
+struct StrList *strlist_init_arena(struct Arena *arena) {
+    struct StrList *pStrList = strlist_init();
+    if (pStrList) {
+        pStrList->arena = arena;
+    }
+    return pStrList;
+}
@@ -8,16 +8,120 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 
 struct tpl_item {
     char *key;
     char **ptr;
 };
-struct tpl_item *tpl_pool[1024] = {0};
+
+struct tpl_namespace {
+    char *key;
+    tpl_resolver *resolver;
+    void *data;
+};
+
+/**
+ * Open addressing hash table keyed by string
+ *
+ * Values must begin with a `char *key` member. The table does not own its
+ * values.
+ */
+struct tpl_table {
+    struct tpl_table_entry {
+        uint64_t hash;
+        void *value;
+    } *entries;
+    size_t size;    //!< Number of entries allocated (always a power of two)
+    size_t used;    //!< Number of entries in use
+};
+
+static struct tpl_table tpl_pool;
 unsigned tpl_pool_used = 0;
-struct tplfunc_frame *tpl_pool_func[1024] = {0};
+static struct tpl_table tpl_pool_func;
 unsigned tpl_pool_func_used = 0;
+static struct tpl_table tpl_pool_namespace;
+// Incremented whenever registered items are released. Programs compiled
+// under an older generation must not use their cached items.
+static unsigned tpl_generation = 0;
+
+static const char *tpl_table_key(const void *value) {
+    return *(char * const *) value;
+}
+
+static struct tpl_table_entry *tpl_table_slot(const struct tpl_table *table, const char *key, size_t len, uint64_t hash) {
+    if (!table->size) {
+        return NULL;
+    }
+    for (size_t i = hash & (table->size - 1);; i = (i + 1) & (table->size - 1)) {
+        struct tpl_table_entry *entry = &table->entries[i];
+        if (!entry->value) {
+            return entry;
+        }
+        if (entry->hash == hash) {
+            const char *entry_key = tpl_table_key(entry->value);
+            if (!strncmp(entry_key, key, len) && entry_key[len] == '\0') {
+                return entry;
+            }
+        }
+    }
+}
+
+static void *tpl_table_get(const struct tpl_table *table, const char *key, size_t len, uint64_t hash) {
+    struct tpl_table_entry *entry = tpl_table_slot(table, key, len, hash);
+    return entry ? entry->value : NULL;
+}
+
+static int tpl_table_put(struct tpl_table *table, void *value) {
+    const char *key = tpl_table_key(value);
+    uint64_t hash = hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key));
+
+    // Keep the load factor at or below 50%
+    if ((table->used + 1) * 2 > table->size) {
+        struct tpl_table resized = {0};
+        resized.size = table->size ? table->size * 2 : 64;
+        resized.entries = calloc(resized.size, sizeof(*resized.entries));
+        if (!resized.entries) {
+            return -1;
+        }
+        for (size_t i = 0; i < table->size; i++) {
+            struct tpl_table_entry *entry = &table->entries[i];
+            if (entry->value) {
+                size_t slot = entry->hash & (resized.size - 1);
+                while (resized.entries[slot].value) {
+                    slot = (slot + 1) & (resized.size - 1);
+                }
+                resized.entries[slot] = *entry;
+            }
+        }
+        resized.used = table->used;
+        guard_free(table->entries);
+        *table = resized;
+    }
+
+    struct tpl_table_entry *entry = tpl_table_slot(table, key, strlen(key), hash);
+    if (!entry->value) {
+        table->used++;
+    }
+    entry->hash = hash;
+    entry->value = value;
+    return 0;
+}
+
+static void tpl_table_free(struct tpl_table *table, void (*value_free)(void *value)) {
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->entries[i].value && value_free) {
+            value_free(table->entries[i].value);
+        }
+    }
+    guard_free(table->entries);
+    table->size = 0;
+    table->used = 0;
+}
 
 extern void tpl_reset() {
     tpl_free();
@@ -26,285 +130,937 @@ extern void tpl_reset() {
 }
 
 void tpl_register_func(char *key, struct tplfunc_frame *frame) {
-    (void) key;  // TODO: placeholder
-    tpl_pool_func[tpl_pool_func_used] = calloc(1, sizeof(*tpl_pool_func[tpl_pool_func_used]));
-    memcpy(tpl_pool_func[tpl_pool_func_used], frame, sizeof(*frame));
+    struct tplfunc_frame *item = tpl_table_get(&tpl_pool_func, key, strlen(key), hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key)));
+    if (item) {
+        // Replace the existing function. Its key is reused.
+        char *item_key = item->key;
+        memcpy(item, frame, sizeof(*frame));
+        item->key = item_key;
+        return;
+    }
+
+    item = calloc(1, sizeof(*item));
+    if (!item) {
+        SYSERROR("unable to register tplfunc_frame for %s", key);
+        exit(1);
+    }
+    memcpy(item, frame, sizeof(*frame));
+    item->key = strdup(key);
+    if (!item->key || tpl_table_put(&tpl_pool_func, item)) {
+        SYSERROR("unable to register tplfunc_frame for %s", key);
+        exit(1);
+    }
     tpl_pool_func_used++;
 }
 
-int tpl_key_exists(char *key) {
-    for (size_t i = 0; i < tpl_pool_used; i++) {
-        if (tpl_pool[i]->key) {
-            if (!strcmp(tpl_pool[i]->key, key)) {
-                return true;
-            }
+void tpl_register_namespace(char *ns, tpl_resolver *resolver, void *data) {
+    struct tpl_namespace *item = tpl_table_get(&tpl_pool_namespace, ns, strlen(ns), hash_fnv1a(HASH_FNV1A_INIT, ns, strlen(ns)));
+    if (!item) {
+        item = calloc(1, sizeof(*item));
+        if (!item || !(item->key = strdup(ns)) || tpl_table_put(&tpl_pool_namespace, item)) {
+            SYSERROR("unable to register template namespace %s", ns);
+            exit(1);
         }
     }
-    return false;
+    item->resolver = resolver;
+    item->data = data;
+}
+
+static struct tpl_item *tpl_lookup(const char *key, size_t len, uint64_t hash) {
+    return tpl_table_get(&tpl_pool, key, len, hash);
+}
+
+int tpl_key_exists(char *key) {
+    return tpl_lookup(key, strlen(key), hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key))) != NULL;
 }
 
 void tpl_register(char *key, char **ptr) {
-    struct tpl_item *item = NULL;
-    int replacing = 0;
-
-    if (tpl_key_exists(key)) {
-        for (size_t i = 0; i < tpl_pool_used; i++) {
-            if (tpl_pool[i]->key) {
-                if (!strcmp(tpl_pool[i]->key, key)) {
-                    item = tpl_pool[i];
-                    break;
-                }
-            }
-        }
-        replacing = 1;
-    } else {
+    struct tpl_item *item = tpl_lookup(key, strlen(key), hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key)));
+    int replacing = item != NULL;
+
+    if (!replacing) {
         item = calloc(1, sizeof(*item));
-        item->key = strdup(key);
+        if (item) {
+            item->key = strdup(key);
+        }
     }
 
-    if (!item) {
+    if (!item || !item->key) {
         SYSERROR("unable to register tpl_item for %s", key);
         exit(1);
     }
 
     item->ptr = ptr;
     if (!replacing) {
-        tpl_pool[tpl_pool_used] = item;
+        if (tpl_table_put(&tpl_pool, item)) {
+            SYSERROR("unable to register tpl_item for %s", key);
+            exit(1);
+        }
         tpl_pool_used++;
     }
 }
 
-void tpl_free() {
-    for (unsigned i = 0; i < tpl_pool_used; i++) {
-        struct tpl_item *item = tpl_pool[i];
-        if (item) {
-            if (item->key) {
+static void tpl_item_free(void *value) {
+    struct tpl_item *item = value;
 #ifdef DEBUG
-                SYSERROR("freeing template item key: %s", item->key);
+    SYSERROR("freeing template item key: %s", item->key);
 #endif
-                guard_free(item->key);
-            }
+    guard_free(item->key);
 #ifdef DEBUG
-            SYSERROR("freeing template item: %p", item);
+    SYSERROR("freeing template item: %p", item);
 #endif
-            item->ptr = NULL;
-        }
-        guard_free(item);
+    item->ptr = NULL;
+    guard_free(item);
+}
+
+static void tpl_keyed_free(void *value) {
+    // tplfunc_frame and tpl_namespace records begin with an allocated key
+    char **key = value;
+    guard_free(*key);
+    guard_free(value);
+}
+
+void tpl_free() {
+    tpl_table_free(&tpl_pool, tpl_item_free);
+    tpl_table_free(&tpl_pool_func, tpl_keyed_free);
+    tpl_table_free(&tpl_pool_namespace, tpl_keyed_free);
+    tpl_generation++;
+}
+
+/**
+ * Resolve `name` through a namespace
+ *
+ * The "env" namespace resolves to the runtime environment unless another
+ * resolver has been registered for it.
+ *
+ * @param ns namespace name
+ * @param ns_len length of `ns`
+ * @param name key within the namespace
+ * @param result set to the resolved value
+ * @return 1 if the namespace exists, 0 if not
+ */
+static int tpl_resolve_namespace(const char *ns, size_t ns_len, const char *name, char **result) {
+    struct tpl_namespace *item = tpl_table_get(&tpl_pool_namespace, ns, ns_len, hash_fnv1a(HASH_FNV1A_INIT, ns, ns_len));
+    if (item) {
+        *result = item->resolver(name, item->data);
+        return 1;
     }
-    for (unsigned i = 0; i < tpl_pool_func_used; i++) {
-        struct tplfunc_frame *item = tpl_pool_func[i];
-        guard_free(item);
+    if (ns_len == 3 && !strncmp(ns, "env", ns_len)) {
+        *result = getenv(name);
+        return 1;
     }
+    return 0;
+}
+
+/**
+ * Resolve a key that is not registered through its namespace.
+ * The namespace is the text before the first ':' or '.' in the key.
+ * @param key key to resolve
+ * @return the resolved value, or NULL
+ */
+static char *tpl_resolve_key(const char *key) {
+    char *result = NULL;
+    const char *sep = strpbrk(key, ":.");
+    if (sep) {
+        tpl_resolve_namespace(key, sep - key, sep + 1, &result);
+    }
+    return result;
 }
 
 char *tpl_getval(char *key) {
     char *result = NULL;
-    for (size_t i = 0; i < tpl_pool_used; i++) {
-        if (tpl_pool[i]->key) {
-            if (!strcmp(tpl_pool[i]->key, key)) {
-                result = *tpl_pool[i]->ptr;
-                break;
-            }
-        }
+    struct tpl_item *item = tpl_lookup(key, strlen(key), hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key)));
+    if (item) {
+        result = *item->ptr;
+    } else {
+        result = tpl_resolve_key(key);
     }
     return result;
 }
 
 struct tplfunc_frame *tpl_getfunc(char *key) {
-    struct tplfunc_frame *result = NULL;
-    for (size_t i = 0; i < tpl_pool_func_used; i++) {
-        if (tpl_pool_func[i]->key) {
-            if (!strcmp(tpl_pool_func[i]->key, key)) {
-                result = tpl_pool_func[i];
-                break;
+    return tpl_table_get(&tpl_pool_func, key, strlen(key), hash_fnv1a(HASH_FNV1A_INIT, key, strlen(key)));
+}
+
+/**
+ * Receives each instruction produced by `tpl_parse`
+ *
+ * The callee owns `insn->name` and `insn->args`, even on failure.
+ */
+typedef int tpl_visit(struct tpl_instruction *insn, void *data);
+
+static void tpl_instruction_free(struct tpl_instruction *insn) {
+    guard_free(insn->name);
+    GENERIC_ARRAY_FREE(insn->args);
+}
+
+/**
+ * Parse the body of a `{{ func:NAME(a, ...) }}` tag
+ * @param insn instruction to populate
+ * @param body function name followed by its argument list
+ * @return 0 on success, -1 on error
+ */
+static int tpl_compile_func(struct tpl_instruction *insn, const char *body) {
+    const char *param_begin = strchr(body, '(');
+    if (!param_begin) {
+        fprintf(stderr, "offset %zu: function name must be followed by a '('\n", insn->offset);
+        return -1;
+    }
+    const char *param_end = strrchr(param_begin, ')');
+    if (!param_end) {
+        fprintf(stderr, "offset %zu: function arguments must be closed with a ')'\n", insn->offset);
+        return -1;
+    }
+
+    insn->name = strndup(body, param_begin - body);
+    char *params = strndup(param_begin + 1, param_end - param_begin - 1);
+    if (!insn->name || !params) {
+        guard_free(params);
+        return -1;
+    }
+    insn->args = split(params, ",", 0);
+    guard_free(params);
+    if (!insn->args) {
+        return -1;
+    }
+    for (insn->argc = 0; insn->args[insn->argc] != NULL; insn->argc++) {
+        lstrip(insn->args[insn->argc]);
+        strip(insn->args[insn->argc]);
+    }
+    return 0;
+}
+
+/**
+ * Split a template into instructions
+ *
+ * TPL_OP_TEXT instructions point into `str`, so it must outlive them.
+ *
+ * @param str template text (need not be NUL terminated)
+ * @param len length of `str`
+ * @param visit function called for each instruction, in order
+ * @param data passed to `visit`
+ * @return 0 on success, -1 on error
+ */
+static int tpl_parse(const char *str, size_t len, tpl_visit *visit, void *data) {
+    const char *pos = str;
+    const char *end = str + len;
+    const char *literal = pos;
+
+    while ((pos = bytes_find_str(pos, end - pos, "{{", 2))) {
+        struct tpl_instruction insn = {.offset = pos - str};
+        char key[STASIS_NAME_MAX] = {0};
+        size_t key_len = 0;
+        const char *key_end;
+        const char *b_close;
+
+        // Text leading up to the tag
+        if (pos > literal) {
+            struct tpl_instruction text = {.op = TPL_OP_TEXT, .text = literal, .len = pos - literal, .offset = literal - str};
+            if (visit(&text, data)) {
+                return -1;
+            }
+        }
+
+        // Scan until key is reached
+        pos += 2;
+        while (pos < end && *pos != '}' && !isalnum((unsigned char) *pos)) {
+            pos++;
+        }
+
+        // Read key name, ignoring whitespace
+        key_end = bytes_find(pos, end - pos, '}');
+        if (!key_end || !(b_close = bytes_find_str(key_end, end - key_end, "}}", 2))) {
+            fprintf(stderr, "error while templating '%.*s'\n\nunbalanced brace at position %zu\n", (int) len, str, insn.offset);
+            return -1;
+        }
+        for (; pos < key_end; pos++) {
+            if (isspace((unsigned char) *pos)) {
+                continue;
+            }
+            if (key_len >= sizeof(key) - 1) {
+                fprintf(stderr, "offset %zu: template key is too long\n", insn.offset);
+                return -1;
+            }
+            key[key_len++] = *pos;
+        }
+
+        char *type_stop = strchr(key, ':');
+        if (type_stop && !strncmp(key, "env", type_stop - key) && type_stop - key == 3) {
+            // {{ env:VAR }}
+            insn.op = TPL_OP_ENV;
+            insn.name = strdup(type_stop + 1);
+        } else if (type_stop && !strncmp(key, "func", type_stop - key) && type_stop - key == 4) {
+            // {{ func:NAME(a, ...) }}
+            insn.op = TPL_OP_FUNC;
+            if (tpl_compile_func(&insn, type_stop + 1)) {
+                tpl_instruction_free(&insn);
+                return -1;
             }
+        } else {
+            // {{ VAR }}
+            insn.op = TPL_OP_VAR;
+            insn.name = strdup(key);
+            insn.hash = hash_fnv1a(HASH_FNV1A_INIT, key, key_len);
+            insn.item = tpl_lookup(key, key_len, insn.hash);
         }
+        if (!insn.name) {
+            tpl_instruction_free(&insn);
+            return -1;
+        }
+        if (visit(&insn, data)) {
+            return -1;
+        }
+
+        // Jump past closing brace
+        pos = b_close + 2;
+        literal = pos;
     }
-    return result;
+
+    // Text following the last tag
+    if (end > literal) {
+        struct tpl_instruction text = {.op = TPL_OP_TEXT, .text = literal, .len = end - literal, .offset = literal - str};
+        if (visit(&text, data)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int tpl_program_emit(struct tpl_instruction *insn, void *data) {
+    struct tpl_program *prog = data;
+    if (prog->count == prog->alloc) {
+        size_t new_alloc = prog->alloc ? prog->alloc * 2 : 16;
+        struct tpl_instruction *tmp = realloc(prog->code, new_alloc * sizeof(*prog->code));
+        if (!tmp) {
+            SYSERROR("unable to grow template program to %zu instructions", new_alloc);
+            tpl_instruction_free(insn);
+            return -1;
+        }
+        prog->code = tmp;
+        prog->alloc = new_alloc;
+    }
+    if (insn->op == TPL_OP_TEXT) {
+        prog->text_len += insn->len;
+    }
+    prog->code[prog->count] = *insn;
+    prog->count++;
+    return 0;
+}
+
+struct tpl_program *tpl_compile(const char *str) {
+    struct tpl_program *prog = NULL;
+
+    if (!str) {
+        return NULL;
+    }
+    prog = calloc(1, sizeof(*prog));
+    if (!prog) {
+        SYSERROR("%s", "unable to allocate template program");
+        return NULL;
+    }
+    prog->generation = tpl_generation;
+    prog->source = strdup(str);
+    if (!prog->source || tpl_parse(prog->source, strlen(prog->source), tpl_program_emit, prog)) {
+        tpl_program_free(&prog);
+        return NULL;
+    }
+    return prog;
+}
+
+void tpl_program_free(struct tpl_program **prog) {
+    if (!prog || !*prog) {
+        return;
+    }
+    for (size_t i = 0; i < (*prog)->count; i++) {
+        tpl_instruction_free(&(*prog)->code[i]);
+    }
+    guard_free((*prog)->code);
+    guard_free((*prog)->source);
+    guard_free(*prog);
+}
+
+/**
+ * Call a registered template function
+ * @param insn TPL_OP_FUNC instruction
+ * @param result output buffer
+ * @param maxlen size of `result`
+ * @return 0 on success, -1 on error
+ */
+static int tpl_call(const struct tpl_instruction *insn, char *result, size_t maxlen) {
+    struct tplfunc_frame *registered = tpl_getfunc(insn->name);
+    if (!registered) {
+        fprintf(stderr, "offset %zu: Unknown function: %s()\n", insn->offset, insn->name);
+        return -1;
+    }
+    memset(result, 0, maxlen);
+    if (insn->argc > registered->argc) {
+        fprintf(stderr, "offset %zu: Too many arguments for function: %s()\n", insn->offset, registered->key);
+        return 0;
+    }
+
+    // Arguments are bound to a copy of the frame so the registered frame is never modified
+    struct tplfunc_frame frame = *registered;
+    for (int p = 0; p < insn->argc && p < (int) (sizeof(frame.argv) / sizeof(*frame.argv)); p++) {
+        frame.argv[p].t_char_ptr = insn->args[p];
+    }
+    frame.func(&frame, result);
+    result[maxlen - 1] = '\0';
+    return 0;
 }
 
-static int grow(size_t z, size_t *output_bytes, char **output) {
-    if (z >= *output_bytes) {
-        size_t new_size = *output_bytes + z + 1;
+/**
+ * Produce the output of one instruction
+ * @param insn instruction to evaluate
+ * @param generation registry generation `insn` was parsed under
+ * @param scratch storage for function results
+ * @param maxlen size of `scratch`
+ * @param result set to the output text. It remains valid until `scratch` is
+ * reused or the registered value changes.
+ * @return 0 on success, -1 on error
+ */
+static int tpl_eval(const struct tpl_instruction *insn, unsigned generation, char *scratch, size_t maxlen, struct StrView *result) {
+    const char *value = NULL;
+
+    switch (insn->op) {
+        case TPL_OP_TEXT:
+            *result = strview_n(insn->text, insn->len);
+            return 0;
+        case TPL_OP_VAR: {
+            const struct tpl_item *item = insn->item;
+            if (!item || generation != tpl_generation) {
+                item = tpl_lookup(insn->name, strlen(insn->name), insn->hash);
+            }
+            value = item ? *item->ptr : tpl_resolve_key(insn->name);
+            break;
+        }
+        case TPL_OP_ENV: {
+            char *env_val = NULL;
+            tpl_resolve_namespace("env", 3, insn->name, &env_val);
+            value = env_val;
+            break;
+        }
+        case TPL_OP_FUNC:
+            if (tpl_call(insn, scratch, maxlen)) {
+                return -1;
+            }
+            value = scratch;
+            break;
+    }
+    *result = strview(value);
+    return 0;
+}
+
+/**
+ * Growable output buffer used by tpl_execute()
+ */
+struct tpl_buffer {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+static int tpl_buffer_append(struct tpl_buffer *buf, const char *str, size_t len) {
+    if (buf->len + len + 1 > buf->size) {
+        size_t new_size = buf->size;
+        while (buf->len + len + 1 > new_size) {
+            new_size *= 2;
+        }
 #ifdef DEBUG
         fprintf(stderr, "template output buffer new size: %zu\n", new_size);
 #endif
-        char *tmp = realloc(*output, new_size);
+        char *tmp = realloc(buf->data, new_size);
         if (!tmp) {
             perror("realloc failed");
             return -1;
-        } else if (tmp != *output) {
-            *output = tmp;
         }
-        *output_bytes = new_size;
+        buf->data = tmp;
+        buf->size = new_size;
     }
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
     return 0;
 }
 
-char *tpl_render(char *str) {
-    if (!str) {
+char *tpl_execute(const struct tpl_program *prog) {
+    struct tpl_buffer buf = {0};
+    char scratch[STASIS_NAME_MAX];
+
+    if (!prog) {
         return NULL;
-    } else if (!strlen(str)) {
-        return strdup("");
     }
-    size_t output_bytes = 1024 + strlen(str); // TODO: Is grow working correctly?
-    char *output = NULL;
-    char *b_close = NULL;
-    char *pos = NULL;
-    pos = str;
-
-    output = calloc(output_bytes, sizeof(*output));
-    if (!output) {
+    buf.size = prog->text_len + 1024;
+    buf.data = calloc(buf.size, sizeof(*buf.data));
+    if (!buf.data) {
         perror("unable to allocate output buffer");
         return NULL;
     }
+    for (size_t i = 0; i < prog->count; i++) {
+        struct StrView value;
+        if (tpl_eval(&prog->code[i], prog->generation, scratch, sizeof(scratch), &value)
+            || tpl_buffer_append(&buf, value.ptr, value.len)) {
+            guard_free(buf.data);
+            return NULL;
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr, "template output length: %zu\n", buf.len);
+    fprintf(stderr, "template output bytes: %zu\n", buf.size);
+#endif
+    return buf.data;
+}
 
-    for (size_t off = 0, z = 0; off < strlen(str); off++) {
-        char key[255] = {0};
-        char *value = NULL;
+char *tpl_render(char *str) {
+    struct tpl_program *prog = tpl_compile(str);
+    char *output = tpl_execute(prog);
+    tpl_program_free(&prog);
+    return output;
+}
 
-        memset(key, 0, sizeof(key));
-        grow(z, &output_bytes, &output);
-        // At opening brace
-        if (!strncmp(&pos[off], "{{", 2)) {
-            // Scan until key is reached
-            while (!isalnum(pos[off])) {
-                off++;
-            }
+#define TPL_WRITER_IOV_MAX 64
 
-            // Read key name
-            size_t key_len = 0;
-            while (isalnum(pos[off]) || pos[off] != '}') {
-                if (isspace(pos[off]) || isblank(pos[off])) {
-                    // skip whitespace in key
-                    off++;
-                    continue;
-                }
-                key[key_len] = pos[off];
-                key_len++;
-                off++;
-            }
+/**
+ * Collects output spans and writes them to a file descriptor with writev()
+ */
+struct tpl_writer {
+    int fd;
+    int count;
+    struct iovec iov[TPL_WRITER_IOV_MAX];
+    char scratch[STASIS_NAME_MAX];
+    unsigned generation;
+};
 
-            char *type_stop = NULL;
-            type_stop = strchr(key, ':');
+static int tpl_writer_flush(struct tpl_writer *writer) {
+    struct iovec *iov = writer->iov;
+    int count = writer->count;
 
-            int do_env = 0;
-            int do_func = 0;
-            if (type_stop) {
-                if (!strncmp(key, "env", type_stop - key)) {
-                    do_env = 1;
-                } else if (!strncmp(key, "func", type_stop - key)) {
-                    do_func = 1;
-                }
+    while (count) {
+        ssize_t written = writev(writer->fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            return -1;
+        }
+        // Drop the spans that were written completely, and trim a partial one
+        while (count && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    writer->count = 0;
+    return 0;
+}
 
-            // Find closing brace
-            b_close = strstr(&pos[off], "}}");
-            if (!b_close) {
-                fprintf(stderr, "error while templating '%s'\n\nunbalanced brace at position %zu\n", str, z);
-                return NULL;
-            } else {
-                // Jump past closing brace
-                off = ((b_close + 2) - pos);
-            }
+static int tpl_writer_add(struct tpl_writer *writer, const char *str, size_t len) {
+    if (!len) {
+        return 0;
+    }
+    if (writer->count == TPL_WRITER_IOV_MAX && tpl_writer_flush(writer)) {
+        return -1;
+    }
+    writer->iov[writer->count].iov_base = (void *) str;
+    writer->iov[writer->count].iov_len = len;
+    writer->count++;
+    return 0;
+}
 
-            if (do_env) { // {{ env:VAR }}
-                char *k = type_stop + 1;
-                size_t klen = strlen(k);
-                memmove(key, k, klen);
-                key[klen] = 0;
-                char *env_val = getenv(key);
-                value = strdup(env_val ? env_val : "");
-            } else if (do_func) { // {{ func:NAME(a, ...) }}
-                char func_name_temp[STASIS_NAME_MAX] = {0};
-                strcpy(func_name_temp, type_stop + 1);
-                char *param_begin = strchr(func_name_temp, '(');
-                if (!param_begin) {
-                    fprintf(stderr, "offset %zu: function name must be followed by a '('\n", off);
-                    guard_free(output);
-                    return NULL;
-                }
-                *param_begin = 0;
-                param_begin++;
-                char *param_end = strrchr(param_begin, ')');
-                if (!param_end) {
-                    fprintf(stderr, "offset %zu: function arguments must be closed with a ')'\n", off);
-                    guard_free(output);
-                    return NULL;
-                }
-                *param_end = 0;
-                char *k = func_name_temp;
-                char **params = split(param_begin, ",", 0);
-                int params_count;
-                for (params_count = 0; params[params_count] != NULL; params_count++);
-
-                struct tplfunc_frame *frame = tpl_getfunc(k);
-                if (params_count > frame->argc) {
-                    fprintf(stderr, "offset %zu: Too many arguments for function: %s()\n", off, frame->key);
-                    value = strdup("");
-                } else {
-                    for (size_t p = 0; p < sizeof(frame->argv) / sizeof(*frame->argv) && params[p] != NULL; p++) {
-                        lstrip(params[p]);
-                        strip(params[p]);
-                        frame->argv[p].t_char_ptr = params[p];
-                    }
-                    char func_result[100];
-                    char *fres = func_result;
-                    frame->func(frame, fres);
-                    value = strdup(fres);
-                }
-                GENERIC_ARRAY_FREE(params);
-            } else {
-                // Read replacement value
-                value = strdup(tpl_getval(key) ? tpl_getval(key) : "");
-            }
+static int tpl_writer_emit(const struct tpl_instruction *insn, struct tpl_writer *writer) {
+    struct StrView value;
+    if (tpl_eval(insn, writer->generation, writer->scratch, sizeof(writer->scratch), &value)
+        || tpl_writer_add(writer, value.ptr, value.len)) {
+        return -1;
+    }
+    // Function results live in the scratch buffer and must be written before it is reused
+    if (insn->op == TPL_OP_FUNC) {
+        return tpl_writer_flush(writer);
+    }
+    return 0;
+}
+
+static int tpl_writer_visit(struct tpl_instruction *insn, void *data) {
+    int result = tpl_writer_emit(insn, data);
+    tpl_instruction_free(insn);
+    return result;
+}
+
+int tpl_execute_fd(const struct tpl_program *prog, int fd) {
+    struct tpl_writer writer = {.fd = fd};
+
+    if (!prog) {
+        return -1;
+    }
+    writer.generation = prog->generation;
+    for (size_t i = 0; i < prog->count; i++) {
+        if (tpl_writer_emit(&prog->code[i], &writer)) {
+            return -1;
         }
+    }
+    return tpl_writer_flush(&writer);
+}
+
+int tpl_render_fd(const char *str, size_t len, int fd) {
+    struct tpl_writer writer = {.fd = fd, .generation = tpl_generation};
+
+    if (!str) {
+        return -1;
+    }
+    if (tpl_parse(str, len, tpl_writer_visit, &writer)) {
+        return -1;
+    }
+    if (tpl_writer_flush(&writer)) {
+        perror("unable to write template output");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Produces the contents of an output file
+ * @param fd destination file descriptor
+ * @param data passed through from `tpl_write_atomic`
+ * @return 0 on success, -1 on error
+ */
+typedef int tpl_emit(int fd, void *data);
+
+/**
+ * Write a temporary file with `emit` and rename it to `filename`
+ * @param filename output file name
+ * @param emit writes the contents
+ * @param data passed to `emit`
+ * @return 0 on success, -1 on error
+ */
+static int tpl_write_atomic(const char *filename, tpl_emit *emit, void *data) {
+    static unsigned counter = 0;
+    char tempfile[PATH_MAX];
+    int fd;
+
+    // Created in the destination's directory so rename() does not cross file systems.
+    // mkstemp() is not used because it ignores the umask.
+    if ((size_t) snprintf(tempfile, sizeof(tempfile), "%s.tmp.%d.%u", filename, (int) getpid(),
+                          __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED)) >= sizeof(tempfile)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = open(tempfile, O_WRONLY | O_CREAT | O_EXCL | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(tempfile);
+        return -1;
+    }
+    if (emit(fd, data)) {
+        close(fd);
+        remove(tempfile);
+        return -1;
+    }
+    if (close(fd) || rename(tempfile, filename)) {
+        perror(filename);
+        remove(tempfile);
+        return -1;
+    }
+    return 0;
+}
 
-        if (value) {
-            // Set output iterator to end of replacement value
-            z += strlen(value);
+static int tpl_emit_render(int fd, void *data) {
+    const struct StrView *str = data;
+    return tpl_render_fd(str->ptr, str->len, fd);
+}
+
+/**
+ * Render `len` bytes of `str` to a temporary file and rename it to `filename`
+ * @param str template text
+ * @param len length of `str`
+ * @param filename output file name
+ * @return 0 on success, -1 on error
+ */
+static int tpl_render_atomic(const char *str, size_t len, const char *filename) {
+    struct StrView view = strview_n(str, len);
+    return tpl_write_atomic(filename, tpl_emit_render, &view);
+}
 
-            // Append replacement value
-            grow(z, &output_bytes, &output);
-            strcat(output, value);
-            guard_free(value);
-            output[z] = 0;
+/**
+ * Map a template file into memory
+ * @param filename path to template
+ * @param len set to the size of the file
+ * @return pointer to the file contents, or NULL on error. Release with `tpl_unmap_file`
+ */
+static char *tpl_map_file(const char *filename, size_t *len) {
+    struct stat st;
+    char *data = "";
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror(filename);
+        return NULL;
+    }
+    if (fstat(fd, &st)) {
+        perror(filename);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(filename);
+            close(fd);
+            return NULL;
         }
+    }
+    close(fd);
+    *len = st.st_size;
+    return data;
+}
 
-#ifdef DEBUG
-        fprintf(stderr, "z=%zu, output_bytes=%zu\n", z, output_bytes);
-#endif
-        output[z] = pos[off];
-        z++;
+static void tpl_unmap_file(char *data, size_t len) {
+    if (len) {
+        munmap(data, len);
     }
-#ifdef DEBUG
-    fprintf(stderr, "template output length: %zu\n", strlen(output));
-    fprintf(stderr, "template output bytes: %zu\n", output_bytes);
-#endif
-    return output;
 }
 
-int tpl_render_to_file(char *str, const char *filename) {
-    char *result;
-    FILE *fp;
+int tpl_render_file(const char *src, const char *dest) {
+    size_t len;
+    char *data = tpl_map_file(src, &len);
+    if (!data) {
+        return -1;
+    }
+    int result = tpl_render_atomic(data, len, dest);
+    tpl_unmap_file(data, len);
+    return result;
+}
+
+/**
+ * A span of rendered output: literal text from the template, or a value
+ * stored in `tpl_fingerprint_state.values`
+ */
+struct tpl_span {
+    const char *text;   //!< Literal text, or NULL for a stored value
+    size_t offset;      //!< Offset of a stored value
+    size_t len;
+};
+
+struct tpl_fingerprint_state {
+    uint64_t hash;
+    unsigned generation;
+    char scratch[STASIS_NAME_MAX];
+    int record;                 //!< Keep the output spans, so the template can be written without evaluating it again
+    struct tpl_span *spans;
+    size_t count;
+    size_t alloc;
+    struct tpl_buffer values;   //!< Copies of the tag values
+};
+
+static int tpl_fingerprint_record(struct tpl_fingerprint_state *state, const struct tpl_span *span) {
+    if (state->count == state->alloc) {
+        size_t new_alloc = state->alloc ? state->alloc * 2 : 64;
+        struct tpl_span *tmp = realloc(state->spans, new_alloc * sizeof(*state->spans));
+        if (!tmp) {
+            SYSERROR("unable to grow template output to %zu spans", new_alloc);
+            return -1;
+        }
+        state->spans = tmp;
+        state->alloc = new_alloc;
+    }
+    state->spans[state->count++] = *span;
+    return 0;
+}
+
+static void tpl_fingerprint_state_free(struct tpl_fingerprint_state *state) {
+    guard_free(state->spans);
+    guard_free(state->values.data);
+}
+
+static int tpl_fingerprint_visit(struct tpl_instruction *insn, void *data) {
+    struct tpl_fingerprint_state *state = data;
+    struct StrView value;
+    int result = 0;
+
+    if (insn->op == TPL_OP_TEXT) {
+        if (state->record) {
+            result = tpl_fingerprint_record(state, &(struct tpl_span) {.text = insn->text, .len = insn->len});
+        }
+    } else {
+        result = tpl_eval(insn, state->generation, state->scratch, sizeof(state->scratch), &value);
+        if (!result) {
+            // Lengths keep adjacent values from producing the same byte stream
+            state->hash = hash_fnv1a(state->hash, insn->name, strlen(insn->name) + 1);
+            state->hash = hash_fnv1a(state->hash, &value.len, sizeof(value.len));
+            state->hash = hash_fnv1a(state->hash, value.ptr, value.len);
+        }
+        // Values may live in the scratch buffer or in a resolver's static storage, so they are copied
+        if (!result && state->record) {
+            const size_t offset = state->values.len;
+            result = tpl_buffer_append(&state->values, value.ptr, value.len)
+                     || tpl_fingerprint_record(state, &(struct tpl_span) {.offset = offset, .len = value.len});
+        }
+    }
+    tpl_instruction_free(insn);
+    return result;
+}
+
+/**
+ * Hash a template, and optionally record its output
+ * @param state initialized state. With `state->record`, the caller must release it with `tpl_fingerprint_state_free`
+ * @return 0 on success, -1 on error
+ */
+static int tpl_fingerprint_run(const char *str, size_t len, struct tpl_fingerprint_state *state) {
+    state->hash = HASH_FNV1A_INIT;
+    state->generation = tpl_generation;
+    if (state->record) {
+        state->values.size = 1024;
+        state->values.data = calloc(state->values.size, sizeof(*state->values.data));
+        if (!state->values.data) {
+            perror("unable to allocate template values");
+            return -1;
+        }
+    }
+    return tpl_parse(str, len, tpl_fingerprint_visit, state);
+}
 
-    // Render the input string
-    result = tpl_render(str);
-    if (!result) {
+int tpl_fingerprint(const char *str, size_t len, uint64_t *source_hash, uint64_t *values_hash) {
+    struct tpl_fingerprint_state state = {0};
+
+    if (!str || tpl_fingerprint_run(str, len, &state)) {
         return -1;
     }
+    *source_hash = hash_fnv1a(HASH_FNV1A_INIT, str, len);
+    *values_hash = state.hash;
+    return 0;
+}
 
-    // Open the destination file for writing
-    fp = fopen(filename, "w+");
-    if (!fp) {
-        guard_free(result);
+// Write the output recorded by tpl_fingerprint_run()
+static int tpl_emit_spans(int fd, void *data) {
+    const struct tpl_fingerprint_state *state = data;
+    struct tpl_writer writer = {.fd = fd};
+
+    for (size_t i = 0; i < state->count; i++) {
+        const struct tpl_span *span = &state->spans[i];
+        if (tpl_writer_add(&writer, span->text ? span->text : state->values.data + span->offset, span->len)) {
+            return -1;
+        }
+    }
+    if (tpl_writer_flush(&writer)) {
+        perror("unable to write template output");
         return -1;
     }
+    return 0;
+}
 
-    // Write rendered string to file
-    fprintf(fp, "%s", result);
+/**
+ * Record of the inputs used to produce a rendered file
+ */
+struct tpl_render_state {
+    uint64_t source_hash;
+    uint64_t values_hash;
+    long long size;         //!< Size of the output file after rendering
+    long long mtime_sec;    //!< Modification time of the output file after rendering
+    long mtime_nsec;
+};
+
+static int tpl_state_path(const char *dest, const char *state_dir, char *result, size_t maxlen) {
+    const uint64_t hash = hash_fnv1a(HASH_FNV1A_INIT, dest, strlen(dest));
+    if ((size_t) snprintf(result, maxlen, "%s/%016llx.tpl-state", state_dir, (unsigned long long) hash) >= maxlen) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static int tpl_state_read(const char *filename, struct tpl_render_state *state) {
+    unsigned long long source_hash;
+    unsigned long long values_hash;
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        return -1;
+    }
+    int matched = fscanf(fp, "source=%llx values=%llx size=%lld mtime=%lld.%ld",
+                         &source_hash, &values_hash, &state->size, &state->mtime_sec, &state->mtime_nsec);
     fclose(fp);
+    if (matched != 5) {
+        return -1;
+    }
+    state->source_hash = source_hash;
+    state->values_hash = values_hash;
+    return 0;
+}
+
+static int tpl_state_write(const char *filename, const struct tpl_render_state *state) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp, "source=%016llx values=%016llx size=%lld mtime=%lld.%09ld\n",
+            (unsigned long long) state->source_hash, (unsigned long long) state->values_hash,
+            state->size, state->mtime_sec, state->mtime_nsec);
+    return fclose(fp);
+}
+
+static void tpl_state_set_output(struct tpl_render_state *state, const struct stat *st) {
+    state->size = st->st_size;
+    state->mtime_sec = STAT_MTIM(*st).tv_sec;
+    state->mtime_nsec = STAT_MTIM(*st).tv_nsec;
+}
 
-    guard_free(result);
+int tpl_render_file_incremental(const char *src, const char *dest, const char *state_dir) {
+    struct tpl_render_state previous = {0};
+    struct tpl_render_state current = {0};
+    char state_file[PATH_MAX];
+    struct stat st;
+    size_t len;
+    char *data;
+    int result;
+
+    if (!state_dir || tpl_state_path(dest, state_dir, state_file, sizeof(state_file))) {
+        return tpl_render_file(src, dest);
+    }
+    data = tpl_map_file(src, &len);
+    if (!data) {
+        return -1;
+    }
+    // Tags are evaluated once. The output is written from the values that were hashed.
+    struct tpl_fingerprint_state values = {.record = 1};
+    if (tpl_fingerprint_run(data, len, &values)) {
+        tpl_fingerprint_state_free(&values);
+        tpl_unmap_file(data, len);
+        return -1;
+    }
+    current.source_hash = hash_fnv1a(HASH_FNV1A_INIT, data, len);
+    current.values_hash = values.hash;
+
+    // Skip the output when the inputs match, and the file is exactly as it was left
+    if (!tpl_state_read(state_file, &previous) && !stat(dest, &st)) {
+        tpl_state_set_output(&current, &st);
+        if (previous.source_hash == current.source_hash && previous.values_hash == current.values_hash
+            && previous.size == current.size && previous.mtime_sec == current.mtime_sec
+            && previous.mtime_nsec == current.mtime_nsec) {
+            tpl_fingerprint_state_free(&values);
+            tpl_unmap_file(data, len);
+            return TPL_RENDER_UNCHANGED;
+        }
+    }
+
+    result = tpl_write_atomic(dest, tpl_emit_spans, &values);
+    tpl_fingerprint_state_free(&values);
+    tpl_unmap_file(data, len);
+    if (result) {
+        return result;
+    }
+    if (!stat(dest, &st)) {
+        tpl_state_set_output(&current, &st);
+        if (tpl_state_write(state_file, &current)) {
+            perror(state_file);
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+int tpl_render_to_file(char *str, const char *filename) {
+    if (!str) {
+        return -1;
+    }
+    return tpl_render_atomic(str, strlen(str), filename);
+}
@@ -1,4 +1,5 @@
 #include <stdarg.h>
+#include <fcntl.h>
 #include "core.h"
 
 char *dirstack[STASIS_DIRSTACK_MAX];
@@ -31,46 +32,369 @@ int popd() {
     return result;
 }
 
-int rmtree(char *_path) {
-    int status = 0;
-    char path[PATH_MAX] = {0};
-    strncpy(path, _path, sizeof(path));
-    DIR *dir;
-    struct dirent *d_entity;
+/**
+ * State shared by the workers of `rmtree`
+ */
+struct RmTree {
+    struct Pool *pool;
+    int root_fd;                //!< Directory being removed. Paths below are relative to it.
+    pthread_mutex_t lock;       //!< Protects every member below, and RmTreeNode.pending
+    size_t errors;              //!< Entries that could not be removed
+    int error;                  //!< First errno recorded
+};
 
-    dir = opendir(path);
-    if (!dir) {
-        return 1;
+/**
+ * A directory below the root. It is removed once `pending` drops to zero.
+ */
+struct RmTreeNode {
+    struct RmTree *tree;
+    struct RmTreeNode *parent;
+    char *path;                 //!< Path relative to RmTree.root_fd
+    size_t pending;             //!< Subdirectories not removed yet, plus one while the directory is listed
+};
+
+static void rmtree_task(void *arg);
+
+static void rmtree_failed(struct RmTree *tree) {
+    pthread_mutex_lock(&tree->lock);
+    tree->errors++;
+    if (!tree->error) {
+        tree->error = errno;
+    }
+    pthread_mutex_unlock(&tree->lock);
+}
+
+static struct RmTreeNode *rmtree_node(struct RmTree *tree, struct RmTreeNode *parent, const char *name) {
+    char path[PATH_MAX];
+    if (parent) {
+        if ((size_t) snprintf(path, sizeof(path), "%s/%s", parent->path, name) >= sizeof(path)) {
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+    } else {
+        strcpy(path, ".");
+    }
+    struct RmTreeNode *node = calloc(1, sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+    node->path = strdup(path);
+    if (!node->path) {
+        guard_free(node);
+        return NULL;
+    }
+    node->tree = tree;
+    node->parent = parent;
+    node->pending = 1;
+    return node;
+}
+
+/**
+ * Drop a reference to `node`. The last one removes the directory, and
+ * releases its parent in turn.
+ */
+static void rmtree_release(struct RmTreeNode *node) {
+    while (node) {
+        struct RmTree *tree = node->tree;
+        struct RmTreeNode *parent = node->parent;
+
+        pthread_mutex_lock(&tree->lock);
+        size_t pending = --node->pending;
+        pthread_mutex_unlock(&tree->lock);
+        if (pending) {
+            return;
+        }
+        // The root itself is removed by rmtree()
+        if (parent && unlinkat(tree->root_fd, node->path, AT_REMOVEDIR) && errno != ENOENT) {
+            rmtree_failed(tree);
+        }
+        guard_free(node->path);
+        guard_free(node);
+        node = parent;
     }
+}
 
-    while ((d_entity = readdir(dir)) != NULL) {
-        char abspath[PATH_MAX] = {0};
-        strcat(abspath, path);
-        strcat(abspath, DIR_SEP);
-        strcat(abspath, d_entity->d_name);
+/**
+ * Open a directory below the root, making it writable by its owner if needed
+ */
+static int rmtree_open(struct RmTree *tree, const char *path) {
+    const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+    struct stat st;
+    int fd = openat(tree->root_fd, path, flags);
 
-        if (!strcmp(d_entity->d_name, ".") || !strcmp(d_entity->d_name, "..") || !strcmp(abspath, path)) {
+    if (fd < 0 && errno == EACCES && !fchmodat(tree->root_fd, path, S_IRWXU, 0)) {
+        fd = openat(tree->root_fd, path, flags);
+    }
+    if (fd >= 0 && !fstat(fd, &st) && (st.st_mode & (S_IWUSR | S_IXUSR)) != (S_IWUSR | S_IXUSR)) {
+        // Entries cannot be unlinked from a read-only directory
+        fchmod(fd, (st.st_mode & 07777) | S_IWUSR | S_IXUSR);
+    }
+    return fd;
+}
+
+static void rmtree_dir(struct RmTreeNode *node) {
+    struct RmTree *tree = node->tree;
+    struct dirent *rec;
+    int fd = rmtree_open(tree, node->path);
+    DIR *dir = fd < 0 ? NULL : fdopendir(fd);
+
+    if (!dir) {
+        rmtree_failed(tree);
+        if (fd >= 0) {
+            close(fd);
+        }
+        rmtree_release(node);
+        return;
+    }
+    while ((rec = readdir(dir))) {
+        if (!strcmp(rec->d_name, ".") || !strcmp(rec->d_name, "..")) {
             continue;
         }
-
-        // Test for sufficient privilege
-        if (access(abspath, F_OK) < 0 && errno == EACCES) {
+        unsigned char type = rec->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(fd, rec->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+                rmtree_failed(tree);
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+        }
+        if (type != DT_DIR) {
+            // Symbolic links are removed, never followed
+            if (unlinkat(fd, rec->d_name, 0) && errno != ENOENT) {
+                rmtree_failed(tree);
+            }
             continue;
         }
 
-        // Push directories on to the stack first
-        if (d_entity->d_type == DT_DIR) {
-            rmtree(abspath);
-        } else {
-            remove(abspath);
+        struct RmTreeNode *child = rmtree_node(tree, node, rec->d_name);
+        if (!child) {
+            rmtree_failed(tree);
+            continue;
+        }
+        pthread_mutex_lock(&tree->lock);
+        node->pending++;
+        pthread_mutex_unlock(&tree->lock);
+        // Idle workers pick up subdirectories from the pool's queue
+        if (pool_submit(tree->pool, rmtree_task, child)) {
+            rmtree_dir(child);
         }
     }
     closedir(dir);
+    rmtree_release(node);
+}
 
-    if (access(path, F_OK) == 0) {
-        remove(path);
+static void rmtree_task(void *arg) {
+    rmtree_dir(arg);
+}
+
+int rmtree(char *_path) {
+    struct RmTree tree;
+    struct RmTreeNode *root;
+    char *resolved;
+
+    if (isempty(_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Refuse to destroy the entire file system
+    resolved = realpath(_path, NULL);
+    if (resolved && !strcmp(resolved, "/")) {
+        guard_free(resolved);
+        errno = EINVAL;
+        return -1;
+    }
+    guard_free(resolved);
+
+    memset(&tree, 0, sizeof(tree));
+    tree.root_fd = open(_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (tree.root_fd < 0) {
+        return -1;
+    }
+    tree.pool = pool_init(0);
+    root = rmtree_node(&tree, NULL, NULL);
+    if (!tree.pool || !root) {
+        pool_free(&tree.pool);
+        guard_free(root);
+        close(tree.root_fd);
+        return -1;
     }
-    return status;
+    pthread_mutex_init(&tree.lock, NULL);
+    if (pool_submit(tree.pool, rmtree_task, root)) {
+        rmtree_dir(root);
+    }
+    pool_wait(tree.pool);
+    pool_free(&tree.pool);
+    pthread_mutex_destroy(&tree.lock);
+    close(tree.root_fd);
+
+    if (tree.errors) {
+        errno = tree.error;
+        return -1;
+    }
+    return rmdir(_path);
+}
+
+/**
+ * A directory waiting to be removed by `rmtree_background`
+ */
+struct RmTreeJob {
+    char *path;
+    struct RmTreeJob *next;
+};
+
+/**
+ * Queue of directories removed, one at a time, by a single worker thread.
+ * Each removal is parallelized by `rmtree`.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        //!< Signalled when a job is queued or finished
+    struct RmTreeJob *head;
+    struct RmTreeJob *tail;
+    int busy;                   //!< The worker is removing a directory
+    int running;                //!< The worker has been started
+    pid_t owner;                //!< Process that started the worker
+} rmtree_background_state = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+static pthread_once_t rmtree_background_once = PTHREAD_ONCE_INIT;
+
+static void rmtree_background_register(void) {
+    atexit(rmtree_background_wait);
+}
+
+static void rmtree_background_remove(char *path) {
+    if (rmtree(path)) {
+        msg(STASIS_MSG_WARN, "Unable to remove %s: %s\n", path, strerror(errno));
+    }
+    guard_free(path);
+}
+
+static void *rmtree_background_thread(void *arg) {
+    (void) arg;
+    pthread_mutex_lock(&rmtree_background_state.lock);
+    while (1) {
+        struct RmTreeJob *job = rmtree_background_state.head;
+        if (!job) {
+            pthread_cond_wait(&rmtree_background_state.cond, &rmtree_background_state.lock);
+            continue;
+        }
+        rmtree_background_state.head = job->next;
+        if (!rmtree_background_state.head) {
+            rmtree_background_state.tail = NULL;
+        }
+        rmtree_background_state.busy = 1;
+        pthread_mutex_unlock(&rmtree_background_state.lock);
+
+        rmtree_background_remove(job->path);
+        guard_free(job);
+
+        pthread_mutex_lock(&rmtree_background_state.lock);
+        rmtree_background_state.busy = 0;
+        pthread_cond_broadcast(&rmtree_background_state.cond);
+    }
+    return NULL;
+}
+
+/**
+ * Queue `path` for the worker, starting it if needed
+ * @return 0 on success, -1 if the worker is unavailable
+ */
+static int rmtree_background_queue(char *path) {
+    struct RmTreeJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        return -1;
+    }
+    job->path = path;
+
+    pthread_once(&rmtree_background_once, rmtree_background_register);
+    pthread_mutex_lock(&rmtree_background_state.lock);
+    if (rmtree_background_state.running && rmtree_background_state.owner != getpid()) {
+        // A forked child inherits the queue, but not the worker. The parent
+        // finishes the inherited jobs.
+        rmtree_background_state.running = 0;
+        rmtree_background_state.busy = 0;
+        rmtree_background_state.head = NULL;
+        rmtree_background_state.tail = NULL;
+    }
+    if (!rmtree_background_state.running) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, rmtree_background_thread, NULL)) {
+            pthread_mutex_unlock(&rmtree_background_state.lock);
+            guard_free(job);
+            return -1;
+        }
+        pthread_detach(thread);
+        rmtree_background_state.running = 1;
+        rmtree_background_state.owner = getpid();
+    }
+    if (rmtree_background_state.tail) {
+        rmtree_background_state.tail->next = job;
+    } else {
+        rmtree_background_state.head = job;
+    }
+    rmtree_background_state.tail = job;
+    pthread_cond_broadcast(&rmtree_background_state.cond);
+    pthread_mutex_unlock(&rmtree_background_state.lock);
+    return 0;
+}
+
+int rmtree_background(const char *path) {
+    char src[PATH_MAX];
+    char tmpl[PATH_MAX];
+    char *trash;
+    size_t len = strlen(path);
+
+    while (len > 1 && path[len - 1] == '/') {
+        len--;
+    }
+    if (!len || len >= sizeof(src)) {
+        errno = !len ? EINVAL : ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(src, path, len);
+    src[len] = '\0';
+
+    if ((size_t) snprintf(tmpl, sizeof(tmpl), "%s.stasis-rm.XXXXXX", src) >= sizeof(tmpl)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    trash = strdup(tmpl);
+    if (!trash) {
+        return -1;
+    }
+    // rename() replaces an empty directory atomically. The name stays on the
+    // same file system, and unique, because mkdtemp() created it beside the original.
+    if (!mkdtemp(trash) || rename(src, trash)) {
+        int error = errno;
+        rmdir(trash);
+        guard_free(trash);
+        if (error == ENOENT || error == ENOTDIR) {
+            errno = error;
+            return -1;
+        }
+        // Not movable (e.g. a mount point). Remove it in place.
+        return rmtree(src);
+    }
+
+    if (rmtree_background_queue(trash)) {
+        // No worker available. Remove it now.
+        rmtree_background_remove(trash);
+    }
+    return 0;
+}
+
+void rmtree_background_wait(void) {
+    pthread_mutex_lock(&rmtree_background_state.lock);
+    // A forked child inherits the queue, but not the worker
+    if (rmtree_background_state.running && rmtree_background_state.owner == getpid()) {
+        while (rmtree_background_state.head || rmtree_background_state.busy) {
+            pthread_cond_wait(&rmtree_background_state.cond, &rmtree_background_state.lock);
+        }
+    }
+    pthread_mutex_unlock(&rmtree_background_state.lock);
 }
 
 char *expandpath(const char *_path) {
@@ -494,6 +818,10 @@ int isempty_dir(const char *path) {
 }
 
 int path_store(char **destptr, size_t maxlen, const char *base, const char *path) {
+    return path_store_arena(NULL, destptr, maxlen, base, path);
+}
+
+int path_store_arena(struct Arena *arena, char **destptr, size_t maxlen, const char *base, const char *path) {
     char *path_tmp;
     size_t base_len = 0;
     size_t path_len = 0;
@@ -522,11 +850,14 @@ int path_store(char **destptr, size_t maxlen, const char *base, const char *path
         goto l_path_setup_error;
     }
 
-    if (*destptr) {
-        guard_free(*destptr);
-    }
+    guard_arena_free(arena, *destptr);
 
-    if (!(*destptr = realpath(path_tmp, NULL))) {
+    if (arena) {
+        char resolved[PATH_MAX];
+        if (!realpath(path_tmp, resolved) || !(*destptr = arena_strdup(arena, resolved))) {
+            goto l_path_setup_error;
+        }
+    } else if (!(*destptr = realpath(path_tmp, NULL))) {
         goto l_path_setup_error;
     }
 
@@ -673,29 +1004,26 @@ int fix_tox_conf(const char *filename, char **result) {
     return 0;
 }
 
-static size_t count_blanks(char *s) {
-    // return the number of leading blanks (tab/space) in a string
-    size_t blank = 0;
-    for (size_t i = 0; i < strlen(s); i++) {
-        if (isblank(s[i])) {
-            blank++;
-        } else {
-            break;
-        }
-    }
-    return blank;
-}
-
 char *collapse_whitespace(char **s) {
     char *x = (*s);
-    size_t len = strlen(x);
-    for (size_t i = 0; i < len; i++) {
-        size_t blank = count_blanks(&x[i]);
-        if (blank > 1) {
-            memmove(&x[i], &x[i] + blank, strlen(&x[i]));
+    char *dest = x;
+    const char *src = x;
+
+    // Runs of two or more blanks are removed. Single blanks are kept.
+    while (*src != '\0') {
+        size_t blank = 0;
+        while (isblank((unsigned char) src[blank])) {
+            blank++;
+        }
+        if (blank == 1) {
+            *dest++ = *src;
+        }
+        src += blank;
+        if (*src != '\0') {
+            *dest++ = *src++;
         }
     }
-
+    *dest = '\0';
     return *s;
 }
 
@@ -710,21 +1038,21 @@ char *collapse_whitespace(char **s) {
 int redact_sensitive(const char **to_redact, size_t to_redact_size, char *src, char *dest, size_t maxlen) {
     const char *redacted = "***REDACTED***";
 
-    char *tmp = calloc(strlen(redacted) + strlen(src) + 1, sizeof(*tmp));
-    if (!tmp) {
-        return -1;
-    }
-    strcpy(tmp, src);
+    struct StrView view = strview(src);
+    char *tmp = NULL;
 
     for (size_t i = 0; i < to_redact_size; i++) {
-        if (to_redact[i] && strstr(tmp, to_redact[i])) {
-            replace_text(tmp, to_redact[i], redacted, 0);
+        if (to_redact[i] && *to_redact[i] && strview_find(view, strview(to_redact[i])) >= 0) {
+            tmp = strview_replace(view, strview(to_redact[i]), strview(redacted));
+            if (!tmp) {
+                return -1;
+            }
             break;
         }
     }
 
     memset(dest, 0, maxlen);
-    strncpy(dest, tmp, maxlen - 1);
+    strncpy(dest, tmp ? tmp : src, maxlen - 1);
     guard_free(tmp);
 
     return 0;
@@ -758,3 +1086,11 @@ struct StrList *listdir(const char *path) {
     return node;
 }
 
+uint64_t hash_fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,105 @@
+#include "testing.h"
+
+void test_arena_init() {
+    struct Arena *arena = arena_init(0);
+    STASIS_ASSERT_FATAL(arena != NULL, "arena should not be NULL");
+    STASIS_ASSERT(arena->block_size == ARENA_BLOCK_SIZE_DEFAULT, "unexpected default block size");
+    STASIS_ASSERT(arena->head == NULL, "fresh arena should not allocate a block");
+    arena_free(&arena);
+    STASIS_ASSERT(arena == NULL, "arena should be NULL after free");
+    arena_free(&arena);
+}
+
+void test_arena_alloc() {
+    struct Arena *arena = arena_init(128);
+    STASIS_ASSERT(arena_alloc(NULL, 10) == NULL, "NULL arena should fail");
+
+    char *a = arena_alloc(arena, 10);
+    char *b = arena_alloc(arena, 10);
+    STASIS_ASSERT_FATAL(a != NULL && b != NULL, "allocation failed");
+    STASIS_ASSERT(((uintptr_t) a % ARENA_ALIGN) == 0 && ((uintptr_t) b % ARENA_ALIGN) == 0, "allocations should be aligned");
+    STASIS_ASSERT(b >= a + 10, "allocations should not overlap");
+    for (size_t i = 0; i < 10; i++) {
+        STASIS_ASSERT(a[i] == 0 && b[i] == 0, "memory should be zeroed");
+    }
+
+    struct ArenaBlock *head = arena->head;
+    char *big = arena_alloc(arena, 1000);
+    STASIS_ASSERT_FATAL(big != NULL, "oversized allocation failed");
+    memset(big, 'x', 1000);
+    STASIS_ASSERT(arena->head == head, "oversized allocation should not replace the current block");
+    char *c = arena_alloc(arena, 10);
+    STASIS_ASSERT(c > b && c < head->data + head->size, "current block should continue to be used");
+
+    for (size_t i = 0; i < 100; i++) {
+        STASIS_ASSERT_FATAL(arena_alloc(arena, 64) != NULL, "allocation failed");
+    }
+    STASIS_ASSERT(arena_owns(arena, a) && arena_owns(arena, big) && arena_owns(arena, c), "arena should own its allocations");
+    arena_free(&arena);
+}
+
+void test_arena_strdup() {
+    struct Arena *arena = arena_init(0);
+    const char *data = "hello world";
+    char *s = arena_strdup(arena, data);
+    STASIS_ASSERT_FATAL(s != NULL, "strdup failed");
+    STASIS_ASSERT(s != data && strcmp(s, data) == 0, "string should be copied");
+    char *n = arena_strndup(arena, data, 5);
+    STASIS_ASSERT(n && strcmp(n, "hello") == 0, "strndup should truncate");
+    n = arena_strndup(arena, "hi", 5);
+    STASIS_ASSERT(n && strcmp(n, "hi") == 0, "strndup should stop at the end of the string");
+    STASIS_ASSERT(arena_strdup(arena, NULL) == NULL, "NULL string should return NULL");
+    arena_free(&arena);
+}
+
+void test_arena_owns() {
+    struct Arena *arena = arena_init(0);
+    char *heap = strdup("heap");
+    char *owned = arena_strdup(arena, "arena");
+    STASIS_ASSERT(arena_owns(arena, owned), "arena should own its string");
+    STASIS_ASSERT(!arena_owns(arena, heap), "arena should not own heap memory");
+    STASIS_ASSERT(!arena_owns(NULL, owned), "NULL arena should not own anything");
+    STASIS_ASSERT(!arena_owns(arena, NULL), "NULL pointer should not be owned");
+
+    guard_arena_free(arena, owned);
+    guard_arena_free(arena, heap);
+    STASIS_ASSERT(owned == NULL && heap == NULL, "pointers should be NULL after guard_arena_free");
+    arena_free(&arena);
+}
+
+void test_arena_strlist() {
+    struct Arena *arena = arena_init(0);
+    struct StrList *list = strlist_init_arena(arena);
+    const char *data[] = {"one", "two", "three"};
+
+    strlist_append(&list, "zero");
+    strlist_append_n(list, (char **) data, 3);
+    strlist_append_tokenize(list, "four\nfive", "\n");
+    STASIS_ASSERT(strlist_count(list) == 6, "unexpected number of records");
+    for (size_t i = 0; i < strlist_count(list); i++) {
+        STASIS_ASSERT(arena_owns(arena, strlist_item(list, i)), "record should be allocated from the arena");
+    }
+    strlist_set(&list, 0, "a longer replacement value");
+    STASIS_ASSERT(strcmp(strlist_item(list, 0), "a longer replacement value") == 0, "set failed");
+    STASIS_ASSERT(arena_owns(arena, strlist_item(list, 0)), "replacement should be allocated from the arena");
+
+    struct StrList *copy = strlist_copy(list);
+    STASIS_ASSERT(copy->arena == NULL, "copies should not share the arena");
+    guard_strlist_free(&list);
+    arena_free(&arena);
+    STASIS_ASSERT(strcmp(strlist_item(copy, 3), "three") == 0, "copy should outlive the arena");
+    guard_strlist_free(&copy);
+}
+
+int main(int argc, char *argv[]) {
+    STASIS_TEST_BEGIN_MAIN();
+    STASIS_TEST_FUNC *tests[] = {
+        test_arena_init,
+        test_arena_alloc,
+        test_arena_strdup,
+        test_arena_owns,
+        test_arena_strlist,
+    };
+    STASIS_TEST_RUN(tests);
+    STASIS_TEST_END_MAIN();
+}
@@ -0,0 +1,183 @@
+#include "testing.h"
+
+static const int impls[] = {BYTESEARCH_SCALAR, BYTESEARCH_SSE2, BYTESEARCH_AVX2};
+static const char *impl_names[] = {"auto", "scalar", "sse2", "avx2"};
+
+static char *random_bytes(size_t len, const char *alphabet) {
+    size_t alphabet_len = strlen(alphabet);
+    char *result = malloc(len + 1);
+    for (size_t i = 0; i < len; i++) {
+        result[i] = alphabet[rand() % alphabet_len];
+    }
+    result[len] = '\0';
+    return result;
+}
+
+static const char *ref_find_set(const char *s, size_t len, const char *set) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] && strchr(set, s[i])) {
+            return &s[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t ref_count(const char *s, size_t len, int ch) {
+    size_t result = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == (char) ch) {
+            result++;
+        }
+    }
+    return result;
+}
+
+static const char *ref_find_str(const char *s, size_t len, const char *needle, size_t needle_len) {
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (memcmp(&s[i], needle, needle_len) == 0) {
+            return &s[i];
+        }
+    }
+    return NULL;
+}
+
+void test_bytesearch_select() {
+    STASIS_ASSERT(bytesearch_select(BYTESEARCH_SCALAR) == BYTESEARCH_SCALAR, "scalar implementation must always be available");
+    STASIS_ASSERT(bytesearch_impl() == BYTESEARCH_SCALAR, "selected implementation not reported");
+    int impl = bytesearch_select(BYTESEARCH_AUTO);
+    STASIS_ASSERT(impl >= BYTESEARCH_SCALAR, "automatic selection failed");
+    STASIS_ASSERT(bytesearch_impl() == impl, "automatic selection not reported");
+    STASIS_ASSERT(bytesearch_select(-100) == -1 || bytesearch_impl() == BYTESEARCH_SCALAR, "unknown implementation accepted");
+    bytesearch_select(BYTESEARCH_AUTO);
+}
+
+void test_bytes_find() {
+    char *data = random_bytes(256, "abcdefgh\n\0");
+    for (size_t x = 0; x < sizeof(impls) / sizeof(*impls); x++) {
+        size_t mismatch = 0;
+        if (bytesearch_select(impls[x]) < 0) {
+            continue;
+        }
+        for (size_t offset = 0; offset < 40; offset++) {
+            for (size_t len = 0; offset + len <= 256; len += 7) {
+                const char *s = data + offset;
+                mismatch += bytes_find(s, len, '\n') != memchr(s, '\n', len);
+                mismatch += bytes_find(s, len, '\0') != memchr(s, '\0', len);
+                mismatch += bytes_find(s, len, 'z') != NULL;
+            }
+        }
+        STASIS_ASSERT(mismatch == 0, impl_names[impls[x]]);
+    }
+    bytesearch_select(BYTESEARCH_AUTO);
+    guard_free(data);
+}
+
+void test_bytes_find_set() {
+    const char *sets[] = {";#", "xyz\n", "0123456789ABCDEFGHIJ", "h", "", NULL};
+    char *data = random_bytes(256, "abcdefghijklmnopqrstuvwxyz0123456789;#\n");
+    for (size_t x = 0; x < sizeof(impls) / sizeof(*impls); x++) {
+        size_t mismatch = 0;
+        if (bytesearch_select(impls[x]) < 0) {
+            continue;
+        }
+        for (size_t i = 0; sets[i] != NULL; i++) {
+            for (size_t offset = 0; offset < 40; offset++) {
+                for (size_t len = 0; offset + len <= 256; len += 5) {
+                    const char *s = data + offset;
+                    mismatch += bytes_find_set(s, len, sets[i]) != ref_find_set(s, len, sets[i]);
+                }
+            }
+        }
+        STASIS_ASSERT(mismatch == 0, impl_names[impls[x]]);
+    }
+    bytesearch_select(BYTESEARCH_AUTO);
+    guard_free(data);
+}
+
+void test_bytes_count() {
+    char *data = random_bytes(1024, "ab\n");
+    for (size_t x = 0; x < sizeof(impls) / sizeof(*impls); x++) {
+        size_t mismatch = 0;
+        if (bytesearch_select(impls[x]) < 0) {
+            continue;
+        }
+        for (size_t offset = 0; offset < 40; offset++) {
+            for (size_t len = 0; offset + len <= 1024; len += 11) {
+                const char *s = data + offset;
+                mismatch += bytes_count(s, len, '\n') != ref_count(s, len, '\n');
+                mismatch += bytes_count(s, len, 'z') != 0;
+            }
+        }
+        STASIS_ASSERT(bytes_count("a\0a\0a", 5, '\0') == 2, "NUL bytes should be counted");
+        STASIS_ASSERT(mismatch == 0, impl_names[impls[x]]);
+    }
+    bytesearch_select(BYTESEARCH_AUTO);
+    guard_free(data);
+}
+
+void test_bytes_find_str() {
+    const char *needles[] = {"ab", "aba", "abab", "bbbb", "a", "abaabbabaaabbbab", "abababababababababababababababababab", NULL};
+    char *data = random_bytes(512, "ab");
+    for (size_t x = 0; x < sizeof(impls) / sizeof(*impls); x++) {
+        size_t mismatch = 0;
+        if (bytesearch_select(impls[x]) < 0) {
+            continue;
+        }
+        for (size_t i = 0; needles[i] != NULL; i++) {
+            size_t needle_len = strlen(needles[i]);
+            for (size_t offset = 0; offset < 40; offset++) {
+                for (size_t len = 0; offset + len <= 512; len += 3) {
+                    const char *s = data + offset;
+                    mismatch += bytes_find_str(s, len, needles[i], needle_len) != ref_find_str(s, len, needles[i], needle_len);
+                }
+            }
+        }
+        STASIS_ASSERT(bytes_find_str(data, 10, "", 0) == data, "empty needle should match at the start");
+        STASIS_ASSERT(bytes_find_str("abc", 3, "abcd", 4) == NULL, "needle longer than input should not match");
+        STASIS_ASSERT(mismatch == 0, impl_names[impls[x]]);
+    }
+    bytesearch_select(BYTESEARCH_AUTO);
+    guard_free(data);
+}
+
+void test_bytesearch_benchmark() {
+    const size_t len = 32 * 1024 * 1024;
+    char *data = random_bytes(len, "abcdefghijklmnopqrstuvwxyz/_.-");
+    const char *needle = "/opt/conda/envs/stasis";
+    data[len - 1] = '#';
+    memcpy(data + len - 64, needle, strlen(needle));
+
+    for (size_t x = 0; x < sizeof(impls) / sizeof(*impls); x++) {
+        struct timespec start, end;
+        if (bytesearch_select(impls[x]) < 0) {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        size_t count = bytes_count(data, len, '/');
+        const char *set = bytes_find_set(data, len, ";#");
+        const char *str = bytes_find_str(data, len, needle, strlen(needle));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        STASIS_ASSERT(count == ref_count(data, len, '/'), "count mismatch");
+        STASIS_ASSERT(set == data + len - 1, "set mismatch");
+        STASIS_ASSERT(str == data + len - 64, "substring mismatch");
+        printf("%s: count, find_set, and find_str over %zu MiB: %.3fs (%.0f MiB/s)\n",
+               impl_names[impls[x]], len / 1024 / 1024, elapsed, (double) (len * 3) / 1024 / 1024 / elapsed);
+    }
+    bytesearch_select(BYTESEARCH_AUTO);
+    guard_free(data);
+}
+
+int main(int argc, char *argv[]) {
+    STASIS_TEST_BEGIN_MAIN();
+    STASIS_TEST_FUNC *tests[] = {
+        test_bytesearch_select,
+        test_bytes_find,
+        test_bytes_find_set,
+        test_bytes_count,
+        test_bytes_find_str,
+        test_bytesearch_benchmark,
+    };
+    STASIS_TEST_RUN(tests);
+    STASIS_TEST_END_MAIN();
+}
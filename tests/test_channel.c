@@ -0,0 +1,405 @@
+#include "testing.h"
+#include <bzlib.h>
+
+/**
+ * Build a tar archive containing an info/index.json, preceded by another member
+ * @return tar archive (caller must free), or NULL on error
+ */
+static char *make_tar(const char *index_json, size_t *tar_size) {
+    const char *members[][2] = {
+        {"info/files", "lib/example.py\n"},
+        {"info/index.json", index_json},
+    };
+    char *tar = calloc(1, 64 * 1024);
+    if (!tar) {
+        return NULL;
+    }
+    *tar_size = 0;
+    for (size_t i = 0; i < sizeof(members) / sizeof(*members); i++) {
+        char *header = &tar[*tar_size];
+        size_t len = strlen(members[i][1]);
+        unsigned checksum = 0;
+
+        strcpy(header, members[i][0]);
+        sprintf(&header[100], "%07o", 0644);
+        sprintf(&header[108], "%07o", 0);
+        sprintf(&header[116], "%07o", 0);
+        sprintf(&header[124], "%011zo", len);
+        sprintf(&header[136], "%011o", 0);
+        header[156] = '0';
+        memcpy(&header[257], "ustar", 6);
+        memcpy(&header[263], "00", 2);
+        memset(&header[148], ' ', 8);
+        for (size_t b = 0; b < 512; b++) {
+            checksum += (unsigned char) header[b];
+        }
+        sprintf(&header[148], "%06o", checksum);
+        memcpy(&tar[*tar_size + 512], members[i][1], len);
+        *tar_size += 512 + (len + 511) / 512 * 512;
+    }
+    // End of archive marker
+    *tar_size += 1024;
+    return tar;
+}
+
+/**
+ * Write a .tar.bz2 package containing an info/index.json, preceded by another member
+ */
+static int write_package(const char *filename, const char *index_json) {
+    size_t tar_size = 0;
+    char *tar = make_tar(index_json, &tar_size);
+    if (!tar) {
+        return -1;
+    }
+
+    unsigned int compressed_size = tar_size + tar_size / 100 + 600;
+    char *compressed = malloc(compressed_size);
+    int status = -1;
+    if (compressed && BZ2_bzBuffToBuffCompress(compressed, &compressed_size, tar, tar_size, 9, 0, 0) == BZ_OK) {
+        FILE *fp = fopen(filename, "wb");
+        if (fp) {
+            status = fwrite(compressed, 1, compressed_size, fp) == compressed_size ? 0 : -1;
+            fclose(fp);
+        }
+    }
+    guard_free(compressed);
+    guard_free(tar);
+    return status;
+}
+
+static void put_le16(FILE *fp, unsigned value) {
+    fputc(value & 0xff, fp);
+    fputc((value >> 8) & 0xff, fp);
+}
+
+static void put_le32(FILE *fp, unsigned long value) {
+    put_le16(fp, value & 0xffff);
+    put_le16(fp, (value >> 16) & 0xffff);
+}
+
+static unsigned long crc32_buf(const unsigned char *data, size_t size) {
+    unsigned long crc = 0xffffffffUL;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320UL & (0UL - (crc & 1)));
+        }
+    }
+    return crc ^ 0xffffffffUL;
+}
+
+/**
+ * Write a .conda package: an uncompressed zip holding metadata.json and an
+ * info-*.tar.zst member. The zstd frame stores the tar archive in raw
+ * blocks, so no compressor is needed to produce it.
+ */
+static int write_conda_package(const char *filename, const char *index_json) {
+    const char *metadata = "{\"conda_pkg_format_version\": 2}";
+    const char *info_name = "info-example-1.0-0.tar.zst";
+    const size_t block_max = 128 * 1024;
+    size_t tar_size = 0;
+    char *tar = make_tar(index_json, &tar_size);
+    if (!tar) {
+        return -1;
+    }
+
+    // Frame header: magic, no checksum, 128 KiB window; then raw blocks
+    size_t zst_size = 0;
+    unsigned char *zst = malloc(6 + tar_size + (tar_size / block_max + 1) * 3);
+    if (!zst) {
+        guard_free(tar);
+        return -1;
+    }
+    memcpy(zst, "\x28\xb5\x2f\xfd\x00\x38", 6);
+    zst_size = 6;
+    for (size_t off = 0; off < tar_size; off += block_max) {
+        size_t len = tar_size - off < block_max ? tar_size - off : block_max;
+        unsigned long header = (unsigned long) len << 3 | (off + len == tar_size);
+        zst[zst_size++] = header & 0xff;
+        zst[zst_size++] = (header >> 8) & 0xff;
+        zst[zst_size++] = (header >> 16) & 0xff;
+        memcpy(&zst[zst_size], &tar[off], len);
+        zst_size += len;
+    }
+    guard_free(tar);
+
+    const struct {
+        const char *name;
+        const unsigned char *data;
+        size_t size;
+    } members[] = {
+        {"metadata.json", (const unsigned char *) metadata, strlen(metadata)},
+        {info_name, zst, zst_size},
+    };
+    const size_t count = sizeof(members) / sizeof(*members);
+    unsigned long offsets[sizeof(members) / sizeof(*members)];
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        guard_free(zst);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = ftell(fp);
+        put_le32(fp, 0x04034b50);
+        put_le16(fp, 20);
+        put_le16(fp, 0);
+        put_le16(fp, 0);    // stored
+        put_le16(fp, 0);
+        put_le16(fp, 0);
+        put_le32(fp, crc32_buf(members[i].data, members[i].size));
+        put_le32(fp, members[i].size);
+        put_le32(fp, members[i].size);
+        put_le16(fp, strlen(members[i].name));
+        put_le16(fp, 0);
+        fputs(members[i].name, fp);
+        fwrite(members[i].data, 1, members[i].size, fp);
+    }
+    unsigned long central = ftell(fp);
+    for (size_t i = 0; i < count; i++) {
+        put_le32(fp, 0x02014b50);
+        put_le16(fp, 20);
+        put_le16(fp, 20);
+        put_le16(fp, 0);
+        put_le16(fp, 0);    // stored
+        put_le16(fp, 0);
+        put_le16(fp, 0);
+        put_le32(fp, crc32_buf(members[i].data, members[i].size));
+        put_le32(fp, members[i].size);
+        put_le32(fp, members[i].size);
+        put_le16(fp, strlen(members[i].name));
+        put_le16(fp, 0);
+        put_le16(fp, 0);
+        put_le16(fp, 0);
+        put_le16(fp, 0);
+        put_le32(fp, 0);
+        put_le32(fp, offsets[i]);
+        fputs(members[i].name, fp);
+    }
+    unsigned long central_size = ftell(fp) - central;
+    put_le32(fp, 0x06054b50);
+    put_le16(fp, 0);
+    put_le16(fp, 0);
+    put_le16(fp, count);
+    put_le16(fp, count);
+    put_le32(fp, central_size);
+    put_le32(fp, central);
+    put_le16(fp, 0);
+
+    int status = ferror(fp) ? -1 : 0;
+    if (fclose(fp)) {
+        status = -1;
+    }
+    guard_free(zst);
+    return status;
+}
+
+void test_channel_version_cmp() {
+    const char *ordered[] = {
+        "0.4",
+        "0.4.1.dev1",
+        "0.4.1a1",
+        "0.4.1b",
+        "0.4.1rc1",
+        "0.4.1",
+        "0.4.1post1",
+        "0.4.2",
+        "0.10",
+        "1.0",
+        "1!0.1",
+    };
+    const size_t count = sizeof(ordered) / sizeof(*ordered);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t k = 0; k < count; k++) {
+            int result = channel_version_cmp(ordered[i], ordered[k]);
+            int expected = i < k ? -1 : i > k ? 1 : 0;
+            if (result != expected) {
+                fprintf(stderr, "%s vs %s: %d (expected %d)\n", ordered[i], ordered[k], result, expected);
+                mismatches++;
+            }
+        }
+    }
+    STASIS_ASSERT(mismatches == 0, "versions are not ordered as conda orders them");
+    STASIS_ASSERT(channel_version_cmp("1.0", "1.0.0") == 0, "missing components should count as zero");
+    STASIS_ASSERT(channel_version_cmp("1.0A", "1.0a") == 0, "letters should compare case-insensitively");
+}
+
+void test_channel_index() {
+    const char *channel = "channel_dir";
+    struct ChannelIndexStats stats = {0};
+    char *data;
+
+    mkdirs("channel_dir/linux-64", 0755);
+    mkdirs("channel_dir/osx-arm64", 0755);
+    mkdirs("channel_dir/docs", 0755);
+    mkdirs("channel_dir/my-docs", 0755);
+    mkdirs("channel_dir/linux-notes", 0755);
+    STASIS_ASSERT_FATAL(write_package("channel_dir/linux-64/example-1.0-0.tar.bz2",
+        "{\n  \"name\": \"example\",\n  \"version\": \"1.0\",\n  \"build\": \"0\",\n  \"build_number\": 0,\n"
+        "  \"depends\": [\n    \"python >=3.11\",\n    \"ex \\\"quoted\\\"\"\n  ],\n"
+        "  \"license\": \"BSD\",\n  \"subdir\": \"linux-64\",\n  \"timestamp\": 100\n}") == 0,
+        "unable to create package");
+    STASIS_ASSERT_FATAL(write_package("channel_dir/linux-64/example-1.10-0.tar.bz2",
+        "{\"name\": \"example\", \"version\": \"1.10\", \"build\": \"0\", \"build_number\": 0, \"subdir\": \"linux-64\", \"timestamp\": 200}") == 0,
+        "unable to create package");
+    STASIS_ASSERT_FATAL(write_package("channel_dir/docs/ignored-1.0-0.tar.bz2",
+        "{\"name\": \"ignored\", \"version\": \"1.0\"}") == 0,
+        "unable to create package");
+    STASIS_ASSERT_FATAL(write_package("channel_dir/my-docs/ignored-1.0-0.tar.bz2",
+        "{\"name\": \"ignored\", \"version\": \"1.0\"}") == 0,
+        "unable to create package");
+
+    STASIS_ASSERT(channel_index(channel, 0, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.subdirs == 3, "linux-64, osx-arm64, and noarch should have been indexed");
+    STASIS_ASSERT(stats.packages == 2, "two packages should have been indexed");
+    STASIS_ASSERT(stats.failed == 0 && stats.unsupported == 0, "no packages should have failed");
+    STASIS_ASSERT(access("channel_dir/docs/repodata.json", F_OK) < 0, "a directory that is not a subdir was indexed");
+    STASIS_ASSERT(access("channel_dir/my-docs/repodata.json", F_OK) < 0, "a hyphenated directory that is not a subdir was indexed");
+    STASIS_ASSERT(access("channel_dir/linux-notes/repodata.json", F_OK) < 0, "an unknown architecture was indexed");
+    STASIS_ASSERT(access("channel_dir/osx-arm64/repodata.json", F_OK) == 0, "an empty platform subdir was not indexed");
+
+    data = stasis_testing_read_ascii("channel_dir/linux-64/repodata.json");
+    STASIS_ASSERT_FATAL(data != NULL, "repodata.json was not written");
+    STASIS_ASSERT(strstr(data, "\"subdir\": \"linux-64\"") != NULL, "info.subdir is missing");
+    STASIS_ASSERT(strstr(data, "\"example-1.0-0.tar.bz2\": {") != NULL, "example 1.0 is missing");
+    STASIS_ASSERT(strstr(data, "\"example-1.10-0.tar.bz2\": {") != NULL, "example 1.10 is missing");
+    STASIS_ASSERT(strstr(data, "\"depends\": [\"python >=3.11\",\"ex \\\"quoted\\\"\"]") != NULL, "depends was not preserved");
+    STASIS_ASSERT(strstr(data, "\"md5\": \"") != NULL, "md5 is missing");
+    STASIS_ASSERT(strstr(data, "\"sha256\": \"") != NULL, "sha256 is missing");
+    STASIS_ASSERT(strstr(data, "\"packages.conda\": {}") != NULL, "packages.conda should be empty");
+    guard_free(data);
+
+    data = stasis_testing_read_ascii("channel_dir/linux-64/current_repodata.json");
+    STASIS_ASSERT_FATAL(data != NULL, "current_repodata.json was not written");
+    STASIS_ASSERT(strstr(data, "example-1.10-0.tar.bz2") != NULL, "the latest version is missing");
+    STASIS_ASSERT(strstr(data, "example-1.0-0.tar.bz2") == NULL, "an older version was included");
+    guard_free(data);
+
+    data = stasis_testing_read_ascii("channel_dir/noarch/repodata.json");
+    STASIS_ASSERT(data != NULL && strstr(data, "\"packages\": {}") != NULL, "noarch/repodata.json should be empty");
+    guard_free(data);
+
+    data = stasis_testing_read_ascii("channel_dir/channeldata.json");
+    STASIS_ASSERT_FATAL(data != NULL, "channeldata.json was not written");
+    STASIS_ASSERT(strstr(data, "\"version\": \"1.10\"") != NULL, "channeldata should list the latest version");
+    STASIS_ASSERT(strstr(data, "\"timestamp\": 200") != NULL, "channeldata should list the latest timestamp");
+    guard_free(data);
+
+    // A damaged package is reported and left out
+    stasis_testing_write_ascii("channel_dir/linux-64/broken-1.0-0.tar.bz2", "not a bzip2 stream");
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(channel, 0, &stats) < 0, "indexing a damaged package should fail");
+    STASIS_ASSERT(stats.failed == 1 && stats.packages == 2, "only the damaged package should have failed");
+    data = stasis_testing_read_ascii("channel_dir/linux-64/repodata.json");
+    STASIS_ASSERT(data != NULL && strstr(data, "broken") == NULL, "the damaged package was indexed");
+    guard_free(data);
+
+    rmtree((char *) channel);
+}
+
+void test_channel_index_cache() {
+    const char *channel = "channel_cache";
+    const char *copy = "channel_cache_copy";
+    struct ChannelIndexStats stats = {0};
+    char *first;
+    char *data;
+
+    mkdirs("channel_cache/noarch", 0755);
+    STASIS_ASSERT_FATAL(write_package("channel_cache/noarch/one-1.0-0.tar.bz2",
+        "{\"name\": \"one\", \"version\": \"1.0\", \"build\": \"0\", \"subdir\": \"noarch\"}") == 0,
+        "unable to create package");
+    STASIS_ASSERT_FATAL(write_package("channel_cache/noarch/two-1.0-0.tar.bz2",
+        "{\"name\": \"two\", \"version\": \"1.0\", \"build\": \"0\", \"subdir\": \"noarch\", \"depends\": [\"one\"]}") == 0,
+        "unable to create package");
+
+    STASIS_ASSERT(channel_index(channel, CHANNEL_INDEX_CACHE, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.packages == 2 && stats.cached == 0 && stats.bytes > 0, "every package should have been read");
+    STASIS_ASSERT(access("channel_cache/noarch/" CHANNEL_INDEX_CACHE_FILE, F_OK) == 0, "the cache was not written");
+    first = stasis_testing_read_ascii("channel_cache/noarch/repodata.json");
+    STASIS_ASSERT_FATAL(first != NULL, "repodata.json was not written");
+
+    // Nothing changed
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(channel, CHANNEL_INDEX_CACHE, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.packages == 2 && stats.cached == 2 && stats.bytes == 0, "every package should have come from the cache");
+    data = stasis_testing_read_ascii("channel_cache/noarch/repodata.json");
+    STASIS_ASSERT(data != NULL && !strcmp(first, data), "repodata.json differs when written from the cache");
+    guard_free(data);
+
+    // A replaced package is read again, and a removed package drops out
+    STASIS_ASSERT_FATAL(write_package("channel_cache/noarch/two-1.0-0.tar.bz2",
+        "{\"name\": \"two\", \"version\": \"1.0\", \"build\": \"0\", \"subdir\": \"noarch\", \"depends\": [\"one >=1.0\"]}") == 0,
+        "unable to create package");
+    struct timespec times[2] = {{.tv_sec = 1000000000}, {.tv_sec = 1000000000}};
+    utimensat(AT_FDCWD, "channel_cache/noarch/two-1.0-0.tar.bz2", times, 0);
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(channel, CHANNEL_INDEX_CACHE, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.cached == 1, "only the unchanged package should have come from the cache");
+    data = stasis_testing_read_ascii("channel_cache/noarch/repodata.json");
+    STASIS_ASSERT(data != NULL && strstr(data, "one >=1.0") != NULL, "the replaced package was not read again");
+    guard_free(data);
+
+    remove("channel_cache/noarch/one-1.0-0.tar.bz2");
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(channel, CHANNEL_INDEX_CACHE, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.packages == 1 && stats.cached == 1, "the remaining package should have come from the cache");
+    data = stasis_testing_read_ascii("channel_cache/noarch/" CHANNEL_INDEX_CACHE_FILE);
+    STASIS_ASSERT(data != NULL && strstr(data, "one-1.0-0") == NULL, "the removed package is still cached");
+    guard_free(data);
+
+    // A damaged cache is ignored
+    stasis_testing_write_ascii("channel_cache/noarch/" CHANNEL_INDEX_CACHE_FILE, CHANNEL_INDEX_CACHE_MAGIC "\ntwo-1.0-0.tar.bz2\t1\t2\n");
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(channel, CHANNEL_INDEX_CACHE, &stats) == 0 && stats.cached == 0, "a damaged cache should be ignored");
+
+    // Caches can be carried over to a copy of the channel
+    mkdirs("channel_cache_copy/noarch", 0755);
+    STASIS_ASSERT(copy2("channel_cache/noarch/two-1.0-0.tar.bz2", "channel_cache_copy/noarch/two-1.0-0.tar.bz2", CT_TIME) == 0, "copy failed");
+    STASIS_ASSERT(channel_cache_import(copy, channel) == 0, "unable to import the cache");
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(channel_index(copy, CHANNEL_INDEX_CACHE, &stats) == 0, "indexing failed");
+    STASIS_ASSERT(stats.packages == 1 && stats.cached == 1, "the imported cache was not used");
+
+    guard_free(first);
+    rmtree((char *) channel);
+    rmtree((char *) copy);
+}
+
+void test_channel_index_conda() {
+    const char *channel = "channel_conda";
+    struct ChannelIndexStats stats = {0};
+    char *data;
+
+    mkdirs("channel_conda/noarch", 0755);
+    STASIS_ASSERT_FATAL(write_conda_package("channel_conda/noarch/three-1.0-0.conda",
+        "{\"name\": \"three\", \"version\": \"1.0\", \"build\": \"0\", \"subdir\": \"noarch\"}") == 0,
+        "unable to create package");
+
+    int result = channel_index(channel, 0, &stats);
+    data = stasis_testing_read_ascii("channel_conda/noarch/repodata.json");
+    STASIS_ASSERT_FATAL(data != NULL, "repodata.json was not written");
+#if defined(STASIS_HAVE_ZSTD)
+    STASIS_ASSERT(result == 0, "indexing failed");
+    STASIS_ASSERT(stats.packages == 1 && stats.unsupported == 0, "the .conda package should have been indexed");
+    STASIS_ASSERT(strstr(data, "\"packages.conda\": {\n    \"three-1.0-0.conda\": {") != NULL, "three is missing from packages.conda");
+    STASIS_ASSERT(strstr(data, "\"name\": \"three\"") != NULL, "index.json was not read from the info member");
+#else
+    STASIS_ASSERT(result < 0 && errno == ENOTSUP, "indexing should report .conda packages as unsupported");
+    STASIS_ASSERT(stats.packages == 0 && stats.unsupported == 1, "the .conda package should have been counted as unsupported");
+    STASIS_ASSERT(strstr(data, "three-1.0-0.conda") == NULL, "an unsupported package was indexed");
+#endif
+    guard_free(data);
+    rmtree((char *) channel);
+}
+
+int main(int argc, char *argv[]) {
+    STASIS_TEST_BEGIN_MAIN();
+    STASIS_TEST_FUNC *tests[] = {
+        test_channel_version_cmp,
+        test_channel_index,
+        test_channel_index_cache,
+        test_channel_index_conda,
+    };
+    STASIS_TEST_RUN(tests);
+    STASIS_TEST_END_MAIN();
+}
@@ -0,0 +1,330 @@
+#include "testing.h"
+
+static int files_equal(const char *a, const char *b) {
+    int result = 0;
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    if (fa && fb) {
+        int ca;
+        int cb;
+        do {
+            ca = fgetc(fa);
+            cb = fgetc(fb);
+        } while (ca == cb && ca != EOF);
+        result = ca == cb;
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return result;
+}
+
+void test_copy2_sizes() {
+    const char *src = "test_copy2.src";
+    const char *dest = "test_copy2.dest";
+    // Empty, smaller than, equal to, and larger than the copy buffers
+    const size_t sizes[] = {0, 1, STASIS_BUFSIZ, STASIS_BUFSIZ + 1, 1024 * 1024 * 3 + 17};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        struct stat st;
+        FILE *fp = fopen(src, "wb");
+        STASIS_ASSERT_FATAL(fp != NULL, "unable to create source file");
+        for (size_t b = 0; b < sizes[i]; b++) {
+            fputc((int) (b * 31 % 251), fp);
+        }
+        fclose(fp);
+
+        STASIS_ASSERT(copy2(src, dest, CT_PERM) == 0, "copy failed");
+        STASIS_ASSERT(stat(dest, &st) == 0 && (size_t) st.st_size == sizes[i], "destination size differs");
+        STASIS_ASSERT(files_equal(src, dest), "destination contents differ");
+        remove(src);
+        remove(dest);
+    }
+}
+
+void test_copy2_overwrite() {
+    const char *src = "test_copy2_overwrite.src";
+    const char *dest = "test_copy2_overwrite.dest";
+    stasis_testing_write_ascii(src, "short");
+    stasis_testing_write_ascii(dest, "a much longer destination file");
+    STASIS_ASSERT(copy2(src, dest, 0) == 0, "copy failed");
+    char *data = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(data && strcmp(data, "short") == 0, "destination should be replaced");
+    guard_free(data);
+    remove(src);
+    remove(dest);
+}
+
+void test_copy2_metadata() {
+    const char *src = "test_copy2_metadata.src";
+    const char *dest = "test_copy2_metadata.dest";
+    const struct timespec times[2] = {{.tv_sec = 1000000000, .tv_nsec = 5000}, {.tv_sec = 1234567890, .tv_nsec = 123456789}};
+    struct stat st;
+
+    stasis_testing_write_ascii(src, "metadata");
+    chmod(src, 0751);
+    utimensat(AT_FDCWD, src, times, 0);
+
+    STASIS_ASSERT(copy2(src, dest, CT_PERM | CT_TIME) == 0, "copy failed");
+    STASIS_ASSERT_FATAL(stat(dest, &st) == 0, "destination does not exist");
+    STASIS_ASSERT((st.st_mode & 07777) == 0751, "permissions should be preserved");
+    STASIS_ASSERT(STAT_MTIM(st).tv_sec == times[1].tv_sec && STAT_MTIM(st).tv_nsec == times[1].tv_nsec, "modification time should be preserved");
+    STASIS_ASSERT(STAT_ATIM(st).tv_sec == times[0].tv_sec, "access time should be preserved");
+    remove(dest);
+
+    STASIS_ASSERT(copy2(src, dest, 0) == 0, "copy failed");
+    STASIS_ASSERT_FATAL(stat(dest, &st) == 0, "destination does not exist");
+    STASIS_ASSERT(STAT_MTIM(st).tv_sec != times[1].tv_sec, "modification time should not be preserved without CT_TIME");
+    remove(dest);
+    remove(src);
+}
+
+void test_copy2_symlink() {
+    const char *link = "test_copy2.link";
+    const char *dest = "test_copy2_link.dest";
+    char target[PATH_MAX] = {0};
+    struct stat st;
+
+    symlink("does/not/exist", link);
+    STASIS_ASSERT(copy2(link, dest, 0) == 0, "copy failed");
+    STASIS_ASSERT(lstat(dest, &st) == 0 && S_ISLNK(st.st_mode), "destination should be a link");
+    STASIS_ASSERT(readlink(dest, target, sizeof(target) - 1) > 0 && strcmp(target, "does/not/exist") == 0, "link target differs");
+    remove(link);
+    remove(dest);
+}
+
+void test_copy2_missing() {
+    STASIS_ASSERT(copy2("test_copy2.does_not_exist", "test_copy2_missing.dest", 0) < 0, "missing source should fail");
+    STASIS_ASSERT(access("test_copy2_missing.dest", F_OK) != 0, "destination should not be created");
+}
+
+void test_copytree_parallel() {
+    const char *src = "test_copytree_src";
+    const char *dest = "test_copytree_dest";
+    const size_t files_max = 300;
+    char path[PATH_MAX];
+    char target[PATH_MAX];
+    struct CopyTreeReport report;
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+    STASIS_ASSERT_FATAL(mkdirs("test_copytree_src/a/b/c", 0755) == 0, "unable to create tree");
+    mkdirs("test_copytree_src/many", 0755);
+    mkdirs("test_copytree_src/empty", 0755);
+    for (size_t i = 0; i < files_max; i++) {
+        sprintf(path, "%s/many/%zu", src, i);
+        sprintf(target, "file %zu\n", i);
+        stasis_testing_write_ascii(path, target);
+    }
+    stasis_testing_write_ascii("test_copytree_src/a/b/c/deep.txt", "deep\n");
+    chmod("test_copytree_src/a/b/c/deep.txt", 0700);
+    symlink("b/c/deep.txt", "test_copytree_src/a/link");
+
+    STASIS_ASSERT(copytree_parallel(src, dest, CT_PERM, &report) == 0, "copy failed");
+    STASIS_ASSERT(report.errors == 0 && strlist_count(report.failed) == 0, "no errors expected");
+    STASIS_ASSERT(report.dirs == 5, "unexpected number of directories");
+    STASIS_ASSERT(report.files == files_max + 2, "unexpected number of files");
+    guard_strlist_free(&report.failed);
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < files_max; i++) {
+        char src_path[PATH_MAX];
+        sprintf(src_path, "%s/many/%zu", src, i);
+        sprintf(path, "%s/many/%zu", dest, i);
+        if (!files_equal(src_path, path)) {
+            mismatch++;
+        }
+    }
+    STASIS_ASSERT(mismatch == 0, "copied files differ");
+    STASIS_ASSERT(files_equal("test_copytree_src/a/b/c/deep.txt", "test_copytree_dest/a/b/c/deep.txt"), "nested file differs");
+
+    struct stat st;
+    STASIS_ASSERT(stat("test_copytree_dest/a/b/c/deep.txt", &st) == 0 && (st.st_mode & 07777) == 0700, "permissions should be preserved");
+    STASIS_ASSERT(stat("test_copytree_dest/empty", &st) == 0 && S_ISDIR(st.st_mode), "empty directory should be created");
+    memset(target, 0, sizeof(target));
+    STASIS_ASSERT(readlink("test_copytree_dest/a/link", target, sizeof(target) - 1) > 0 && !strcmp(target, "b/c/deep.txt"), "link should be copied as a link");
+
+    // Errors are reported and do not stop the copy
+    rmtree("test_copytree_dest/many");
+    mkdirs("test_copytree_dest/many/7/blocker", 0755);
+    STASIS_ASSERT(copytree_parallel(src, dest, 0, &report) < 0, "expected a failure");
+    STASIS_ASSERT(report.errors == 1 && strlist_count(report.failed) == 1, "expected one error");
+    STASIS_ASSERT(strlist_count(report.failed) && startswith(strlist_item(report.failed, 0), "many/7:"), "error should name the entry");
+    STASIS_ASSERT(report.files == files_max + 1, "remaining files should be copied");
+    guard_strlist_free(&report.failed);
+
+    // A directory cannot be copied into itself
+    STASIS_ASSERT(copytree_parallel(src, "test_copytree_src/a/inside", 0, &report) < 0, "copy into itself should fail");
+    STASIS_ASSERT(access("test_copytree_src/a/inside", F_OK) != 0, "destination should be removed");
+    guard_strlist_free(&report.failed);
+    rmtree((char *) src);
+    rmtree((char *) dest);
+}
+
+void test_sync_tree() {
+    const char *src = "test_sync_tree_src";
+    const char *dest = "test_sync_tree_dest";
+    const struct timespec times[2] = {{.tv_sec = 1234567890}, {.tv_sec = 1234567890}};
+    char *exclude[] = {"tmp/", "*.pyc", NULL};
+    struct CopyTreeReport report;
+    struct stat st;
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+    mkdirs("test_sync_tree_src/pkg/sub", 0755);
+    mkdirs("test_sync_tree_src/tmp", 0755);
+    stasis_testing_write_ascii("test_sync_tree_src/pkg/a.txt", "aaaa");
+    stasis_testing_write_ascii("test_sync_tree_src/pkg/sub/b.txt", "bbbb");
+    stasis_testing_write_ascii("test_sync_tree_src/pkg/c.pyc", "compiled");
+    stasis_testing_write_ascii("test_sync_tree_src/tmp/scratch", "scratch");
+    stasis_testing_write_ascii("test_sync_tree_src/conflict", "file");
+
+    // Stale destination entries
+    mkdirs("test_sync_tree_dest/stale/dir", 0755);
+    mkdirs("test_sync_tree_dest/tmp", 0755);
+    mkdirs("test_sync_tree_dest/conflict", 0755);
+    stasis_testing_write_ascii("test_sync_tree_dest/stale/dir/old", "old");
+    stasis_testing_write_ascii("test_sync_tree_dest/stale.txt", "old");
+    stasis_testing_write_ascii("test_sync_tree_dest/tmp/keep", "keep");
+    stasis_testing_write_ascii("test_sync_tree_dest/conflict/old", "old");
+
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_DELETE, exclude, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.errors == 0, "no errors expected");
+    guard_strlist_free(&report.failed);
+    STASIS_ASSERT(report.files == 3, "unexpected number of files copied");
+    STASIS_ASSERT(report.deleted == 2, "unexpected number of deletions");
+    STASIS_ASSERT(files_equal("test_sync_tree_src/pkg/sub/b.txt", "test_sync_tree_dest/pkg/sub/b.txt"), "nested file differs");
+    STASIS_ASSERT(files_equal("test_sync_tree_src/conflict", "test_sync_tree_dest/conflict"), "directory should be replaced by a file");
+    STASIS_ASSERT(access("test_sync_tree_dest/pkg/c.pyc", F_OK) != 0, "excluded file should not be copied");
+    STASIS_ASSERT(access("test_sync_tree_dest/tmp/scratch", F_OK) != 0, "excluded directory should not be copied");
+    STASIS_ASSERT(access("test_sync_tree_dest/tmp/keep", F_OK) == 0, "excluded directory should not be deleted");
+    STASIS_ASSERT(access("test_sync_tree_dest/stale", F_OK) != 0 && access("test_sync_tree_dest/stale.txt", F_OK) != 0, "stale entries should be deleted");
+
+    // Nothing changed
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_DELETE, exclude, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.files == 0 && report.skipped == 3 && report.deleted == 0, "nothing should be copied");
+    guard_strlist_free(&report.failed);
+
+    // Different size
+    stasis_testing_write_ascii("test_sync_tree_src/pkg/a.txt", "aaaaaaaa");
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM, exclude, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.files == 1 && report.skipped == 2, "only the modified file should be copied");
+    STASIS_ASSERT(files_equal("test_sync_tree_src/pkg/a.txt", "test_sync_tree_dest/pkg/a.txt"), "modified file differs");
+    guard_strlist_free(&report.failed);
+
+    // Same size and modification time, different contents
+    stasis_testing_write_ascii("test_sync_tree_src/pkg/a.txt", "AAAAAAAA");
+    utimensat(AT_FDCWD, "test_sync_tree_src/pkg/a.txt", times, 0);
+    utimensat(AT_FDCWD, "test_sync_tree_dest/pkg/a.txt", times, 0);
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM, exclude, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.files == 0, "size and modification time are trusted by default");
+    guard_strlist_free(&report.failed);
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_CHECKSUM, exclude, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.files == 1 && report.skipped == 2, "contents should be compared");
+    STASIS_ASSERT(files_equal("test_sync_tree_src/pkg/a.txt", "test_sync_tree_dest/pkg/a.txt"), "modified file differs");
+    STASIS_ASSERT(stat("test_sync_tree_dest/pkg/a.txt", &st) == 0 && STAT_MTIM(st).tv_sec == times[1].tv_sec, "modification time should be preserved");
+    guard_strlist_free(&report.failed);
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+}
+
+void test_sync_tree_replace() {
+    const char *src = "test_sync_tree_replace_src";
+    const char *dest = "test_sync_tree_replace_dest";
+    const struct timespec times[2] = {{.tv_sec = 1000000000}, {.tv_sec = 1000000000}};
+    struct CopyTreeReport report;
+    struct stat st;
+
+    mkdirs("test_sync_tree_replace_src/pkg", 0755);
+    mkdirs("test_sync_tree_replace_dest/pkg", 0755);
+    stasis_testing_write_ascii("test_sync_tree_replace_src/pkg/a.txt", "new");
+    stasis_testing_write_ascii("test_sync_tree_replace_outside", "outside");
+    link("test_sync_tree_replace_outside", "test_sync_tree_replace_dest/pkg/a.txt");
+    chmod("test_sync_tree_replace_src/pkg", 0750);
+    utimensat(AT_FDCWD, "test_sync_tree_replace_src/pkg", times, 0);
+
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_DELETE, NULL, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.files == 1 && report.errors == 0, "the file should be replaced");
+    guard_strlist_free(&report.failed);
+    char *data = stasis_testing_read_ascii("test_sync_tree_replace_outside");
+    STASIS_ASSERT(data && strcmp(data, "outside") == 0, "other names of a replaced file should not be modified");
+    guard_free(data);
+    struct StrList *listing = listdir("test_sync_tree_replace_dest/pkg");
+    STASIS_ASSERT(listing && strlist_count(listing) == 1, "temporary files should not be left behind");
+    guard_strlist_free(&listing);
+
+    // Existing directories are updated too
+    STASIS_ASSERT_FATAL(stat("test_sync_tree_replace_dest/pkg", &st) == 0, "destination directory is missing");
+    STASIS_ASSERT((st.st_mode & 07777) == 0750, "directory permissions should be updated");
+    STASIS_ASSERT(STAT_MTIM(st).tv_sec == times[1].tv_sec, "directory modification time should be updated");
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+    remove("test_sync_tree_replace_outside");
+}
+
+void test_sync_tree_link() {
+    const char *src = "test_sync_tree_link_src";
+    const char *dest = "test_sync_tree_link_dest";
+    struct CopyTreeReport report;
+    struct stat src_st;
+    struct stat dest_st;
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+    mkdirs("test_sync_tree_link_src/conda/noarch", 0755);
+    mkdirs("test_sync_tree_link_dest/conda/noarch", 0755);
+    stasis_testing_write_ascii("test_sync_tree_link_src/conda/noarch/a.tar.bz2", "package a");
+    stasis_testing_write_ascii("test_sync_tree_link_src/conda/noarch/b.tar.bz2", "package b");
+    chmod("test_sync_tree_link_src/conda/noarch/b.tar.bz2", 0600);
+    // A copy left by an earlier build, and a package that no longer exists
+    stasis_testing_write_ascii("test_sync_tree_link_dest/conda/noarch/a.tar.bz2", "package a");
+    stasis_testing_write_ascii("test_sync_tree_link_dest/conda/noarch/old.tar.bz2", "old package");
+
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_LINK | CT_DELETE, NULL, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.linked == 2 && report.files == 0 && report.deleted == 1, "files should be linked and stale entries pruned");
+    guard_strlist_free(&report.failed);
+    stat("test_sync_tree_link_src/conda/noarch/a.tar.bz2", &src_st);
+    stat("test_sync_tree_link_dest/conda/noarch/a.tar.bz2", &dest_st);
+    STASIS_ASSERT(src_st.st_ino == dest_st.st_ino, "destination should be a hard link");
+    STASIS_ASSERT(access("test_sync_tree_link_dest/conda/noarch/old.tar.bz2", F_OK) != 0, "stale package should be pruned");
+    stat("test_sync_tree_link_src/conda/noarch/b.tar.bz2", &src_st);
+    STASIS_ASSERT((src_st.st_mode & 07777) == 0600, "source permissions should not change");
+
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_LINK | CT_DELETE, NULL, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.linked == 0 && report.skipped == 2, "links should be up to date");
+    guard_strlist_free(&report.failed);
+
+    // A rebuilt package is a new file, so the link is replaced
+    stasis_testing_write_ascii("test_sync_tree_link_src/conda/noarch/a.tar.bz2.new", "package a, rebuilt");
+    rename("test_sync_tree_link_src/conda/noarch/a.tar.bz2.new", "test_sync_tree_link_src/conda/noarch/a.tar.bz2");
+    STASIS_ASSERT(sync_tree(src, dest, CT_PERM | CT_LINK | CT_DELETE, NULL, &report) == 0, "sync failed");
+    STASIS_ASSERT(report.linked == 1 && report.skipped == 1, "only the rebuilt package should be linked");
+    guard_strlist_free(&report.failed);
+    char *data = stasis_testing_read_ascii("test_sync_tree_link_dest/conda/noarch/a.tar.bz2");
+    STASIS_ASSERT(data && strcmp(data, "package a, rebuilt") == 0, "destination should be the rebuilt package");
+    guard_free(data);
+
+    rmtree((char *) src);
+    rmtree((char *) dest);
+}
+
+int main(int argc, char *argv[]) {
+    STASIS_TEST_BEGIN_MAIN();
+    STASIS_TEST_FUNC *tests[] = {
+        test_copy2_sizes,
+        test_copy2_overwrite,
+        test_copy2_metadata,
+        test_copy2_symlink,
+        test_copy2_missing,
+        test_copytree_parallel,
+        test_sync_tree,
+        test_sync_tree_replace,
+        test_sync_tree_link,
+    };
+    STASIS_TEST_RUN(tests);
+    STASIS_TEST_END_MAIN();
+}
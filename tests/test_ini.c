@@ -1,4 +1,5 @@
 #include "testing.h"
+#include <pthread.h>
 #include "ini.h"
 
 void test_ini_open_empty() {
@@ -94,6 +95,356 @@ void test_ini_setval_getval() {
     remove(filename);
 }
 
+static int ini_compare(struct INIFILE *a, struct INIFILE *b) {
+    if (a->section_count != b->section_count) {
+        return -1;
+    }
+    for (size_t i = 0; i < a->section_count; i++) {
+        struct INISection *x = a->section[i];
+        struct INISection *y = b->section[i];
+        if (strcmp(x->key, y->key) || x->data_count != y->data_count) {
+            return -1;
+        }
+        for (size_t d = 0; d < x->data_count; d++) {
+            if (strcmp(x->data[d]->key, y->data[d]->key) || strcmp(x->data[d]->value, y->data[d]->value)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void test_ini_open_mmap() {
+    const char *filename = "ini_open_mmap.ini";
+    const char *data = "top = level\n"
+                       "[default]\n"
+                       "a=1 ; comment\n"
+                       "b='quoted'\n"
+                       "c = escaped\\;semicolon\n"
+                       "[section name here]\n"
+                       "script =\n"
+                       "    echo hello\n"
+                       "    # not a comment\n"
+                       "\n"
+                       "    echo world\n"
+                       "test=true\n";
+    struct INIFILE *ini;
+    struct INIFILE *ini_mmap;
+
+    stasis_testing_write_ascii(filename, data);
+    ini = ini_open(filename);
+    ini_mmap = ini_open_mmap(filename);
+    STASIS_ASSERT_FATAL(ini_mmap != NULL, "unable to parse INI file");
+    STASIS_ASSERT(ini_compare(ini, ini_mmap) == 0, "ini_open_mmap() and ini_open() results should be identical");
+
+    union INIVal val;
+    STASIS_ASSERT(ini_getval(ini_mmap, "default", "b", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "quoted") == 0, "quotes should be removed");
+    STASIS_ASSERT(ini_getval(ini_mmap, "default", "c", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "escaped;semicolon") == 0, "escape character should be removed");
+    STASIS_ASSERT(ini_getval(ini_mmap, "section name here", "script", INIVAL_TYPE_STR_ARRAY, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "echo hello\n# not a comment\n\necho world\n") == 0, "unexpected multi-line value");
+    ini_free(&ini);
+    ini_free(&ini_mmap);
+
+    ini_mmap = ini_open_mmap("/dev/null");
+    STASIS_ASSERT(ini_mmap && ini_mmap->section_count == 1, "should have at least one section pre-allocated");
+    ini_free(&ini_mmap);
+    STASIS_ASSERT(ini_open_mmap("ini_open_mmap_missing.ini") == NULL, "missing file should return NULL");
+    remove(filename);
+}
+
+void test_ini_open_mmap_long_value() {
+    const char *filename = "ini_open_mmap_long.ini";
+    const size_t line_len = STASIS_BUFSIZ * 2;
+    const size_t lines = 16;
+    FILE *fp = fopen(filename, "w");
+    STASIS_ASSERT_FATAL(fp != NULL, "unable to create INI file");
+    fprintf(fp, "[long]\nsingle = ");
+    for (size_t i = 0; i < line_len; i++) {
+        fputc('x', fp);
+    }
+    fprintf(fp, "\nmulti =\n");
+    for (size_t i = 0; i < lines; i++) {
+        fprintf(fp, "    ");
+        for (size_t c = 0; c < line_len; c++) {
+            fputc('y', fp);
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "after = 1\n");
+    fclose(fp);
+
+    struct INIFILE *ini = ini_open_mmap(filename);
+    STASIS_ASSERT_FATAL(ini != NULL, "unable to parse INI file");
+    union INIVal val;
+    STASIS_ASSERT(ini_getval(ini, "long", "single", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strlen(val.as_char_p) == line_len, "long single-line value was truncated");
+    STASIS_ASSERT(ini_getval(ini, "long", "multi", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strlen(val.as_char_p) == (line_len + 1) * lines, "long multi-line value was truncated");
+    // Reading an array must not depend on the value's length, or change it
+    for (size_t pass = 0; pass < 2; pass++) {
+        STASIS_ASSERT(ini_getval(ini, "long", "multi", INIVAL_TYPE_STR_ARRAY, &val) == 0, "failed to get array value");
+        STASIS_ASSERT(strlen(val.as_char_p) == (line_len + 1) * lines, "long array value changed length");
+        STASIS_ASSERT(val.as_char_p[0] == 'y' && val.as_char_p[line_len] == '\n' && val.as_char_p[line_len + 1] == 'y',
+                      "array lines were not stripped");
+    }
+    STASIS_ASSERT(ini_getval(ini, "long", "after", INIVAL_TYPE_INT, &val) == 0 && val.as_int == 1, "record following a long value was not parsed");
+    ini_free(&ini);
+    remove(filename);
+}
+
+void test_ini_open_mmap_benchmark() {
+    const char *filename = "ini_open_mmap_bench.ini";
+    const size_t sections = 1000;
+    FILE *fp = fopen(filename, "w");
+    STASIS_ASSERT_FATAL(fp != NULL, "unable to create INI file");
+    for (size_t i = 0; i < sections; i++) {
+        fprintf(fp, "[test:package_%zu]\n", i);
+        fprintf(fp, "version = 1.%zu.0 ; comment\n", i);
+        fprintf(fp, "repository = https://github.com/example/package_%zu\n", i);
+        fprintf(fp, "script =\n");
+        for (size_t line = 0; line < 20; line++) {
+            fprintf(fp, "    pytest -n auto --basetemp=/tmp/package_%zu tests/test_%zu.py\n", i, line);
+        }
+    }
+    fclose(fp);
+
+    struct timespec start, stop;
+    double elapsed[2];
+    struct INIFILE *ini[2];
+    struct INIFILE *(*parser[2])(const char *) = {ini_open, ini_open_mmap};
+    for (size_t i = 0; i < 2; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ini[i] = parser[i](filename);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        elapsed[i] = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+        STASIS_ASSERT_FATAL(ini[i] != NULL, "unable to parse INI file");
+    }
+    printf("ini_open: %.6lfs, ini_open_mmap: %.6lfs (%zu sections)\n", elapsed[0], elapsed[1], sections);
+    STASIS_ASSERT(ini_compare(ini[0], ini[1]) == 0, "ini_open_mmap() and ini_open() results should be identical");
+    ini_free(&ini[1]);
+
+    const char *cache_dir = "ini_open_mmap_bench.d";
+    ini[1] = ini_open_cached(filename, cache_dir);
+    ini_free(&ini[1]);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ini[1] = ini_open_cached(filename, cache_dir);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    printf("ini_open_cached: %.6lfs (compiled)\n", (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9);
+    STASIS_ASSERT(ini_compare(ini[0], ini[1]) == 0, "ini_open_cached() and ini_open() results should be identical");
+    ini_free(&ini[0]);
+    ini_free(&ini[1]);
+    rmtree((char *) cache_dir);
+    remove(filename);
+}
+
+void test_ini_open_cached() {
+    const char *filename = "ini_open_cached.ini";
+    const char *cache_dir = "ini_open_cached.d";
+    const char *data = "[default]\na=1\n[section]\nscript =\n    echo hello\n    echo world\nb='quoted'\n";
+    struct INIFILE *ini;
+    struct INIFILE *ini_cached;
+    struct StrList *files;
+    union INIVal val;
+
+    stasis_testing_write_ascii(filename, data);
+    ini = ini_open(filename);
+
+    // First call compiles the file, second call uses the compiled image
+    for (size_t i = 0; i < 2; i++) {
+        ini_cached = ini_open_cached(filename, cache_dir);
+        STASIS_ASSERT_FATAL(ini_cached != NULL, "unable to parse INI file");
+        STASIS_ASSERT(ini_compare(ini, ini_cached) == 0, "ini_open_cached() and ini_open() results should be identical");
+        STASIS_ASSERT((i == 0 && ini_cached->_mapping == NULL) || (i == 1 && ini_cached->_mapping != NULL), "compiled image was not used");
+        ini_free(&ini_cached);
+    }
+    files = listdir(cache_dir);
+    STASIS_ASSERT(files && strlist_count(files) == 1, "cache directory should contain one compiled file");
+    guard_strlist_free(&files);
+
+    // Values backed by the compiled image can be modified
+    ini_cached = ini_open_cached(filename, cache_dir);
+    STASIS_ASSERT(ini_getval(ini_cached, "section", "script", INIVAL_TYPE_STR_ARRAY, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "echo hello\necho world\n") == 0, "unexpected multi-line value");
+    STASIS_ASSERT(ini_setval(&ini_cached, INI_SETVAL_APPEND, "section", "b", " twice") == 0, "failed to append value");
+    STASIS_ASSERT(ini_getval(ini_cached, "section", "b", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "quoted twice") == 0, "unexpected value loaded from modified variable");
+    STASIS_ASSERT(ini_setval(&ini_cached, INI_SETVAL_REPLACE, "default", "a", "changed") == 0, "failed to replace value");
+    STASIS_ASSERT(ini_getval(ini_cached, "default", "a", INIVAL_TYPE_STR, &val) == 0, "failed to get value");
+    STASIS_ASSERT(strcmp(val.as_char_p, "changed") == 0, "unexpected value loaded from modified variable");
+    ini_free(&ini_cached);
+
+    // Changes to the source file invalidate the compiled image
+    sleep(1);
+    stasis_testing_write_ascii(filename, "[default]\na=2\n");
+    ini_cached = ini_open_cached(filename, cache_dir);
+    STASIS_ASSERT_FATAL(ini_cached != NULL, "unable to parse INI file");
+    STASIS_ASSERT(ini_cached->_mapping == NULL, "stale compiled image was used");
+    STASIS_ASSERT(ini_getval(ini_cached, "default", "a", INIVAL_TYPE_INT, &val) == 0 && val.as_int == 2, "stale value returned");
+    ini_free(&ini_cached);
+
+    // A damaged image is ignored and replaced
+    files = listdir(cache_dir);
+    char cachefile[PATH_MAX];
+    sprintf(cachefile, "%s/%s", cache_dir, strlist_item(files, 0));
+    guard_strlist_free(&files);
+    stasis_testing_write_ascii(cachefile, "garbage");
+    ini_cached = ini_open_cached(filename, cache_dir);
+    STASIS_ASSERT(ini_cached && ini_cached->_mapping == NULL, "damaged compiled image was used");
+    ini_free(&ini_cached);
+    ini_cached = ini_open_cached(filename, cache_dir);
+    STASIS_ASSERT(ini_cached && ini_cached->_mapping != NULL, "compiled image was not replaced");
+    STASIS_ASSERT(ini_getval(ini_cached, "default", "a", INIVAL_TYPE_INT, &val) == 0 && val.as_int == 2, "unexpected value");
+    ini_free(&ini_cached);
+
+    // An image written with the other byte order is ignored. The ABI tag follows the magic and version.
+    unsigned char tag[4];
+    int fd = open(cachefile, O_RDWR);
+    STASIS_ASSERT_FATAL(fd >= 0 && pread(fd, tag, sizeof(tag), 12) == sizeof(tag), "unable to read compiled image");
+    for (size_t i = 0; i < sizeof(tag) / 2; i++) {
+        unsigned char c = tag[i];
+        tag[i] = tag[sizeof(tag) - 1 - i];
+        tag[sizeof(tag) - 1 - i] = c;
+    }
+    STASIS_ASSERT_FATAL(pwrite(fd, tag, sizeof(tag), 12) == sizeof(tag), "unable to modify compiled image");
+    close(fd);
+    ini_cached = ini_open_cached(filename, cache_dir);
+    STASIS_ASSERT(ini_cached && ini_cached->_mapping == NULL, "compiled image from another platform was used");
+    STASIS_ASSERT(ini_getval(ini_cached, "default", "a", INIVAL_TYPE_INT, &val) == 0 && val.as_int == 2, "unexpected value");
+    ini_free(&ini_cached);
+
+    // A compiled image that cannot be written is still used, even after the source is touched
+    struct stat cache_st;
+    STASIS_ASSERT(stat(cachefile, &cache_st) == 0 && (cache_st.st_mode & 0444) == 0444, "compiled image should be readable by everyone");
+    chmod(cachefile, 0444);
+    chmod(cache_dir, 0555);
+    struct timespec times[2] = {{.tv_sec = 1000000000}, {.tv_sec = 1000000000}};
+    utimensat(AT_FDCWD, filename, times, 0);
+    for (size_t i = 0; i < 2; i++) {
+        ini_cached = ini_open_cached(filename, cache_dir);
+        STASIS_ASSERT(ini_cached && ini_cached->_mapping != NULL, "read-only compiled image was not used");
+        STASIS_ASSERT(ini_getval(ini_cached, "default", "a", INIVAL_TYPE_INT, &val) == 0 && val.as_int == 2, "unexpected value");
+        ini_free(&ini_cached);
+    }
+    chmod(cache_dir, 0755);
+
+    ini_free(&ini);
+    rmtree((char *) cache_dir);
+    remove(filename);
+}
+
+void test_ini_iter() {
+    const char *filename = "ini_iter.ini";
+    const char *data = "[default]\na=1\nb=2\nc=3\n"
+                       "[test:one]\nversion=1\n"
+                       "[deploy:docker]\ntags=x\n"
+                       "[test:two]\nversion=2\nscript=true\n";
+    struct INIFILE *ini;
+    struct INIIterator iter;
+    struct INIIterator iter_nested;
+    struct INISection *section;
+    struct INIData *record;
+    size_t count;
+
+    stasis_testing_write_ascii(filename, data);
+    ini = ini_open(filename);
+
+    ini_section_iter_init(&iter, ini, INI_SEARCH_BEGINS, "test:");
+    section = ini_section_iter_next(&iter);
+    STASIS_ASSERT(section && strcmp(section->key, "test:one") == 0, "expected first test section");
+    section = ini_section_iter_next(&iter);
+    STASIS_ASSERT(section && strcmp(section->key, "test:two") == 0, "expected second test section");
+    STASIS_ASSERT(ini_section_iter_next(&iter) == NULL, "iteration should end after the last matching section");
+    STASIS_ASSERT(ini_section_iter_next(&iter) == NULL, "exhausted iterator should stay exhausted");
+
+    ini_section_iter_init(&iter, ini, INI_SEARCH_EXACT, NULL);
+    for (count = 0; ini_section_iter_next(&iter) != NULL; count++);
+    STASIS_ASSERT(count == ini->section_count, "NULL pattern should visit every section");
+
+    // Iterators are independent of each other
+    STASIS_ASSERT(ini_data_iter_init(&iter, ini, "default") == 0, "default section should exist");
+    record = ini_data_iter_next(&iter);
+    STASIS_ASSERT(record && strcmp(record->key, "a") == 0, "expected first record");
+    STASIS_ASSERT(ini_data_iter_init(&iter_nested, ini, "test:two") == 0, "test:two section should exist");
+    for (count = 0; ini_data_iter_next(&iter_nested) != NULL; count++);
+    STASIS_ASSERT(count == 2, "test:two should have two records");
+    record = ini_data_iter_next(&iter);
+    STASIS_ASSERT(record && strcmp(record->key, "b") == 0, "nested iteration disturbed the outer iterator");
+
+    // An abandoned loop does not affect the next one
+    STASIS_ASSERT(ini_data_iter_init(&iter, ini, "default") == 0, "default section should exist");
+    record = ini_data_iter_next(&iter);
+    STASIS_ASSERT(record && strcmp(record->key, "a") == 0, "iteration should restart at the first record");
+
+    STASIS_ASSERT(ini_data_iter_init(&iter, ini, "missing") != 0, "missing section should be reported");
+    STASIS_ASSERT(ini_data_iter_next(&iter) == NULL, "missing section should not produce records");
+    ini_free(&ini);
+    remove(filename);
+}
+
+struct ini_reader {
+    struct INIFILE *ini;
+    size_t sections;
+    size_t mismatches;
+};
+
+static void *ini_reader_run(void *arg) {
+    struct ini_reader *reader = arg;
+    for (size_t pass = 0; pass < 50; pass++) {
+        struct INIIterator iter;
+        struct INIIterator records;
+        struct INISection *section;
+        union INIVal val;
+
+        reader->sections = 0;
+        ini_section_iter_init(&iter, reader->ini, INI_SEARCH_BEGINS, "test:");
+        while ((section = ini_section_iter_next(&iter)) != NULL) {
+            size_t count = 0;
+            ini_data_iter_init(&records, reader->ini, section->key);
+            while (ini_data_iter_next(&records) != NULL) {
+                count++;
+            }
+            if (count != 2
+                || ini_getval(reader->ini, section->key, "version", INIVAL_TYPE_STR, &val)
+                || strcmp(val.as_char_p, "1.0") != 0
+                || ini_getval(reader->ini, section->key, "script", INIVAL_TYPE_STR_ARRAY, &val)
+                || strcmp(val.as_char_p, "echo one\necho two\n") != 0) {
+                reader->mismatches++;
+            }
+            reader->sections++;
+        }
+    }
+    return NULL;
+}
+
+void test_ini_iter_threads() {
+    const char *filename = "ini_iter_threads.ini";
+    const size_t sections = 100;
+    struct ini_reader readers[2];
+    pthread_t threads[2];
+    FILE *fp = fopen(filename, "w");
+    STASIS_ASSERT_FATAL(fp != NULL, "unable to create INI file");
+    for (size_t i = 0; i < sections; i++) {
+        fprintf(fp, "[test:package_%zu]\nversion =   1.0\nscript =\n    echo one\n\techo two\n", i);
+    }
+    fclose(fp);
+
+    struct INIFILE *ini = ini_open_mmap(filename);
+    STASIS_ASSERT_FATAL(ini != NULL, "unable to parse INI file");
+    for (size_t i = 0; i < 2; i++) {
+        readers[i] = (struct ini_reader) {.ini = ini};
+        STASIS_ASSERT_FATAL(pthread_create(&threads[i], NULL, ini_reader_run, &readers[i]) == 0, "unable to start reader");
+    }
+    for (size_t i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        STASIS_ASSERT(readers[i].sections == sections, "every section should have been visited");
+        STASIS_ASSERT(readers[i].mismatches == 0, "concurrent readers observed unexpected values");
+    }
+    ini_free(&ini);
+    remove(filename);
+}
+
 int main(int argc, char *argv[]) {
     STASIS_TEST_BEGIN_MAIN();
     STASIS_TEST_FUNC *tests[] = {
@@ -102,6 +453,12 @@ int main(int argc, char *argv[]) {
         test_ini_section_search,
         test_ini_has_key,
         test_ini_setval_getval,
+        test_ini_open_mmap,
+        test_ini_open_mmap_long_value,
+        test_ini_open_mmap_benchmark,
+        test_ini_open_cached,
+        test_ini_iter,
+        test_ini_iter_threads,
     };
     STASIS_TEST_RUN(tests);
     STASIS_TEST_END_MAIN();
@@ -0,0 +1,72 @@
+#include "testing.h"
+
+static void increment(void *arg) {
+    __atomic_fetch_add((size_t *) arg, 1, __ATOMIC_RELAXED);
+}
+
+struct SlowTask {
+    int done;
+};
+
+static void slow(void *arg) {
+    struct SlowTask *task = arg;
+    usleep(1000);
+    task->done = 1;
+}
+
+void test_pool_default_size() {
+    long cpu_limit = globals.cpu_limit;
+    STASIS_ASSERT(pool_default_size() > 0, "at least one thread is required");
+    globals.cpu_limit = 3;
+    STASIS_ASSERT(pool_default_size() == 3, "cpu_limit should be honored");
+    globals.cpu_limit = cpu_limit;
+}
+
+void test_pool_submit() {
+    const size_t sizes[] = {1, 2, 4, 0};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        size_t counter = 0;
+        struct Pool *pool = pool_init(sizes[i]);
+        STASIS_ASSERT_FATAL(pool != NULL, "pool_init failed");
+        STASIS_ASSERT(pool->nthreads == (sizes[i] ? sizes[i] : pool_default_size()), "unexpected number of threads");
+        for (size_t task = 0; task < 10000; task++) {
+            pool_submit(pool, increment, &counter);
+        }
+        pool_wait(pool);
+        STASIS_ASSERT(counter == 10000, "every task should run exactly once");
+
+        // The pool is reusable after waiting
+        for (size_t task = 0; task < 100; task++) {
+            pool_submit(pool, increment, &counter);
+        }
+        pool_wait(pool);
+        STASIS_ASSERT(counter == 10100, "every task should run exactly once after reuse");
+        pool_free(&pool);
+        STASIS_ASSERT(pool == NULL, "pool should be NULL after free");
+    }
+}
+
+void test_pool_free_drains() {
+    struct SlowTask tasks[16] = {0};
+    struct Pool *pool = pool_init(2);
+    for (size_t i = 0; i < sizeof(tasks) / sizeof(*tasks); i++) {
+        pool_submit(pool, slow, &tasks[i]);
+    }
+    pool_free(&pool);
+    size_t done = 0;
+    for (size_t i = 0; i < sizeof(tasks) / sizeof(*tasks); i++) {
+        done += tasks[i].done;
+    }
+    STASIS_ASSERT(done == sizeof(tasks) / sizeof(*tasks), "queued tasks should finish before the pool is freed");
+}
+
+int main(int argc, char *argv[]) {
+    STASIS_TEST_BEGIN_MAIN();
+    STASIS_TEST_FUNC *tests[] = {
+        test_pool_default_size,
+        test_pool_submit,
+        test_pool_free_drains,
+    };
+    STASIS_TEST_RUN(tests);
+    STASIS_TEST_END_MAIN();
+}
@@ -22,6 +22,26 @@ void test_replace_text() {
 
 }
 
+void test_replace_text_all() {
+    char input[STASIS_BUFSIZ] = {0};
+    strcpy(input, "a.b.c.d");
+    STASIS_ASSERT(replace_text(input, ".", "::", 0) == 0, "string replacement failed");
+    STASIS_ASSERT(strcmp(input, "a::b::c::d") == 0, "every match should be replaced");
+    STASIS_ASSERT(replace_text(input, "::", "", 0) == 0, "string replacement failed");
+    STASIS_ASSERT(strcmp(input, "abcd") == 0, "every match should be removed");
+    STASIS_ASSERT(replace_text(input, "missing", "x", 0) == 0, "missing target is not an error");
+    STASIS_ASSERT(strcmp(input, "abcd") == 0, "input should not change when the target is missing");
+
+    strcpy(input, "key = value # comment" LINE_SEP);
+    STASIS_ASSERT(replace_text(input, "value", "other", REPLACE_TRUNCATE_AFTER_MATCH) == 0, "string replacement failed");
+    STASIS_ASSERT(strcmp(input, "key = other" LINE_SEP) == 0, "input should be truncated after the match");
+
+    memset(input, 'x', sizeof(input) / 2);
+    input[sizeof(input) / 2] = '\0';
+    STASIS_ASSERT(replace_text(input, "x", "yy", 0) < 0, "overflowing the buffer should fail");
+    STASIS_ASSERT(input[0] == 'x', "input should not change on failure");
+}
+
 void test_file_replace_text() {
     for (size_t i = 0; i < sizeof(targets) / sizeof(*targets); i += 2) {
         const char *filename = "test_file_replace_text.txt";
@@ -51,11 +71,227 @@ void test_file_replace_text() {
     }
 }
 
+void test_file_replace_text_long_line() {
+    const char *filename = "test_file_replace_text_long.txt";
+    const size_t padding = STASIS_BUFSIZ * 3;
+    char *data = calloc(padding + 100, sizeof(*data));
+    memset(data, 'x', padding);
+    strcat(data, "/old/prefix/bin\n");
+    stasis_testing_write_ascii(filename, data);
+
+    STASIS_ASSERT(file_replace_text(filename, "/old/prefix", "/new", 0) == 0, "string replacement failed");
+    char *result = stasis_testing_read_ascii(filename);
+    STASIS_ASSERT(result && strlen(result) == padding + strlen("/new/bin\n"), "unexpected length");
+    STASIS_ASSERT(result && strcmp(result + padding, "/new/bin\n") == 0, "match past the old line buffer was not replaced");
+    guard_free(result);
+    guard_free(data);
+    remove(filename);
+}
+
+void test_file_replace_text_rules() {
+    const char *sequential = "test_file_replace_text_rules.seq";
+    const char *single = "test_file_replace_text_rules.yaml";
+    const char *meta =
+        "{% set name = \"example\" %}\n"
+        "{% set version = \"1.2.3\" %}\n"
+        "package:\n"
+        "  name: {{ name|lower }}\n"
+        "source:\n"
+        "  url: https://example.com/{{ name }}-{{ version }}.tar.gz\n"
+        "  sha256: 0123456789abcdef\n"
+        "build:\n"
+        "  number: 3\n"
+        "  script: echo @TOKEN@ @TOKEN@ @TOKENS@\n"
+        "about:\n"
+        "  home: https://example.com";
+    struct ReplaceRule rules[] = {
+        {.target = "{% set version = ", .replacement = "{% set version = \"4.5.6\" %}", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+        {.target = "  url:", .replacement = "  url: https://example.com/archive/refs/tags/{{ version }}.tar.gz", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+        {.target = "  sha256:", .replacement = "\n", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+        {.target = "  number:", .replacement = "  number: 0", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+        {.target = "@TOKEN@", .replacement = "value"},
+        {.target = "@TOKENS@", .replacement = "values"},
+        {.target = "  home:", .replacement = "  home: https://example.org", .flags = REPLACE_TRUNCATE_AFTER_MATCH},
+        {NULL},
+    };
+
+    stasis_testing_write_ascii(sequential, meta);
+    stasis_testing_write_ascii(single, meta);
+    for (size_t i = 0; rules[i].target; i++) {
+        file_replace_text(sequential, rules[i].target, rules[i].replacement, rules[i].flags);
+    }
+    STASIS_ASSERT(file_replace_text_rules(single, rules) == 8, "expected eight replacements");
+
+    char *expected = stasis_testing_read_ascii(sequential);
+    char *result = stasis_testing_read_ascii(single);
+    STASIS_ASSERT_FATAL(expected && result, "unable to read results");
+    STASIS_ASSERT(strcmp(result, expected) == 0, "single pass result differs from sequential replacement");
+    guard_free(expected);
+    guard_free(result);
+
+    // Overlapping targets: the first to end wins, then the longest
+    struct ReplaceRule overlap[] = {
+        {.target = "he", .replacement = "1"},
+        {.target = "she", .replacement = "2"},
+        {.target = "hers", .replacement = "3"},
+        {.target = "his", .replacement = "4"},
+        {NULL},
+    };
+    stasis_testing_write_ascii(single, "ushers this\nhishe");
+    STASIS_ASSERT(file_replace_text_rules(single, overlap) == 4, "expected four replacements");
+    result = stasis_testing_read_ascii(single);
+    STASIS_ASSERT(result && strcmp(result, "u2rs t4\n41") == 0, "unexpected overlapping replacement");
+    guard_free(result);
+
+    // No match leaves the file alone
+    struct stat before;
+    struct stat after;
+    stat(single, &before);
+    STASIS_ASSERT(file_replace_text_rules(single, overlap) == 0, "expected no replacements");
+    stat(single, &after);
+    STASIS_ASSERT(before.st_ino == after.st_ino, "unmatched file should not be replaced");
+    remove(sequential);
+    remove(single);
+}
+
+void test_relocate_file_text() {
+    const char *filename = "test_relocate_file.sh";
+    struct RelocationStats stats = {0};
+    struct stat st;
+
+    stasis_testing_write_ascii(filename, "#!/build/env/bin/python\nPREFIX=/build/env\n");
+    chmod(filename, 0750);
+    STASIS_ASSERT(relocate_file(filename, "/build/env", "/opt/relocated/env", RELOCATE_AUTO, &stats) == 2, "expected two replacements");
+    char *result = stasis_testing_read_ascii(filename);
+    STASIS_ASSERT(result && strcmp(result, "#!/opt/relocated/env/bin/python\nPREFIX=/opt/relocated/env\n") == 0, "unexpected output");
+    guard_free(result);
+    STASIS_ASSERT(stat(filename, &st) == 0 && (st.st_mode & 07777) == 0750, "permissions should be preserved");
+    STASIS_ASSERT(stats.files_rewritten == 1 && stats.replacements == 2 && stats.files_binary == 0, "unexpected statistics");
+
+    // No match leaves the file alone
+    struct stat before;
+    stat(filename, &before);
+    STASIS_ASSERT(relocate_file(filename, "/build/env", "/x", RELOCATE_AUTO, &stats) == 0, "expected no replacements");
+    stat(filename, &st);
+    STASIS_ASSERT(st.st_ino == before.st_ino, "unmatched file should not be replaced");
+    STASIS_ASSERT(stats.files_scanned == 2 && stats.files_rewritten == 1, "unexpected statistics");
+
+    // Symbolic links are followed
+    const char *link = "test_relocate_file.link";
+    symlink(filename, link);
+    STASIS_ASSERT(relocate_file(link, "/opt/relocated/env", "/srv", RELOCATE_AUTO, NULL) == 2, "expected two replacements through link");
+    STASIS_ASSERT(lstat(link, &st) == 0 && S_ISLNK(st.st_mode), "link should remain a link");
+    result = stasis_testing_read_ascii(filename);
+    STASIS_ASSERT(result && strcmp(result, "#!/srv/bin/python\nPREFIX=/srv\n") == 0, "unexpected output");
+    guard_free(result);
+    remove(link);
+    remove(filename);
+}
+
+void test_relocate_file_binary() {
+    const char *filename = "test_relocate_file.bin";
+    const char input[] = "\x7f" "ELF\0\0rpath=/build/env/lib:/build/env/lib64\0other\0/build/env\0tail /build/env";
+    const char expected[] = "\x7f" "ELF\0\0rpath=/opt/lib:/opt/lib64\0\0\0\0\0\0\0\0\0\0\0\0\0other\0/opt\0\0\0\0\0\0\0tail /build/env";
+    struct RelocationStats stats = {0};
+    FILE *fp;
+    char result[sizeof(input)] = {0};
+
+    STASIS_ASSERT(sizeof(input) == sizeof(expected), "test data must have the same length");
+    fp = fopen(filename, "wb");
+    fwrite(input, 1, sizeof(input) - 1, fp);
+    fclose(fp);
+
+    STASIS_ASSERT(relocate_file(filename, "/build/env", "/opt", RELOCATE_AUTO, &stats) == 3, "expected three replacements");
+    STASIS_ASSERT(stats.files_binary == 1, "file should be relocated as binary");
+    fp = fopen(filename, "rb");
+    size_t len = fread(result, 1, sizeof(result), fp);
+    fclose(fp);
+    STASIS_ASSERT(len == sizeof(input) - 1, "binary relocation must not change the file size");
+    STASIS_ASSERT(memcmp(result, expected, sizeof(expected) - 1) == 0, "unexpected binary output");
+
+    // Binary prefixes cannot grow
+    STASIS_ASSERT(relocate_file(filename, "/opt", "/a/longer/prefix", RELOCATE_BINARY, NULL) < 0, "longer binary prefix should fail");
+    fp = fopen(filename, "rb");
+    len = fread(result, 1, sizeof(result), fp);
+    fclose(fp);
+    STASIS_ASSERT(memcmp(result, expected, sizeof(expected) - 1) == 0, "failed relocation should not modify the file");
+    remove(filename);
+}
+
+void test_relocate_tree() {
+    const char *root = "test_relocate_tree";
+    const char *outside = "test_relocate_tree.outside";
+    const size_t files_max = 150;
+    char path[PATH_MAX];
+    struct RelocationStats stats = {0};
+
+    rmtree((char *) root);
+    STASIS_ASSERT_FATAL(mkdirs("test_relocate_tree/a/b/c", 0755) == 0, "unable to create tree");
+    mkdirs("test_relocate_tree/many", 0755);
+    // Enough files to be split into several batches
+    for (size_t i = 0; i < files_max; i++) {
+        sprintf(path, "%s/many/%zu.txt", root, i);
+        stasis_testing_write_ascii(path, i % 2 ? "prefix=/build/env\n" : "nothing to see here\n");
+    }
+    sprintf(path, "%s/a/b/c/deep.txt", root);
+    stasis_testing_write_ascii(path, "/build/env/bin:/build/env/lib\n");
+    sprintf(path, "%s/a/lib.so", root);
+    FILE *fp = fopen(path, "wb");
+    fwrite("\0rpath=/build/env/lib\0", 1, 22, fp);
+    fclose(fp);
+
+    // Links are not followed
+    stasis_testing_write_ascii(outside, "/build/env\n");
+    sprintf(path, "%s/a/link.txt", root);
+    char target[PATH_MAX];
+    sprintf(target, "../../%s", outside);
+    symlink(target, path);
+
+    STASIS_ASSERT(relocate_tree(root, "/build/env", "/opt/env", RELOCATE_AUTO, &stats) == (ssize_t) files_max / 2 + 3, "unexpected number of replacements");
+    STASIS_ASSERT(stats.files_scanned == files_max + 2, "unexpected number of files scanned");
+    STASIS_ASSERT(stats.files_rewritten == files_max / 2 + 2, "unexpected number of files rewritten");
+    STASIS_ASSERT(stats.files_binary == 1, "unexpected number of binary files");
+    STASIS_ASSERT(stats.files_failed == 0, "no failures expected");
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < files_max; i++) {
+        sprintf(path, "%s/many/%zu.txt", root, i);
+        char *data = stasis_testing_read_ascii(path);
+        if (!data || strcmp(data, i % 2 ? "prefix=/opt/env\n" : "nothing to see here\n") != 0) {
+            mismatch++;
+        }
+        guard_free(data);
+    }
+    STASIS_ASSERT(mismatch == 0, "files were not relocated correctly");
+    sprintf(path, "%s/a/b/c/deep.txt", root);
+    char *data = stasis_testing_read_ascii(path);
+    STASIS_ASSERT(data && strcmp(data, "/opt/env/bin:/opt/env/lib\n") == 0, "nested file was not relocated");
+    guard_free(data);
+    data = stasis_testing_read_ascii(outside);
+    STASIS_ASSERT(data && strcmp(data, "/build/env\n") == 0, "file outside of the tree was modified");
+    guard_free(data);
+
+    // A binary file that cannot be relocated is counted and the walk continues
+    memset(&stats, 0, sizeof(stats));
+    STASIS_ASSERT(relocate_tree(root, "/opt/env", "/a/much/longer/prefix", RELOCATE_BINARY, &stats) < 0, "expected a failure");
+    STASIS_ASSERT(stats.files_failed == files_max / 2 + 2, "unexpected number of failures");
+    STASIS_ASSERT(stats.files_scanned == files_max + 2, "every file should be scanned");
+
+    rmtree((char *) root);
+    remove(outside);
+}
+
 int main(int argc, char *argv[]) {
     STASIS_TEST_BEGIN_MAIN();
     STASIS_TEST_FUNC *tests[] = {
         test_replace_text,
+        test_replace_text_all,
         test_file_replace_text,
+        test_file_replace_text_long_line,
+        test_file_replace_text_rules,
+        test_relocate_file_text,
+        test_relocate_file_binary,
+        test_relocate_tree,
     };
     STASIS_TEST_RUN(tests);
     STASIS_TEST_END_MAIN();
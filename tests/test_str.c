@@ -209,6 +209,160 @@ void test_split() {
     }
 }
 
+void test_split_compact() {
+    struct testcase {
+            const char *data;
+            const size_t max_split;
+            const char *delim;
+    };
+    struct testcase tc[] = {
+            {.data = "a/b/c/d/e", .delim = "/", .max_split = 0},
+            {.data = "a/b/c/d/e", .delim = "/", .max_split = 1},
+            {.data = "a/b/c/d/e", .delim = "/", .max_split = 4},
+            {.data = "a/b/c/d/e", .delim = "/", .max_split = 10},
+            {.data = "multiple words split n times", .delim = " ", .max_split = 0},
+            {.data = "multiple words split n times", .delim = " ", .max_split = 1},
+            {.data = "KEY=value=with=equals", .delim = "=", .max_split = 1},
+            {.data = "trailing/", .delim = "/", .max_split = 0},
+            {.data = "//", .delim = "/", .max_split = 0},
+            {.data = "a b/c", .delim = " /", .max_split = 0},
+            {.data = "no delimiter", .delim = "/", .max_split = 0},
+            {.data = "", .delim = "/", .max_split = 0},
+    };
+    STASIS_ASSERT(split_compact(NULL, "/", 0) == NULL, "NULL input should return NULL");
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        char **expected = split((char *) tc[i].data, tc[i].delim, tc[i].max_split);
+        char **result = split_compact(tc[i].data, tc[i].delim, tc[i].max_split);
+        STASIS_ASSERT_FATAL(result != NULL, "split_compact failed");
+        STASIS_ASSERT(strcmp_array((const char **) result, (const char **) expected) == 0, "split_compact and split results should be identical");
+        GENERIC_ARRAY_FREE(expected);
+        guard_free(result);
+    }
+}
+
+void test_str_split_next() {
+    struct testcase {
+            const char *data;
+            const char *delim;
+    };
+    struct testcase tc[] = {
+            {.data = "a/b/c/d/e", .delim = "/"},
+            {.data = "KEY=value=with=equals", .delim = "="},
+            {.data = "trailing/", .delim = "/"},
+            {.data = "//", .delim = "/"},
+            {.data = "a b/c", .delim = " /"},
+            {.data = "no delimiter", .delim = "/"},
+            {.data = "", .delim = "/"},
+    };
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        struct StrSplit it;
+        struct StrView token;
+        size_t count = 0;
+        int mismatch = 0;
+        char **expected = split((char *) tc[i].data, tc[i].delim, 0);
+
+        str_split_init(&it, tc[i].data, tc[i].delim);
+        while (str_split_next(&it, &token)) {
+            if (!expected[count] || strlen(expected[count]) != token.len || strncmp(expected[count], token.ptr, token.len) != 0) {
+                mismatch++;
+            }
+            count++;
+        }
+        STASIS_ASSERT(mismatch == 0, "str_split_next tokens should match split");
+        STASIS_ASSERT(expected[count] == NULL, "str_split_next should produce as many tokens as split");
+        STASIS_ASSERT(str_split_next(&it, &token) == 0, "finished iterator should stay finished");
+        GENERIC_ARRAY_FREE(expected);
+    }
+}
+
+void test_strview_find() {
+    struct testcase {
+        const char *data;
+        const char *needle;
+        ssize_t expected;
+    };
+    struct testcase tc[] = {
+            {.data = "I have a pencil box.", .needle = "I", .expected = 0},
+            {.data = "I have a pencil box.", .needle = "pencil", .expected = 9},
+            {.data = "I have a pencil box.", .needle = "box.", .expected = 16},
+            {.data = "I have a pencil box.", .needle = "box..", .expected = -1},
+            {.data = "I have a pencil box.", .needle = "", .expected = 0},
+            {.data = "aaab", .needle = "aab", .expected = 1},
+            {.data = "", .needle = "a", .expected = -1},
+    };
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        ssize_t result = strview_find(strview(tc[i].data), strview(tc[i].needle));
+        STASIS_ASSERT(result == tc[i].expected, "wrong offset");
+    }
+    // Views do not need to be NUL terminated
+    STASIS_ASSERT(strview_find(strview_n("pencil", 3), strview("cil")) == -1, "match should not extend past the view");
+    STASIS_ASSERT(strview_startswith(strview_n("pencil", 3), strview("pen")), "view should start with prefix");
+    STASIS_ASSERT(!strview_startswith(strview_n("pencil", 3), strview("penc")), "prefix is longer than the view");
+    STASIS_ASSERT(strview_endswith(strview_n("pencil", 3), strview("en")), "view should end with suffix");
+    STASIS_ASSERT(strview_eq(strview_n("pencil", 3), strview("pen")), "views should be equal");
+    STASIS_ASSERT(strview(NULL).len == 0, "NULL should produce an empty view");
+}
+
+void test_strview_strip() {
+    struct testcase {
+        const char *data;
+        const char *expected;
+    };
+    struct testcase tc[] = {
+            {.data = "  I am a string.\n", .expected = "I am a string."},
+            {.data = "\t\v\f\r", .expected = ""},
+            {.data = "", .expected = ""},
+            {.data = "x", .expected = "x"},
+    };
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        struct StrView result = strview_strip(strview(tc[i].data));
+        STASIS_ASSERT(strview_eq(result, strview(tc[i].expected)), "incorrect strip");
+    }
+}
+
+void test_strview_replace() {
+    struct testcase {
+        const char *data;
+        const char *target;
+        const char *replacement;
+        const char *expected;
+    };
+    struct testcase tc[] = {
+            {.data = "I have a pencil box.", .target = "pencil", .replacement = "pen", .expected = "I have a pen box."},
+            {.data = "aaaa", .target = "aa", .replacement = "b", .expected = "bb"},
+            {.data = "a.b.c", .target = ".", .replacement = "/./", .expected = "a/./b/./c"},
+            {.data = "no match", .target = "xyz", .replacement = "abc", .expected = "no match"},
+            {.data = "", .target = "xyz", .replacement = "abc", .expected = ""},
+            {.data = "secret", .target = "secret", .replacement = "", .expected = ""},
+    };
+    STASIS_ASSERT(strview_replace(strview("abc"), strview(""), strview("x")) == NULL, "empty target should fail");
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        char *result = strview_replace(strview(tc[i].data), strview(tc[i].target), strview(tc[i].replacement));
+        STASIS_ASSERT(result && strcmp(result, tc[i].expected) == 0, "incorrect replacement");
+        guard_free(result);
+    }
+}
+
+void test_normalize_space() {
+    struct testcase {
+        const char *data;
+        const char *expected;
+    };
+    struct testcase tc[] = {
+            {.data = "  I   am \t a string.  ", .expected = "I am a string."},
+            {.data = "\t\t", .expected = ""},
+            {.data = "line\n  next", .expected = "line\n next"},
+            {.data = "", .expected = ""},
+    };
+    STASIS_ASSERT(normalize_space(NULL) == NULL, "NULL input should return NULL");
+    for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
+        char *data = strdup(tc[i].data);
+        normalize_space(data);
+        STASIS_ASSERT(strcmp(data, tc[i].expected) == 0, "incorrect normalization");
+        guard_free(data);
+    }
+}
+
 void test_join() {
     struct testcase {
         const char **data;
@@ -368,6 +522,12 @@ int main(int argc, char *argv[]) {
             test_startswith,
             test_endswith,
             test_split,
+            test_split_compact,
+            test_str_split_next,
+            test_strview_find,
+            test_strview_strip,
+            test_strview_replace,
+            test_normalize_space,
             test_join,
             test_join_ex,
             test_substring_between,
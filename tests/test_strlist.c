@@ -48,7 +48,8 @@ void test_strlist_append() {
     for (size_t i = 0; i < sizeof(tc) / sizeof(*tc); i++) {
         strlist_append(&list, (char *) tc[i].data);
         STASIS_ASSERT(list->num_inuse == tc[i].expected_in_use, "incorrect number of records in use");
-        STASIS_ASSERT(list->num_alloc == tc[i].expected_in_use + 1, "incorrect number of records allocated");
+        STASIS_ASSERT(list->num_alloc > tc[i].expected_in_use, "too few records allocated");
+        STASIS_ASSERT(list->data[list->num_inuse] == NULL, "list should be NULL terminated");
         STASIS_ASSERT(strcmp(strlist_item(list, i), tc[i].data) == 0, "value was appended incorrectly. data mismatch.");
     }
     guard_strlist_free(&list);
@@ -66,6 +67,106 @@ void test_strlist_append_many_records() {
     guard_strlist_free(&list);
 }
 
+void test_strlist_reserve() {
+    struct StrList *list;
+    list = strlist_init();
+    STASIS_ASSERT(strlist_reserve(NULL, 10) < 0, "NULL list should fail");
+    STASIS_ASSERT(strlist_reserve(list, 100) == 0, "reserve failed");
+    STASIS_ASSERT(list->num_alloc > 100, "reserve did not allocate enough records");
+    STASIS_ASSERT(list->num_inuse == 0, "reserve should not change the number of records in use");
+
+    char **data = list->data;
+    for (size_t i = 0; i < 100; i++) {
+        strlist_append(&list, "reserved");
+    }
+    STASIS_ASSERT(list->data == data, "appending within the reserved capacity should not reallocate");
+    STASIS_ASSERT(list->data[100] == NULL, "list should be NULL terminated");
+    STASIS_ASSERT(strlist_reserve(list, 10) == 0, "shrinking reserve should succeed");
+    STASIS_ASSERT(strlist_count(list) == 100, "shrinking reserve should not remove records");
+    guard_strlist_free(&list);
+}
+
+void test_strlist_append_n() {
+    const char *data[] = {
+            "Appending",
+            "Some",
+            "Data",
+            "Not this",
+    };
+    struct StrList *list;
+    list = strlist_init();
+    strlist_append(&list, "First");
+    strlist_append_n(list, (char **) data, 3);
+    STASIS_ASSERT(strlist_count(list) == 4, "unexpected number of records");
+    STASIS_ASSERT(strcmp(strlist_item(list, 0), "First") == 0, "existing record was modified");
+    for (size_t i = 0; i < 3; i++) {
+        STASIS_ASSERT(strcmp(strlist_item(list, i + 1), data[i]) == 0, "record was appended incorrectly");
+        STASIS_ASSERT(strlist_item(list, i + 1) != data[i], "record should be a copy");
+    }
+    STASIS_ASSERT(list->data[4] == NULL, "list should be NULL terminated");
+    strlist_append_n(list, (char **) data, 0);
+    STASIS_ASSERT(strlist_count(list) == 4, "appending zero records should do nothing");
+    guard_strlist_free(&list);
+}
+
+void test_strlist_append_benchmark() {
+    const size_t maxrec = 100000;
+    const char *record = "numpy                     1.26.4          py311h64a7726_0    conda-forge";
+    struct timespec start, stop;
+    double elapsed[3];
+    struct StrList *list[3];
+
+    char **arr = calloc(maxrec + 1, sizeof(*arr));
+    STASIS_ASSERT_FATAL(arr != NULL, "unable to allocate array");
+    for (size_t i = 0; i < maxrec; i++) {
+        arr[i] = (char *) record;
+    }
+    size_t text_len = (strlen(record) + 1) * maxrec;
+    char *text = calloc(text_len + 1, sizeof(*text));
+    STASIS_ASSERT_FATAL(text != NULL, "unable to allocate text");
+    for (size_t i = 0; i < maxrec; i++) {
+        strcat(text + (strlen(record) + 1) * i, record);
+        text[(strlen(record) + 1) * (i + 1) - 1] = '\n';
+    }
+    text[text_len - 1] = '\0';
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    list[0] = strlist_init();
+    for (size_t i = 0; i < maxrec; i++) {
+        strlist_append(&list[0], arr[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    elapsed[0] = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    list[1] = strlist_init();
+    strlist_append_n(list[1], arr, maxrec);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    elapsed[1] = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    list[2] = strlist_init();
+    strlist_append_tokenize(list[2], text, "\n");
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    elapsed[2] = (double) (stop.tv_sec - start.tv_sec) + (double) (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("strlist_append: %.1lfns/record, strlist_append_n: %.1lfns/record, strlist_append_tokenize: %.1lfns/record (%zu records)\n",
+           elapsed[0] * 1e9 / (double) maxrec,
+           elapsed[1] * 1e9 / (double) maxrec,
+           elapsed[2] * 1e9 / (double) maxrec,
+           maxrec);
+    for (size_t i = 0; i < 3; i++) {
+        STASIS_ASSERT(strlist_count(list[i]) == maxrec, "record count mismatch");
+    }
+    STASIS_ASSERT(strlist_cmp(list[0], list[1]) == 0, "strlist_append() and strlist_append_n() results should be identical");
+    STASIS_ASSERT(strlist_cmp(list[0], list[2]) == 0, "strlist_append() and strlist_append_tokenize() results should be identical");
+    for (size_t i = 0; i < 3; i++) {
+        guard_strlist_free(&list[i]);
+    }
+    guard_free(text);
+    guard_free(arr);
+}
+
 void test_strlist_set() {
     struct StrList *list;
     list = strlist_init();
@@ -167,6 +268,23 @@ void test_strlist_append_strlist() {
     guard_strlist_free(&right);
 }
 
+void test_strlist_append_strlist_self() {
+    const char *expected[] = {"A", "B", "C", "A", "B", "C", "A", "B", "C", "A", "B", "C"};
+    struct StrList *list = strlist_init();
+    strlist_append(&list, "A");
+    strlist_append(&list, "B");
+    strlist_append(&list, "C");
+
+    // Each append doubles the list, so its storage is reallocated
+    strlist_append_strlist(list, list);
+    strlist_append_strlist(list, list);
+    STASIS_ASSERT_FATAL(strlist_count(list) == sizeof(expected) / sizeof(*expected), "list should contain four copies of its records");
+    for (size_t i = 0; i < strlist_count(list); i++) {
+        STASIS_ASSERT(strcmp(strlist_item(list, i), expected[i]) == 0, "unexpected record");
+    }
+    guard_strlist_free(&list);
+}
+
 void test_strlist_append_array() {
     const char *data[] = {
             "Appending",
@@ -584,9 +702,13 @@ int main(int argc, char *argv[]) {
         test_strlist_free,
         test_strlist_append,
         test_strlist_append_many_records,
+        test_strlist_reserve,
+        test_strlist_append_n,
+        test_strlist_append_benchmark,
         test_strlist_set,
         test_strlist_append_file,
         test_strlist_append_strlist,
+        test_strlist_append_strlist_self,
         test_strlist_append_tokenize,
         test_strlist_append_array,
         test_strlist_copy,
@@ -1,7 +1,8 @@
 #include "testing.h"
+#include <fcntl.h>
 
 extern void tpl_reset();
-extern struct tpl_item *tpl_pool[];
+extern int tpl_key_exists(char *key);
 extern unsigned tpl_pool_used;
 extern unsigned tpl_pool_func_used;
 
@@ -53,7 +54,9 @@ void test_tpl_register() {
     tpl_register("hello_message", &data);
 
     STASIS_ASSERT(tpl_pool_used == (used_before_register + 1), "tpl_register did not increment allocation counter");
-    STASIS_ASSERT(tpl_pool[used_before_register] != NULL, "register did not allocate a tpl_item record in the pool");
+    STASIS_ASSERT(tpl_key_exists("hello_message"), "register did not allocate a tpl_item record in the pool");
+    tpl_register("hello_message", &data);
+    STASIS_ASSERT(tpl_pool_used == (used_before_register + 1), "registering an existing key should replace it");
     free(data);
 }
 
@@ -88,12 +91,393 @@ void test_tpl_register_func() {
     STASIS_ASSERT(result != NULL && strcmp(result, "3") == 0, "Answer was not 3");
 }
 
+static char *resolve_upper(const char *name, void *data) {
+    (void) data;
+    static char buf[255];
+    size_t i;
+    for (i = 0; name[i] && i < sizeof(buf) - 1; i++) {
+        buf[i] = (char) toupper((unsigned char) name[i]);
+    }
+    buf[i] = '\0';
+    return buf;
+}
+
+void test_tpl_register_many() {
+    const size_t count = 5000;
+    char **values = calloc(count + 1, sizeof(*values));
+    tpl_reset();
+    for (size_t i = 0; i < count; i++) {
+        char key[100];
+        sprintf(key, "meta.key_%zu", i);
+        values[i] = strdup(key);
+        tpl_register(key, &values[i]);
+    }
+    STASIS_ASSERT(tpl_pool_used == count, "every key should be registered");
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < count; i++) {
+        char key[100];
+        sprintf(key, "meta.key_%zu", i);
+        char *value = tpl_getval(key);
+        mismatch += !value || strcmp(value, key) != 0;
+    }
+    STASIS_ASSERT(mismatch == 0, "registered values should be retrievable");
+    STASIS_ASSERT(tpl_getval("meta.key_missing") == NULL, "unregistered key should not be found");
+
+    char *result = tpl_render("{{ meta.key_0 }}/{{ meta.key_4999 }}");
+    STASIS_ASSERT(result && strcmp(result, "meta.key_0/meta.key_4999") == 0, "unexpected render");
+    guard_free(result);
+    tpl_reset();
+    GENERIC_ARRAY_FREE(values);
+}
+
+void test_tpl_register_namespace() {
+    char *name = strdup("registered");
+    tpl_reset();
+    tpl_register("upper.name", &name);
+    tpl_register_namespace("upper", resolve_upper, NULL);
+    setenv("STASIS_TPL_NS", "environment", 1);
+
+    char *result = tpl_render("{{ upper.name }} {{ upper.other }} {{ upper:value }} {{ env:STASIS_TPL_NS }} {{ nothing.here }}.");
+    STASIS_ASSERT(result && strcmp(result, "registered OTHER VALUE environment .") == 0, "unexpected namespace render");
+    guard_free(result);
+    STASIS_ASSERT(tpl_getval("env:STASIS_TPL_NS") && strcmp(tpl_getval("env:STASIS_TPL_NS"), "environment") == 0, "env namespace should resolve");
+
+    tpl_register_namespace("env", resolve_upper, NULL);
+    result = tpl_render("{{ env:STASIS_TPL_NS }}");
+    STASIS_ASSERT(result && strcmp(result, "STASIS_TPL_NS") == 0, "env namespace should be replaceable");
+    guard_free(result);
+
+    unsetenv("STASIS_TPL_NS");
+    tpl_reset();
+    guard_free(name);
+}
+
+void test_tpl_register_delivery() {
+    struct Delivery ctx = {0};
+    char name[] = "demo";
+    char tmpdir[] = "/tmp/demo";
+    tpl_reset();
+    delivery_register_templates(&ctx);
+
+    char *result = tpl_render("[{{ meta.name }}][{{ storage.tmpdir }}][{{ meta.unknown }}]");
+    STASIS_ASSERT(result && strcmp(result, "[][][]") == 0, "unpopulated fields should render empty");
+    guard_free(result);
+
+    ctx.meta.name = name;
+    ctx.storage.tmpdir = tmpdir;
+    result = tpl_render("[{{ meta.name }}][{{ storage.tmpdir }}][{{ meta.unknown }}]");
+    STASIS_ASSERT(result && strcmp(result, "[demo][/tmp/demo][]") == 0, "fields should be read at render time");
+    guard_free(result);
+    tpl_reset();
+}
+
+void test_tpl_compile() {
+    char *data = strdup("first");
+    tpl_reset();
+    tpl_register("value", &data);
+
+    struct tpl_program *prog = tpl_compile("<{{ value }}>{{value}}{{ missing }}<");
+    STASIS_ASSERT_FATAL(prog != NULL, "compile failed");
+    STASIS_ASSERT(prog->count == 6, "unexpected number of instructions");
+
+    char *result = tpl_execute(prog);
+    STASIS_ASSERT(result && strcmp(result, "<first>first<") == 0, "adjacent tags should both be rendered");
+    guard_free(result);
+
+    guard_free(data);
+    data = strdup("second");
+    result = tpl_execute(prog);
+    STASIS_ASSERT(result && strcmp(result, "<second>second<") == 0, "programs should render the current value");
+    guard_free(result);
+    tpl_program_free(&prog);
+    STASIS_ASSERT(prog == NULL, "program pointer should be NULL after free");
+
+    STASIS_ASSERT(tpl_compile("unbalanced {{ value") == NULL, "unbalanced braces should not compile");
+    STASIS_ASSERT(tpl_compile("{{ func:missing_paren }}") == NULL, "function without arguments should not compile");
+    guard_free(data);
+}
+
+void test_tpl_render_benchmark() {
+    const char *line = "echo {{ meta.name }} {{ env:HOME }} > /tmp/{{ meta.version }}/output.txt\n";
+    const size_t line_len = strlen(line);
+    const size_t count = (1024 * 1024) / line_len;
+    char *name = strdup("delivery");
+    char *version = strdup("1.2.3");
+    char *input = calloc(count * line_len + 1, sizeof(*input));
+    struct timespec start, end;
+
+    tpl_reset();
+    tpl_register("meta.name", &name);
+    tpl_register("meta.version", &version);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(input + i * line_len, line, line_len);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char *result = tpl_render(input);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("tpl_render: %zu byte template: %.3fs\n", strlen(input), elapsed);
+    STASIS_ASSERT(result != NULL, "render failed");
+    STASIS_ASSERT(result && strstr(result, "echo delivery ") == result, "unexpected output");
+    STASIS_ASSERT(result && num_chars(result, '\n') == (int) count, "every line should be rendered");
+
+    struct tpl_program *prog = tpl_compile(input);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < 10; i++) {
+        char *again = tpl_execute(prog);
+        STASIS_ASSERT(again && result && strcmp(again, result) == 0, "compiled output differs");
+        guard_free(again);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("tpl_execute: %zu byte template: %.3fs per render\n", strlen(input), elapsed / 10);
+
+    const char *filename = "test_tpl_render_benchmark.txt";
+    FILE *fp = fopen(filename, "w");
+    fputs(input, fp);
+    fclose(fp);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    STASIS_ASSERT(tpl_render_file(filename, filename) == 0, "file render failed");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("tpl_render_file: %zu byte template: %.3fs\n", strlen(input), elapsed);
+    char *streamed = stasis_testing_read_ascii(filename);
+    STASIS_ASSERT(streamed && result && strcmp(streamed, result) == 0, "streamed output differs");
+    guard_free(streamed);
+    remove(filename);
+
+    tpl_program_free(&prog);
+    guard_free(result);
+    guard_free(input);
+    guard_free(name);
+    guard_free(version);
+}
+
+void test_tpl_render_file() {
+    const char *src = "test_tpl_render_file.in";
+    const char *dest = "test_tpl_render_file.out";
+    char *name = strdup("stasis");
+    char *result = NULL;
+    FILE *fp;
+
+    tpl_reset();
+    tpl_register("meta.name", &name);
+    tpl_register_func("add", &(struct tplfunc_frame) {.key = "add", .argc = 2, .func = adder});
+
+    fp = fopen(src, "w");
+    fputs("FROM {{ meta.name }}\nRUN echo {{ func:add(1, 2) }}{{meta.name}}\n", fp);
+    fclose(fp);
+    STASIS_ASSERT(tpl_render_file(src, dest) == 0, "render failed");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "FROM stasis\nRUN echo 3stasis\n") == 0, "unexpected output");
+    guard_free(result);
+
+    // A failed render must leave the destination untouched
+    fp = fopen(src, "w");
+    fputs("{{ meta.name", fp);
+    fclose(fp);
+    STASIS_ASSERT(tpl_render_file(src, dest) < 0, "unbalanced template should fail");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "FROM stasis\nRUN echo 3stasis\n") == 0, "destination was modified");
+    guard_free(result);
+
+    // Empty templates produce empty files
+    fp = fopen(src, "w");
+    fclose(fp);
+    STASIS_ASSERT(tpl_render_file(src, dest) == 0, "empty template should render");
+    struct stat st;
+    STASIS_ASSERT(stat(dest, &st) == 0 && st.st_size == 0, "empty template should produce an empty file");
+
+    struct tpl_program *prog = tpl_compile("{{ meta.name }}:{{ func:add(2, 2) }}");
+    int fd = open(dest, O_WRONLY | O_TRUNC);
+    STASIS_ASSERT(tpl_execute_fd(prog, fd) == 0, "execute to file descriptor failed");
+    close(fd);
+    tpl_program_free(&prog);
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "stasis:4") == 0, "unexpected output");
+    guard_free(result);
+
+    STASIS_ASSERT(tpl_render_to_file("{{ meta.name }}", dest) == 0, "render to file failed");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "stasis") == 0, "unexpected output");
+    guard_free(result);
+
+    remove(src);
+    remove(dest);
+    tpl_reset();
+    guard_free(name);
+}
+
+static int counter_calls = 0;
+
+static int counter(struct tplfunc_frame *frame, void *result) {
+    (void) frame;
+    sprintf(result, "%d", ++counter_calls);
+    return 0;
+}
+
+void test_tpl_render_file_incremental_once() {
+    const char *src = "test_tpl_incremental_once.in";
+    const char *dest = "test_tpl_incremental_once.out";
+    const char *state_dir = "test_tpl_incremental_once_state";
+    struct tplfunc_frame task = {.key = "counter", .argc = 1, .func = counter};
+    char *result;
+
+    tpl_reset();
+    tpl_register_func("counter", &task);
+    mkdir(state_dir, 0755);
+    stasis_testing_write_ascii(src, "a={{ func:counter(a) }} b={{ func:counter(b) }}\n");
+
+    // Every call produces a new value, so the output is written each time,
+    // from the same values that were hashed
+    counter_calls = 0;
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "first render should write the output");
+    STASIS_ASSERT(counter_calls == 2, "each function tag should be evaluated once");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "a=1 b=2\n") == 0, "output should contain the values that were hashed");
+    guard_free(result);
+
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "a changing function should re-render");
+    STASIS_ASSERT(counter_calls == 4, "each function tag should be evaluated once");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "a=3 b=4\n") == 0, "output should contain the values that were hashed");
+    guard_free(result);
+
+    remove(src);
+    remove(dest);
+    rmtree((char *) state_dir);
+    tpl_reset();
+}
+
+void test_tpl_render_file_incremental() {
+    const char *src = "test_tpl_incremental.in";
+    const char *dest = "test_tpl_incremental.out";
+    const char *state_dir = "test_tpl_incremental_state";
+    char *name = strdup("stasis");
+    char *result;
+    struct stat before, after;
+
+    tpl_reset();
+    tpl_register("meta.name", &name);
+    mkdir(state_dir, 0755);
+    stasis_testing_write_ascii(src, "name: {{ meta.name }}\n");
+
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "first render should write the output");
+    stat(dest, &before);
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == TPL_RENDER_UNCHANGED, "unchanged inputs should be skipped");
+    stat(dest, &after);
+    STASIS_ASSERT(before.st_ino == after.st_ino && STAT_MTIM(before).tv_nsec == STAT_MTIM(after).tv_nsec, "skipped output should not be touched");
+
+    // A value change re-renders
+    guard_free(name);
+    name = strdup("changed");
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "changed value should re-render");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "name: changed\n") == 0, "unexpected output");
+    guard_free(result);
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == TPL_RENDER_UNCHANGED, "unchanged inputs should be skipped");
+
+    // A source change re-renders
+    stasis_testing_write_ascii(src, "NAME: {{ meta.name }}\n");
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "changed source should re-render");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "NAME: changed\n") == 0, "unexpected output");
+    guard_free(result);
+
+    // Modified or missing output re-renders
+    stasis_testing_write_ascii(dest, "edited");
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "modified output should re-render");
+    remove(dest);
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, state_dir) == 0, "missing output should re-render");
+    result = stasis_testing_read_ascii(dest);
+    STASIS_ASSERT(result && strcmp(result, "NAME: changed\n") == 0, "unexpected output");
+    guard_free(result);
+
+    // Without a state directory every call renders
+    STASIS_ASSERT(tpl_render_file_incremental(src, dest, NULL) == 0, "render without state should write the output");
+
+    uint64_t source_hash, values_hash, values_hash_2;
+    STASIS_ASSERT(tpl_fingerprint("{{ meta.name }}", 15, &source_hash, &values_hash) == 0, "fingerprint failed");
+    STASIS_ASSERT(tpl_fingerprint("{{meta.name}}", 13, &source_hash, &values_hash_2) == 0, "fingerprint failed");
+    STASIS_ASSERT(values_hash == values_hash_2, "equivalent tags should produce the same value hash");
+
+    remove(src);
+    remove(dest);
+    rmtree((char *) state_dir);
+    tpl_reset();
+    guard_free(name);
+}
+
+struct RenderJob {
+    char src[255];
+    char dest[255];
+    int status;
+};
+
+static void render_job(void *arg) {
+    struct RenderJob *job = arg;
+    job->status = tpl_render_file(job->src, job->dest);
+}
+
+void test_tpl_render_file_parallel() {
+    struct RenderJob jobs[32];
+    char *name = strdup("stasis");
+    char *version = strdup("1.0.0");
+    tpl_reset();
+    tpl_register("meta.name", &name);
+    tpl_register("meta.version", &version);
+    tpl_register_func("add", &(struct tplfunc_frame) {.key = "add", .argc = 2, .func = adder});
+
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(*jobs); i++) {
+        sprintf(jobs[i].src, "test_tpl_parallel_%zu.in", i);
+        sprintf(jobs[i].dest, "test_tpl_parallel_%zu.out", i);
+        FILE *fp = fopen(jobs[i].src, "w");
+        for (size_t line = 0; line < 1000; line++) {
+            fprintf(fp, "%zu {{ meta.name }}-{{ meta.version }} {{ func:add(%zu, 1) }}\n", i, line);
+        }
+        fclose(fp);
+    }
+
+    struct Pool *pool = pool_init(4);
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(*jobs); i++) {
+        pool_submit(pool, render_job, &jobs[i]);
+    }
+    pool_free(&pool);
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(*jobs); i++) {
+        char *result = stasis_testing_read_ascii(jobs[i].dest);
+        char expected[255];
+        sprintf(expected, "%zu stasis-1.0.0 1\n%zu stasis-1.0.0 2\n", i, i);
+        mismatch += jobs[i].status != 0 || !result || strncmp(result, expected, strlen(expected)) != 0
+                    || num_chars(result, '\n') != 1000 || !strstr(result, " 1000\n");
+        guard_free(result);
+        remove(jobs[i].src);
+        remove(jobs[i].dest);
+    }
+    STASIS_ASSERT(mismatch == 0, "concurrent renders should produce the same output as serial renders");
+    tpl_reset();
+    guard_free(name);
+    guard_free(version);
+}
+
 int main(int argc, char *argv[]) {
     STASIS_TEST_BEGIN_MAIN();
     STASIS_TEST_FUNC *tests[] = {
         test_tpl_workflow,
         test_tpl_register_func,
         test_tpl_register,
+        test_tpl_register_many,
+        test_tpl_register_namespace,
+        test_tpl_register_delivery,
+        test_tpl_compile,
+        test_tpl_render_file,
+        test_tpl_render_file_parallel,
+        test_tpl_render_file_incremental,
+        test_tpl_render_file_incremental_once,
+        test_tpl_render_benchmark,
     };
     STASIS_TEST_RUN(tests);
     STASIS_TEST_END_MAIN();
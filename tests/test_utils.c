@@ -369,6 +369,70 @@ void test_rmtree() {
     STASIS_ASSERT(access(root, F_OK) < 0, "the directory is still present");
 }
 
+void test_rmtree_nested() {
+    const char *root = "rmtree_nested";
+    const char *outside = "rmtree_outside";
+    char path[PATH_MAX];
+    size_t missing = 0;
+    chdir(cwd_workspace);
+
+    mkdir(outside, 0755);
+    touch("rmtree_outside/keep.txt");
+    for (size_t i = 0; i < 8; i++) {
+        for (size_t j = 0; j < 8; j++) {
+            sprintf(path, "%s/%zu/%zu/deep/er", root, i, j);
+            mkdirs(path, 0755);
+            for (size_t k = 0; k < 16; k++) {
+                sprintf(path, "%s/%zu/%zu/deep/er/%zu.txt", root, i, j, k);
+                missing += touch(path) != 0;
+            }
+            sprintf(path, "%s/%zu/%zu/file.txt", root, i, j);
+            missing += touch(path) != 0;
+        }
+    }
+    STASIS_ASSERT_FATAL(missing == 0, "unable to create test tree");
+    // Links must be removed, not followed
+    symlink("../../rmtree_outside", "rmtree_nested/0/link");
+    // Directories without write or search permission are emptied anyway
+    chmod("rmtree_nested/1/1/deep", 0555);
+    chmod("rmtree_nested/2/2/deep/er", 0);
+    chmod("rmtree_nested/3", 0500);
+
+    STASIS_ASSERT(rmtree((char *) root) == 0, "rmtree should have been able to remove the directory");
+    STASIS_ASSERT(access(root, F_OK) < 0, "the directory is still present");
+    STASIS_ASSERT(access("rmtree_outside/keep.txt", F_OK) == 0, "rmtree followed a symbolic link");
+    STASIS_ASSERT(rmtree((char *) root) < 0 && errno == ENOENT, "removing a missing directory should fail");
+    rmtree((char *) outside);
+}
+
+void test_rmtree_background() {
+    const char *root = "rmtree_background";
+    char path[PATH_MAX];
+    chdir(cwd_workspace);
+
+    for (size_t i = 0; i < 16; i++) {
+        sprintf(path, "%s/%zu/sub", root, i);
+        mkdirs(path, 0755);
+        sprintf(path, "%s/%zu/sub/file.txt", root, i);
+        touch(path);
+    }
+    STASIS_ASSERT(rmtree_background(root) == 0, "rmtree_background failed");
+    STASIS_ASSERT(access(root, F_OK) < 0, "the directory should be renamed aside immediately");
+    STASIS_ASSERT(mkdir(root, 0755) == 0, "the path should be reusable immediately");
+    rmtree_background_wait();
+
+    struct StrList *listing = listdir(".");
+    size_t leftover = 0;
+    for (size_t i = 0; listing && i < strlist_count(listing); i++) {
+        leftover += startswith(strlist_item(listing, i), "rmtree_background.stasis-rm.") > 0;
+    }
+    guard_strlist_free(&listing);
+    STASIS_ASSERT(leftover == 0, "the renamed directory was not removed");
+    STASIS_ASSERT(rmtree_background(root) == 0, "rmtree_background failed on an empty directory");
+    STASIS_ASSERT(rmtree_background(root) < 0 && errno == ENOENT, "removing a missing directory should fail");
+    rmtree_background_wait();
+}
+
 void test_dirstack() {
     const char *data[] = {
         "testdir",
@@ -459,6 +523,8 @@ int main(int argc, char *argv[]) {
             test_path_basename,
             test_expandpath,
             test_rmtree,
+            test_rmtree_nested,
+            test_rmtree_background,
             test_dirstack,
             test_pushd_popd,
             test_pushd_popd_suggested_workflow,